@@ -6,6 +6,9 @@
 
 #include <unordered_set>
 #include <functional>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 struct BindingsRow {
     uint8_t size;
@@ -14,18 +17,21 @@ struct BindingsRow {
     BindingsRow() : size(0), row(NULL) {}
 
     BindingsRow(const uint8_t s, Term_t const * const r) : size(s), row(r) {}
-
-    bool operator==(const BindingsRow &other) const;
 };
 
-struct hash_BindingsRow {
-    size_t operator()(const BindingsRow &x) const {
-        size_t hash = 0;
-        for (uint8_t i = 0; i < x.size; ++i) {
-            hash = (hash + (324723947 + x.row[i])) ^93485734985;
+struct hash_Terms {
+    static uint64_t add(const uint64_t hash, const Term_t value) {
+        uint64_t h = (hash ^ value) * UINT64_C(0xff51afd7ed558ccd);
+        return h ^ (h >> 32);
+    }
+
+    size_t operator()(const std::vector<Term_t> &x) const {
+        uint64_t hash = x.size();
+        for (auto v : x) {
+            hash = add(hash, v);
         }
-        return hash;
-     }
+        return (size_t) hash;
+    }
 };
 
 class RawBindings {
@@ -82,9 +88,27 @@ class RawBindings {
 
 class BindingsTable {
     private:
-        std::unordered_set<BindingsRow, hash_BindingsRow> uniqueElements;
+        //Index of the projection of the rows on some columns. The rows with
+        //the same hash are chained.
+        struct ProjectionIndex {
+            std::vector<uint8_t> positions;
+            //First row of every bucket, plus one (0 if empty)
+            std::vector<size_t> buckets;
+            //Next row in the same bucket, plus one. Its size is the number of
+            //indexed rows.
+            std::vector<size_t> next;
+        };
+
         RawBindings *rawBindings;
         Term_t *currentRow;
+        std::atomic<size_t> ntuples;
+        //Open-addressing hash set of the rows, to check whether a row is new.
+        //Every slot contains the index of a row, plus one (0 if empty).
+        std::vector<size_t> slots;
+        std::vector<uint64_t> hashes;
+        std::vector<ProjectionIndex> projections;
+        //Only set if the table is shared among threads (see enableLocking)
+        std::unique_ptr<std::mutex> mutex;
 
         size_t nPosToCopy;
         size_t *posToCopy;
@@ -110,7 +134,14 @@ class BindingsTable {
             }
         };
 
-        void insertIfNotExists(Term_t const * const cr);
+        bool insertIfNotExists(Term_t const * const cr);
+
+        void rehash();
+
+        uint64_t hashProjection(const Term_t *row,
+                const std::vector<uint8_t> &positions) const;
+
+        void extendIndex(ProjectionIndex &index);
     public:
         BindingsTable(uint8_t sizeAdornment, uint8_t adornment);
 
@@ -133,8 +164,33 @@ class BindingsTable {
 
         void addRawTuple(Term_t *row);
 
+        //Adds nrows rows stored one after the other. The new ones get
+        //consecutive indices, starting from firstNew. Returns the number of
+        //new rows.
+        size_t addRawTuples(const Term_t *rows, const size_t nrows,
+                size_t &firstNew);
+
+        //Makes the table safe to use from several threads. The tuples are
+        //added under a lock, and getTuple may only be called with the lock
+        //returned by lock().
+        void enableLocking() {
+            mutex = std::unique_ptr<std::mutex>(new std::mutex());
+        }
+
+        std::unique_lock<std::mutex> lock() {
+            return mutex != NULL ? std::unique_lock<std::mutex>(*mutex) :
+                std::unique_lock<std::mutex>();
+        }
+
         std::vector<Term_t> getProjection(std::vector<uint8_t> pos);
 
+        //Adds to rows the indices of the rows that contain values at the
+        //given positions. The index on the positions is created the first
+        //time, and then extended with the new rows. If the table is shared
+        //among threads, the caller must hold lock().
+        void lookup(const std::vector<uint8_t> &positions,
+                const Term_t *values, std::vector<size_t> &rows);
+
         std::vector<Term_t> getUniqueSortedProjection(std::vector<uint8_t> pos);
 
         size_t getNTuples();
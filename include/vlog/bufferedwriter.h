@@ -0,0 +1,91 @@
+#ifndef _BUFFERED_WRITER_H
+#define _BUFFERED_WRITER_H
+
+#include <vlog/consts.h>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+//Size of the buffer of a BufferedWriter
+#define BUFFEREDWRITER_SIZE (UINT64_C(8) << 20)
+
+typedef enum { COMPR_NONE, COMPR_GZIP, COMPR_ZSTD } ExportCompression;
+
+//Writes a file through a large buffer, optionally compressed with gzip or
+//with zstd (only if VLog was compiled with ZSTD). The callers format the
+//rows directly in the buffer, so no temporary strings are created and the
+//file is not flushed after every line.
+class BufferedWriter {
+    private:
+        struct Compressor;
+
+        const std::string path;
+        FILE *file;
+        std::unique_ptr<Compressor> compressor;
+        std::vector<char> buffer;
+        size_t size;
+        //Set when a flush fails: the content is not written again
+        bool failed;
+
+        void flush(const bool end);
+
+    public:
+        BufferedWriter(const std::string &path,
+                const ExportCompression compression,
+                const size_t capacity = BUFFEREDWRITER_SIZE);
+
+        //Appends the extension of the compression to path
+        static std::string getFileName(const std::string &path,
+                const ExportCompression compression);
+
+        //Parses "none", "gzip" or "zstd"
+        VLIBEXP static ExportCompression parseCompression(
+                const std::string &name);
+
+        void write(const char *s, const size_t len) {
+            if (size + len > buffer.size()) {
+                flush(false);
+                if (len > buffer.size()) {
+                    buffer.resize(len);
+                }
+            }
+            memcpy(buffer.data() + size, s, len);
+            size += len;
+        }
+
+        void write(const std::string &s) {
+            write(s.c_str(), s.size());
+        }
+
+        void put(const char c) {
+            if (size == buffer.size()) {
+                flush(false);
+            }
+            buffer[size++] = c;
+        }
+
+        //Writes v in decimal notation
+        void writeNumber(uint64_t v) {
+            char digits[20];
+            int n = 0;
+            do {
+                digits[n++] = '0' + (v % 10);
+                v /= 10;
+            } while (v != 0);
+            if (size + n > buffer.size()) {
+                flush(false);
+            }
+            while (n > 0) {
+                buffer[size++] = digits[--n];
+            }
+        }
+
+        void close();
+
+        ~BufferedWriter();
+};
+
+#endif
@@ -7,9 +7,16 @@
 #include <vector>
 #include <map>
 #include <set>
-#include <unordered_map>
 
 #define SIZE_BLOCK 1000
+//Number of rows that are hashed (and whose entries are prefetched) before
+//they are looked up
+#define CHASE_BATCH_SIZE 32
+//The table of every existential variable is split in 2^CHASE_SHARD_BITS
+//shards, selected by the highest bits of the hash of the rows
+#define CHASE_SHARD_BITS 4
+//Below this number of rows, the lookups are not done in parallel
+#define CHASE_PARALLEL_THRESHOLD 65536
 
 #define RULE_MASK INT64_C(0xffffff0000000000)
 #define RULE_SHIFT(x) (((uint64_t) ((x) + 1)) << 40)
@@ -22,39 +29,19 @@
 
 typedef enum TypeChase {RESTRICTED_CHASE, SKOLEM_CHASE, SUM_CHASE, SUM_RESTRICTED_CHASE } TypeChase;
 
-struct ChaseRow {
-    uint8_t sz;
-    uint64_t *row;
-
-    ChaseRow() : sz(0), row(NULL) {}
-
-    ChaseRow(const uint8_t s, uint64_t *r) : sz(s), row(r) {
-    }
-
-    bool operator == (const ChaseRow &other) const {
-        for (int i = 0; i < sz; i++) {
-            if (row[i] != other.row[i]) {
-                return false;
-            }
-        }
-        return true;
-    }
-};
-
-struct hash_ChaseRow {
-    size_t operator() (const ChaseRow &x) const {
-        uint64_t result = 0;
-        for (int i = 0; i < x.sz; i++) {
-            result = (result + (324723947 + x.row[i])) ^93485734985;
-        }
-        return (size_t) result;
-    }
-};
-
 class ChaseMgmt {
     private:
         class Rows {
             private:
+                //Open-addressing table with linear probing. Every entry
+                //contains the hash of a row and its position (+1) in blocks,
+                //or 0 if it is empty.
+                struct Shard {
+                    std::vector<std::pair<uint64_t, uint64_t>> entries;
+                    uint64_t nrows;
+                    Shard() : nrows(0) {}
+                };
+
                 const uint64_t startCounter;
                 const uint8_t sizerow;
                 std::vector<uint8_t> nameArgVars;
@@ -62,10 +49,19 @@ class ChaseMgmt {
                 std::vector<std::unique_ptr<uint64_t[]>> blocks;
                 uint32_t blockCounter;
                 uint64_t *currentblock;
-                std::unordered_map<ChaseRow, uint64_t, hash_ChaseRow> rows;
+                uint64_t nrows;
+                Shard shards[1 << CHASE_SHARD_BITS];
                 TypeChase typeChase;
 				std::set<uint64_t> deps;	// For SUM chases.
 
+                const Shard &getShard(const uint64_t hash) const {
+                    return shards[hash >> (64 - CHASE_SHARD_BITS)];
+                }
+
+                bool sameRow(const uint64_t pos, const uint64_t *row) const;
+
+                void grow(Shard &shard);
+
             public:
                 Rows(uint64_t startCounter, uint8_t sizerow,
                         std::vector<uint8_t> nameArgVars,
@@ -75,6 +71,7 @@ class ChaseMgmt {
                         blockCounter = 0;
                         currentblock = NULL;
                         currentcounter = startCounter;
+                        nrows = 0;
                         this->typeChase = typeChase;
                     }
 
@@ -88,9 +85,21 @@ class ChaseMgmt {
                     return nameArgVars;
                 }
 
-                uint64_t addRow(uint64_t* row);
+                //Hash of the row at position i in the columns
+                static uint64_t hash(const std::vector<const Term_t *> &columns,
+                        const size_t i);
 
-                bool existingRow(uint64_t *row, uint64_t &value);
+                //Loads in the cache the first entry where the row could be
+                void prefetch(const uint64_t hash) const;
+
+                uint64_t addRow(const uint64_t *row, const uint64_t hash);
+
+                //Can be called by multiple threads at the same time, as long
+                //as no row is added
+                bool existingRow(const uint64_t *row, const uint64_t hash,
+                        uint64_t &value) const;
+
+                bool existingRow(const uint64_t *row, uint64_t &value) const;
 
                 bool checkRecursive(uint64_t target, uint64_t value,
                         std::set<uint64_t> &toCheck);
@@ -130,6 +139,8 @@ class ChaseMgmt {
         bool cyclic;
         PredId_t predIgnoreBlock;
 
+        struct LookupRows;
+
         bool checkSingle(uint64_t target, uint64_t rv, std::set<uint64_t> &toCheck);
 
         bool checkRecursive(uint64_t target, uint64_t rv);
@@ -140,11 +151,16 @@ class ChaseMgmt {
                 const int ruleToCheck = -1,
                 const PredId_t predIgnoreBlocking = -1);
 
+        //Returns, for every row of columns, the ID of the null that the rule
+        //creates for the existential variable var. The rows are first looked
+        //up (in parallel, if nthreads > 1), then the IDs of the new rows are
+        //assigned in order.
         std::shared_ptr<Column> getNewOrExistingIDs(
                 uint32_t ruleid,
                 uint8_t var,
                 std::vector<std::shared_ptr<Column>> &columns,
-                uint64_t size);
+                uint64_t size,
+                const int nthreads = -1);
 
         bool checkCyclicTerms(uint32_t ruleid);
 
@@ -194,6 +194,160 @@ class CompressedColumn final : public Column {
 };
 //----- END COMPRESSED COLUMN ----------
 
+//----- PACKED COLUMN ----------
+
+//Columns with fewer values are never packed
+#define PACKED_COLUMN_MIN_SIZE 65536
+
+//Frame-of-reference column. The values are stored in blocks of BLOCK_SIZE
+//values. Every block stores its smallest value, and the differences of the
+//values from it are bit-packed, with the number of bits needed for the
+//largest difference in the block.
+class PackedColumn final : public Column {
+    private:
+        std::vector<Term_t> bases;
+        std::vector<uint8_t> bits;
+        //First word of every block
+        std::vector<size_t> offsets;
+        //The last word is padding, so that the decoding can always read two
+        //words. The words are either in ownedWords, or in a memory region
+        //(e.g. a mapped file) that is kept alive by region.
+        std::vector<uint64_t> ownedWords;
+        std::shared_ptr<const char> region;
+        const uint64_t *words;
+        size_t nwords;
+        size_t _size;
+
+        static uint8_t getBits(const Term_t *values, const size_t n,
+                Term_t &base);
+
+        PackedColumn(const std::vector<Term_t> &values);
+
+        PackedColumn(const PackedColumn &column,
+                std::shared_ptr<const char> region, const uint64_t *words);
+
+    public:
+        static const size_t BLOCK_SIZE = 128;
+
+        //Returns a packed copy of values, or NULL if it would not save at
+        //least half of the memory
+        static std::shared_ptr<Column> pack(const std::vector<Term_t> &values);
+
+        //Copies the values of block b in out
+        void decodeBlock(const size_t b, Term_t *out) const;
+
+        size_t getNBlocks() const {
+            return bases.size();
+        }
+
+        //Packed words, including the padding
+        const uint64_t *getWords(size_t &n) const {
+            n = nwords;
+            return words;
+        }
+
+        //Returns a column with the same values, which reads the packed words
+        //from region instead of its own copy
+        std::shared_ptr<Column> remap(std::shared_ptr<const char> region,
+                const uint64_t *words) const;
+
+        size_t size() const {
+            return _size;
+        }
+
+        size_t getRepresentationSize() const {
+            return (region == NULL ? nwords : 0) + bases.size();
+        }
+
+        size_t estimateSize() const {
+            return _size;
+        }
+
+        Term_t getValue(const size_t pos) const {
+            const size_t b = pos / BLOCK_SIZE;
+            const uint8_t nbits = bits[b];
+            if (nbits == 0) {
+                return bases[b];
+            }
+            const size_t bit = (pos % BLOCK_SIZE) * nbits;
+            const uint64_t *w = &words[offsets[b] + (bit >> 6)];
+            const unsigned shift = bit & 63;
+            const uint64_t v = (w[0] >> shift) | ((w[1] << 1) << (63 - shift));
+            const uint64_t mask = nbits == 64 ? ~(uint64_t) 0 :
+                (((uint64_t) 1 << nbits) - 1);
+            return bases[b] + (Term_t) (v & mask);
+        }
+
+        bool supportsDirectAccess() const {
+            return true;
+        }
+
+        bool isEmpty() const {
+            return _size == 0;
+        }
+
+        bool isEDB() const {
+            return false;
+        }
+
+        std::unique_ptr<ColumnReader> getReader() const;
+
+        std::shared_ptr<Column> sort() const;
+
+        std::shared_ptr<Column> sort(const int nthreads) const;
+
+        std::shared_ptr<Column> unique() const;
+
+        //As for InmemoryColumn, the column is assumed to be sorted
+        bool isIn(const Term_t t) const;
+
+        bool isConstant() const;
+
+        Term_t first() const {
+            assert(_size > 0);
+            return getValue(0);
+        }
+};
+
+class PackedColumnReader final : public ColumnReader {
+    private:
+        const PackedColumn &column;
+        Term_t buffer[PackedColumn::BLOCK_SIZE];
+        size_t position;
+
+    public:
+        PackedColumnReader(const PackedColumn &column) : column(column),
+        position(0) {
+        }
+
+        Term_t first() {
+            return column.getValue(0);
+        }
+
+        Term_t last() {
+            return column.getValue(column.size() - 1);
+        }
+
+        std::vector<Term_t> asVector();
+
+        bool hasNext() {
+            return position < column.size();
+        }
+
+        Term_t next() {
+            const size_t offset = position % PackedColumn::BLOCK_SIZE;
+            if (offset == 0) {
+                column.decodeBlock(position / PackedColumn::BLOCK_SIZE, buffer);
+            }
+            position++;
+            return buffer[offset];
+        }
+
+        void clear() {
+        }
+};
+//----- END PACKED COLUMN ----------
+
 class ColumnWriter {
     private:
         bool cached;
@@ -629,6 +783,138 @@ class SubColumn final : public Column {
 };
 //----- END SUBCOLUMN ----------
 
+//----- MAPPED COLUMN ----------
+//Column stored in a memory region (e.g., a memory-mapped file) that can be
+//shared by several columns. The values are not copied.
+class MappedColumnReader final : public ColumnReader {
+    private:
+        const Term_t *values;
+        const size_t _size;
+        size_t currentPos;
+
+    public:
+        MappedColumnReader(const Term_t *values, const size_t size) :
+            values(values), _size(size), currentPos(0) {
+            }
+
+        Term_t first() {
+            return values[0];
+        }
+
+        Term_t last() {
+            return values[_size - 1];
+        }
+
+        std::vector<Term_t> asVector() {
+            return std::vector<Term_t>(values, values + _size);
+        }
+
+        bool hasNext() {
+            return currentPos < _size;
+        }
+
+        Term_t next() {
+            return values[currentPos++];
+        }
+
+        void clear() {
+        }
+};
+
+class MappedColumn final : public Column {
+    private:
+        std::shared_ptr<const char> region;
+        const Term_t *values;
+        const size_t _size;
+
+    public:
+        MappedColumn(std::shared_ptr<const char> region, const Term_t *values,
+                const size_t size) : region(region), values(values),
+        _size(size) {
+        }
+
+        size_t size() const {
+            return _size;
+        }
+
+        size_t getRepresentationSize() const {
+            return _size;
+        }
+
+        size_t estimateSize() const {
+            return _size;
+        }
+
+        bool isEmpty() const {
+            return _size == 0;
+        }
+
+        Term_t getValue(const size_t pos) const {
+            return values[pos];
+        }
+
+        bool supportsDirectAccess() const {
+            return true;
+        }
+
+        bool isEDB() const {
+            return false;
+        }
+
+        bool containsDuplicates() const {
+            return _size > 1;
+        }
+
+        std::unique_ptr<ColumnReader> getReader() const {
+            return std::unique_ptr<ColumnReader>(new MappedColumnReader(
+                        values, _size));
+        }
+
+        std::shared_ptr<Column> sort() const {
+            std::vector<Term_t> newvals(values, values + _size);
+            std::sort(newvals.begin(), newvals.end());
+            return std::shared_ptr<Column>(new InmemoryColumn(newvals, true));
+        }
+
+        std::shared_ptr<Column> sort(const int nthreads) const {
+            if (nthreads <= 1) {
+                return sort();
+            }
+            std::vector<Term_t> newvals(values, values + _size);
+            ParallelTasks::sort_int(newvals.begin(), newvals.end());
+            return std::shared_ptr<Column>(new InmemoryColumn(newvals, true));
+        }
+
+        std::shared_ptr<Column> unique() const {
+            //I assume the column is already sorted
+            std::vector<Term_t> newvals;
+            Term_t prev = (Term_t) - 1;
+            for (size_t i = 0; i < _size; i++) {
+                Term_t v = values[i];
+                if (v != prev) {
+                    newvals.push_back(v);
+                    prev = v;
+                }
+            }
+            newvals.shrink_to_fit();
+            return std::shared_ptr<Column>(new InmemoryColumn(newvals, true));
+        }
+
+        bool isConstant() const {
+            return _size < 2;
+        }
+
+        Term_t first() const {
+            assert(_size > 0);
+            return values[0];
+        }
+
+        bool isIn(const Term_t t) const {
+            return std::binary_search(values, values + _size, t);
+        }
+};
+//----- END MAPPED COLUMN ----------
+
 
 //----- EDB COLUMN ----------
 class EDBColumnReader final : public ColumnReader {
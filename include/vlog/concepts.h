@@ -475,6 +475,9 @@ class Program {
         std::vector<std::vector<uint32_t>> rules; // [head_predicate_id (idx) : [rule_ids]]
         std::vector<Rule> allrules;
         int rewriteCounter;
+        //Changes every time the rules change. Values are unique across all
+        //the programs, so that they can identify their rules.
+        uint64_t generation;
 
         Dictionary dictPredicates;
         std::unordered_map<PredId_t, uint8_t> cardPredicates;
@@ -501,6 +504,10 @@ class Program {
             kb = e;
         }
 
+        uint64_t getGeneration() const {
+            return generation;
+        }
+
         uint64_t getMaxPredicateId() {
             return dictPredicates.getCounter();
         }
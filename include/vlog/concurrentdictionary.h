@@ -0,0 +1,136 @@
+#ifndef _CONCURRENT_DICTIONARY_H
+#define _CONCURRENT_DICTIONARY_H
+
+#include <google/dense_hash_map>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+//Dictionary of the terms that are not in the EDB tables. It can be used by
+//several threads at the same time. The strings are hashed to one of NSHARDS
+//shards, each with its own lock, hash map and arena where the strings are
+//copied. The reverse mapping (ID -> string) is an array of pointers in the
+//arenas, indexed by ID, which can be read without locks.
+//When used by a single thread, the IDs are assigned in the same order as
+//with Dictionary.
+class ConcurrentDictionary {
+    private:
+        //Key of the hash maps. The text is stored in an arena; hash contains
+        //the lower bits of the hash of the text.
+        struct StringRef {
+            const char *text;
+            uint32_t len;
+            uint32_t hash;
+        };
+
+        struct hashStringRef {
+            size_t operator()(const StringRef &s) const {
+                return s.hash;
+            }
+        };
+
+        struct eqStringRef {
+            bool operator()(const StringRef &s1, const StringRef &s2) const {
+                if (s1.text == s2.text) {
+                    return s1.len == s2.len;
+                }
+                return s1.len == s2.len && s1.hash == s2.hash &&
+                    s1.text != NULL && s2.text != NULL &&
+                    memcmp(s1.text, s2.text, s1.len) == 0;
+            }
+        };
+
+        typedef google::dense_hash_map<StringRef, uint64_t, hashStringRef,
+                eqStringRef> ShardMap;
+
+        struct Shard {
+            std::mutex mutex;
+            ShardMap map;
+            std::vector<char*> arena;
+            char *arenaPos;
+            size_t arenaLeft;
+
+            Shard() : arenaPos(NULL), arenaLeft(0) {
+                StringRef empty;
+                empty.text = NULL;
+                empty.len = 0;
+                empty.hash = 0;
+                map.set_empty_key(empty);
+            }
+        };
+
+        static const size_t NSHARDS = 64;
+        static const size_t ARENA_BLOCK_SIZE = 1024 * 1024;
+        //The reverse mapping has at most REVERSE_NBLOCKS blocks of
+        //REVERSE_BLOCK_SIZE entries, allocated when needed.
+        static const size_t REVERSE_BLOCK_SIZE = 1 << 18;
+        static const size_t REVERSE_NBLOCKS = 1 << 14;
+
+        typedef std::atomic<const char *> ReverseEntry;
+
+        const uint64_t startCounter;
+        std::atomic<uint64_t> counter;
+        Shard shards[NSHARDS];
+        std::atomic<ReverseEntry *> reverse[REVERSE_NBLOCKS];
+        std::mutex reverseMutex;
+
+        static uint64_t hashText(const char *text, const size_t len);
+
+        static StringRef getKey(const char *text, const size_t len,
+                size_t &shard);
+
+        //Copies the string in the arena of the shard. The string is
+        //preceded by its length (4 bytes).
+        static const char *store(Shard &shard, const char *text,
+                const size_t len);
+
+        void setRawText(const uint64_t id, const char *record);
+
+        //Returns the stored string (preceded by its length), or NULL
+        const char *getRecord(const uint64_t id) const;
+
+        ConcurrentDictionary(const ConcurrentDictionary &) = delete;
+
+        ConcurrentDictionary &operator=(const ConcurrentDictionary &) = delete;
+
+    public:
+        ConcurrentDictionary() : ConcurrentDictionary(1) {
+        }
+
+        ConcurrentDictionary(uint64_t startingCounter);
+
+        bool get(const char *text, const size_t len, uint64_t &id);
+
+        bool get(const std::string &rawValue, uint64_t &id) {
+            return get(rawValue.c_str(), rawValue.size(), id);
+        }
+
+        uint64_t getOrAdd(const char *text, const size_t len);
+
+        uint64_t getOrAdd(const std::string &rawValue) {
+            return getOrAdd(rawValue.c_str(), rawValue.size());
+        }
+
+        //Copies the text of id in text (followed by '\0'). Returns false if
+        //the ID is unknown.
+        bool getText(const uint64_t id, char *text) const;
+
+        //Returns the text of id, or "" if the ID is unknown
+        std::string getRawValue(const uint64_t id) const;
+
+        uint64_t getCounter() const {
+            return counter.load();
+        }
+
+        uint64_t size() const {
+            return counter.load() - startCounter;
+        }
+
+        ~ConcurrentDictionary();
+};
+
+#endif
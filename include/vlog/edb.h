@@ -5,6 +5,7 @@
 #include <vlog/concepts.h>
 #include <vlog/qsqquery.h>
 #include <vlog/support.h>
+#include <vlog/concurrentdictionary.h>
 #include <vlog/idxtupletable.h>
 
 #include <vlog/edbtable.h>
@@ -15,6 +16,8 @@
 
 #include <vector>
 #include <map>
+#include <atomic>
+#include <mutex>
 
 class Column;
 class EDBMemIterator final : public EDBIterator {
@@ -122,7 +125,21 @@ class EDBLayer {
         Factory<EDBMemIterator> memItrFactory;
         std::vector<IndexedTupleTable *>tmpRelations;
 
-        std::shared_ptr<Dictionary> termsDictionary;//std::string, Term_t
+        std::shared_ptr<ConcurrentDictionary> termsDictionary;//std::string, Term_t
+        //termsDictionary is created on demand, possibly by concurrent
+        //callers. The pointer is read without taking the lock.
+        std::atomic<ConcurrentDictionary *> termsDictionaryPtr;
+        std::mutex termsDictionaryMutex;
+        //See getDictTextMutex
+        std::mutex dictTextMutex;
+
+        //Changes every time a table is added or removed. Values are unique
+        //across all the layers, so that they can identify their content.
+        uint64_t generation;
+
+        static uint64_t nextGeneration();
+
+        ConcurrentDictionary *getOrCreateTermsDictionary();
 
         VLIBEXP void addTridentTable(const EDBConf::Table &tableConf, bool multithreaded);
 
@@ -144,7 +161,8 @@ class EDBLayer {
     public:
         EDBLayer(EDBLayer &db, bool copyTables = false);
 
-        EDBLayer(EDBConf &conf, bool multithreaded) {
+        EDBLayer(EDBConf &conf, bool multithreaded) : termsDictionaryPtr(NULL),
+            generation(nextGeneration()) {
             const std::vector<EDBConf::Table> tables = conf.getTables();
 
             predDictionary = std::shared_ptr<Dictionary>(new Dictionary());
@@ -183,6 +201,17 @@ class EDBLayer {
 
         std::vector<PredId_t> getAllPredicateIDs();
 
+        uint64_t getGeneration() const {
+            return generation;
+        }
+
+        //The dictionaries of the tables (e.g., the one of Trident) are not
+        //guaranteed to be thread-safe. Threads that decode terms with
+        //getDictText concurrently must hold this mutex during the lookups.
+        std::mutex &getDictTextMutex() {
+            return dictTextMutex;
+        }
+
         VLIBEXP uint64_t getPredSize(PredId_t id);
 
         std::string getPredType(PredId_t id);
@@ -282,6 +311,11 @@ class EDBLayer {
         VLIBEXP bool getOrAddDictNumber(const char *text,
                 const size_t sizeText, uint64_t &id);
 
+        //Looks up text only among the terms added with getOrAddDictNumber.
+        //It can be called by several threads at the same time.
+        VLIBEXP bool getAddedDictNumber(const char *text,
+                const size_t sizeText, uint64_t &id);
+
         VLIBEXP bool getDictText(const uint64_t id, char *text);
 
         VLIBEXP std::string getDictText(const uint64_t id);
@@ -322,11 +356,27 @@ class EDBLayer {
         VLIBEXP void addInmemoryTable(std::string predicate,
                 PredId_t id, std::vector<std::vector<std::string>> &rows);
 
+        //Adds a table whose columns contain the IDs of the terms. The
+        //vectors are moved in the table.
+        VLIBEXP void addInmemoryTable(std::string predicate,
+                std::vector<std::vector<Term_t>> &columns);
+
+        //Adds a table of nrows rows of arity terms, stored one row after
+        //the other in text: term i is text[offsets[i], offsets[i + 1]).
+        //The terms get the same IDs as with the version that takes strings.
+        VLIBEXP void addInmemoryTable(std::string predicate,
+                const uint8_t arity, const char *text,
+                const int32_t *offsets, const size_t nrows);
+
         //For RMFA check
         VLIBEXP void addInmemoryTable(PredId_t predicate,
                 uint8_t arity,
                 std::vector<uint64_t> &rows);
 
+        //Removes the table of a predicate (used for the temporary tables
+        //of updateEDB)
+        VLIBEXP void removeTable(PredId_t predicate);
+
         ~EDBLayer() {
             for (int i = 0; i < tmpRelations.size(); ++i) {
                 if (tmpRelations[i] != NULL) {
@@ -1,8 +1,13 @@
 #include <vlog/seminaiver.h>
 #include <vlog/consts.h>
+#include <vlog/bufferedwriter.h>
 
 #include <trident/tree/root.h>
 
+#include <mutex>
+#include <string>
+#include <vector>
+
 struct _EDBPredicates {
     PredId_t id;
     size_t ruleid;
@@ -11,10 +16,90 @@ struct _EDBPredicates {
     uint8_t posToCopy[3];
 };
 
+//Rows in a block of the columnar export
+#define COLUMNAR_BLOCK_ROWS 65536
+//Triples in a file of the N-Triples export
+#define NT_SHARD_TRIPLES 10000000
+//Triples whose terms are decoded together in the N-Triples export
+#define NT_CHUNK_TRIPLES 65536
+
+class ParallelRange;
+
 class Exporter {
 private:
     std::shared_ptr<SemiNaiver> sn;
 
+    //Writes the columnar files of some predicates and collects the terms
+    //that they contain
+    struct ColumnarPredicates {
+        Exporter *exporter;
+        const std::vector<PredId_t> &preds;
+        const std::string &outputdir;
+        std::vector<std::vector<Term_t>> &terms;
+        //First error, if any
+        std::string *error;
+        std::mutex *errorMutex;
+
+        ColumnarPredicates(Exporter *exporter,
+                const std::vector<PredId_t> &preds,
+                const std::string &outputdir,
+                std::vector<std::vector<Term_t>> &terms,
+                std::string *error, std::mutex *errorMutex) :
+            exporter(exporter), preds(preds), outputdir(outputdir),
+            terms(terms), error(error), errorMutex(errorMutex) {
+            }
+
+        void operator()(const ParallelRange& r) const;
+    };
+
+    void writeColumnar(const std::string &filename, const PredId_t pred,
+                       std::vector<Term_t> &terms);
+
+    //Rows [begin, end) of a table of a predicate to extract
+    struct NTSegment {
+        size_t pred;
+        std::shared_ptr<const FCInternalTable> table;
+        size_t begin, end;
+    };
+
+    //Writes some files of the N-Triples export
+    struct NTShards {
+        Exporter *exporter;
+        const std::vector<_EDBPredicates> &predicatesToExtract;
+        const std::vector<std::vector<NTSegment>> &shards;
+        const std::string &outputdir;
+        const bool decompress;
+        const ExportCompression compression;
+        //First error, if any
+        std::string *error;
+        std::mutex *errorMutex;
+
+        NTShards(Exporter *exporter,
+                const std::vector<_EDBPredicates> &predicatesToExtract,
+                const std::vector<std::vector<NTSegment>> &shards,
+                const std::string &outputdir, const bool decompress,
+                const ExportCompression compression, std::string *error,
+                std::mutex *errorMutex) : exporter(exporter),
+            predicatesToExtract(predicatesToExtract), shards(shards),
+            outputdir(outputdir), decompress(decompress),
+            compression(compression), error(error), errorMutex(errorMutex) {
+            }
+
+        void operator()(const ParallelRange& r) const;
+    };
+
+    std::vector<std::vector<NTSegment>> getNTShards(
+            const std::vector<_EDBPredicates> &predicatesToExtract,
+            size_t &ntriples);
+
+    void writeNTShard(const std::string &filename,
+                      const std::vector<_EDBPredicates> &predicatesToExtract,
+                      const std::vector<NTSegment> &segments,
+                      const bool decompress,
+                      const ExportCompression compression);
+
+    std::vector<_EDBPredicates> getPredicatesToExtract();
+
     void extractTriples(std::vector <uint64_t> &all_s,
                         std::vector <uint64_t> &all_p,
                         std::vector <uint64_t> &all_o);
@@ -34,5 +119,26 @@ public:
 
     //void generateTridentDiffIndexTabByTab(std::string outputdir);
 
-    VLIBEXP void generateNTTriples(std::string outputdir, bool decompress);
+    //Writes every derived predicate in a binary, columnar file
+    //<predicate>.vcol, and the text of all the terms in dictionary.vdict.
+    //The columns are read directly from the tables. All integers are
+    //little-endian. A .vcol file contains:
+    //  "VLOGCOL1", arity (1 byte), number of rows (8 bytes), blocks
+    //A block contains up to COLUMNAR_BLOCK_ROWS rows:
+    //  number of rows (4 bytes), iteration (8 bytes), then for every column
+    //  the minimum value (8 bytes) and the bits per value (1 byte). If the
+    //  bits are not 0, they are followed by the size (4 bytes) of a zlib
+    //  stream that contains the values minus the minimum, packed in 64-bit
+    //  words from the least significant bit.
+    //dictionary.vdict contains:
+    //  "VLOGDIC1", number of terms (8 bytes), then for every term, sorted
+    //  by ID, the ID (8 bytes), the length (4 bytes) and the text.
+    VLIBEXP void generateColumnar(std::string outputdir);
+
+    //Writes the triples in files of NT_SHARD_TRIPLES triples each, or more
+    //if a table cannot be split (gzipped by default). The files are written
+    //in parallel, directly from the tables, so the memory does not grow
+    //with the number of triples.
+    VLIBEXP void generateNTTriples(std::string outputdir, bool decompress,
+            ExportCompression compression = COMPR_GZIP);
 };
@@ -23,10 +23,17 @@ class ExistentialRuleProcessor : public FinalRuleProcessor {
         std::vector<uint8_t> varsUsedForExt;
         std::vector<int> colsForExt;
 
+        struct ProbeTable;
+        struct CopyNonExisting;
+
+        //Clears, in the bitmap existing, the bits of the rows of tobeRetained
+        //for which t does not contain a fact with the same values in
+        //columnsToCheck
         static void filterDerivations(FCTable *t,
                 std::vector<std::shared_ptr<Column>> &tobeRetained,
                 std::vector<uint8_t> &columnsToCheck,
-                std::vector<uint64_t> &outputProc);
+                std::vector<uint64_t> &existing,
+                const int nthreads);
 
         static void filterDerivations(
                 const Literal &literal,
@@ -38,10 +45,12 @@ class ExistentialRuleProcessor : public FinalRuleProcessor {
                 std::pair<uint8_t, uint8_t> *posFromSecond,
                 std::vector<std::shared_ptr<Column>> c,
                 uint64_t sizecolumns,
-                std::vector<uint64_t> &output);
+                std::vector<uint64_t> &existing,
+                const int nthreads);
 
+        //Removes from c the rows whose bit is set in existing
         void retainNonExisting(
-                std::vector<uint64_t> &filterRows,
+                const std::vector<uint64_t> &existing,
                 uint64_t &sizecolumns,
                 std::vector<std::shared_ptr<Column>> &c);
 
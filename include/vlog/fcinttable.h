@@ -3,9 +3,11 @@
 
 #include <vlog/edb.h>
 #include <vlog/segment.h>
+#include <vlog/projectioncache.h>
 #include <kognac/factory.h>
 
 #include <vector>
+#include <atomic>
 #include <inttypes.h>
 #include <string>
 #include <unordered_map>
@@ -441,6 +443,10 @@ class InmemoryFCInternalTable final : public FCInternalTable {
         //size_t nrows;
         bool sorted;
 
+        //Identifies the sorted projections of the table in the ProjectionCache
+        const uint64_t cacheId = ProjectionCache::newOwnerId();
+        mutable std::atomic<bool> projectionsCached{false};
+
         InmemoryFCInternalTable(const size_t iteration, const uint8_t nfields,
                 const bool sorted,
                 std::shared_ptr<const Segment> values) :
@@ -455,6 +461,11 @@ class InmemoryFCInternalTable final : public FCInternalTable {
 
         bool isPrimarySorting(const std::vector<uint8_t> &fields) const;
 
+        //Returns the rows sorted by fields (or by all the columns if fields
+        //is NULL). The result is taken from the ProjectionCache, if possible.
+        std::shared_ptr<const Segment> getSortedValues(
+                const std::vector<uint8_t> *fields, const int nthreads) const;
+
         static std::string vector2string(const std::vector<uint8_t> &v);
 
         std::shared_ptr<Segment> doSort(
@@ -4,6 +4,7 @@
 #include <trident/model/table.h>
 #include <vlog/concepts.h>
 #include <vlog/fcinttable.h>
+#include <vlog/projectioncache.h>
 
 #include <inttypes.h>
 #include <string>
@@ -30,18 +31,22 @@ struct FCBlock {
     const uint8_t ruleExecOrder;
 
     bool isCompleted;
+    //The table was moved to disk (or has nothing worth moving)
+    bool spilled;
 
     FCBlock(size_t iteration, std::shared_ptr<const FCInternalTable> table,
             Literal query, uint8_t posQueryInRule, const RuleExecutionDetails *rule,
             const uint8_t ruleExecOrder, bool isCompleted) : iteration(iteration),
     table(table), query(query), posQueryInRule(posQueryInRule),
     rule(rule), ruleExecOrder(ruleExecOrder),
-    isCompleted(isCompleted) {
+    isCompleted(isCompleted), spilled(false) {
     }
 };
 
+//Filtered view of a table. The view is kept alive by the ProjectionCache,
+//which can evict it.
 struct FCCacheBlock {
-    std::shared_ptr<FCTable> table;
+    std::weak_ptr<FCTable> table;
     size_t begin, end;
 };
 
@@ -77,7 +82,7 @@ class FCIterator {
         VLIBEXP void moveNextCount();
 };
 
-typedef std::unordered_map<std::string, FCCacheBlock, std::hash<std::string>, std::equal_to<std::string>> FCCache;
+typedef std::unordered_map<std::vector<uint64_t>, FCCacheBlock, SignatureHash> FCCache;
 
 class FCTable {
     private:
@@ -86,7 +91,9 @@ class FCTable {
         std::vector<FCBlock> blocks;
 
         FCCache cache;
-        std::string getSignature(const Literal &literal);
+        //Identifies the filtered views of the table in the ProjectionCache
+        const uint64_t cacheId;
+        std::vector<uint64_t> getSignature(const Literal &literal);
 
         std::mutex *mutex;
         std::mutex cache_mutex;
@@ -163,6 +170,28 @@ class FCTable {
 
         void collapseBlocks(size_t iteration, int nThreads);
 
+        //Replaces the columns that are read from the EDB relations in preds
+        //with in-memory copies, so that the blocks do not change when the
+        //relations are updated. Returns the tables that were replaced, with
+        //their replacements.
+        std::vector<std::pair<std::shared_ptr<const FCInternalTable>,
+            std::shared_ptr<const FCInternalTable>>> copyEDBColumns(
+                    const std::vector<PredId_t> &preds);
+
+        //Removes the given (sorted and unique) rows. Returns the tables that
+        //were replaced, with their replacements (NULL if the whole block was
+        //removed).
+        std::vector<std::pair<std::shared_ptr<const FCInternalTable>,
+            std::shared_ptr<const FCInternalTable>>> removeRows(
+                    std::shared_ptr<const Segment> rows);
+
+        //Estimated number of bytes used by the blocks that are in memory
+        size_t getMemorySize() const;
+
+        //Moves the block of the given iteration to the file path. Returns
+        //the (estimated) number of bytes that are released.
+        size_t spill(const size_t iteration, const std::string &path);
+
         ~FCTable();
 };
 
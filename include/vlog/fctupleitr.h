@@ -0,0 +1,70 @@
+#ifndef _FC_TUPLE_ITR_H
+#define _FC_TUPLE_ITR_H
+
+#include <vlog/fcinttable.h>
+#include <vlog/fctable.h>
+#include <vlog/concepts.h>
+
+#include <trident/iterators/tupleiterators.h>
+
+#include <memory>
+#include <vector>
+
+//Iterates over the facts of the materialization that match a query, reading
+//the columns of the tables directly instead of copying the answers in a
+//TupleTable. The tables are kept alive by the iterator, so it remains valid
+//also if the SemiNaiver is destroyed.
+class FCTupleItr : public TupleIterator {
+    private:
+        std::vector<std::shared_ptr<const FCInternalTable>> tables;
+        const VTuple tuple;
+        const std::vector<std::pair<uint8_t, uint8_t>> repeated;
+        //Positions of the query that are returned
+        std::vector<uint8_t> outputPos;
+        //True if some rows of a table might not match the query
+        bool filtering;
+
+        size_t currentTable;
+        //Positions with a constant that must be checked on every row
+        std::vector<uint8_t> checkPos;
+        //Readers of the columns of the current table that are used (NULL
+        //for the others). They are opened only when rows are read.
+        std::vector<std::unique_ptr<ColumnReader>> readers;
+        bool readersOpen;
+        size_t rowsLeft;
+
+        std::vector<Term_t> current;
+        std::vector<Term_t> row;
+        std::vector<Term_t> pendingRow;
+        bool nextProcessed;
+        bool nextOutcome;
+
+        bool moveToNextTable();
+
+        void openReaders();
+
+        bool readMatchingRow(std::vector<Term_t> &out);
+
+    public:
+        FCTupleItr(FCIterator tableItr, const Literal &query,
+                const bool returnOnlyVars);
+
+        bool hasNext();
+
+        void next();
+
+        size_t getTupleSize();
+
+        uint64_t getElementAt(const int pos);
+
+        //Copies up to maxRows of the next rows in out, one row after the
+        //other, and returns the number of rows that were copied
+        size_t nextRows(uint64_t *out, const size_t maxRows);
+
+        //Counts the remaining rows. Rows are read only if the query contains
+        //constants that are not stored as constant columns or repeated
+        //variables
+        size_t count();
+};
+
+#endif
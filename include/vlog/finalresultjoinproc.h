@@ -110,6 +110,10 @@ class SingleHeadFinalRuleProcessor: public ResultJoinProcessor {
 
         bool isEmpty() const;
 
+        //Rows in the buffers, before the duplicates with the facts already
+        //in the table are removed
+        size_t getNRows() const;
+
         void processResults(std::vector<int> &blockid, Term_t *p,
                 std::vector<bool> &unique, std::mutex *m);
 
@@ -197,6 +201,9 @@ class FinalRuleProcessor: public ResultJoinProcessor {
 
         bool isEmpty() const;
 
+        //Rows in the buffers of all heads
+        size_t getNRows() const;
+
         virtual void processResults(const int blockid, const bool unique,
                 std::mutex *m);
 
@@ -233,6 +240,16 @@ class FinalRuleProcessor: public ResultJoinProcessor {
 
         virtual void consolidate(const bool isFinished);
 
+        //The processors of every head. They contain the results if they
+        //are not added to the tables.
+        std::vector<SingleHeadFinalRuleProcessor*> getAtomTables() const {
+            std::vector<SingleHeadFinalRuleProcessor*> out;
+            for (const auto &t : atomTables) {
+                out.push_back(t.get());
+            }
+            return out;
+        }
+
         ~FinalRuleProcessor() {}
 };
 
@@ -0,0 +1,109 @@
+#ifndef _CSV_LOADER_H
+#define _CSV_LOADER_H
+
+#include <vlog/segment.h>
+#include <vlog/edb.h>
+
+#include <istream>
+#include <string>
+#include <vector>
+
+//Loads CSV files into a SegmentInserter. The input is split at newlines
+//into chunks which are tokenized in parallel. Since quoted fields can
+//contain newlines, a chunk is accepted only if the previous one ended
+//exactly at its start; otherwise the input is split again from where the
+//previous chunk stopped. Each chunk collects its distinct terms. The
+//terms that are already in the dictionary are looked up in parallel, the
+//new ones are then added in order of appearance. The rows and the IDs of the terms are the same as those
+//produced by parsing the file one character at a time.
+class CSVLoader {
+    private:
+        struct Chunk {
+            const char *begin;
+            const char *end;
+            bool eof;
+            const char *consumed;
+            uint8_t arity;
+            bool multipleArities;
+            std::string error;
+            size_t nrows;
+            std::vector<uint32_t> cells;
+            std::vector<std::string> terms;
+            std::vector<uint64_t> dictIds;
+            std::vector<bool> found;
+
+            Chunk() : begin(NULL), end(NULL), eof(true), consumed(NULL),
+            arity(0), multipleArities(false), nrows(0) {
+            }
+        };
+
+        struct ParseChunks {
+            std::vector<Chunk> &chunks;
+
+            ParseChunks(std::vector<Chunk> &chunks) : chunks(chunks) {
+            }
+
+            void operator()(const ParallelRange& r) const;
+        };
+
+        struct LookupChunks {
+            std::vector<Chunk> &chunks;
+            EDBLayer *layer;
+
+            LookupChunks(std::vector<Chunk> &chunks, EDBLayer *layer) :
+                chunks(chunks), layer(layer) {
+                }
+
+            void operator()(const ParallelRange& r) const;
+        };
+
+        const std::string path;
+        EDBLayer *layer;
+        SegmentInserter *inserter;
+        uint8_t arity;
+
+        static void parseChunk(Chunk &chunk);
+
+        static void lookupChunk(Chunk &chunk, EDBLayer *layer);
+
+        //Returns the first newline after target. If exact is set, the rows
+        //are parsed from from, so that the result is the start of a row
+        //also if quoted fields contain newlines.
+        static const char *nextRowStart(const char *from, const char *target,
+                const char *end, const bool exact);
+
+        const char *processWindow(const char *begin, const char *end,
+                const bool eof);
+
+        void addChunk(Chunk &chunk);
+
+        void loadFromStream(std::istream &ifs);
+
+#if !defined(_WIN32)
+        void loadFromMappedFile();
+#endif
+
+        CSVLoader(std::string path, EDBLayer *layer) : path(path),
+        layer(layer), inserter(NULL), arity(0) {
+        }
+
+    public:
+        //Size of the chunks that are tokenized by a single task
+        static const size_t CHUNK_SIZE = 16 * 1024 * 1024;
+
+        //Maximum size of a field (same limit as the old reader)
+        static const size_t MAX_FIELD_SIZE = 65535;
+
+        //Parses one row starting at p. Returns the start of the next row,
+        //or NULL if the row does not end before "end" and !eof. At the
+        //end of the input it returns "end" and leaves row empty.
+        static const char *parseRow(const char *p, const char *end,
+                const bool eof, std::vector<std::string> &row);
+
+        //Loads path (which may be gzipped) and returns the rows (unsorted)
+        //in a SegmentInserter, or NULL if the file contains no rows.
+        VLIBEXP static SegmentInserter *load(std::string path, EDBLayer *layer,
+                uint8_t &arity);
+};
+
+#endif
@@ -65,9 +65,14 @@ class InmemoryTable : public EDBTable {
         EDBLayer *layer;
 
         std::shared_ptr<const Segment> segment;
+        //Minimum and maximum value of every column
+        std::vector<Term_t> minValues;
+        std::vector<Term_t> maxValues;
         std::map<uint64_t, std::shared_ptr<const Segment>> cachedSortedSegments;
         std::map<uint64_t, std::shared_ptr<HashMapEntry>> cacheHashes;
 
+        void computeMinMax();
+
         std::shared_ptr<const Segment> getSortedCachedSegment(
                 std::shared_ptr<const Segment> segment,
                 const std::vector<uint8_t> &filterBy);
@@ -77,10 +82,18 @@ class InmemoryTable : public EDBTable {
                 const std::vector<uint8_t> &fields);
 
     public:
-        InmemoryTable(std::string repository, std::string tablename, PredId_t predid, EDBLayer *layer);
+        //If snapshot is true, the table is loaded from the snapshot file in
+        //repository (if it exists) instead of the CSV or NT file
+        InmemoryTable(std::string repository, std::string tablename, PredId_t predid, EDBLayer *layer,
+                bool snapshot = false);
 
         InmemoryTable(PredId_t predid, std::vector<std::vector<std::string>> &entries, EDBLayer *layer);
 
+        //The vectors in columns are moved in the table
+        InmemoryTable(PredId_t predid,
+                std::vector<std::vector<Term_t>> &columns,
+                EDBLayer *layer);
+
         InmemoryTable(PredId_t predid,
                 uint8_t arity,
                 std::vector<uint64_t> &entries,
@@ -119,6 +132,8 @@ class InmemoryTable : public EDBTable {
 
         uint64_t getSize();
 
+        VLIBEXP void storeSnapshot(std::string path);
+
         ~InmemoryTable();
 };
 
@@ -0,0 +1,53 @@
+#ifndef _TABLE_SNAPSHOT_H
+#define _TABLE_SNAPSHOT_H
+
+#include <vlog/segment.h>
+#include <vlog/edb.h>
+
+#include <string>
+#include <vector>
+
+//Binary columnar snapshot of an InmemoryTable. The file contains a header
+//(arity, number of rows, minimum and maximum of every column), the sorted
+//and unique rows stored column by column, and the text of every term that
+//occurs in the table. All numbers are stored as 64-bit values in the byte
+//order of the machine that wrote the file.
+//If the terms get the same IDs when the snapshot is loaded (which is the
+//case when the tables are loaded in the same order as when the snapshot was
+//written), the columns are mapped from the file without copying them.
+//Otherwise, the IDs are translated and the rows sorted again.
+class TableSnapshot {
+    private:
+        static const uint64_t VERSION = 1;
+
+        //Offsets in the header (in 64-bit words)
+        static const size_t H_MAGIC = 0;
+        static const size_t H_VERSION = 1;
+        static const size_t H_ARITY = 2;
+        static const size_t H_NROWS = 3;
+        static const size_t H_NTERMS = 4;
+        static const size_t H_DICT = 5;
+        static const size_t H_COLUMNS = 6; //min, max and offset per column
+
+    public:
+        //File extension of the snapshots
+        static const std::string EXTENSION;
+
+        //Maps the file in memory (on Windows, it is read instead). The
+        //mapping stays valid until the returned pointer is released.
+        VLIBEXP static std::shared_ptr<const char> readFile(
+                const std::string &path, size_t &size);
+
+        VLIBEXP static void store(const std::string &path,
+                std::shared_ptr<const Segment> segment, const uint8_t arity,
+                EDBLayer *layer);
+
+        //Returns the (sorted and unique) segment stored in path, or NULL if
+        //it contains no rows.
+        VLIBEXP static std::shared_ptr<const Segment> load(
+                const std::string &path, EDBLayer *layer, uint8_t &arity,
+                std::vector<Term_t> &minValues,
+                std::vector<Term_t> &maxValues);
+};
+
+#endif
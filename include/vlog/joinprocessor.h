@@ -33,8 +33,16 @@ struct LessTwoTuples {
 //If the previous table has less than these lines, then it executes an hash join
 #define THRESHOLD_HASHJOIN 100
 
+//If the previous table has more than these lines, then the merge join is
+//replaced by a (radix-partitioned) hash join
+#define THRESHOLD_RADIXJOIN (1 << 20)
+
 #define FLUSH_SIZE (1 << 20)
 
+//Number of key ranges per thread in a parallel merge join. Having more ranges
+//than threads balances the work when some keys have many more matches.
+#define MERGEJOIN_TASKS_PER_THREAD 4
+
 class Output {
     private:
 
@@ -129,7 +137,7 @@ class Output {
         }
 
         void flush() {
-            if (m == NULL) {
+            if (m == NULL || resultBlockId.empty()) {
                 return;
             }
             Term_t *p = &resultTerms[0];
@@ -265,12 +273,32 @@ class JoinExecutor {
                 const Term_t *valBlocks,
                 ResultJoinProcessor *output);
 
+        static void do_merge_join_fasteralgo(
+                const std::vector<const std::vector<Term_t> *> &vectors1,
+                size_t n1,
+                const std::vector<const std::vector<Term_t> *> &vectors2,
+                size_t n2,
+                const std::vector<uint8_t> &fields1,
+                const std::vector<uint8_t> &fields2,
+                const uint8_t posBlocks,
+                const uint8_t nValBlocks,
+                const Term_t *valBlocks,
+                ResultJoinProcessor *output,
+                int nthreads);
+
         static void do_mergejoin(const FCInternalTable *filteredT1, std::vector<uint8_t> &fieldsToSortInMap,
                 std::vector<std::shared_ptr<const FCInternalTable>> &tables2,
                 const std::vector<uint8_t> &fields1, const uint8_t *posOtherVars, const std::vector<Term_t> *valuesOtherVars,
                 const std::vector<uint8_t> &fields2, ResultJoinProcessor *output, int nthreads);
 
     public:
+        //Returns the first row in [0, n) of vectors whose key is not smaller
+        //than the key of row i in keyVectors
+        static size_t lowerBoundKey(const std::vector<const std::vector<Term_t> *> &vectors,
+                const std::vector<uint8_t> &fields, size_t n,
+                const std::vector<const std::vector<Term_t> *> &keyVectors,
+                const std::vector<uint8_t> &keyFields, size_t i);
+
         static void do_merge_join_classicalgo(FCInternalTableItr *sortedItr1,
                 FCInternalTableItr *sortedItr2,
                 const std::vector<uint8_t> &fields1,
@@ -0,0 +1,124 @@
+#ifndef _LEAPFROGJOIN_H
+#define _LEAPFROGJOIN_H
+
+#include <vlog/concepts.h>
+#include <vlog/resultjoinproc.h>
+
+#include <vector>
+
+//Number of bindings that a worker collects before it passes them to the output
+#define LEAPFROG_BATCH 4096
+//Below this number of rows, the join is not split among the threads
+#define LEAPFROG_PARALLEL_THRESHOLD 65536
+//Number of ranges of values of the first variable per thread
+#define LEAPFROG_TASKS_PER_THREAD 4
+
+class SemiNaiver;
+class Output;
+
+//Leapfrog triejoin (Veldhuizen, ICDT 2014) of all the atoms of a rule body.
+//The variables are bound one at a time, by intersecting the sorted values of
+//all the atoms that contain them. Contrary to a sequence of binary joins, it
+//never materializes intermediate results that are larger than the output,
+//which makes it suitable for bodies whose variables form a cycle. The bindings
+//are written directly in the final ResultJoinProcessor.
+class LeapfrogTrieJoin {
+    private:
+        //The facts of an atom, projected on its variables (in the order in
+        //which they are bound), sorted and without duplicates
+        struct Relation {
+            //Positions of the variables in "variables"
+            std::vector<uint8_t> vars;
+            std::vector<std::vector<Term_t>> columns;
+            size_t nrows;
+            Relation() : nrows(0) {}
+        };
+
+        class TrieIterator {
+            private:
+                const Relation *relation;
+                int depth;
+                std::vector<size_t> end;
+                std::vector<size_t> pos;
+
+            public:
+                TrieIterator(const Relation *relation) : relation(relation),
+                depth(-1), end(relation->vars.size()),
+                pos(relation->vars.size()) {
+                }
+
+                void open();
+
+                void up() {
+                    depth--;
+                }
+
+                Term_t key() const {
+                    return relation->columns[depth][pos[depth]];
+                }
+
+                bool atEnd() const {
+                    return pos[depth] >= end[depth];
+                }
+
+                //Moves to the next distinct value
+                void next();
+
+                //Moves to the first value >= v
+                void seek(const Term_t v);
+        };
+
+        //State of a worker
+        struct State {
+            std::vector<TrieIterator> iterators;
+            //For every variable, the iterators of the atoms that contain it
+            std::vector<std::vector<TrieIterator *>> levels;
+            std::vector<Term_t> binding;
+            std::vector<std::vector<Term_t>> results;
+            std::vector<const std::vector<Term_t> *> vectors;
+            Output *output;
+        };
+
+        struct JoinRanges;
+
+        //IDs of the variables, in the order in which they are bound. The
+        //variables that appear in only one atom and not in the head are left
+        //out.
+        std::vector<uint8_t> variables;
+        std::vector<std::pair<uint8_t, uint8_t>> posFromFirst;
+        std::vector<const Literal *> atoms;
+        std::vector<Relation> relations;
+
+        bool load(SemiNaiver *naiver, const Literal &literal,
+                const size_t min, const size_t max, Relation &relation,
+                int &processedTables, const int nthreads);
+
+        void initState(State &state, Output *output) const;
+
+        //Binds the variable at position level. At level 0, only the values in
+        //[lo, hi) are considered (or >= lo, if hi is not bounded).
+        void search(State &state, const size_t level, const Term_t lo,
+                const Term_t hi, const bool bounded) const;
+
+        void flush(State &state) const;
+
+    public:
+        LeapfrogTrieJoin(const std::vector<const Literal *> &body,
+                const std::vector<Literal> &heads);
+
+        //Positions of the variables of the heads in the bindings. The output
+        //must copy them from the first vectors.
+        std::vector<std::pair<uint8_t, uint8_t>> &getPosFromFirst() {
+            return posFromFirst;
+        }
+
+        //Joins the facts of every atom i of the body in the iterations
+        //ranges[i]
+        void join(SemiNaiver *naiver,
+                const std::vector<std::pair<size_t, size_t>> &ranges,
+                ResultJoinProcessor *output,
+                int &processedTables,
+                const int nthreads);
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef _PROJECTIONCACHE_H
+#define _PROJECTIONCACHE_H
+
+#include <vlog/segment.h>
+#include <vlog/consts.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//Default memory (in bytes) used by the cached tables
+#define PROJECTIONCACHE_BUDGET (UINT64_C(1) << 30)
+//Number of projections that were computed once and not (yet) cached, which
+//are remembered to decide which projections are cached
+#define PROJECTIONCACHE_MAX_CANDIDATES 65536
+
+class FCTable;
+
+//Identifies a projection: the table it comes from (see
+//ProjectionCache::newOwnerId) and the column order or filter that was applied
+struct ProjectionKey {
+    uint64_t owner;
+    std::vector<uint64_t> signature;
+
+    ProjectionKey(const uint64_t owner, const std::vector<uint64_t> &signature) :
+        owner(owner), signature(signature) {
+        }
+
+    bool operator ==(const ProjectionKey &other) const {
+        return owner == other.owner && signature == other.signature;
+    }
+};
+
+struct SignatureHash {
+    size_t operator()(const std::vector<uint64_t> &signature) const {
+        uint64_t h = signature.size();
+        for (auto v : signature) {
+            h = (h ^ v) * UINT64_C(0x100000001b3);
+        }
+        return (size_t) h;
+    }
+};
+
+struct ProjectionKeyHash {
+    size_t operator()(const ProjectionKey &key) const {
+        return SignatureHash()(key.signature) ^
+            (size_t) (key.owner * UINT64_C(0x9e3779b97f4a7c15));
+    }
+};
+
+//Cache of the sorted projections of the in-memory blocks and of the filtered
+//views of the tables. It is shared by all the tables, so the projections
+//survive across the iterations, and its size is bounded by a memory budget.
+//The entries are evicted with GreedyDual-Size: every entry has a priority
+//(the priority of the last evicted entry, plus the cost to compute it again
+//divided by its size) which is renewed when the entry is used, and the entry
+//with the lowest priority is evicted first. This is the LRU policy if all
+//the entries have the same cost per byte.
+class ProjectionCache {
+    public:
+        struct Stats {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            uint64_t entries;
+            uint64_t bytes;
+            Stats() : hits(0), misses(0), evictions(0), entries(0), bytes(0) {}
+        };
+
+    private:
+        struct Entry {
+            std::shared_ptr<const Segment> segment;
+            std::shared_ptr<FCTable> table;
+            size_t size;
+            double cost;
+            std::multimap<double, ProjectionKey>::iterator position;
+        };
+
+        std::mutex mutex;
+        size_t budget;
+        double inflation;
+        std::unordered_map<ProjectionKey, Entry, ProjectionKeyHash> entries;
+        std::multimap<double, ProjectionKey> priorities;
+        std::unordered_map<uint64_t, std::vector<std::vector<uint64_t>>> owners;
+        //Projections that were computed once
+        std::unordered_set<ProjectionKey, ProjectionKeyHash> candidates;
+        //Filtered views that were removed. They are destroyed after the lock
+        //is released, since their destructor calls removeOwner.
+        std::vector<std::shared_ptr<FCTable>> released;
+        Stats stats;
+
+        static std::atomic<uint64_t> ownerCounter;
+
+        ProjectionCache() : budget(PROJECTIONCACHE_BUDGET), inflation(0) {}
+
+        Entry *find(const ProjectionKey &key);
+
+        void add(const ProjectionKey &key, Entry &entry);
+
+        void remove(std::unordered_map<ProjectionKey, Entry,
+                ProjectionKeyHash>::iterator itr);
+
+        void evict();
+
+    public:
+        VLIBEXP static ProjectionCache &getInstance();
+
+        //Returns a new ID for a table whose projections are cached
+        static uint64_t newOwnerId() {
+            return ++ownerCounter;
+        }
+
+        //Memory (in bytes) that the cached tables may use. 0 disables the
+        //cache.
+        VLIBEXP void setBudget(const size_t bytes);
+
+        std::shared_ptr<const Segment> getSegment(const ProjectionKey &key);
+
+        //Sorted projections are only cached the second time they are
+        //computed, so that the ones of short-lived tables (e.g., the
+        //intermediate results of the joins) do not replace the others. Returns
+        //true if the segment was cached.
+        bool putSegment(const ProjectionKey &key,
+                std::shared_ptr<const Segment> segment, const double cost);
+
+        std::shared_ptr<FCTable> getTable(const ProjectionKey &key);
+
+        //Adds or replaces a filtered view
+        void putTable(const ProjectionKey &key, std::shared_ptr<FCTable> table,
+                const size_t size, const double cost);
+
+        //Removes the projections of a table that no longer exists or was
+        //changed
+        void removeOwner(const uint64_t owner);
+
+        VLIBEXP Stats getStats();
+};
+
+#endif
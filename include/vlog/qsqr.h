@@ -14,6 +14,12 @@
 #include <trident/model/table.h>
 
 #include <vector>
+#include <list>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 class TupleTable;
 class RuleExecutor;
@@ -21,11 +27,17 @@ class RuleExecutor;
 #define QSQR_EVAL 0
 #define QSQR_EST 1
 
+//When the evaluation is parallel, the new input tuples of a rule are split
+//in tasks of this many tuples, which other threads can steal
+#define QSQR_RANGE_SIZE 256
+
 #ifndef RECURSIVE_QSQR
 
 class QSQR;
 
-enum QSQR_TaskType { RULE, QUERY, RULE_QUERY}; //Execute rule or query
+//Execute rule or query. RULE_RANGE executes a rule on a range of input
+//tuples.
+enum QSQR_TaskType { RULE, QUERY, RULE_QUERY, RULE_RANGE};
 struct QSQR_Task {
     const QSQR_TaskType type;
 
@@ -33,6 +45,7 @@ struct QSQR_Task {
     Predicate pred;
     BindingsTable *inputTable;
     size_t offsetInput;
+    size_t endInput;
     bool repeat;
     int currentRuleIndex;
     size_t totalAnswers;
@@ -64,9 +77,40 @@ private:
 
     //const Timeout * timeout;
 
+    int nthreads;
+    //Protects the creation of the inputs, answers and rules
+    std::mutex tablesMutex;
+
 #ifndef RECURSIVE_QSQR
     std::vector<QSQR_Task> tasks;
     void processTask(QSQR_Task &task);
+
+    //Stack of tasks of a thread. The thread takes the tasks from the end.
+    //The other threads can steal the oldest tasks that do not depend on the
+    //tasks above them (QUERY and RULE_RANGE).
+    struct Worker {
+        QSQR *qsqr;
+        std::mutex mutex;
+        std::list<QSQR_Task> tasks;
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    //Tasks that are in a stack or being processed
+    std::atomic<size_t> pendingTasks;
+    static thread_local Worker *currentWorker;
+    //The threads without tasks wait on idleCond until a task is pushed
+    //(taskVersion changes) or all the tasks are done
+    std::mutex idleMutex;
+    std::condition_variable idleCond;
+    std::atomic<size_t> idleWorkers;
+    std::atomic<uint64_t> taskVersion;
+
+    //Processes the tasks until there are none left
+    void processTasks();
+
+    void runWorker(const size_t id);
+
+    //Moves a task of another thread in out
+    bool stealTask(const size_t id, std::list<QSQR_Task> &out);
 #endif
 
 
@@ -75,7 +119,8 @@ private:
     void createRules(Predicate &pred);
 
 public:
-    QSQR(EDBLayer &layer, Program *program) : layer(layer), program(program) {
+    QSQR(EDBLayer &layer, Program *program) : layer(layer), program(program),
+    nthreads(1) {
         int nPreds = program->getNPredicates();
         sizePreds.resize(nPreds);
         inputs.resize(nPreds);
@@ -89,11 +134,19 @@ public:
     }*/
 
 #ifndef RECURSIVE_QSQR
-    void pushTask(QSQR_Task &task) {
-        tasks.push_back(task);
-    }
+    void pushTask(QSQR_Task &task);
 #endif
 
+    //Number of threads used by evaluateQuery. The EDB layer must support
+    //concurrent queries if it is larger than 1.
+    void setNThreads(const int nthreads) {
+        this->nthreads = std::max(1, nthreads);
+    }
+
+    int getNThreads() const {
+        return nthreads;
+    }
+
     void setProgram(Program *program) {
         this->program = program;
     }
@@ -131,11 +184,13 @@ public:
 
     void evaluate(Predicate &pred, BindingsTable *inputTable,
                   size_t offsetInput) {
-        evaluate(pred, inputTable, offsetInput, true);
+        evaluate(pred, inputTable, offsetInput, inputTable->getNTuples(),
+                true);
     }
 
+    //Evaluates the input tuples in [offsetInput, endInput)
     void evaluate(Predicate &pred, BindingsTable *inputTable,
-                  size_t offsetInput, bool repeat);
+                  size_t offsetInput, size_t endInput, bool repeat);
 
     ~QSQR();
 };
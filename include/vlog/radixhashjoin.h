@@ -0,0 +1,76 @@
+#ifndef _RADIXHASHJOIN_H
+#define _RADIXHASHJOIN_H
+
+#include <vlog/resultjoinproc.h>
+#include <vlog/joinprocessor.h>
+
+#include <vector>
+
+//Size of the hash table of a partition. The partitions are made small enough
+//to fit in the L2 cache.
+#define RADIXJOIN_PARTITION_SIZE (256 * 1024)
+#define RADIXJOIN_MAX_PARTITIONS (1 << 14)
+
+//Hash join for large inputs. Both sides are partitioned on the lower bits of
+//the hash of the join key, then for every partition a hash table is built on
+//the rows of the first side and probed with the rows of the second side. The
+//partitions are processed in parallel. Unlike the merge join, it does not
+//need to sort the inputs.
+class RadixHashJoin {
+    private:
+        //The rows of a table, grouped by partition. The rows of partition p
+        //are in [offsets[p], offsets[p + 1]).
+        struct Partitioned {
+            std::vector<size_t> rows;
+            std::vector<uint64_t> hashes;
+            std::vector<size_t> offsets;
+        };
+
+        struct PartitionChunks;
+
+        struct BuildPartitions;
+
+        struct ProbePartitions;
+
+        const std::vector<const std::vector<Term_t> *> &vectors1;
+        const std::vector<uint8_t> &fields1;
+        const int nthreads;
+        const uint8_t bits;
+
+        Partitioned build;
+        //Hash tables of the partitions. The buckets of partition p start at
+        //bucketOffsets[p]. Every bucket contains the position (+1) in build
+        //of the first row in the chain, and next the following one.
+        std::vector<size_t> bucketOffsets;
+        std::vector<size_t> buckets;
+        std::vector<size_t> next;
+
+        //Number of bits of the hash used to select the partition
+        static uint8_t getBits(const size_t nrows);
+
+        static uint64_t hash(const std::vector<const std::vector<Term_t> *> &vectors,
+                const std::vector<uint8_t> &fields, const size_t row);
+
+        void partition(const std::vector<const std::vector<Term_t> *> &vectors,
+                const std::vector<uint8_t> &fields, const size_t nrows,
+                Partitioned &out) const;
+
+        void buildPartition(const size_t p);
+
+        void probePartition(const size_t p, const Partitioned &probe,
+                const std::vector<const std::vector<Term_t> *> &vectors2,
+                const std::vector<uint8_t> &fields2, Output *out) const;
+
+        RadixHashJoin(const std::vector<const std::vector<Term_t> *> &vectors1,
+                const std::vector<uint8_t> &fields1, const size_t nrows1,
+                const int nthreads);
+
+    public:
+        static void join(const FCInternalTable *t1,
+                std::vector<std::shared_ptr<const FCInternalTable>> &tables2,
+                const std::vector<uint8_t> &fields1,
+                const std::vector<uint8_t> &fields2,
+                ResultJoinProcessor *output, int nthreads);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _RADIXSORT_H
+#define _RADIXSORT_H
+
+#include <vlog/concepts.h>
+
+#include <vector>
+
+//Below this number of rows, segments are sorted with the comparator sort
+#define RADIXSORT_THRESHOLD 4096
+
+//LSD radix sort of the rows of a set of columns. The columns are processed
+//from the last (least significant) to the first. Every column is reduced to
+//its range of values, and only the digits that occur in that range are
+//sorted, so that columns with a single value cost nothing. Every pass is
+//done in parallel on chunks of the rows, and keeps the order of the rows with
+//the same digit.
+class RadixSort {
+    private:
+        static const uint8_t DIGIT_BITS = 11;
+        static const size_t NDIGITS = (size_t) 1 << DIGIT_BITS;
+
+        struct MinMax;
+
+        struct Gather;
+
+        struct RadixPass;
+
+        struct CopyRows;
+
+    public:
+        //Sorts the rows of vectors (the first vector is the most significant)
+        //and stores the sorted columns in out. If unique is set, duplicated
+        //rows are removed while the columns are copied.
+        VLIBEXP static void sort(const std::vector<const std::vector<Term_t> *> &vectors,
+                const bool unique, const int nthreads,
+                std::vector<std::vector<Term_t>> &out);
+};
+
+#endif
@@ -13,15 +13,51 @@
 
 #include <trident/sparql/query.h>
 
+#include <map>
+#include <memory>
+#include <tuple>
+
 #define QUERY_MAT 0
 #define QUERY_ONDEM 1
 
 typedef enum {TOPDOWN, MAGIC} ReasoningMode;
 
+//Magic-set rewriting of a program for a predicate and an adornment, together
+//with its materialization. The rewriting does not depend on the constants of
+//the query, so the session is reused by all the queries with the same
+//adornment: their constants are added to the magic relation and only the
+//facts that follow from them are derived. Sessions are identified by the
+//generations of the program and of the EDB layer, so they are not reused
+//once the rules or the tables change.
+struct MagicSession {
+    std::shared_ptr<Program> adornedProgram;
+    std::shared_ptr<Program> magicProgram;
+    std::pair<PredId_t, PredId_t> inputOutputRelIDs;
+    //False if the materialization cannot be resumed (with negation)
+    bool resumable;
+    //Declared last, so that it is destroyed before the programs
+    std::unique_ptr<SemiNaiver> naiver;
+};
+
 class Reasoner {
     private:
+        //Generation of the program, generation of the EDB layer, predicate
+        //and adornment
+        typedef std::tuple<uint64_t, uint64_t, PredId_t, uint8_t>
+            MagicSessionKey;
 
         const uint64_t threshold;
+        int nthreads;
+        std::map<MagicSessionKey, std::shared_ptr<MagicSession>> magicSessions;
+
+        static MagicSessionKey getMagicSessionKey(Literal &query,
+                EDBLayer &layer, Program &program);
+
+        //Returns the session of the query, or a new one if there is none
+        //(created is set to true). New sessions are not stored: the caller
+        //stores them once their first materialization is complete.
+        std::shared_ptr<MagicSession> getMagicSession(Literal &query,
+                EDBLayer &layer, Program &program, bool &created);
 
         void cleanBindings(std::vector<Term_t> &bindings, std::vector<uint8_t> * posJoins,
                 TupleTable *input);
@@ -46,7 +82,19 @@ class Reasoner {
 
     public:
 
-        Reasoner(const uint64_t threshold) : threshold(threshold) {}
+        Reasoner(const uint64_t threshold) : threshold(threshold), nthreads(1) {}
+
+        //Number of threads used by the top-down evaluation
+        void setNThreads(const int nthreads) {
+            this->nthreads = nthreads;
+        }
+
+        //Drops the magic-set sessions. The sessions of a program or an EDB
+        //layer that changed are dropped by the next query, this releases
+        //also the others.
+        void clearMagicSessions() {
+            magicSessions.clear();
+        }
 
         size_t estimate(Literal &query, std::vector<uint8_t> *posBindings,
                 std::vector<Term_t> *valueBindings, EDBLayer &layer,
@@ -97,6 +145,20 @@ class Reasoner {
                 bool returnOnlyVars,
                 std::vector<uint8_t> *sortByFields);
 
+        //Answers at once the queries obtained by binding the variables at
+        //positions posJoins (as in the other methods, positions among the
+        //variables of the query) to every row of possibleValuesJoins. If sn
+        //is not NULL, the answers are read from its materialization,
+        //otherwise IDB queries are evaluated with a single magic-set
+        //materialization seeded with all the rows. Every output row starts
+        //with the index of the input row it answers, followed by all the
+        //terms of the query. The rows are sorted by input row.
+        VLIBEXP TupleIterator *getBatchIterator(Literal &query,
+                std::vector<uint8_t> &posJoins,
+                std::vector<Term_t> &possibleValuesJoins,
+                EDBLayer &layer, Program &program,
+                SemiNaiver *sn = NULL);
+
         //static std::shared_ptr<SemiNaiver> fullMaterialization(EDBLayer &layer,
         //        Program *p, bool opt_intersect, bool opt_filtering, bool opt_threaded,
         //        bool restrictedChase, int nthreads, int interRuleThreads, bool shuffleRules);
@@ -15,6 +15,12 @@ struct RuleExecutionDetails {
 
     uint8_t nIDBs = 0;
     std::vector<RuleExecutionPlan> orderExecutions;
+    //Number of times the joins were reordered in the last execution
+    int nReplans = 0;
+
+    //True if the variables of the positive body atoms form a cycle (e.g.,
+    //p(X,Y),p(Y,Z),p(Z,X)). Such bodies are joined with a leapfrog triejoin.
+    bool cyclicBody = false;
 
     std::vector<uint8_t> posEDBVarsInHead;
     std::vector<std::vector<std::pair<uint8_t, uint8_t>>> occEDBVarsInHead;
@@ -47,5 +53,7 @@ struct RuleExecutionDetails {
 
     void extractAllEDBPatterns(std::vector<const Literal*> &output,
             const std::vector<Literal> &input);
+
+    void checkCyclicBody();
 };
 #endif
@@ -4,6 +4,9 @@
 #include <vlog/concepts.h>
 #include <vector>
 #include <map>
+#include <memory>
+
+class TableStatistics;
 
 struct RuleExecutionPlan {
     //The two functions above were written for a full materialization. As TODO
@@ -65,6 +68,22 @@ struct RuleExecutionPlan {
             const std::vector<Literal> &heads,
             bool copyAllVars) const;
 
+    //Returns the order of the literals that minimizes the estimated size of
+    //the intermediate results, given the cardinality of every literal and
+    //the statistics of its facts (NULL if not available). Negated literals
+    //are put at the end. The first nFixed literals keep their position: they
+    //have already been joined, and their join has observedCard rows.
+    std::vector<uint8_t> costBasedOrder(const std::vector<size_t> &cards,
+            const std::vector<std::shared_ptr<const TableStatistics>> &stats,
+            const uint8_t nFixed = 0, const double observedCard = 0) const;
+
+    //Estimated size of the join of the first n literals. If nFixed > 0,
+    //the join of the first nFixed literals has observedCard rows.
+    double estimateCardinality(const std::vector<size_t> &cards,
+            const std::vector<std::shared_ptr<const TableStatistics>> &stats,
+            const uint8_t n, const uint8_t nFixed = 0,
+            const double observedCard = 0) const;
+
 };
 
 #endif
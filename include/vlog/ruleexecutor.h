@@ -82,6 +82,12 @@ private:
 
     void join(TupleTable *r1, TupleTable *r2, std::pair<uint8_t, uint8_t> *joins, uint8_t njoins, BindingsTable *output);
 
+    //Joins the bindings of the IDB atom bodyAtom with its answers. The
+    //answers that match every binding are looked up in an index of the
+    //answer table.
+    void joinWithAnswers(const uint8_t bodyAtom, BindingsTable **supplRelations,
+                         BindingsTable *answer);
+
     void copyLastRelInAnswers(QSQR *qsqr,
                               size_t nTuples,
                               BindingsTable **supplRelations,
@@ -101,8 +107,9 @@ public:
     size_t estimate(const int depth, BindingsTable *input/*, size_t offsetInput*/, QSQR *qsqr,
                       EDBLayer &edbLayer);
 
-    void evaluate(BindingsTable *input, size_t offsetInput, QSQR *qsqr,
-                  EDBLayer &edbLayer
+    //Evaluates the rule on the input tuples in [offsetInput, endInput)
+    void evaluate(BindingsTable *input, size_t offsetInput, size_t endInput,
+                  QSQR *qsqr, EDBLayer &edbLayer
 #ifdef LINEAGE
                   , std::vector<LineageInfo> &lineage
 #endif
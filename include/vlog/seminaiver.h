@@ -7,18 +7,30 @@
 #include <vlog/ruleexecplan.h>
 #include <vlog/ruleexecdetails.h>
 #include <vlog/chasemgmt.h>
+#include <vlog/statistics.h>
+#include <vlog/bufferedwriter.h>
 #include <vlog/consts.h>
 
 #include <trident/model/table.h>
 
 #include <vector>
+#include <map>
+#include <mutex>
 #include <unordered_map>
 
+//Number of rows whose terms are decoded together when the derivations are
+//written to files
+#define STORE_DECODE_ROWS 65536
+
 struct StatIteration {
     size_t iteration;
     const Rule *rule;
     double time;
     bool derived;
+    //Number of times the joins were reordered during the execution
+    int nReplans;
+
+    StatIteration() : nReplans(0) {}
 
     bool operator <(const StatIteration &it) const {
         return time > it.time;
@@ -31,7 +43,10 @@ struct StatsRule {
     int idRule;
     long timems;
     long totaltimems;
-    StatsRule() : idRule(-1) {}
+    //Number of times the order of the joins was changed during the
+    //execution, because the intermediate results were far from the estimates
+    int nReplans;
+    StatsRule() : idRule(-1), nReplans(0) {}
 };
 
 struct StatsSizeIDB {
@@ -40,8 +55,17 @@ struct StatsSizeIDB {
     long derivation;
 };
 
+//Changes to an EDB relation. The rows are stored one after the other, as
+//term IDs.
+struct EDBUpdate {
+    PredId_t predicate;
+    std::vector<uint64_t> inserted;
+    std::vector<uint64_t> deleted;
+};
+
 typedef std::unordered_map<std::string, FCTable*> EDBCache;
 class ResultJoinProcessor;
+class ParallelRange;
 class SemiNaiver {
     private:
         std::vector<RuleExecutionDetails> allEDBRules;
@@ -59,6 +83,8 @@ class SemiNaiver {
         bool running;
 
         std::vector<FCBlock> listDerivations;
+        //Rules referenced by chaseMgmt
+        std::vector<RuleExecutionDetails> chaseRules;
         std::vector<StatsRule> statsRuleExecution;
 
         bool ignoreDuplicatesElimination;
@@ -66,6 +92,19 @@ class SemiNaiver {
         int nStratificationClasses;
         Program *RMFC_program;
 
+        //Memory (in bytes) that the derived tables may use before the older
+        //blocks are moved to disk. 0 means no limit.
+        size_t memoryBudget;
+        //Directory created for this instance, removed by the destructor
+        std::string spillDir;
+
+        //Statistics of the facts in the tables, used to order the joins
+        Statistics statistics;
+        //If the size of an intermediate result differs from the estimate by
+        //more than this factor, the remaining joins are reordered. 0 disables
+        //the re-planning.
+        double replanFactor;
+
 #ifdef WEBINTERFACE
         long statsLastIteration;
         std::string currentRule;
@@ -84,12 +123,13 @@ class SemiNaiver {
 
         size_t countAllIDBs();
 
-        bool bodyChangedSince(Rule &rule, size_t iteration);
-
+        //If stats is not NULL, it receives the statistics of the facts of
+        //every atom
         bool checkIfAtomsAreEmpty(const RuleExecutionDetails &ruleDetails,
                 const RuleExecutionPlan &plan,
                 size_t limitView,
-                std::vector<size_t> &cards);
+                std::vector<size_t> &cards,
+                std::vector<std::shared_ptr<const TableStatistics>> *stats = NULL);
 
         void processRuleFirstAtom(const uint8_t nBodyLiterals,
                 const Literal *bodyLiteral,
@@ -104,20 +144,50 @@ class SemiNaiver {
                 std::vector<std::pair<uint8_t, uint8_t>> *filterValueVars,
                 ResultJoinProcessor *joinOutput);
 
+        //Uses the statistics (if any) to choose a cost-based order, and
+        //otherwise orders the atoms on cardinality
         void reorderPlan(RuleExecutionPlan &plan,
                 const std::vector<size_t> &cards,
                 const std::vector<Literal> &headLiteral,
-                bool copyAllVars);
+                bool copyAllVars,
+                const std::vector<std::shared_ptr<const TableStatistics>> &stats);
 
         void reorderPlanForNegatedLiterals(RuleExecutionPlan &plan,
                 const std::vector<Literal> &heads);
 
+        //Called after the first nJoined atoms of plan have been joined, with
+        //observed rows. If the estimate for this join, given that the first
+        //nPrevious atoms had previousRows rows, is off by more than
+        //replanFactor, the remaining atoms are reordered. cards and stats
+        //follow the order of the atoms. Returns true if plan was changed.
+        bool replan(RuleExecutionPlan &plan, const uint8_t nJoined,
+                const size_t observed, const uint8_t nPrevious,
+                const size_t previousRows, std::vector<size_t> &cards,
+                std::vector<std::shared_ptr<const TableStatistics>> &stats,
+                const std::vector<Literal> &heads);
+
         bool executeRules(std::vector<RuleExecutionDetails> &allEDBRules,
                 std::vector<std::vector<RuleExecutionDetails>> &allIDBRules,    // one entry for each stratification class
                 std::vector<StatIteration> &costRules,
                 const size_t limitView,
                 bool fixpoint, unsigned long *timeout = NULL);
 
+        void executeProgram(std::vector<RuleExecutionDetails> &edbRules,
+                std::vector<std::vector<RuleExecutionDetails>> &idbRules,
+                std::vector<StatIteration> &costRules,
+                unsigned long *timeout);
+
+        //Creates the processor that stores the results of the last join in
+        //the tables of the heads
+        ResultJoinProcessor *createFinalProcessor(
+                RuleExecutionDetails &ruleDetails,
+                std::vector<Literal> &heads,
+                std::vector<std::pair<uint8_t, uint8_t>> &posFromFirst,
+                std::vector<std::pair<uint8_t, uint8_t>> &posFromSecond,
+                const uint8_t orderExecution,
+                const size_t iteration,
+                const bool addToEndTable);
+
         bool executeRule(RuleExecutionDetails &ruleDetails,
                 std::vector<Literal> &heads,
                 const size_t iteration,
@@ -128,6 +198,59 @@ class SemiNaiver {
                 const size_t minIteration,
                 const size_t maxIteration);
 
+        //Methods used by updateEDB
+        PredId_t getAuxiliaryPredicate(const std::string &prefix,
+                const PredId_t pred, const uint8_t card);
+
+        void setAuxiliaryTable(const PredId_t pred, const uint8_t arity,
+                std::vector<Term_t> &rows);
+
+        bool executeAuxiliaryRule(const Rule &rule,
+                const RuleExecutionDetails &original,
+                std::map<PredId_t, const RuleExecutionDetails*> &producers);
+
+        void endAuxiliaryIteration(const size_t nderivations,
+                const std::map<PredId_t, const RuleExecutionDetails*> &producers);
+
+        bool executeDeltaRules(const std::map<PredId_t, PredId_t> &deltas,
+                std::map<PredId_t, PredId_t> *heads);
+
+        void replaceDerivations(const std::vector<std::pair<
+                std::shared_ptr<const FCInternalTable>,
+                std::shared_ptr<const FCInternalTable>>> &replaced);
+
+        void applyEDBUpdates(std::vector<EDBUpdate> &updates);
+
+        //Removes the predicates with ID >= firstAuxiliary from the EDB layer
+        //and shrinks predicatesTables back to nTables
+        void removeAuxiliaryPredicates(const PredId_t firstAuxiliary,
+                const size_t nTables);
+
+        //Writes the files of some predicates (see storeOnFiles)
+        struct StorePredicates {
+            SemiNaiver *sn;
+            const std::vector<PredId_t> &preds;
+            const std::string &path;
+            const bool decompress;
+            const int minLevel;
+            const bool csv;
+            const ExportCompression compression;
+            //First error, if any
+            std::string *error;
+            std::mutex *errorMutex;
+
+            StorePredicates(SemiNaiver *sn, const std::vector<PredId_t> &preds,
+                    const std::string &path, const bool decompress,
+                    const int minLevel, const bool csv,
+                    const ExportCompression compression, std::string *error,
+                    std::mutex *errorMutex) : sn(sn), preds(preds), path(path),
+            decompress(decompress), minLevel(minLevel), csv(csv),
+            compression(compression), error(error), errorMutex(errorMutex) {
+            }
+
+            void operator()(const ParallelRange& r) const;
+        };
+
     protected:
         std::vector<FCTable *>predicatesTables;
         EDBLayer &layer;
@@ -141,6 +264,10 @@ class SemiNaiver {
                 const size_t limitView,
                 std::vector<ResultJoinProcessor*> *finalResultContainer);
 
+        bool bodyChangedSince(const Rule &rule, size_t iteration);
+
+        void checkMemoryBudget();
+
         virtual FCIterator getTableFromEDBLayer(const Literal & literal);
 
         virtual long getNLastDerivationsFromList();
@@ -184,6 +311,33 @@ class SemiNaiver {
             run(0, 1, timeout, checkCyclicTerms, -1, -1);
         }
 
+        //Sets the memory budget for the derived tables. When the budget is
+        //exceeded, the oldest completed blocks are moved to files in a new
+        //directory inside spillDir, and read back (through mmap) when they
+        //are used.
+        VLIBEXP void setMemoryBudget(const size_t bytes,
+                const std::string &spillDir);
+
+        VLIBEXP void setReplanFactor(const double factor) {
+            replanFactor = factor;
+        }
+
+        //Updates the materialization after rows are inserted in and deleted
+        //from EDB relations (only in-memory relations can be updated). The
+        //insertions are propagated semi-naively. The deletions are handled
+        //with delete and rederive (DRed): all facts with a derivation that
+        //uses a deleted fact are removed, then the ones that can still be
+        //derived are added again. Deletions are not supported with
+        //existential rules, and no update is supported with negation.
+        VLIBEXP void updateEDB(std::vector<EDBUpdate> &updates);
+
+        //Adds a block of facts to an IDB relation after the materialization
+        //and derives semi-naively only the facts that follow from them. The
+        //iteration of the block is replaced with the current one. Not
+        //supported with negation.
+        VLIBEXP void addDataAndResume(const Predicate pred, FCBlock block,
+                unsigned long *timeout = NULL);
+
         Program *get_RMFC_program() {
             return RMFC_program;
         }
@@ -209,11 +363,17 @@ class SemiNaiver {
                 int singleRule = -1,
                 PredId_t predIgnoreBlock = -1);
 
+        //Writes the facts of a predicate in path (plus the extension of the
+        //compression, if any)
         VLIBEXP void storeOnFile(std::string path, const PredId_t pred, const bool decompress,
-                const int minLevel, const bool csv);
+                const int minLevel, const bool csv,
+                const ExportCompression compression = COMPR_NONE);
 
+        //Writes every derived predicate in a file in path. The predicates
+        //are written in parallel, largest first.
         VLIBEXP void storeOnFiles(std::string path, const bool decompress,
-                const int minLevel, const bool csv);
+                const int minLevel, const bool csv,
+                const ExportCompression compression = COMPR_NONE);
 
         FCIterator getTable(const Literal &literal, const size_t minIteration,
                 const size_t maxIteration) {
@@ -6,69 +6,50 @@
 #include <mutex>
 #include <thread>
 
-struct SemiNaiver_Threadlocal {
-    std::vector<FCBlock> listDerivations;
-    std::vector<StatsRule> statsRuleExecution;
-    size_t iteration;
-};
-
-class StatusRuleExecution_ThreadSafe {
-    private:
-        //Internal data structures
-
-        //Hold all rules to execution
-        std::mutex mutexRules;
-        int rulecount;
-        const int nrules;
-
-        std::vector<ResultJoinProcessor*> tmpderivations;
-
-    public:
-
-        StatusRuleExecution_ThreadSafe(const int nrules);
-
-        int getRuleIDToExecute();
-
-        void registerDerivations(ResultJoinProcessor *res);
-
-        std::vector<ResultJoinProcessor*> &getTmpDerivations() {
-            return  tmpderivations;
-        }
-};
-
+class SingleHeadFinalRuleProcessor;
+
+//Executes the rules of a stratum in parallel, in waves. All rules of a wave
+//read the tables as they were at the start of the wave (the version of the
+//wave), so that they can be executed without locks: their derivations are
+//kept aside and only added to the tables, as new blocks, when all rules of the
+//wave are finished. The rules of the next wave are the ones that depend (in
+//the graph of SemiNaiver::createGraphRuleDependency) on a predicate that
+//received new facts. Existential rules are executed one at a time between the
+//waves.
 class SemiNaiverThreaded: public SemiNaiver {
 
     private:
-        //const int nthreads;
-        //TODO This variable is only visible to the thread
-        std::shared_ptr<SemiNaiver_Threadlocal> thread_data;
-
-        std::vector<bool> marked;
-        std::vector<bool> newMarked;
-
-        /*** VARIOUS MUTEXES */
-        std::mutex mutexInsert;
-        std::mutex mutexIteration;
         std::mutex mutexGetTable;
+        std::mutex mutexEDBTables;
         std::mutex mutexStatistics;
         std::mutex mutexListDer;
+        //Only used to mark the tables as shared between threads, so that
+        //their caches are locked
+        std::mutex mutexTables;
         const int interRuleThreads;
 
-        //Create one mutex per table
-        std::mutex *mutexes;
+        //For every rule, the rules that use its head predicates in the body
+        std::vector<std::vector<int>> consumers;
 
-        size_t getAtomicIteration() {
-            std::lock_guard<std::mutex> lock(mutexIteration);
-            return iteration++;
-        }
+        void computeConsumers();
 
-        bool doGlobalConsolidation(StatusRuleExecution_ThreadSafe &data);
+        //Creates the tables of all the predicates of the rules, so that they
+        //are not created while the rules are executed
+        void createTables(std::vector<RuleExecutionDetails> &ruleset);
 
-        bool tryLock(std::vector<PredId_t> &predicates, PredId_t idHeadPredicate);
+        //Executes the rules in wave (positions in ruleset) on
+        //interRuleThreads threads. The rule at position i in wave is
+        //executed in iteration version + i.
+        void executeWave(std::vector<RuleExecutionDetails> &ruleset,
+                const std::vector<size_t> &wave, const size_t version,
+                std::vector<ResultJoinProcessor*> *outputs,
+                std::vector<StatIteration> &costRules);
 
-        void lock(std::vector<PredId_t> &predicates, PredId_t idHeadPredicate);
-
-        void unlock(std::vector<PredId_t> &predicates, PredId_t idHeadPredicate);
+        //Adds the derivations of a wave to the tables. Returns the
+        //predicates that received new facts.
+        std::vector<PredId_t> publish(
+                std::vector<ResultJoinProcessor*> *outputs,
+                const size_t nOutputs, const size_t version);
 
     public:
         SemiNaiverThreaded(EDBLayer &layer,
@@ -80,19 +61,9 @@ class SemiNaiverThreaded: public SemiNaiver {
                 const int interRuleThreads) : SemiNaiver(layer,
                     program, opt_intersect, opt_filtering, true,
                     nthreads, shuffleRules, false),
-                interRuleThreads(interRuleThreads) {
-                    // Marks for parallel version
-                    for (int i = 0; i < program->getNPredicates(); i++) {
-                        marked.push_back(true);
-                        newMarked.push_back(false);
-                    }
-                    mutexes = new std::mutex[program->getNPredicates()];
+                interRuleThreads(std::max(1, interRuleThreads)) {
                 }
 
-        ~SemiNaiverThreaded() {
-            delete[] mutexes;
-        }
-
     protected:
         long getNLastDerivationsFromList();
 
@@ -104,17 +75,11 @@ class SemiNaiverThreaded: public SemiNaiver {
 
         FCIterator getTableFromEDBLayer(const Literal & literal);
 
-        void runThread(
-                std::vector<RuleExecutionDetails> &ruleset,
-                StatusRuleExecution_ThreadSafe *status,
-                std::vector<StatIteration> *costRules,
-                size_t lastExec);
-
         bool executeUntilSaturation(
                 std::vector<RuleExecutionDetails> &ruleset,
                 std::vector<StatIteration> &costRules,
-                uint32_t limitView,
-                bool fixpoint);
+                size_t limitView,
+                bool fixpoint, unsigned long *timeout = NULL);
 };
 
 #endif
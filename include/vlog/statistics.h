@@ -0,0 +1,147 @@
+#ifndef _STATISTICS_H
+#define _STATISTICS_H
+
+#include <vlog/concepts.h>
+#include <vlog/fctable.h>
+#include <vlog/edb.h>
+
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+//Number of bits of the hash used to select a register of the HyperLogLog
+//sketches (2^8 registers, ~6.5% standard error)
+#define HLL_BITS 8
+#define HISTOGRAM_BUCKETS 16
+
+//Sketch of the number of distinct values of a column
+class HyperLogLog {
+    private:
+        uint8_t registers[1 << HLL_BITS];
+
+    public:
+        HyperLogLog();
+
+        void add(const Term_t value);
+
+        void merge(const HyperLogLog &other);
+
+        uint64_t estimate() const;
+};
+
+//Equi-width histogram of the values of a column
+class Histogram {
+    private:
+        Term_t min, max;
+        uint64_t counts[HISTOGRAM_BUCKETS];
+        uint64_t total;
+
+        uint64_t getWidth() const {
+            return (max - min) / HISTOGRAM_BUCKETS + 1;
+        }
+
+        size_t getBucket(const Term_t value) const;
+
+    public:
+        Histogram();
+
+        void build(std::vector<Term_t> &values);
+
+        void merge(const Histogram &other);
+
+        bool isEmpty() const {
+            return total == 0;
+        }
+
+        Term_t getMin() const {
+            return min;
+        }
+
+        Term_t getMax() const {
+            return max;
+        }
+
+        //Fraction of the values that are in [lo, hi]. The values are assumed
+        //to be uniformly distributed within a bucket.
+        double fractionIn(const Term_t lo, const Term_t hi) const;
+};
+
+class ColumnStatistics {
+    private:
+        HyperLogLog sketch;
+        Histogram histogram;
+        //If not zero, the number of distinct values is known and the sketch
+        //is not used (this is the case of the EDB tables)
+        uint64_t knownNDV;
+
+    public:
+        ColumnStatistics() : knownNDV(0) {}
+
+        void build(std::vector<Term_t> &values);
+
+        void setNDV(const uint64_t ndv) {
+            knownNDV = ndv;
+        }
+
+        void merge(const ColumnStatistics &other);
+
+        uint64_t getNDV() const;
+
+        const Histogram &getHistogram() const {
+            return histogram;
+        }
+};
+
+class TableStatistics {
+    private:
+        uint64_t nrows;
+        std::vector<ColumnStatistics> columns;
+
+    public:
+        TableStatistics(const uint8_t ncolumns) : nrows(0), columns(ncolumns) {
+        }
+
+        //Computes the statistics of the facts of a block. The columns of
+        //EDB tables are not read: their number of distinct values is asked
+        //to the EDB layer
+        static std::shared_ptr<const TableStatistics> compute(
+                const FCBlock &block, EDBLayer &layer);
+
+        void merge(const TableStatistics &other);
+
+        uint64_t getNRows() const {
+            return nrows;
+        }
+
+        uint8_t getNColumns() const {
+            return columns.size();
+        }
+
+        const ColumnStatistics &getColumn(const uint8_t pos) const {
+            return columns[pos];
+        }
+};
+
+//Keeps the statistics of the blocks of the tables. Blocks do not change once
+//they are added, so their statistics are computed only once.
+class Statistics {
+    private:
+        std::mutex mutex;
+        std::unordered_map<const FCInternalTable *,
+            std::pair<std::weak_ptr<const FCInternalTable>,
+            std::shared_ptr<const TableStatistics>>> blocks;
+        size_t pruneAt;
+
+        std::shared_ptr<const TableStatistics> getBlock(const FCBlock &block,
+                EDBLayer &layer);
+
+    public:
+        Statistics() : pruneAt(1024) {}
+
+        //Statistics of the facts of table in the iterations [min, max]
+        std::shared_ptr<const TableStatistics> get(FCTable *table,
+                const size_t min, const size_t max, EDBLayer &layer);
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _TABLE_SPILLER_H
+#define _TABLE_SPILLER_H
+
+#include <vlog/fcinttable.h>
+
+#include <string>
+
+//Moves the columns of an in-memory table to a file, which is then mapped
+//in memory. The operating system pages the columns in when they are read,
+//and can drop them again under memory pressure. Columns that can be
+//bit-packed (see PackedColumn) are stored packed, all others as plain 64-bit
+//values. Constant, run-length compressed and EDB columns are small, and stay
+//in memory.
+//The file is removed as soon as it is mapped, so the space on disk is
+//released when the table is no longer used.
+class TableSpiller {
+    private:
+        static bool shouldSpill(std::shared_ptr<Column> column);
+
+    public:
+        //Returns a copy of table whose columns are read from path, or NULL
+        //if none of the columns is worth moving. freed contains the number
+        //of bytes written to the file.
+        static std::shared_ptr<const FCInternalTable> spill(
+                std::shared_ptr<const FCInternalTable> table,
+                const size_t iteration, const std::string &path,
+                size_t &freed);
+};
+
+#endif
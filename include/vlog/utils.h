@@ -18,6 +18,7 @@ class VLogUtils {
                 DBLayer &db);
     public:
         VLIBEXP static std::string csvString(std::string);
+        VLIBEXP static std::string fileName(std::string name);
         VLIBEXP static void execSPARQLQuery(std::string sparqlquery,
                 bool explain,
                 long nterms,
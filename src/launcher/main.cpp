@@ -6,6 +6,7 @@
 #include <vlog/edb.h>
 #include <vlog/webinterface.h>
 #include <vlog/fcinttable.h>
+#include <vlog/projectioncache.h>
 #include <vlog/exporter.h>
 #include <vlog/utils.h>
 #include <vlog/ml/ml.h>
@@ -13,6 +14,11 @@
 
 #include <vlog/cycles/checker.h>
 
+#include <vlog/inmemory/inmemorytable.h>
+#include <vlog/inmemory/snapshot.h>
+#include <vlog/inmemory/csvloader.h>
+#include <vlog/radixsort.h>
+
 //Used to load a Trident KB
 #include <vlog/trident/tridenttable.h>
 #include <launcher/vloglayer.h>
@@ -37,11 +43,15 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <mutex>
 #include <sstream>
 #include <fstream>
 #include <chrono>
 #include <thread>
 #include <cmath>
+#include <random>
+#include <set>
+#include <map>
 
 void printHelp(const char *programName, ProgramArgs &desc) {
     cout << "Usage: " << programName << " <command> [options]" << endl << endl;
@@ -57,6 +67,12 @@ void printHelp(const char *programName, ProgramArgs &desc) {
     cout << "lookup\t\t lookup for values in the dictionary." << endl << endl;
     cout << "cycles\t\t try and detect cycles in the rules." << endl << endl;
     cout << "deps\t\t detect dependencies in the database." << endl << endl;
+    cout << "convert\t\t store the INMEMORY tables of the EDB as binary snapshots." << endl << endl;
+    cout << "benchdict\t compare the performance of the term dictionaries." << endl << endl;
+    cout << "benchsort\t compare the radix sort of segments with the comparator sort." << endl << endl;
+    cout << "benchcolumns\t compare the scans of bit-packed columns with those of plain vectors." << endl << endl;
+    cout << "checkupdate\t check the incremental updates of the EDB against a full rematerialization." << endl << endl;
+    cout << "checkqsqr\t check the multi-threaded top-down evaluation against the single-threaded one." << endl << endl;
 
     cout << desc.tostring() << endl;
 }
@@ -79,7 +95,9 @@ bool checkParams(ProgramArgs &vm, int argc, const char** argv) {
 
     if (cmd != "help" && cmd != "query" && cmd != "lookup" && cmd != "load" && cmd != "queryLiteral"
             && cmd != "mat" && cmd != "mat_tg" && cmd != "rulesgraph" && cmd != "server" && cmd != "gentq" &&
-            cmd != "cycles" && cmd !="deps") {
+            cmd != "cycles" && cmd !="deps" && cmd != "convert" && cmd != "benchdict" &&
+            cmd != "benchsort" && cmd != "benchcolumns" && cmd != "checkupdate" &&
+            cmd != "checkqsqr") {
         printErrorMsg("The command \"" + cmd + "\" is unknown.");
         return false;
     }
@@ -201,6 +219,16 @@ bool checkParams(ProgramArgs &vm, int argc, const char** argv) {
                 printErrorMsg("The rule file \"" + path + "\" does not exists");
                 return false;
             }
+        } else if (cmd == "benchdict") {
+            if (vm["nterms"].as<int64_t>() < 1) {
+                printErrorMsg("The number of terms must be at least 1");
+                return false;
+            }
+        } else if (cmd == "benchsort" || cmd == "benchcolumns") {
+            if (vm["nrows"].as<int64_t>() < 1) {
+                printErrorMsg("The number of rows must be at least 1");
+                return false;
+            }
         }
     }
 
@@ -238,13 +266,13 @@ bool initParams(int argc, const char** argv, ProgramArgs &vm) {
     query_options.add<string>("", "premat", "",
             "Pre-materialize the atoms in the file passed as argument. Default is '' (disabled).", false);
     query_options.add<bool>("","multithreaded", false,
-            "Run multithreaded (currently only supported for <mat>).", false);
+            "Run multithreaded (currently only supported for <mat> and for the topdown evaluation of <queryLiteral>).", false);
     query_options.add<bool>("","restrictedChase", true,
             "Use the restricted chase if there are existential rules.", false);
     query_options.add<int>("", "nthreads", std::max((unsigned int)1, std::thread::hardware_concurrency() / 2),
             "Set maximum number of threads to use when run in multithreaded mode. Default is " + to_string(std::max((unsigned int)1, std::thread::hardware_concurrency() / 2)), false);
-    query_options.add<int>("", "interRuleThreads", 0,
-            "Set maximum number of threads to use for inter-rule parallelism. Default is 0", false);
+    query_options.add<int>("", "interRuleThreads", std::max((unsigned int)1, std::thread::hardware_concurrency() / 2),
+            "Set maximum number of threads to use for inter-rule parallelism when run in multithreaded mode (0 disables it). Default is " + to_string(std::max((unsigned int)1, std::thread::hardware_concurrency() / 2)), false);
 
     query_options.add<bool>("", "shufflerules", false,
             "shuffle rules randomly instead of using heuristics (only for <mat>, and only when running multithreaded).", false);
@@ -253,7 +281,21 @@ bool initParams(int argc, const char** argv, ProgramArgs &vm) {
     query_options.add<string>("","storemat_path", "",
             "Directory where to store all results of the materialization. Default is '' (disable).",false);
     query_options.add<string>("","storemat_format", "files",
-            "Format in which to dump the materialization. 'files' simply dumps the IDBs in files. 'csv' creates comma-separated files. 'db' creates a new RDF database. Default is 'files'.",false);
+            "Format in which to dump the materialization. 'files' simply dumps the IDBs in files. 'csv' creates comma-separated files. 'db' creates a new RDF database. 'nt' writes N-Triples. 'columnar' writes binary, compressed columns with a shared dictionary. Default is 'files'.",false);
+    query_options.add<string>("","storemat_compression", "",
+            "Compression of the files of the materialization: 'none', 'gzip' or 'zstd' (if compiled with ZSTD). Default is 'none' for 'files' and 'csv', 'gzip' for 'nt'.",false);
+    query_options.add<int64_t>("", "memlimit", 0,
+            "Memory (in MB) that the derived tables may use during <mat>. Above it, the oldest tables are moved to disk. Default is 0 (no limit).", false);
+    query_options.add<string>("", "spill_path", "/tmp",
+            "Directory where the tables are moved when the memory limit is reached. Default is /tmp.", false);
+    query_options.add<int>("", "replanfactor", 10,
+            "During <mat>, reorder the remaining joins of a rule when an intermediate result is this many times larger or smaller than estimated. 0 disables it. Default is 10.", false);
+    query_options.add<int64_t>("", "cachebudget", 1024,
+            "Memory (in MB) used during <mat> to keep the sorted and filtered versions of the derived tables across the iterations. 0 disables the cache. Default is 1024.", false);
+    query_options.add<string>("", "edbadd", "",
+            "Directory with <predicate>.csv files of facts that are added to the EDB after <mat>. The materialization is then updated incrementally. Default is '' (disable).", false);
+    query_options.add<string>("", "edbremove", "",
+            "Directory with <predicate>.csv files of facts that are removed from the EDB after <mat>. The materialization is then updated incrementally. Default is '' (disable).", false);
     query_options.add<bool>("","explain", false,
             "Explain the query instead of executing it. Default is false.",false);
     query_options.add<bool>("","decompressmat", false,
@@ -304,6 +346,12 @@ bool initParams(int argc, const char** argv, ProgramArgs &vm) {
     ProgramArgs::GroupArgs& detectCycles_options = *vm.newGroup("Options for command <detectCycles>");
     detectCycles_options.add<string>("", "alg", "MFA", "Algorithm to use for cycle detection", false);
 
+    ProgramArgs::GroupArgs& benchdict_options = *vm.newGroup("Options for command <benchdict>");
+    benchdict_options.add<int64_t>("", "nterms", 1000000, "Number of distinct terms to add to the dictionaries. Every term is added twice. Default is 1000000", false);
+
+    ProgramArgs::GroupArgs& benchsort_options = *vm.newGroup("Options for command <benchsort>");
+    benchsort_options.add<int64_t>("", "nrows", 10000000, "Number of rows of the segments to sort (or of the column, for <benchcolumns>). Default is 10000000", false);
+
     ProgramArgs::GroupArgs& cmdline_options = *vm.newGroup("Parameters");
     cmdline_options.add<string>("l","logLevel", "info",
             "Set the log level (accepted values: trace, debug, info, warning, error, fatal). Default is info.", false);
@@ -336,6 +384,517 @@ void lookup(EDBLayer &layer, ProgramArgs &vm) {
     }
 }
 
+//Stores every INMEMORY table of the EDB as a snapshot next to the original
+//file. The tables use the snapshots if their third parameter is "snapshot".
+void convertInmemoryTables(EDBConf &conf, EDBLayer &layer) {
+    for (const auto &table : conf.getTables()) {
+        if (table.type != "INMEMORY") {
+            continue;
+        }
+        for (auto id : layer.getAllPredicateIDs()) {
+            if (layer.getPredName(id) != table.predname) {
+                continue;
+            }
+            InmemoryTable *t = dynamic_cast<InmemoryTable*>(
+                    layer.getEDBTable(id).get());
+            if (t != NULL) {
+                std::string repository = table.params[0];
+                if (repository == "") {
+                    repository = ".";
+                }
+                std::string path = repository + "/" + table.params[1] +
+                    TableSnapshot::EXTENSION;
+                LOG(INFOL) << "Storing " << table.predname << " in " << path;
+                t->storeSnapshot(path);
+            }
+        }
+    }
+}
+
+//Reads the updates of the EDB relations from the files <predicate>.csv in dir
+static void readEDBUpdates(const std::string &dir, const bool insert,
+        Program &p, EDBLayer &layer, std::vector<EDBUpdate> &updates) {
+    if (!Utils::isDirectory(dir)) {
+        LOG(ERRORL) << "The directory " << dir << " does not exist";
+        throw 10;
+    }
+    for (auto &file : Utils::getFiles(dir)) {
+        if (!Utils::ends_with(file, ".csv")) {
+            continue;
+        }
+        std::string predname = Utils::removeExtension(Utils::filename(file));
+        Predicate pred = p.getPredicate(predname);
+        if (pred.getType() != EDB) {
+            LOG(ERRORL) << "Predicate " << predname << " is not an EDB predicate";
+            throw 10;
+        }
+        uint8_t arity;
+        SegmentInserter *inserter = CSVLoader::load(file, &layer, arity);
+        if (inserter == NULL) {
+            continue;
+        }
+        if (arity != pred.getCardinality()) {
+            delete inserter;
+            LOG(ERRORL) << "The rows in " << file << " do not have arity " <<
+                (int) pred.getCardinality();
+            throw 10;
+        }
+        std::shared_ptr<const Segment> seg = inserter->getSegment();
+        delete inserter;
+        std::vector<std::vector<Term_t>> columns;
+        for (uint8_t i = 0; i < arity; ++i) {
+            columns.push_back(seg->getColumn(i)->getReader()->asVector());
+        }
+        EDBUpdate update;
+        update.predicate = pred.getId();
+        std::vector<uint64_t> &rows = insert ? update.inserted : update.deleted;
+        for (size_t r = 0; r < seg->getNRows(); ++r) {
+            for (uint8_t i = 0; i < arity; ++i) {
+                rows.push_back(columns[i][r]);
+            }
+        }
+        LOG(INFOL) << "Read " << seg->getNRows() << " rows to " <<
+            (insert ? "add to " : "remove from ") << predname;
+        updates.push_back(update);
+    }
+}
+
+//Adds 2 * nterms terms (every term twice) to dict, using nthreads threads,
+//and then reads back their text. Dictionary is not thread-safe, so it is
+//used under a lock.
+template<typename D>
+static void benchDictionary(D &dict, std::mutex *lock, const int64_t nterms,
+        const int nthreads, const std::string name) {
+    std::vector<std::thread> threads;
+    std::vector<std::vector<uint64_t>> ids(nthreads);
+    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    for (int t = 0; t < nthreads; ++t) {
+        threads.push_back(std::thread([&, t]() {
+                    for (int64_t i = t; i < 2 * nterms; i += nthreads) {
+                        std::string term = "<http://example.org/resource/"
+                            + std::to_string((i * 7919) % nterms) + ">";
+                        if (lock) {
+                            std::lock_guard<std::mutex> guard(*lock);
+                            ids[t].push_back(dict.getOrAdd(term));
+                        } else {
+                            ids[t].push_back(dict.getOrAdd(term));
+                        }
+                    }
+                }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    std::chrono::duration<double> secAdd = std::chrono::system_clock::now() - start;
+    threads.clear();
+
+    std::vector<size_t> totalLength(nthreads);
+    start = std::chrono::system_clock::now();
+    for (int t = 0; t < nthreads; ++t) {
+        threads.push_back(std::thread([&, t]() {
+                    for (auto id : ids[t]) {
+                        if (lock) {
+                            std::lock_guard<std::mutex> guard(*lock);
+                            totalLength[t] += dict.getRawValue(id).size();
+                        } else {
+                            totalLength[t] += dict.getRawValue(id).size();
+                        }
+                    }
+                }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    std::chrono::duration<double> secText = std::chrono::system_clock::now() - start;
+    size_t length = 0;
+    for (auto l : totalLength) {
+        length += l;
+    }
+    LOG(INFOL) << name << " (" << nthreads << " threads): getOrAdd "
+        << secAdd.count() * 1000 << "ms, getRawValue " << secText.count() * 1000
+        << "ms (" << length << " bytes)";
+}
+
+void benchDictionaries(ProgramArgs &vm) {
+    const int64_t nterms = vm["nterms"].as<int64_t>();
+    const int maxThreads = std::max(1, vm["nthreads"].as<int>());
+    std::vector<int> nthreads;
+    for (int n = 1; n < maxThreads; n *= 2) {
+        nthreads.push_back(n);
+    }
+    nthreads.push_back(maxThreads);
+    for (auto n : nthreads) {
+        std::mutex lock;
+        Dictionary dict(0);
+        benchDictionary(dict, &lock, nterms, n, "Dictionary");
+    }
+    for (auto n : nthreads) {
+        ConcurrentDictionary dict(0);
+        benchDictionary(dict, (std::mutex*)NULL, nterms, n, "ConcurrentDictionary");
+    }
+}
+
+//Sorts segments with 2, 3 and 4 columns of random values, once with the
+//comparator sort used by Segment::intsort and once with RadixSort
+void benchSort(ProgramArgs &vm) {
+    const size_t nrows = vm["nrows"].as<int64_t>();
+    const int nthreads = std::max(1, vm["nthreads"].as<int>());
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<Term_t> dist(0, nrows);
+    for (int ncolumns = 2; ncolumns <= 4; ++ncolumns) {
+        std::vector<std::vector<Term_t>> columns(ncolumns);
+        std::vector<const std::vector<Term_t> *> vectors;
+        for (auto &c : columns) {
+            c.resize(nrows);
+            for (size_t i = 0; i < nrows; ++i) {
+                c[i] = dist(gen);
+            }
+            vectors.push_back(&c);
+        }
+
+        std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+        std::vector<size_t> idxs(nrows);
+        for (size_t i = 0; i < nrows; ++i) {
+            idxs[i] = i;
+        }
+        SegmentSorter sorter(vectors);
+        if (nthreads > 1) {
+            ParallelTasks::sort_int(idxs.begin(), idxs.end(), std::ref(sorter), nthreads);
+        } else {
+            std::sort(idxs.begin(), idxs.end(), std::ref(sorter));
+        }
+        std::vector<std::vector<Term_t>> out1(ncolumns);
+        for (int j = 0; j < ncolumns; ++j) {
+            out1[j].resize(nrows);
+            for (size_t i = 0; i < nrows; ++i) {
+                out1[j][i] = columns[j][idxs[i]];
+            }
+        }
+        std::chrono::duration<double> secCmp = std::chrono::system_clock::now() - start;
+
+        start = std::chrono::system_clock::now();
+        std::vector<std::vector<Term_t>> out2;
+        RadixSort::sort(vectors, false, nthreads, out2);
+        std::chrono::duration<double> secRadix = std::chrono::system_clock::now() - start;
+        if (out1 != out2) {
+            LOG(ERRORL) << "The two sorts returned different results";
+            throw 10;
+        }
+        LOG(INFOL) << ncolumns << " columns, " << nrows << " rows ("
+            << nthreads << " threads): comparator sort "
+            << secCmp.count() * 1000 << "ms, radix sort "
+            << secRadix.count() * 1000 << "ms";
+    }
+}
+
+//Compares a plain column with a bit-packed one: reading the whole column
+//as a vector (as done by the operators that use getVectorRef), scanning it
+//with a reader, and accessing random positions
+void benchColumns(ProgramArgs &vm) {
+    const size_t nrows = vm["nrows"].as<int64_t>();
+    std::mt19937_64 gen(42);
+    //Sorted values with small gaps, as in the first column of a table
+    std::vector<Term_t> values(nrows);
+    Term_t v = 1000000;
+    for (size_t i = 0; i < nrows; ++i) {
+        v += gen() % 64;
+        values[i] = v;
+    }
+    std::vector<Term_t> copy(values);
+    std::shared_ptr<Column> plain(new InmemoryColumn(copy, true));
+    std::shared_ptr<Column> packed = PackedColumn::pack(values);
+    if (packed == NULL) {
+        LOG(ERRORL) << "The column could not be packed";
+        throw 10;
+    }
+    LOG(INFOL) << nrows << " rows: the packed column uses "
+        << packed->getRepresentationSize() << " words";
+
+    Term_t sum1 = 0, sum2 = 0;
+    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    const std::vector<Term_t> &ref = plain->getVectorRef();
+    for (size_t i = 0; i < nrows; ++i) {
+        sum1 += ref[i];
+    }
+    std::chrono::duration<double> secPlain = std::chrono::system_clock::now() - start;
+    start = std::chrono::system_clock::now();
+    std::vector<Term_t> decoded = packed->getReader()->asVector();
+    for (size_t i = 0; i < nrows; ++i) {
+        sum2 += decoded[i];
+    }
+    std::chrono::duration<double> secPacked = std::chrono::system_clock::now() - start;
+    LOG(INFOL) << "Whole column: vector " << secPlain.count() * 1000
+        << "ms, packed " << secPacked.count() * 1000 << "ms";
+
+    start = std::chrono::system_clock::now();
+    auto reader = plain->getReader();
+    while (reader->hasNext()) {
+        sum1 += reader->next();
+    }
+    secPlain = std::chrono::system_clock::now() - start;
+    start = std::chrono::system_clock::now();
+    reader = packed->getReader();
+    while (reader->hasNext()) {
+        sum2 += reader->next();
+    }
+    secPacked = std::chrono::system_clock::now() - start;
+    LOG(INFOL) << "Reader: vector " << secPlain.count() * 1000
+        << "ms, packed " << secPacked.count() * 1000 << "ms";
+
+    start = std::chrono::system_clock::now();
+    for (size_t i = 0; i < nrows; ++i) {
+        sum1 += plain->getValue((i * 7919) % nrows);
+    }
+    secPlain = std::chrono::system_clock::now() - start;
+    start = std::chrono::system_clock::now();
+    for (size_t i = 0; i < nrows; ++i) {
+        sum2 += packed->getValue((i * 7919) % nrows);
+    }
+    secPacked = std::chrono::system_clock::now() - start;
+    LOG(INFOL) << "Random getValue: vector " << secPlain.count() * 1000
+        << "ms, packed " << secPacked.count() * 1000 << "ms";
+    if (sum1 != sum2) {
+        LOG(ERRORL) << "The two columns returned different values";
+        throw 10;
+    }
+}
+
+//Program used by checkUpdate: a recursive relation plus two relations that
+//depend on it or directly on the EDB
+static const std::string CHECKUPDATE_RULES =
+    "path(X,Y) :- edge(X,Y)\n"
+    "path(X,Z) :- path(X,Y),edge(Y,Z)\n"
+    "cycle(X) :- path(X,X)\n"
+    "mutual(X,Y) :- edge(X,Y),edge(Y,X)\n";
+
+typedef std::set<std::pair<Term_t, Term_t>> EdgeSet;
+
+static void addEdgeTable(EDBLayer &layer, const EdgeSet &edges) {
+    std::vector<std::vector<Term_t>> columns(2);
+    for (const auto &e : edges) {
+        columns[0].push_back(e.first);
+        columns[1].push_back(e.second);
+    }
+    layer.addInmemoryTable("edge", columns);
+}
+
+//Sorted rows of every IDB predicate of the materialization, by name
+static std::map<std::string, std::vector<std::vector<Term_t>>> getIDBContent(
+        SemiNaiver &sn, Program &p) {
+    std::map<std::string, std::vector<std::vector<Term_t>>> out;
+    for (auto id : p.getAllPredicateIDs()) {
+        if (!p.isPredicateIDB(id)) {
+            continue;
+        }
+        std::vector<std::vector<Term_t>> &rows = out[p.getPredicateName(id)];
+        FCIterator itr = sn.getTable(id);
+        while (!itr.isEmpty()) {
+            std::shared_ptr<const FCInternalTable> t = itr.getCurrentTable();
+            FCInternalTableItr *titr = t->getIterator();
+            while (titr->hasNext()) {
+                titr->next();
+                std::vector<Term_t> row;
+                for (uint8_t i = 0; i < t->getRowSize(); ++i) {
+                    row.push_back(titr->getCurrentValue(i));
+                }
+                rows.push_back(row);
+            }
+            t->releaseIterator(titr);
+            itr.moveNextCount();
+        }
+        std::sort(rows.begin(), rows.end());
+    }
+    return out;
+}
+
+//Materializes the program on edges, applies the updates with updateEDB and
+//compares the result with the materialization of the final edges
+static void checkUpdates(const std::string &name, EdgeSet edges,
+        const std::vector<std::pair<EdgeSet, EdgeSet>> &steps) {
+    EDBConf conf("", false);
+    EDBLayer layer(conf, false);
+    addEdgeTable(layer, edges);
+    Program p(&layer);
+    std::string error = p.readFromString(CHECKUPDATE_RULES);
+    if (!error.empty()) {
+        LOG(ERRORL) << error;
+        throw 10;
+    }
+    std::string edgePred = "edge";
+    const PredId_t edgeId = p.getPredicate(edgePred).getId();
+    const uint64_t nPredicates = p.getMaxPredicateId();
+    const size_t nEDBPredicates = layer.getAllPredicateIDs().size();
+    std::shared_ptr<SemiNaiver> sn = Reasoner::getSemiNaiver(layer,
+            &p, true, true, false, TypeChase::SKOLEM_CHASE, 1, 1, false);
+    sn->run();
+
+    for (const auto &step : steps) {
+        std::vector<EDBUpdate> updates(1);
+        updates[0].predicate = edgeId;
+        for (const auto &e : step.first) {
+            updates[0].inserted.push_back(e.first);
+            updates[0].inserted.push_back(e.second);
+        }
+        for (const auto &e : step.second) {
+            updates[0].deleted.push_back(e.first);
+            updates[0].deleted.push_back(e.second);
+            edges.erase(e);
+        }
+        //The inserted rows are added after the deletions
+        for (const auto &e : step.first) {
+            edges.insert(e);
+        }
+        sn->updateEDB(updates);
+        if (p.getMaxPredicateId() != nPredicates ||
+                layer.getAllPredicateIDs().size() != nEDBPredicates) {
+            LOG(ERRORL) << name << ": the update left auxiliary predicates";
+            throw 10;
+        }
+    }
+    auto updated = getIDBContent(*sn, p);
+
+    EDBConf conf2("", false);
+    EDBLayer layer2(conf2, false);
+    addEdgeTable(layer2, edges);
+    Program p2(&layer2);
+    p2.readFromString(CHECKUPDATE_RULES);
+    std::shared_ptr<SemiNaiver> sn2 = Reasoner::getSemiNaiver(layer2,
+            &p2, true, true, false, TypeChase::SKOLEM_CHASE, 1, 1, false);
+    sn2->run();
+    auto expected = getIDBContent(*sn2, p2);
+
+    for (const auto &e : expected) {
+        const auto &rows = updated[e.first];
+        if (rows != e.second) {
+            LOG(ERRORL) << name << ": " << e.first << " has " << rows.size()
+                << " rows after the update, " << e.second.size()
+                << " after the rematerialization";
+            throw 10;
+        }
+        LOG(INFOL) << name << ": " << e.first << " " << rows.size() << " rows";
+    }
+    LOG(INFOL) << name << ": the update and the rematerialization agree";
+}
+
+//Checks updateEDB against a full rematerialization after insertions,
+//deletions and mixed updates of a random graph
+void checkUpdate(ProgramArgs &vm) {
+    const Term_t nnodes = 200;
+    std::mt19937_64 gen(42);
+    auto randomEdges = [&](const size_t n) -> EdgeSet {
+        EdgeSet out;
+        while (out.size() < n) {
+            out.insert(std::make_pair(gen() % nnodes, gen() % nnodes));
+        }
+        return out;
+    };
+    auto someOf = [&](const EdgeSet &edges, const size_t n) -> EdgeSet {
+        EdgeSet out;
+        for (const auto &e : edges) {
+            if (out.size() < n && gen() % 4 == 0) {
+                out.insert(e);
+            }
+        }
+        return out;
+    };
+    const EdgeSet edges = randomEdges(400);
+    const EdgeSet none;
+
+    std::vector<std::pair<EdgeSet, EdgeSet>> steps;
+    steps.push_back(std::make_pair(randomEdges(50), none));
+    checkUpdates("insert", edges, steps);
+
+    steps.clear();
+    steps.push_back(std::make_pair(none, someOf(edges, 50)));
+    checkUpdates("delete", edges, steps);
+
+    //Two mixed updates, to check also that the second one does not see
+    //the auxiliary relations of the first
+    steps.clear();
+    steps.push_back(std::make_pair(randomEdges(30), someOf(edges, 30)));
+    steps.push_back(std::make_pair(randomEdges(30), someOf(edges, 30)));
+    checkUpdates("mixed", edges, steps);
+}
+
+//Program used by checkQSQR: a linear and a non-linear recursive relation
+static const std::string CHECKQSQR_RULES =
+    "reach(X,Y) :- edge(X,Y)\n"
+    "reach(X,Z) :- edge(X,Y),reach(Y,Z)\n"
+    "tc(X,Y) :- edge(X,Y)\n"
+    "tc(X,Z) :- tc(X,Y),tc(Y,Z)\n";
+
+//Sorted answers of a top-down evaluation of query on nthreads threads
+static std::vector<std::vector<Term_t>> queryTopDown(EDBLayer &layer,
+        Program &p, Literal &query, const int nthreads) {
+    Reasoner reasoner(1000000);
+    reasoner.setNThreads(nthreads);
+    TupleIterator *itr = reasoner.getTopDownIterator(query, NULL, NULL,
+            layer, p, true, NULL);
+    std::vector<std::vector<Term_t>> answers;
+    while (itr->hasNext()) {
+        itr->next();
+        std::vector<Term_t> row;
+        for (size_t i = 0; i < itr->getTupleSize(); ++i) {
+            row.push_back(itr->getElementAt(i));
+        }
+        answers.push_back(row);
+    }
+    delete itr;
+    std::sort(answers.begin(), answers.end());
+    answers.erase(std::unique(answers.begin(), answers.end()), answers.end());
+    return answers;
+}
+
+//Checks that the multi-threaded QSQ-R evaluation returns the same answers
+//as the single-threaded one on recursive queries over a random graph
+void checkQSQR(ProgramArgs &vm) {
+    const int nthreads = std::max(2, vm["nthreads"].as<int>());
+    const Term_t nnodes = 300;
+    std::mt19937_64 gen(42);
+    EdgeSet edges;
+    while (edges.size() < 600) {
+        edges.insert(std::make_pair(gen() % nnodes, gen() % nnodes));
+    }
+    EDBConf conf("", false);
+    EDBLayer layer(conf, true);
+    addEdgeTable(layer, edges);
+    Program p(&layer);
+    std::string error = p.readFromString(CHECKQSQR_RULES);
+    if (!error.empty()) {
+        LOG(ERRORL) << error;
+        throw 10;
+    }
+
+    for (std::string name : {"reach", "tc"}) {
+        //Queries with the first, the second or no position bound
+        for (int bound = 0; bound < 3; ++bound) {
+            for (Term_t c = 0; c < (bound == 2 ? 1 : 5); ++c) {
+                VTuple t(2);
+                for (uint8_t i = 0; i < 2; ++i) {
+                    if (i == bound) {
+                        t.set(VTerm(0, c * 7 % nnodes), i);
+                    } else {
+                        t.set(VTerm(i + 1, 0), i);
+                    }
+                }
+                Literal query(Predicate(p.getPredicate(name),
+                            Predicate::calculateAdornment(t)), t);
+                auto expected = queryTopDown(layer, p, query, 1);
+                auto answers = queryTopDown(layer, p, query, nthreads);
+                if (answers != expected) {
+                    LOG(ERRORL) << query.tostring() << ": " << answers.size()
+                        << " answers with " << nthreads << " threads, "
+                        << expected.size() << " with one thread";
+                    throw 10;
+                }
+                LOG(INFOL) << query.tostring() << ": " << answers.size()
+                    << " answers";
+            }
+        }
+    }
+    LOG(INFOL) << "The multi-threaded and the single-threaded evaluation agree";
+}
+
 std::string flattenAllArgs(int argc, const char** argv) {
     std::string args = "";
     for (int i = 1; i < argc; ++i) {
@@ -482,14 +1041,21 @@ void launchTriggeredMat(int argc,
 
         std::string storemat_format = vm["storemat_format"].as<string>();
 
+        std::string compression = vm["storemat_compression"].as<string>();
+
         if (storemat_format == "files" || storemat_format == "csv") {
             sn->storeOnFiles(vm["storemat_path"].as<string>(),
-                    vm["decompressmat"].as<bool>(), 0, storemat_format == "csv");
+                    vm["decompressmat"].as<bool>(), 0, storemat_format == "csv",
+                    BufferedWriter::parseCompression(compression));
         } else if (storemat_format == "db") {
             //I will store the details on a Trident index
             exp.generateTridentDiffIndex(vm["storemat_path"].as<string>());
+        } else if (storemat_format == "columnar") {
+            exp.generateColumnar(vm["storemat_path"].as<string>());
         } else if (storemat_format == "nt") {
-            exp.generateNTTriples(vm["storemat_path"].as<string>(), vm["decompressmat"].as<bool>());
+            exp.generateNTTriples(vm["storemat_path"].as<string>(), vm["decompressmat"].as<bool>(),
+                    compression.empty() ? COMPR_GZIP :
+                    BufferedWriter::parseCompression(compression));
         } else {
             LOG(ERRORL) << "Option 'storemat_format' not recognized";
             throw 10;
@@ -591,6 +1157,13 @@ void launchFullMat(int argc,
                 nthreads,
                 interRuleThreads,
                 ! vm["shufflerules"].empty());
+        if (vm["memlimit"].as<int64_t>() > 0) {
+            sn->setMemoryBudget((size_t) vm["memlimit"].as<int64_t>() * 1024 * 1024,
+                    vm["spill_path"].as<string>());
+        }
+        sn->setReplanFactor(vm["replanfactor"].as<int>());
+        ProjectionCache::getInstance().setBudget((size_t) std::max((int64_t) 0,
+                    vm["cachebudget"].as<int64_t>()) * 1024 * 1024);
 
 #ifdef WEBINTERFACE
         //Start the web interface if requested
@@ -633,6 +1206,24 @@ void launchFullMat(int argc,
         }
 #endif
 
+        if (!vm["edbadd"].as<string>().empty() ||
+                !vm["edbremove"].as<string>().empty()) {
+            std::vector<EDBUpdate> updates;
+            if (!vm["edbremove"].as<string>().empty()) {
+                readEDBUpdates(vm["edbremove"].as<string>(), false, p, db,
+                        updates);
+            }
+            if (!vm["edbadd"].as<string>().empty()) {
+                readEDBUpdates(vm["edbadd"].as<string>(), true, p, db,
+                        updates);
+            }
+            std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+            sn->updateEDB(updates);
+            std::chrono::duration<double> sec = std::chrono::system_clock::now() - start;
+            LOG(INFOL) << "Runtime update = " << sec.count() * 1000 << " milliseconds";
+            sn->printCountAllIDBs("");
+        }
+
         if (vm["printRepresentationSize"].as<bool>()) {
             printRepresentationSize(sn);
         }
@@ -645,14 +1236,21 @@ void launchFullMat(int argc,
 
             std::string storemat_format = vm["storemat_format"].as<string>();
 
+            std::string compression = vm["storemat_compression"].as<string>();
+
             if (storemat_format == "files" || storemat_format == "csv") {
                 sn->storeOnFiles(vm["storemat_path"].as<string>(),
-                        vm["decompressmat"].as<bool>(), 0, storemat_format == "csv");
+                        vm["decompressmat"].as<bool>(), 0, storemat_format == "csv",
+                        BufferedWriter::parseCompression(compression));
             } else if (storemat_format == "db") {
                 //I will store the details on a Trident index
                 exp.generateTridentDiffIndex(vm["storemat_path"].as<string>());
+            } else if (storemat_format == "columnar") {
+                exp.generateColumnar(vm["storemat_path"].as<string>());
             } else if (storemat_format == "nt") {
-                exp.generateNTTriples(vm["storemat_path"].as<string>(), vm["decompressmat"].as<bool>());
+                exp.generateNTTriples(vm["storemat_path"].as<string>(), vm["decompressmat"].as<bool>(),
+                        compression.empty() ? COMPR_GZIP :
+                        BufferedWriter::parseCompression(compression));
             } else {
                 LOG(ERRORL) << "Option 'storemat_format' not recognized";
                 throw 10;
@@ -922,6 +1520,9 @@ void execLiteralQuery(EDBLayer &edb, ProgramArgs &vm) {
     Dictionary dictVariables;
     Literal literal = p.parseLiteral(query, dictVariables);
     Reasoner reasoner(vm["reasoningThreshold"].as<int64_t>());
+    if (!vm["multithreaded"].empty()) {
+        reasoner.setNThreads(vm["nthreads"].as<int>());
+    }
     runLiteralQuery(edb, p, literal, reasoner, vm);
 }
 
@@ -982,7 +1583,9 @@ int main(int argc, const char** argv) {
         edbFile = dirExecFile + DIR_SEP + std::string("edb.conf");
     }
 
-    if (cmd != "load" && !Utils::exists(edbFile)) {
+    if (cmd != "load" && cmd != "benchdict" && cmd != "benchsort" &&
+            cmd != "benchcolumns" && cmd != "checkupdate" &&
+            cmd != "checkqsqr" && !Utils::exists(edbFile)) {
         printErrorMsg("I could not find the EDB conf file " + edbFile);
         return EXIT_FAILURE;
     }
@@ -1007,7 +1610,8 @@ int main(int argc, const char** argv) {
 
     if (cmd == "query" || cmd == "queryLiteral") {
         EDBConf conf(edbFile);
-        EDBLayer *layer = new EDBLayer(conf, false);
+        EDBLayer *layer = new EDBLayer(conf, cmd == "queryLiteral" &&
+                ! vm["multithreaded"].empty());
 
         //Execute the query
         if (cmd == "query") {
@@ -1021,6 +1625,21 @@ int main(int argc, const char** argv) {
         EDBLayer *layer = new EDBLayer(conf, false);
         lookup(*layer, vm);
         delete layer;
+    } else if (cmd == "convert") {
+        EDBConf conf(edbFile);
+        EDBLayer *layer = new EDBLayer(conf, false);
+        convertInmemoryTables(conf, *layer);
+        delete layer;
+    } else if (cmd == "benchdict") {
+        benchDictionaries(vm);
+    } else if (cmd == "benchsort") {
+        benchSort(vm);
+    } else if (cmd == "benchcolumns") {
+        benchColumns(vm);
+    } else if (cmd == "checkupdate") {
+        checkUpdate(vm);
+    } else if (cmd == "checkqsqr") {
+        checkQSQR(vm);
     } else if (cmd == "mat") {
         EDBConf conf(edbFile);
         EDBLayer *layer = new EDBLayer(conf, ! vm["multithreaded"].empty());
@@ -8,9 +8,16 @@
 #include <cstring>
 #include <cmath>
 #include <unordered_map>
+#include <thread>
+#include <iterator>
+
+#ifndef RECURSIVE_QSQR
+thread_local QSQR::Worker *QSQR::currentWorker = NULL;
+#endif
 
 BindingsTable *QSQR::getInputTable(const Predicate pred) {
     //raiseIfExpired();
+    std::lock_guard<std::mutex> lock(tablesMutex);
     BindingsTable **table = inputs[pred.getId()];
     if (table == NULL) {
         const uint8_t maxAdornments = (uint8_t)pow(2, pred.getCardinality());
@@ -21,12 +28,16 @@ BindingsTable *QSQR::getInputTable(const Predicate pred) {
     }
     if (table[pred.getAdorment()] == NULL) {
         table[pred.getAdorment()] = new BindingsTable(pred.getCardinality(), pred.getAdorment());
+        if (nthreads > 1) {
+            table[pred.getAdorment()]->enableLocking();
+        }
     }
     return table[pred.getAdorment()];
 }
 
 BindingsTable *QSQR::getAnswerTable(const Predicate pred, uint8_t adornment) {
     //raiseIfExpired();
+    std::lock_guard<std::mutex> lock(tablesMutex);
     BindingsTable **table = answers[pred.getId()];
     if (table == NULL) {
         const uint8_t maxAdornments = (uint8_t)pow(2, pred.getCardinality());
@@ -37,6 +48,9 @@ BindingsTable *QSQR::getAnswerTable(const Predicate pred, uint8_t adornment) {
     }
     if (table[adornment] == NULL) {
         table[adornment] = new BindingsTable(pred.getCardinality());
+        if (nthreads > 1) {
+            table[adornment]->enableLocking();
+        }
     }
     return table[adornment];
 }
@@ -85,6 +99,7 @@ void QSQR::deallocateAllRules() {
 }
 
 size_t QSQR::calculateAllAnswers() {
+    std::lock_guard<std::mutex> lock(tablesMutex);
     size_t total = 0;
     for (int i = 0; i < answers.size(); ++i) {
         if (answers[i] != NULL) {
@@ -111,6 +126,7 @@ void QSQR::cleanAllInputs() {
 }
 
 void QSQR::createRules(Predicate &pred) {
+    std::lock_guard<std::mutex> lock(tablesMutex);
     //check if the adorned rules are created. If not, then create them.
     if (rules[pred.getId()] == NULL) {
         const uint16_t maxAdornments = (uint16_t)pow(2, pred.getCardinality());
@@ -172,7 +188,7 @@ size_t QSQR::estimate(int depth, Predicate &pred, BindingsTable *inputTable/*, s
 }
 
 void QSQR::evaluate(Predicate &pred, BindingsTable *inputTable,
-        size_t offsetInput, bool repeat) {
+        size_t offsetInput, size_t endInput, bool repeat) {
 #ifdef RECURSIVE_QSQR
     size_t totalAnswers;
     bool shouldRepeat = false;
@@ -184,7 +200,7 @@ void QSQR::evaluate(Predicate &pred, BindingsTable *inputTable,
         createRules(pred);
         for (int i = 0; i < program->getAllRulesByPredicate(pred.getId()).size(); ++i) {
             RuleExecutor *exec = rules[pred.getId()][pred.getAdorment()][i];
-            exec->evaluate(inputTable, offsetInput, this, layer);
+            exec->evaluate(inputTable, offsetInput, endInput, this, layer);
         }
 
         //Repeat the execution if new answers were being produced
@@ -203,11 +219,12 @@ void QSQR::evaluate(Predicate &pred, BindingsTable *inputTable,
         task.currentRuleIndex = 1;
         task.inputTable = inputTable;
         task.offsetInput = offsetInput;
+        task.endInput = endInput;
         task.repeat = repeat;
         task.totalAnswers = calculateAllAnswers();
         pushTask(task);
         RuleExecutor *exec = rules[pred.getId()][pred.getAdorment()][0];
-        exec->evaluate(inputTable, offsetInput, this, layer);
+        exec->evaluate(inputTable, offsetInput, endInput, this, layer);
     }
 #endif
 }
@@ -223,13 +240,15 @@ void QSQR::processTask(QSQR_Task &task) {
                             newTask.currentRuleIndex = task.currentRuleIndex + 1;
                             newTask.inputTable = task.inputTable;
                             newTask.offsetInput = task.offsetInput;
+                            newTask.endInput = task.endInput;
                             newTask.repeat = task.repeat;
                             newTask.totalAnswers = task.totalAnswers;
                             pushTask(newTask);
                             // LOG(DEBUGL) << "pushed new task QUERY, totalAnswers = " << newTask.totalAnswers;
                             RuleExecutor *exec = rules[task.pred.getId()]
                                 [task.pred.getAdorment()][task.currentRuleIndex];
-                            exec->evaluate(task.inputTable, task.offsetInput, this, layer);
+                            exec->evaluate(task.inputTable, task.offsetInput,
+                                    task.endInput, this, layer);
                         } else {
                             size_t newAnswers = calculateAllAnswers();
                             if (task.repeat && newAnswers > task.totalAnswers) {
@@ -238,6 +257,7 @@ void QSQR::processTask(QSQR_Task &task) {
                                 newTask.currentRuleIndex = 1;
                                 newTask.inputTable = task.inputTable;
                                 newTask.offsetInput = task.offsetInput;
+                                newTask.endInput = task.endInput;
                                 newTask.repeat = task.repeat;
                                 //newTask.shouldRepeat = false;
                                 newTask.totalAnswers = newAnswers;
@@ -245,11 +265,16 @@ void QSQR::processTask(QSQR_Task &task) {
                                 // LOG(DEBUGL) << "pushed new task QUERY(0), totalAnswers = " << newTask.totalAnswers;
                                 RuleExecutor *exec = rules[task.pred.getId()]
                                     [task.pred.getAdorment()][0];
-                                exec->evaluate(task.inputTable, task.offsetInput, this, layer);
+                                exec->evaluate(task.inputTable, task.offsetInput,
+                                        task.endInput, this, layer);
                             }
                         }
                         break;
                     }
+        case RULE_RANGE:
+                    task.executor->evaluate(task.inputTable, task.offsetInput,
+                            task.endInput, this, layer);
+                    break;
         case RULE:
         case RULE_QUERY:
                     RuleExecutor *exec = task.executor;
@@ -257,6 +282,123 @@ void QSQR::processTask(QSQR_Task &task) {
                     break;
     }
 }
+
+void QSQR::pushTask(QSQR_Task &task) {
+    if (currentWorker != NULL && currentWorker->qsqr == this) {
+        pendingTasks++;
+        {
+            std::lock_guard<std::mutex> lock(currentWorker->mutex);
+            currentWorker->tasks.push_back(task);
+        }
+        //An idle thread that did not see the task either sees the new
+        //version before it waits, or is woken up here
+        taskVersion++;
+        if (idleWorkers > 0) {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            idleCond.notify_one();
+        }
+    } else {
+        tasks.push_back(task);
+    }
+}
+
+bool QSQR::stealTask(const size_t id, std::list<QSQR_Task> &out) {
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker *victim = workers[(id + i) % workers.size()].get();
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        for (auto itr = victim->tasks.begin(); itr != victim->tasks.end();
+                ++itr) {
+            if (itr->type == QUERY || itr->type == RULE_RANGE) {
+                out.splice(out.end(), victim->tasks, itr);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void QSQR::runWorker(const size_t id) {
+    Worker *worker = workers[id].get();
+    Worker *previous = currentWorker;
+    currentWorker = worker;
+    std::list<QSQR_Task> task;
+    while (true) {
+        const uint64_t version = taskVersion;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            if (!worker->tasks.empty()) {
+                task.splice(task.end(), worker->tasks,
+                        std::prev(worker->tasks.end()));
+                found = true;
+            }
+        }
+        if (!found) {
+            found = stealTask(id, task);
+        }
+        if (found) {
+            processTask(task.front());
+            task.clear();
+            if (--pendingTasks == 0) {
+                std::lock_guard<std::mutex> lock(idleMutex);
+                idleCond.notify_all();
+            }
+        } else {
+            std::unique_lock<std::mutex> lock(idleMutex);
+            if (pendingTasks == 0) {
+                break;
+            }
+            idleWorkers++;
+            idleCond.wait(lock, [&]() {
+                    return taskVersion != version || pendingTasks == 0;
+                    });
+            idleWorkers--;
+        }
+    }
+    currentWorker = previous;
+}
+
+void QSQR::processTasks() {
+    if (nthreads < 2) {
+        //evaluate in this case is not recursive. Process the tasks
+        //until the queue is empty
+        while (tasks.size() > 0) {
+            // LOG(DEBUGL) << "Task size=" << tasks.size();
+            QSQR_Task task = tasks.back();
+            tasks.pop_back();
+            processTask(task);
+        }
+        return;
+    }
+
+    //The tasks pushed so far go to the stack of the first thread. The
+    //threads never wait for each other: if a task is stolen, the tasks below
+    //it can read an answer table that is not complete yet. The answers that
+    //are missed in this way are found in the next round of evaluateQuery,
+    //which is repeated until no new answers are derived.
+    workers.clear();
+    for (int i = 0; i < nthreads; ++i) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        workers.back()->qsqr = this;
+    }
+    pendingTasks = tasks.size();
+    idleWorkers = 0;
+    taskVersion = 0;
+    for (const auto &task : tasks) {
+        workers[0]->tasks.push_back(task);
+    }
+    tasks.clear();
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nthreads; ++i) {
+        threads.push_back(std::thread(&QSQR::runWorker, this, i));
+    }
+    runWorker(0);
+    for (auto &t : threads) {
+        t.join();
+    }
+    workers.clear();
+}
 #endif
 
 TupleTable *QSQR::evaluateQuery(int evaluateOrEstimate, QSQQuery *query,
@@ -320,16 +462,10 @@ TupleTable *QSQR::evaluateQuery(int evaluateOrEstimate, QSQQuery *query,
                 totalAnswers = calculateAllAnswers();
 
                 if (evaluateOrEstimate == QSQR_EVAL) {
-                    evaluate(pred2, inputTable, 0, false);
+                    evaluate(pred2, inputTable, 0, inputTable->getNTuples(),
+                            false);
 #ifndef RECURSIVE_QSQR
-                    //evaluate in this case is not recursive. Process the tasks
-                    //until the queue is empty
-                    while (tasks.size() > 0) {
-                        // LOG(DEBUGL) << "Task size=" << tasks.size();
-                        QSQR_Task task = tasks.back();
-                        tasks.pop_back();
-                        processTask(task);
-                    }
+                    processTasks();
 #endif
 
                 } else {
@@ -347,16 +483,10 @@ TupleTable *QSQR::evaluateQuery(int evaluateOrEstimate, QSQQuery *query,
                 inputTable->addTuple(query->getLiteral());
                 if (evaluateOrEstimate == QSQR_EVAL) {
                     totalAnswers = calculateAllAnswers();
-                    evaluate(pred, inputTable, 0, false);
+                    evaluate(pred, inputTable, 0, inputTable->getNTuples(),
+                            false);
 #ifndef RECURSIVE_QSQR
-                    //evaluate in this case is not recursive. Process the tasks
-                    //until the queue is empty
-                    while (tasks.size() > 0) {
-                        //LOG(DEBUGL) << "Task size=" << tasks.size();
-                        QSQR_Task task = tasks.back();
-                        tasks.pop_back();
-                        processTask(task);
-                    }
+                    processTasks();
 #endif
 
                 } else { //ESTIMATE
@@ -5,6 +5,8 @@
 
 #include <trident/model/table.h>
 
+#include <algorithm>
+
 RuleExecutor::RuleExecutor(const Rule &rule, uint8_t headAdornment
         , Program *program,
         EDBLayer &layer
@@ -414,22 +416,25 @@ void RuleExecutor::evaluateRule(const uint8_t bodyAtom,
         //durationEDB += std::chrono::system_clock::now() - startEDB;
         // LOG(DEBUGL) << "EDB, query " << query.tostring() << ", retrieved " << retrievedBindings->getNRows();
     } else {
-        //Copy in input the query that we are about to launch
+        //Copy in input the query that we are about to launch. The queries
+        //are added at once, so that the new ones have consecutive indices
+        //even if other threads add queries to the same table.
         BindingsTable *table = qsqr->getInputTable(query.getLiteral()->getPredicate());
         //LOG(DEBUGL) << "ENRICH TABLE " << table->getNTuples();
-        size_t offsetInput = table->getNTuples();
+        const size_t sizeRow = table->getSizeTuples();
+        std::vector<Term_t> rows;
+        size_t nrows = 0;
         if (posFromSupplRelation[bodyAtom].size() == 0) {
-            if (posFromLiteral[bodyAtom].size() == 0) {
-                table->addRawTuple(NULL);
-            } else {
+            if (posFromLiteral[bodyAtom].size() != 0) {
                 Term_t tmpRow[256];
                 vector<std::pair<uint8_t, uint8_t>> pairs = posFromLiteral[bodyAtom];
 
                 for (size_t i = 0; i < pairs.size(); ++i) {
                     tmpRow[pairs[i].second] = query.getLiteral()->getTermAtPos(pairs[i].first).getValue();
                 }
-                table->addRawTuple(tmpRow);
+                rows.insert(rows.end(), tmpRow, tmpRow + sizeRow);
             }
+            nrows = 1;
         } else {
             Term_t tmpRow[256];
             if (posFromLiteral[bodyAtom].size() > 0) {
@@ -439,18 +444,23 @@ void RuleExecutor::evaluateRule(const uint8_t bodyAtom,
                 }
             }
             std::vector<std::pair<uint8_t, uint8_t>> pairs = posFromSupplRelation[bodyAtom];
-            for (size_t i = 0; i < supplRelations[bodyAtom]->getNTuples(); ++i) {
+            nrows = supplRelations[bodyAtom]->getNTuples();
+            rows.reserve(nrows * sizeRow);
+            for (size_t i = 0; i < nrows; ++i) {
                 const Term_t *tuple = supplRelations[bodyAtom]->getTuple(i);
                 for (std::vector<std::pair<uint8_t, uint8_t>>::iterator itr = pairs.begin();
                         itr != pairs.end(); ++itr) {
                     tmpRow[itr->second] = tuple[itr->first];
                 }
-                table->addRawTuple(tmpRow);
+                rows.insert(rows.end(), tmpRow, tmpRow + sizeRow);
             }
         }
+        size_t offsetInput;
+        const size_t nNewQueries = table->addRawTuples(rows.data(), nrows,
+                offsetInput);
 
         //Call the query if there are new queries
-        if (table->getNTuples() > offsetInput) {
+        if (nNewQueries > 0) {
             Predicate pred = query.getLiteral()->getPredicate();
 #ifdef RECURSIVE_QSQR
             qsqr->evaluate(pred, table, offsetInput);
@@ -461,16 +471,22 @@ void RuleExecutor::evaluateRule(const uint8_t bodyAtom,
             task.inputTable = table;
             task.supplRelations = supplRelations;
             task.offsetInput = offsetInput;
+            task.endInput = offsetInput + nNewQueries;
             task.currentRuleIndex = bodyAtom;
             task.qsqr = qsqr;
             qsqr->pushTask(task);
-            qsqr->evaluate(pred, table, offsetInput);
+            qsqr->evaluate(pred, table, offsetInput, offsetInput + nNewQueries,
+                    true);
             return;
 #endif
         }
 
         //Get previous answers
         BindingsTable *answer = qsqr->getAnswerTable(query.getLiteral());
+        if (nCurrentJoins > 0) {
+            joinWithAnswers(bodyAtom, supplRelations, answer);
+            return;
+        }
         retrievedBindings = answer->projectAndFilter(l, NULL, NULL);
     }
 
@@ -599,14 +615,21 @@ void RuleExecutor::copyLastRelInAnswers(QSQR *qsqr,
             }
         }
 
+        //Add all the answers at once, since the table can be shared with
+        //other threads
+        const size_t sizeRow = adornedRule.getFirstHead().getTupleSize();
+        std::vector<Term_t> rows;
+        rows.reserve(nTuples * sizeRow);
         for (size_t i = 0; i < nTuples; ++i) {
             const Term_t *supplRow = lastSupplRelation->getTuple(i);
             for (uint8_t j = 0; j < nvars; ++j) {
                 tuple[posVars[j]] = supplRow[projectionLastSuppl
                     [j]];
             }
-            answer->addRawTuple(tuple);
+            rows.insert(rows.end(), tuple, tuple + sizeRow);
         }
+        size_t firstNew;
+        answer->addRawTuples(rows.data(), nTuples, firstNew);
     }
 
     //Delete supplRelations
@@ -614,22 +637,44 @@ void RuleExecutor::copyLastRelInAnswers(QSQR *qsqr,
 }
 
 void RuleExecutor::evaluate(BindingsTable * input, size_t offsetInput,
+        size_t endInput,
         QSQR * qsqr,
         EDBLayer &layer) {
 
     //Evaluate the rule
-    if (input->getNTuples() > offsetInput) {
+    if (endInput > offsetInput) {
+#ifndef RECURSIVE_QSQR
+        //Let the other threads evaluate the rule on the rest of the input
+        if (qsqr->getNThreads() > 1 && endInput - offsetInput > QSQR_RANGE_SIZE) {
+            for (size_t start = offsetInput + QSQR_RANGE_SIZE; start < endInput;
+                    start += QSQR_RANGE_SIZE) {
+                QSQR_Task task(QSQR_TaskType::RULE_RANGE);
+                task.executor = this;
+                task.inputTable = input;
+                task.offsetInput = start;
+                task.endInput = std::min(start + QSQR_RANGE_SIZE, endInput);
+                task.qsqr = qsqr;
+                task.layer = &layer;
+                qsqr->pushTask(task);
+            }
+            endInput = offsetInput + QSQR_RANGE_SIZE;
+        }
+#endif
+
         //Get the new tuples. All the tuples that merge with the head of the
         //adorned rule are being copied in the first supplementary relation
         BindingsTable **supplRelations = createSupplRelations();
 
         //Copy all the tuples that are unifiable with the head in the first
         //supplementary relation.
-        for (size_t i = offsetInput; i < input->getNTuples(); ++i) {
-            const Term_t* tuple = input->getTuple(i);
-            if (isUnifiable(tuple, input->getSizeTuples(),
-                        input->getPosFromAdornment(), layer)) {
-                supplRelations[0]->addTuple(tuple);
+        {
+            std::unique_lock<std::mutex> lock = input->lock();
+            for (size_t i = offsetInput; i < endInput; ++i) {
+                const Term_t* tuple = input->getTuple(i);
+                if (isUnifiable(tuple, input->getSizeTuples(),
+                            input->getPosFromAdornment(), layer)) {
+                    supplRelations[0]->addTuple(tuple);
+                }
             }
         }
 
@@ -702,9 +747,14 @@ void RuleExecutor::processTask(QSQR_Task *t) {
                              Literal l(adornedRule.getBody()[task.currentRuleIndex]);
                              QSQQuery query(l);
                              BindingsTable *answer = task.qsqr->getAnswerTable(query.getLiteral());
+                             const uint8_t nCurrentJoins = this->njoins[task.currentRuleIndex];
+                             if (nCurrentJoins > 0) {
+                                 joinWithAnswers((uint8_t) task.currentRuleIndex,
+                                         task.supplRelations, answer);
+                                 break;
+                             }
                              TupleTable *retrievedBindings = answer->
                                  projectAndFilter(l, NULL, NULL);
-                             const uint8_t nCurrentJoins = this->njoins[task.currentRuleIndex];
                              std::vector<uint8_t> posJoinsSupplRel;
                              std::vector<uint8_t> posJoinsLiteral;
                              if (nCurrentJoins > 0) {
@@ -765,6 +815,60 @@ void RuleExecutor::processTask(QSQR_Task *t) {
 RuleExecutor::~RuleExecutor() {
 }
 
+void RuleExecutor::joinWithAnswers(const uint8_t bodyAtom,
+        BindingsTable **supplRelations, BindingsTable *answer) {
+    Literal l(adornedRule.getBody()[bodyAtom]);
+    const std::vector<uint8_t> posVars = l.getPosVars();
+    const uint8_t nCurrentJoins = this->njoins[bodyAtom];
+    const std::pair<uint8_t, uint8_t> *j = &(joins.at(startJoins[bodyAtom]));
+
+    //Look up the answers on the constants of the literal and on the join
+    //variables
+    std::vector<uint8_t> positions;
+    std::vector<Term_t> values;
+    for (uint8_t i = 0; i < l.getTupleSize(); ++i) {
+        if (!l.getTermAtPos(i).isVariable()) {
+            positions.push_back(i);
+            values.push_back(l.getTermAtPos(i).getValue());
+        }
+    }
+    const size_t nconsts = positions.size();
+    for (uint8_t i = 0; i < nCurrentJoins; ++i) {
+        positions.push_back(posVars[j[i].first]);
+        values.push_back(0);
+    }
+
+    BindingsTable *bindings = supplRelations[bodyAtom];
+    BindingsTable *output = supplRelations[bodyAtom + 1];
+    const uint8_t sizeBindings = (uint8_t) bindings->getSizeTuples();
+    uint64_t rowAnswer[256];
+    uint64_t rowBindings[256];
+    std::vector<size_t> rows;
+    std::unique_lock<std::mutex> lock = answer->lock();
+    for (size_t i = 0; i < bindings->getNTuples(); ++i) {
+        const Term_t *binding = bindings->getTuple(i);
+        for (uint8_t m = 0; m < nCurrentJoins; ++m) {
+            values[nconsts + m] = binding[j[m].second];
+        }
+        rows.clear();
+        answer->lookup(positions, values.data(), rows);
+        if (rows.empty()) {
+            continue;
+        }
+        for (uint8_t m = 0; m < sizeBindings; ++m) {
+            rowBindings[m] = binding[m];
+        }
+        for (auto idx : rows) {
+            const Term_t *a = answer->getTuple(idx);
+            for (size_t m = 0; m < posVars.size(); ++m) {
+                rowAnswer[m] = a[posVars[m]];
+            }
+            output->addTuple(rowAnswer, (uint8_t) posVars.size(), rowBindings,
+                    sizeBindings);
+        }
+    }
+}
+
 char RuleExecutor::cmp(const uint64_t *row1, const uint64_t *row2, const std::pair<uint8_t, uint8_t> *joins, const uint8_t njoins) {
     for (uint8_t i = 0; i < njoins; ++i) {
         Term_t v1 = (Term_t) row1[joins[i].first];
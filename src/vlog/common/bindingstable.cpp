@@ -5,24 +5,12 @@
 #include <algorithm>
 
 Term_t const * const EMPTY_TUPLE = {0};
-BindingsRow EMPTY_ROW(0, EMPTY_TUPLE);
 
-bool BindingsRow::operator==(const BindingsRow &other) const {
-    if (size == other.size) {
-        if (row == other.row)
-            return true;
-        for (int i = 0; i < size; ++i) {
-            if (row[i] != other.row[i])
-                return false;
-        }
-        return true;
-    }
-    LOG(ERRORL) << "Should never happen";
-    return false;
-}
+//Initial number of slots of the hash set of the rows
+#define BINDINGS_INITIAL_SLOTS 16
 
-BindingsTable::BindingsTable(uint8_t sizeAdornment, uint8_t adornment) {
-    uniqueElements.max_load_factor(0.75);
+BindingsTable::BindingsTable(uint8_t sizeAdornment, uint8_t adornment) :
+    ntuples(0) {
     //Mark positions to copy
     std::vector<int> pc;
     for (int i = 0; i < sizeAdornment; ++i) {
@@ -48,8 +36,7 @@ BindingsTable::BindingsTable(uint8_t sizeAdornment, uint8_t adornment) {
     }
 }
 
-BindingsTable::BindingsTable(size_t sizeTuple) {
-    uniqueElements.max_load_factor(0.75);
+BindingsTable::BindingsTable(size_t sizeTuple) : ntuples(0) {
     nPosToCopy = sizeTuple;
     if (nPosToCopy > 0) {
         rawBindings = new RawBindings((uint8_t) sizeTuple);
@@ -61,8 +48,7 @@ BindingsTable::BindingsTable(size_t sizeTuple) {
     posToCopy = NULL;
 }
 
-BindingsTable::BindingsTable(uint8_t npc, std::vector<int> pc) {
-    uniqueElements.max_load_factor(0.75);
+BindingsTable::BindingsTable(uint8_t npc, std::vector<int> pc) : ntuples(0) {
     this->nPosToCopy = npc;
     if (nPosToCopy > 0) {
         this->posToCopy = new size_t[nPosToCopy];
@@ -78,24 +64,140 @@ BindingsTable::BindingsTable(uint8_t npc, std::vector<int> pc) {
     }
 }
 
-void BindingsTable::insertIfNotExists(Term_t const * const cr) {
+bool BindingsTable::insertIfNotExists(Term_t const * const cr) {
     if (cr == EMPTY_TUPLE) {
-        uniqueElements.insert(EMPTY_ROW);
+        //There is only one empty tuple
+        if (ntuples == 0) {
+            ntuples++;
+            return true;
+        }
+        return false;
+    }
+
+    uint64_t hash = nPosToCopy;
+    for (size_t i = 0; i < nPosToCopy; ++i) {
+        hash = hash_Terms::add(hash, cr[i]);
+    }
+    if (slots.empty()) {
+        slots.resize(BINDINGS_INITIAL_SLOTS);
+    }
+    const size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot] != 0) {
+        const size_t idx = slots[slot] - 1;
+        if (hashes[idx] == hash && memcmp(rawBindings->getOffset(idx * nPosToCopy),
+                    cr, sizeof(Term_t) * nPosToCopy) == 0) {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    //The row is new. It is already stored in currentRow.
+    const size_t idx = ntuples;
+    slots[slot] = idx + 1;
+    hashes.push_back(hash);
+    currentRow = rawBindings->newRow();
+    ntuples++;
+    if (hashes.size() * 4 > slots.size() * 3) {
+        rehash();
+    }
+    return true;
+}
+
+void BindingsTable::rehash() {
+    slots.assign(slots.size() * 2, 0);
+    const size_t mask = slots.size() - 1;
+    for (size_t idx = 0; idx < hashes.size(); ++idx) {
+        size_t slot = hashes[idx] & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = idx + 1;
+    }
+}
+
+uint64_t BindingsTable::hashProjection(const Term_t *row,
+        const std::vector<uint8_t> &positions) const {
+    uint64_t hash = positions.size();
+    for (auto p : positions) {
+        hash = hash_Terms::add(hash, row[p]);
+    }
+    return hash;
+}
+
+void BindingsTable::extendIndex(ProjectionIndex &index) {
+    const size_t n = ntuples;
+    if (index.next.size() == n) {
         return;
     }
-    BindingsRow row((uint8_t) nPosToCopy, cr);
-    /*
-    std::unordered_set<BindingsRow, hash_BindingsRow>::iterator itr = uniqueElements.find(row);
-    if (itr == uniqueElements.end()) {
-        uniqueElements.insert(row);
-    */
-    std::pair<std::unordered_set<BindingsRow, hash_BindingsRow>::iterator, bool> result = uniqueElements.insert(row);
-    if (result.second) {
-        currentRow = rawBindings->newRow();
+    if (n > index.buckets.size()) {
+        //Rebuild the index with twice the rows
+        index.buckets.assign(std::max((size_t) BINDINGS_INITIAL_SLOTS,
+                    index.buckets.size() * 2), 0);
+        while (index.buckets.size() < n) {
+            index.buckets.resize(index.buckets.size() * 2);
+        }
+        index.next.clear();
+    }
+    const size_t mask = index.buckets.size() - 1;
+    for (size_t idx = index.next.size(); idx < n; ++idx) {
+        const size_t bucket = hashProjection(
+                rawBindings->getOffset(idx * nPosToCopy), index.positions) & mask;
+        index.next.push_back(index.buckets[bucket]);
+        index.buckets[bucket] = idx + 1;
+    }
+}
+
+void BindingsTable::lookup(const std::vector<uint8_t> &positions,
+        const Term_t *values, std::vector<size_t> &rows) {
+    if (nPosToCopy == 0) {
+        //Only the empty tuple can be stored
+        if (ntuples > 0) {
+            rows.push_back(0);
+        }
+        return;
+    }
+    ProjectionIndex *index = NULL;
+    for (auto &p : projections) {
+        if (p.positions == positions) {
+            index = &p;
+            break;
+        }
+    }
+    if (index == NULL) {
+        projections.push_back(ProjectionIndex());
+        index = &projections.back();
+        index->positions = positions;
+    }
+    extendIndex(*index);
+    if (index->buckets.empty()) {
+        return;
+    }
+
+    uint64_t hash = positions.size();
+    for (size_t i = 0; i < positions.size(); ++i) {
+        hash = hash_Terms::add(hash, values[i]);
+    }
+    size_t next = index->buckets[hash & (index->buckets.size() - 1)];
+    while (next != 0) {
+        const size_t idx = next - 1;
+        const Term_t *row = rawBindings->getOffset(idx * nPosToCopy);
+        bool ok = true;
+        for (size_t i = 0; i < positions.size(); ++i) {
+            if (row[positions[i]] != values[i]) {
+                ok = false;
+                break;
+            }
+        }
+        if (ok) {
+            rows.push_back(idx);
+        }
+        next = index->next[idx];
     }
 }
 
 void BindingsTable::addTuple(const Literal *t) {
+    std::unique_lock<std::mutex> guard = lock();
     if (nPosToCopy == 0) {
         insertIfNotExists(EMPTY_TUPLE);
     } else {
@@ -108,6 +210,7 @@ void BindingsTable::addTuple(const Literal *t) {
 
 #if ! TERM_IS_UINT64
 void BindingsTable::addTuple(const uint64_t *t) {
+    std::unique_lock<std::mutex> guard = lock();
     if (nPosToCopy == 0) {
         insertIfNotExists(EMPTY_TUPLE);
     } else {
@@ -120,6 +223,7 @@ void BindingsTable::addTuple(const uint64_t *t) {
 #endif
 
 void BindingsTable::addTuple(const Term_t *t) {
+    std::unique_lock<std::mutex> guard = lock();
     if (nPosToCopy == 0) {
         insertIfNotExists(EMPTY_TUPLE);
     } else {
@@ -132,6 +236,7 @@ void BindingsTable::addTuple(const Term_t *t) {
 
 void BindingsTable::addTuple(const uint64_t *t1, const uint8_t sizeT1,
                              const uint64_t *t2, const uint8_t sizeT2) {
+    std::unique_lock<std::mutex> guard = lock();
     if (nPosToCopy == 0) {
         insertIfNotExists(EMPTY_TUPLE);
     } else {
@@ -147,6 +252,7 @@ void BindingsTable::addTuple(const uint64_t *t1, const uint8_t sizeT1,
 }
 
 void BindingsTable::addTuple(const uint64_t *t, const uint8_t *positions) {
+    std::unique_lock<std::mutex> guard = lock();
     if (nPosToCopy == 0) {
         insertIfNotExists(EMPTY_TUPLE);
     } else {
@@ -158,6 +264,7 @@ void BindingsTable::addTuple(const uint64_t *t, const uint8_t *positions) {
 }
 
 void BindingsTable::addRawTuple(Term_t *r) {
+    std::unique_lock<std::mutex> guard = lock();
     if (nPosToCopy == 0) {
         insertIfNotExists(EMPTY_TUPLE);
     } else {
@@ -168,8 +275,31 @@ void BindingsTable::addRawTuple(Term_t *r) {
     }
 }
 
+size_t BindingsTable::addRawTuples(const Term_t *rows, const size_t nrows,
+        size_t &firstNew) {
+    std::unique_lock<std::mutex> guard = lock();
+    firstNew = ntuples;
+    size_t added = 0;
+    for (size_t i = 0; i < nrows; ++i) {
+        if (nPosToCopy == 0) {
+            added += insertIfNotExists(EMPTY_TUPLE);
+        } else {
+            const Term_t *r = rows + i * nPosToCopy;
+            for (int j = 0; j < nPosToCopy; ++j) {
+                currentRow[j] = r[j];
+            }
+            added += insertIfNotExists(currentRow);
+        }
+    }
+    return added;
+}
+
 void BindingsTable::clear() {
-    uniqueElements.clear();
+    std::unique_lock<std::mutex> guard = lock();
+    ntuples = 0;
+    std::fill(slots.begin(), slots.end(), 0);
+    hashes.clear();
+    projections.clear();
     if (nPosToCopy > 0) {
         rawBindings->clear();
         currentRow = rawBindings->newRow();
@@ -177,8 +307,10 @@ void BindingsTable::clear() {
 }
 
 TupleTable *BindingsTable::sortBy(std::vector<uint8_t> &fields) {
+    std::unique_lock<std::mutex> guard = lock();
     std::vector<BindingsRow> rowsToSort;
-    for (size_t i = 0; i < uniqueElements.size(); ++i) {
+    const size_t n = ntuples;
+    for (size_t i = 0; i < n; ++i) {
         BindingsRow row((uint8_t) nPosToCopy, rawBindings->getOffset(i * nPosToCopy));
         rowsToSort.push_back(row);
     }
@@ -194,8 +326,32 @@ TupleTable *BindingsTable::sortBy(std::vector<uint8_t> &fields) {
     return outputTable;
 }
 
+typedef std::unordered_set<std::vector<Term_t>, hash_Terms> FilterSet;
+
+//Returns true if the projection of row on posToFilter is in filterSet
+static bool matchesFilter(const Term_t *row,
+        const std::vector<uint8_t> &posToFilter,
+        const FilterSet &filterSet, std::vector<Term_t> &key) {
+    key.clear();
+    for (auto p : posToFilter) {
+        key.push_back(row[p]);
+    }
+    return filterSet.count(key) != 0;
+}
+
+static void fillFilterSet(const std::vector<uint8_t> *posToFilter,
+        const std::vector<Term_t> *valuesToFilter, FilterSet &filterSet) {
+    const size_t sizePosToFilter = posToFilter->size();
+    for (size_t j = 0; j + sizePosToFilter <= valuesToFilter->size();
+            j += sizePosToFilter) {
+        filterSet.insert(std::vector<Term_t>(valuesToFilter->begin() + j,
+                    valuesToFilter->begin() + j + sizePosToFilter));
+    }
+}
+
 TupleTable *BindingsTable::projectAndFilter(const Literal &l, const std::vector<uint8_t> *posToFilter,
         const std::vector<Term_t> *valuesToFilter) {
+    std::unique_lock<std::mutex> guard = lock();
     uint8_t vars[256];
     uint8_t consts[256];
     uint8_t nconsts = 0;
@@ -209,11 +365,17 @@ TupleTable *BindingsTable::projectAndFilter(const Literal &l, const std::vector<
             consts[nconsts++] = i;
         }
     }
+    //The rows must contain one of the tuples of values
+    const bool shouldFilter = posToFilter != NULL && posToFilter->size() != 0;
+    FilterSet filterSet;
+    std::vector<Term_t> key;
+    if (shouldFilter) {
+        fillFilterSet(posToFilter, valuesToFilter, filterSet);
+    }
+
     TupleTable *output = new TupleTable(nvars);
-#if DEBUG
-    bool warn_done = false;
-#endif
-    for (size_t i = 0; i < uniqueElements.size(); ++i) {
+    const size_t n = ntuples;
+    for (size_t i = 0; i < n; ++i) {
         Term_t *row = rawBindings->getOffset(i * nPosToCopy);
         bool ok = true;
         for (uint8_t j = 0; j < nconsts; ++j) {
@@ -224,35 +386,8 @@ TupleTable *BindingsTable::projectAndFilter(const Literal &l, const std::vector<
         }
 
         //check the variables
-        if (ok && posToFilter != NULL && posToFilter->size() != 0) {
-            ok = false;
-            const size_t sizePosToFilter = posToFilter->size();
-            const size_t sizeValuesToFilter = valuesToFilter->size();
-            std::unique_ptr<uint8_t> copyPosToFilter = std::unique_ptr<uint8_t>(new uint8_t[sizePosToFilter]);
-
-#if DEBUG
-	    if (! warn_done) {
-		LOG(DEBUGL) << "Performing linear search (bindingsTable::projectAndFilter). Perhaps this should be optimized";
-		LOG(DEBUGL) << "size = " << sizeValuesToFilter / sizePosToFilter;
-		warn_done = true;
-	    }
-#endif
-            for (uint8_t m = 0; m < sizePosToFilter; ++m) {
-                copyPosToFilter.get()[m] = posToFilter->at(m);
-            }
-
-            for (size_t j = 0; j < sizeValuesToFilter && !ok; j += sizePosToFilter) {
-                bool okRow = true;
-                for (uint8_t m = 0; m < sizePosToFilter; ++m) {
-                    if (row[copyPosToFilter.get()[m]] != valuesToFilter->at(j + m)) {
-                        okRow = false;
-                        break;
-                    }
-                }
-                if (okRow) {
-                    ok = true;
-                }
-            }
+        if (ok && shouldFilter) {
+            ok = matchesFilter(row, *posToFilter, filterSet, key);
         }
 
         if (ok) {
@@ -266,6 +401,7 @@ TupleTable *BindingsTable::projectAndFilter(const Literal &l, const std::vector<
 
 TupleTable *BindingsTable::filter(const Literal &l, const std::vector<uint8_t> *posToFilter,
                                   const std::vector<Term_t> *valuesToFilter) {
+    std::unique_lock<std::mutex> guard = lock();
 
     Term_t consts[256];
     uint8_t posConsts[256];
@@ -277,20 +413,17 @@ TupleTable *BindingsTable::filter(const Literal &l, const std::vector<uint8_t> *
         }
     }
 
-    std::unique_ptr<std::unordered_set<Term_t>> filterSet;
-    if (valuesToFilter != NULL && posToFilter->size() == 1) {
-        filterSet = std::unique_ptr<std::unordered_set<Term_t>>(new std::unordered_set<Term_t>());
-        for (std::vector<Term_t>::const_iterator itr = valuesToFilter->begin();
-                itr != valuesToFilter->end(); ++itr) {
-            filterSet->insert(*itr);
-        }
+    //The rows must contain one of the tuples of values
+    const bool shouldFilter = posToFilter != NULL && posToFilter->size() != 0;
+    FilterSet filterSet;
+    std::vector<Term_t> key;
+    if (shouldFilter) {
+        fillFilterSet(posToFilter, valuesToFilter, filterSet);
     }
 
     TupleTable *output = new TupleTable(nPosToCopy);
-#if DEBUG
-    bool warn_done = false;
-#endif
-    for (size_t i = 0; i < uniqueElements.size(); ++i) {
+    const size_t n = ntuples;
+    for (size_t i = 0; i < n; ++i) {
         Term_t *row = rawBindings->getOffset(i * nPosToCopy);
 
         bool ok = true;
@@ -301,33 +434,8 @@ TupleTable *BindingsTable::filter(const Literal &l, const std::vector<uint8_t> *
             }
         }
 
-        if (ok && posToFilter != NULL && posToFilter->size() != 0) {
-            if (filterSet != NULL) {
-                ok = filterSet->find(row[posToFilter->at(0)]) != filterSet->end();
-            } else {
-                //linear search
-                ok = false;
-#if DEBUG
-		if (! warn_done) {
-		    LOG(DEBUGL) << "Performing linear search (bindingsTable::asTupleTable). Perhaps this should be optimized";
-		    LOG(DEBUGL) << "size = " << valuesToFilter->size() / posToFilter->size();
-		    warn_done = true;
-		}
-#endif
-                const uint8_t sizePosToFilter = (uint8_t) posToFilter->size();
-                for (size_t j = 0; j < valuesToFilter->size() && !ok; j += sizePosToFilter) {
-                    bool okRow = true;
-                    for (uint8_t m = 0; m < posToFilter->size(); ++m) {
-                        if (row[posToFilter->at(m)] != valuesToFilter->at(j + m)) {
-                            okRow = false;
-                            break;
-                        }
-                    }
-                    if (okRow) {
-                        ok = true;
-                    }
-                }
-            }
+        if (ok && shouldFilter) {
+            ok = matchesFilter(row, *posToFilter, filterSet, key);
         }
 
         if (ok) {
@@ -347,7 +455,8 @@ TupleTable *BindingsTable::filter(const Literal &l, const std::vector<uint8_t> *
 }
 
 std::vector<Term_t> BindingsTable::getProjection(std::vector<uint8_t> pos) {
-    size_t size = uniqueElements.size();
+    std::unique_lock<std::mutex> guard = lock();
+    size_t size = ntuples;
     std::vector<Term_t> outputVector;
     for (int i = 0; i < size; ++i) {
         Term_t *startTuple = rawBindings->getOffset(i * nPosToCopy);
@@ -361,7 +470,8 @@ std::vector<Term_t> BindingsTable::getProjection(std::vector<uint8_t> pos) {
 }
 
 std::vector<Term_t> BindingsTable::getUniqueSortedProjection(std::vector<uint8_t> pos) {
-    size_t size = uniqueElements.size();
+    std::unique_lock<std::mutex> guard = lock();
+    size_t size = ntuples;
     std::vector<Term_t> outputVector;
 
     if (pos.size() == 1) {
@@ -413,11 +523,12 @@ const Term_t *BindingsTable::getTuple(size_t idx) {
 }
 
 size_t BindingsTable::getNTuples() {
-    return uniqueElements.size();
+    return ntuples;
 }
 
 void BindingsTable::print() {
-    size_t size = uniqueElements.size();
+    std::unique_lock<std::mutex> guard = lock();
+    size_t size = ntuples;
     for (int i = 0; i < size; ++i) {
         Term_t *startTuple = rawBindings->getOffset(i * nPosToCopy);
         for (int j = 0; j < nPosToCopy; ++j)
@@ -428,12 +539,8 @@ void BindingsTable::print() {
 
 #ifdef DEBUG
 void BindingsTable::statistics() {
-    /*
-    size_t nbuckets = uniqueElements.bucket_count();
-    for (size_t i = 0; i < nbuckets; i++) {
-	LOG(DEBUGL) << "Size bucket " << i << ": " << uniqueElements.bucket_size(i);
-    }
-    */
+    LOG(DEBUGL) << "Rows: " << ntuples << ", slots: " << slots.size()
+        << ", indices: " << projections.size();
 }
 #endif
 
@@ -0,0 +1,173 @@
+#include <vlog/bufferedwriter.h>
+
+#include <kognac/logs.h>
+
+#include <zlib.h>
+#ifdef ZSTD
+#include <zstd.h>
+#endif
+
+//Compresses the content of the buffer before it is written
+struct BufferedWriter::Compressor {
+    const ExportCompression type;
+    std::vector<char> out;
+    z_stream gz;
+#ifdef ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+
+    Compressor(const ExportCompression type) : type(type), out(1 << 20) {
+        if (type == COMPR_GZIP) {
+            memset(&gz, 0, sizeof(gz));
+            //15 + 16: window of 32KB and gzip header
+            if (deflateInit2(&gz, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16,
+                        8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                LOG(ERRORL) << "Could not initialize gzip";
+                throw 10;
+            }
+        } else {
+#ifdef ZSTD
+            zstd = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(zstd, ZSTD_c_compressionLevel, 3);
+#endif
+        }
+    }
+
+    void compress(const char *data, const size_t len, const bool end,
+            FILE *file) {
+        if (type == COMPR_GZIP) {
+            gz.next_in = (Bytef*) data;
+            gz.avail_in = (uInt) len;
+            int ret;
+            do {
+                gz.next_out = (Bytef*) out.data();
+                gz.avail_out = (uInt) out.size();
+                ret = deflate(&gz, end ? Z_FINISH : Z_NO_FLUSH);
+                const size_t produced = out.size() - gz.avail_out;
+                if (produced > 0 && fwrite(out.data(), 1, produced, file)
+                        != produced) {
+                    throw std::string("Could not write the compressed data");
+                }
+            } while (gz.avail_in > 0 || (end && ret != Z_STREAM_END));
+        } else {
+#ifdef ZSTD
+            ZSTD_inBuffer input = { data, len, 0 };
+            size_t remaining;
+            do {
+                ZSTD_outBuffer output = { out.data(), out.size(), 0 };
+                remaining = ZSTD_compressStream2(zstd, &output, &input,
+                        end ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(remaining)) {
+                    throw std::string("Could not compress with zstd");
+                }
+                if (output.pos > 0 && fwrite(out.data(), 1, output.pos, file)
+                        != output.pos) {
+                    throw std::string("Could not write the compressed data");
+                }
+            } while (input.pos < input.size || (end && remaining != 0));
+#endif
+        }
+    }
+
+    ~Compressor() {
+        if (type == COMPR_GZIP) {
+            deflateEnd(&gz);
+        } else {
+#ifdef ZSTD
+            ZSTD_freeCCtx(zstd);
+#endif
+        }
+    }
+};
+
+BufferedWriter::BufferedWriter(const std::string &path,
+        const ExportCompression compression, const size_t capacity) :
+    path(path), buffer(capacity), size(0), failed(false) {
+        if (compression != COMPR_NONE) {
+            compressor = std::unique_ptr<Compressor>(
+                    new Compressor(compression));
+        }
+        file = fopen(path.c_str(), "wb");
+        if (file == NULL) {
+            throw("Could not open " + path + " for writing");
+        }
+    }
+
+std::string BufferedWriter::getFileName(const std::string &path,
+        const ExportCompression compression) {
+    if (compression == COMPR_GZIP) {
+        return path + ".gz";
+    } else if (compression == COMPR_ZSTD) {
+        return path + ".zst";
+    }
+    return path;
+}
+
+ExportCompression BufferedWriter::parseCompression(const std::string &name) {
+    if (name == "" || name == "none") {
+        return COMPR_NONE;
+    } else if (name == "gzip") {
+        return COMPR_GZIP;
+    } else if (name == "zstd") {
+#ifdef ZSTD
+        return COMPR_ZSTD;
+#else
+        LOG(ERRORL) << "VLog was compiled without zstd support";
+        throw 10;
+#endif
+    }
+    LOG(ERRORL) << "Compression " << name << " not recognized";
+    throw 10;
+}
+
+void BufferedWriter::flush(const bool end) {
+    if (failed) {
+        throw("Could not write to " + path);
+    }
+    try {
+        if (compressor != NULL) {
+            compressor->compress(buffer.data(), size, end, file);
+        } else if (size > 0 && fwrite(buffer.data(), 1, size, file) != size) {
+            throw("Could not write to " + path);
+        }
+    } catch (...) {
+        failed = true;
+        size = 0;
+        throw;
+    }
+    size = 0;
+}
+
+void BufferedWriter::close() {
+    if (file != NULL) {
+        //The file is closed also if the last flush fails
+        try {
+            flush(true);
+        } catch (...) {
+            fclose(file);
+            file = NULL;
+            throw;
+        }
+        if (fclose(file) != 0) {
+            file = NULL;
+            throw("Could not close " + path);
+        }
+        file = NULL;
+    }
+}
+
+BufferedWriter::~BufferedWriter() {
+    if (file != NULL && failed) {
+        //The error was already reported to the writer
+        fclose(file);
+        file = NULL;
+    } else if (file != NULL) {
+        try {
+            close();
+        } catch (std::string &e) {
+            LOG(ERRORL) << e;
+        } catch (...) {
+            LOG(ERRORL) << "Could not close " << path;
+        }
+    }
+}
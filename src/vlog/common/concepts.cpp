@@ -6,6 +6,7 @@
 
 #include <kognac/consts.h>
 
+#include <atomic>
 #include <cctype>
 #include <set>
 #include <map>
@@ -800,14 +801,21 @@ const std::vector<uint32_t> &Program::getRulesIDsByPredicate(PredId_t predid) co
     return rules[predid];
 }
 
+static uint64_t nextProgramGeneration() {
+    static std::atomic<uint64_t> counter(0);
+    return ++counter;
+}
+
 Program::Program(EDBLayer *kb) : kb(kb),
     rewriteCounter(0),
+    generation(nextProgramGeneration()),
     dictPredicates(kb->getPredDictionary()),
     cardPredicates(kb->getPredicateCardUnorderedMap()) {
     }
 
 Program::Program(Program *p, EDBLayer *kb) : kb(kb),
     rewriteCounter(0),
+    generation(nextProgramGeneration()),
     dictPredicates(p->dictPredicates),
     cardPredicates(p->cardPredicates) {
     }
@@ -1105,6 +1113,7 @@ std::shared_ptr<Program> Program::cloneNew() const {
 void Program::cleanAllRules() {
     rules.clear();
     allrules.clear();
+    generation = nextProgramGeneration();
 }
 
 void Program::addRule(Rule &rule) {
@@ -1116,6 +1125,7 @@ void Program::addRule(Rule &rule) {
         rules[head.getPredicate().getId()].push_back(allrules.size());
     }
     allrules.push_back(rule);
+    generation = nextProgramGeneration();
 }
 
 void Program::addRule(std::vector<Literal> heads, std::vector<Literal> body, bool rewriteMultihead) {
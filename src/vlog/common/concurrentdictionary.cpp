@@ -0,0 +1,185 @@
+#include <vlog/concurrentdictionary.h>
+
+#include <kognac/logs.h>
+
+#include <algorithm>
+#include <cstdint>
+
+ConcurrentDictionary::ConcurrentDictionary(uint64_t startingCounter) :
+    startCounter(startingCounter), counter(startingCounter) {
+    for (size_t i = 0; i < REVERSE_NBLOCKS; ++i) {
+        reverse[i].store(NULL);
+    }
+}
+
+//MurmurHash64A
+uint64_t ConcurrentDictionary::hashText(const char *text, const size_t len) {
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    uint64_t h = 0x8445d61a4e774912ull ^ (len * m);
+    const char *end = text + (len & ~(size_t)7);
+    while (text != end) {
+        uint64_t k;
+        memcpy(&k, text, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+        text += 8;
+    }
+    if (len & 7) {
+        uint64_t k = 0;
+        memcpy(&k, text, len & 7);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+ConcurrentDictionary::StringRef ConcurrentDictionary::getKey(const char *text,
+        const size_t len, size_t &shard) {
+    if (len > UINT32_MAX) {
+        LOG(ERRORL) << "Term too long for the dictionary";
+        throw 10;
+    }
+    const uint64_t h = hashText(text, len);
+    //The map uses the lower bits, the shard is selected with the upper ones
+    shard = (size_t) (h >> 58) % NSHARDS;
+    StringRef key;
+    key.text = text;
+    key.len = (uint32_t) len;
+    key.hash = (uint32_t) h;
+    return key;
+}
+
+const char *ConcurrentDictionary::store(Shard &shard, const char *text,
+        const size_t len) {
+    const size_t needed = len + sizeof(uint32_t);
+    if (needed > shard.arenaLeft) {
+        const size_t blockSize = std::max(needed, ARENA_BLOCK_SIZE);
+        shard.arenaPos = new char[blockSize];
+        shard.arenaLeft = blockSize;
+        shard.arena.push_back(shard.arenaPos);
+    }
+    char *record = shard.arenaPos;
+    const uint32_t l = (uint32_t) len;
+    memcpy(record, &l, sizeof(uint32_t));
+    memcpy(record + sizeof(uint32_t), text, len);
+    shard.arenaPos += needed;
+    shard.arenaLeft -= needed;
+    return record;
+}
+
+void ConcurrentDictionary::setRawText(const uint64_t id, const char *record) {
+    const uint64_t idx = id - startCounter;
+    const size_t block = idx / REVERSE_BLOCK_SIZE;
+    if (block >= REVERSE_NBLOCKS) {
+        LOG(ERRORL) << "Too many terms in the dictionary";
+        throw 10;
+    }
+    ReverseEntry *entries = reverse[block].load(std::memory_order_acquire);
+    if (entries == NULL) {
+        std::lock_guard<std::mutex> lock(reverseMutex);
+        entries = reverse[block].load(std::memory_order_acquire);
+        if (entries == NULL) {
+            entries = new ReverseEntry[REVERSE_BLOCK_SIZE];
+            for (size_t i = 0; i < REVERSE_BLOCK_SIZE; ++i) {
+                entries[i].store(NULL, std::memory_order_relaxed);
+            }
+            reverse[block].store(entries, std::memory_order_release);
+        }
+    }
+    entries[idx % REVERSE_BLOCK_SIZE].store(record, std::memory_order_release);
+}
+
+const char *ConcurrentDictionary::getRecord(const uint64_t id) const {
+    //An ID below the counter can still be without text if getOrAdd has
+    //not returned it yet: the entry is then NULL
+    if (id < startCounter || id >= counter.load(std::memory_order_acquire)) {
+        return NULL;
+    }
+    const uint64_t idx = id - startCounter;
+    const size_t block = idx / REVERSE_BLOCK_SIZE;
+    if (block >= REVERSE_NBLOCKS) {
+        return NULL;
+    }
+    ReverseEntry *entries = reverse[block].load(std::memory_order_acquire);
+    if (entries == NULL) {
+        return NULL;
+    }
+    return entries[idx % REVERSE_BLOCK_SIZE].load(std::memory_order_acquire);
+}
+
+bool ConcurrentDictionary::get(const char *text, const size_t len,
+        uint64_t &id) {
+    size_t s;
+    const StringRef key = getKey(text, len, s);
+    Shard &shard = shards[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ShardMap::iterator itr = shard.map.find(key);
+    if (itr == shard.map.end()) {
+        return false;
+    }
+    id = itr->second;
+    return true;
+}
+
+uint64_t ConcurrentDictionary::getOrAdd(const char *text, const size_t len) {
+    size_t s;
+    StringRef key = getKey(text, len, s);
+    Shard &shard = shards[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ShardMap::iterator itr = shard.map.find(key);
+    if (itr != shard.map.end()) {
+        return itr->second;
+    }
+    //Add value. The text is stored (with release ordering) before the ID
+    //is inserted in the map or returned, so whoever gets the ID can also
+    //read its text.
+    const char *record = store(shard, text, len);
+    key.text = record + sizeof(uint32_t);
+    const uint64_t id = counter.fetch_add(1);
+    setRawText(id, record);
+    shard.map.insert(std::make_pair(key, id));
+    return id;
+}
+
+bool ConcurrentDictionary::getText(const uint64_t id, char *text) const {
+    const char *record = getRecord(id);
+    if (record == NULL) {
+        return false;
+    }
+    uint32_t len;
+    memcpy(&len, record, sizeof(uint32_t));
+    memcpy(text, record + sizeof(uint32_t), len);
+    text[len] = '\0';
+    return true;
+}
+
+std::string ConcurrentDictionary::getRawValue(const uint64_t id) const {
+    const char *record = getRecord(id);
+    if (record == NULL) {
+        return std::string("");
+    }
+    uint32_t len;
+    memcpy(&len, record, sizeof(uint32_t));
+    return std::string(record + sizeof(uint32_t), len);
+}
+
+ConcurrentDictionary::~ConcurrentDictionary() {
+    for (size_t i = 0; i < REVERSE_NBLOCKS; ++i) {
+        ReverseEntry *entries = reverse[i].load();
+        if (entries != NULL) {
+            delete[] entries;
+        }
+    }
+    for (size_t i = 0; i < NSHARDS; ++i) {
+        for (auto block : shards[i].arena) {
+            delete[] block;
+        }
+    }
+}
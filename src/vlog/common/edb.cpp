@@ -21,13 +21,24 @@
 #endif
 #include <vlog/inmemory/inmemorytable.h>
 
+#include <trident/utils/parallel.h>
+
 #include <unordered_map>
 #include <climits>
 
+//Rows whose terms are looked up by one task when a table is loaded
+#define EDB_LOOKUP_ROWS 65536
+
+uint64_t EDBLayer::nextGeneration() {
+    static std::atomic<uint64_t> counter(0);
+    return ++counter;
+}
 
-EDBLayer::EDBLayer(EDBLayer &db, bool copyTables) {
+EDBLayer::EDBLayer(EDBLayer &db, bool copyTables) :
+    generation(nextGeneration()) {
     this->predDictionary = db.predDictionary;
     this->termsDictionary = db.termsDictionary;
+    this->termsDictionaryPtr = db.termsDictionary.get();
     if (copyTables) {
         this->dbPredicates = db.dbPredicates;
     }
@@ -46,6 +57,7 @@ void EDBLayer::addTridentTable(const EDBConf::Table &tableConf, bool multithread
     infot.type = tableConf.type;
     infot.manager = std::shared_ptr<EDBTable>(new TridentTable(kbpath, multithreaded, this));
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
     LOG(DEBUGL) << "Inserted " << pn << " with number " << infot.id;
 }
 
@@ -60,6 +72,7 @@ void EDBLayer::addMySQLTable(const EDBConf::Table &tableConf) {
                 tableConf.params[1], tableConf.params[2], tableConf.params[3],
                 tableConf.params[4], tableConf.params[5], this));
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
 }
 #endif
 
@@ -74,6 +87,7 @@ void EDBLayer::addODBCTable(const EDBConf::Table &tableConf) {
                 tableConf.params[1], tableConf.params[2], tableConf.params[3],
                 tableConf.params[4], this));
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
 }
 #endif
 
@@ -88,6 +102,7 @@ void EDBLayer::addMAPITable(const EDBConf::Table &tableConf) {
                 (int) strtol(tableConf.params[1].c_str(), NULL, 10), tableConf.params[2], tableConf.params[3],
                 tableConf.params[4], tableConf.params[5], tableConf.params[6], this));
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
 }
 #endif
 
@@ -101,6 +116,7 @@ void EDBLayer::addMDLiteTable(const EDBConf::Table &tableConf) {
     infot.manager = std::shared_ptr<EDBTable>(table);
     infot.arity = table->getArity();
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
 }
 #endif
 
@@ -109,11 +125,15 @@ void EDBLayer::addInmemoryTable(const EDBConf::Table &tableConf) {
     const std::string pn = tableConf.predname;
     infot.id = (PredId_t) predDictionary->getOrAdd(pn);
     infot.type = tableConf.type;
+    //The optional third parameter selects the binary snapshot
+    bool snapshot = tableConf.params.size() > 2 &&
+        tableConf.params[2] == "snapshot";
     InmemoryTable *table = new InmemoryTable(tableConf.params[0],
-            tableConf.params[1], infot.id, this);
+            tableConf.params[1], infot.id, this, snapshot);
     infot.manager = std::shared_ptr<EDBTable>(table);
     infot.arity = table->getArity();
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
 }
 
 void EDBLayer::addInmemoryTable(std::string predicate, std::vector<std::vector<std::string>> &rows) {
@@ -133,9 +153,92 @@ void EDBLayer::addInmemoryTable(std::string predicate, PredId_t id, std::vector<
     infot.arity = table->getArity();
     infot.manager = std::shared_ptr<EDBTable>(table);
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
+    LOG(DEBUGL) << "Added table for " << predicate << ":" << infot.id << ", arity = " << (int) table->getArity() << ", size = " << table->getSize();
+}
+
+
+void EDBLayer::addInmemoryTable(std::string predicate,
+        std::vector<std::vector<Term_t>> &columns) {
+    for (const auto &column : columns) {
+        if (column.size() != columns[0].size()) {
+            throw ("The columns of " + predicate + " have different sizes");
+        }
+    }
+    EDBInfoTable infot;
+    infot.id = (PredId_t) predDictionary->getOrAdd(predicate);
+    if (doesPredExists(infot.id)) {
+        LOG(INFOL) << "Rewriting table for predicate " << predicate;
+        dbPredicates.erase(infot.id);
+    }
+    infot.type = "INMEMORY";
+    InmemoryTable *table = new InmemoryTable(infot.id, columns, this);
+    infot.arity = table->getArity();
+    infot.manager = std::shared_ptr<EDBTable>(table);
+    dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
     LOG(DEBUGL) << "Added table for " << predicate << ":" << infot.id << ", arity = " << (int) table->getArity() << ", size = " << table->getSize();
 }
 
+//Looks up in parallel the terms that were already added to the dictionary
+struct LookupTerms {
+    EDBLayer *layer;
+    const uint8_t arity;
+    const char *text;
+    const int32_t *offsets;
+    const size_t nrows;
+    std::vector<std::vector<Term_t>> &columns;
+    std::vector<char> &found;
+
+    LookupTerms(EDBLayer *layer, const uint8_t arity, const char *text,
+            const int32_t *offsets, const size_t nrows,
+            std::vector<std::vector<Term_t>> &columns,
+            std::vector<char> &found) : layer(layer), arity(arity),
+    text(text), offsets(offsets), nrows(nrows), columns(columns),
+    found(found) {
+    }
+
+    void operator()(const ParallelRange& r) const {
+        const size_t end = std::min(nrows,
+                (size_t) r.end() * EDB_LOOKUP_ROWS);
+        for (size_t row = (size_t) r.begin() * EDB_LOOKUP_ROWS; row < end;
+                ++row) {
+            for (uint8_t j = 0; j < arity; ++j) {
+                const size_t i = row * arity + j;
+                uint64_t id;
+                if (layer->getAddedDictNumber(text + offsets[i],
+                            offsets[i + 1] - offsets[i], id)) {
+                    columns[j][row] = id;
+                    found[i] = 1;
+                }
+            }
+        }
+    }
+};
+
+void EDBLayer::addInmemoryTable(std::string predicate, const uint8_t arity,
+        const char *text, const int32_t *offsets, const size_t nrows) {
+    std::vector<std::vector<Term_t>> columns(arity);
+    for (auto &column : columns) {
+        column.resize(nrows);
+    }
+    std::vector<char> found(nrows * arity);
+    ParallelTasks::parallel_for(0,
+            (nrows + EDB_LOOKUP_ROWS - 1) / EDB_LOOKUP_ROWS, 1,
+            LookupTerms(this, arity, text, offsets, nrows, columns, found));
+    //The new terms are added in order of appearance, so they get the same
+    //IDs as when they are added one row at a time
+    for (size_t i = 0; i < found.size(); ++i) {
+        if (!found[i]) {
+            uint64_t id;
+            getOrAddDictNumber(text + offsets[i], offsets[i + 1] - offsets[i],
+                    id);
+            columns[i % arity][i / arity] = id;
+        }
+    }
+    std::vector<char>().swap(found);
+    addInmemoryTable(predicate, columns);
+}
 
 void EDBLayer::addInmemoryTable(PredId_t id,
         uint8_t arity,
@@ -151,6 +254,12 @@ void EDBLayer::addInmemoryTable(PredId_t id,
     infot.arity = table->getArity();
     infot.manager = std::shared_ptr<EDBTable>(table);
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
+}
+
+void EDBLayer::removeTable(PredId_t id) {
+    dbPredicates.erase(id);
+    generation = nextGeneration();
 }
 
 #ifdef SPARQL
@@ -167,6 +276,7 @@ void EDBLayer::addSparqlTable(const EDBConf::Table &tableConf) {
     infot.arity = table->getArity();
     infot.manager = std::shared_ptr<EDBTable>(table);
     dbPredicates.insert(make_pair(infot.id, infot));
+    generation = nextGeneration();
 }
 #endif
 
@@ -860,13 +970,35 @@ bool EDBLayer::getDictNumber(const char *text, const size_t sizeText, uint64_t &
         resp = dbPredicates.begin()->second.manager->
             getDictNumber(text, sizeText, id);
     }
-    if (!resp && termsDictionary.get()) {
-        std::string t(text, sizeText);
-        resp = termsDictionary->get(t, id);
+    ConcurrentDictionary *dict = termsDictionaryPtr.load();
+    if (!resp && dict != NULL) {
+        resp = dict->get(text, sizeText, id);
     }
     return resp;
 }
 
+bool EDBLayer::getAddedDictNumber(const char *text, const size_t sizeText,
+        uint64_t &id) {
+    ConcurrentDictionary *dict = termsDictionaryPtr.load();
+    return dict != NULL && dict->get(text, sizeText, id);
+}
+
+ConcurrentDictionary *EDBLayer::getOrCreateTermsDictionary() {
+    ConcurrentDictionary *dict = termsDictionaryPtr.load();
+    if (dict == NULL) {
+        std::lock_guard<std::mutex> lock(termsDictionaryMutex);
+        dict = termsDictionaryPtr.load();
+        if (dict == NULL) {
+            LOG(DEBUGL) << "The additional terms will start from " << getNTerms();
+            termsDictionary = std::shared_ptr<ConcurrentDictionary>(
+                    new ConcurrentDictionary(getNTerms()));
+            dict = termsDictionary.get();
+            termsDictionaryPtr.store(dict);
+        }
+    }
+    return dict;
+}
+
 bool EDBLayer::getOrAddDictNumber(const char *text, const size_t sizeText,
         uint64_t &id) {
     bool resp = false;
@@ -875,14 +1007,10 @@ bool EDBLayer::getOrAddDictNumber(const char *text, const size_t sizeText,
             getDictNumber(text, sizeText, id);
     }
     if (!resp) {
-        if (!termsDictionary.get()) {
-            LOG(DEBUGL) << "The additional terms will start from " << getNTerms();
-            termsDictionary = std::shared_ptr<Dictionary>(
-                    new Dictionary(getNTerms()));
-        }
-        std::string t(text, sizeText);
-        id = termsDictionary->getOrAdd(t);
-        LOG(TRACEL) << "getOrAddDictNumber \"" << t << "\" returns " << id;
+        ConcurrentDictionary *dict = getOrCreateTermsDictionary();
+        id = dict->getOrAdd(text, sizeText);
+        LOG(TRACEL) << "getOrAddDictNumber \"" << std::string(text, sizeText)
+            << "\" returns " << id;
         resp = true;
     }
     return resp;
@@ -893,13 +1021,9 @@ bool EDBLayer::getDictText(const uint64_t id, char *text) {
     if (dbPredicates.size() > 0) {
         resp = dbPredicates.begin()->second.manager->getDictText(id, text);
     }
-    if (!resp && termsDictionary.get()) {
-        std::string t = termsDictionary->getRawValue(id);
-        if (t != "") {
-            memcpy(text, t.c_str(), t.size());
-            text[t.size()] = '\0';
-            return true;
-        }
+    ConcurrentDictionary *dict = termsDictionaryPtr.load();
+    if (!resp && dict != NULL) {
+        resp = dict->getText(id, text);
     }
     return resp;
 }
@@ -910,8 +1034,9 @@ std::string EDBLayer::getDictText(const uint64_t id) {
     if (dbPredicates.size() > 0) {
         resp = dbPredicates.begin()->second.manager->getDictText(id, t);
     }
-    if (!resp && termsDictionary.get()) {
-        t = termsDictionary->getRawValue(id);
+    ConcurrentDictionary *dict = termsDictionaryPtr.load();
+    if (!resp && dict != NULL) {
+        t = dict->getRawValue(id);
     }
     return t;
 }
@@ -921,8 +1046,9 @@ uint64_t EDBLayer::getNTerms() {
     if (dbPredicates.size() > 0) {
         size = dbPredicates.begin()->second.manager->getNTerms();
     }
-    if (termsDictionary.get()) {
-        size += termsDictionary->size();
+    ConcurrentDictionary *dict = termsDictionaryPtr.load();
+    if (dict != NULL) {
+        size += dict->size();
     }
     return size;
 }
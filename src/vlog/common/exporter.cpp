@@ -1,26 +1,29 @@
 #include <vlog/exporter.h>
 #include <vlog/seminaiver.h>
 #include <vlog/trident/tridenttable.h>
+#include <vlog/utils.h>
 
 #include <kognac/utils.h>
 #include <trident/tree/root.h>
 #include <trident/kb/kbconfig.h>
 #include <trident/kb/updater.h>
+#include <trident/utils/parallel.h>
+
+#include <zlib.h>
 
 #include <inttypes.h>
 #include <vector>
 #include <fstream>
-#include <zstr/zstr.hpp>
+#include <cstring>
+#include <algorithm>
+#include <functional>
 
 struct AggrIndex {
     uint64_t first, second;
     size_t begin, end;
 };
 
-void Exporter::extractTriples(std::vector <uint64_t> &all_s,
-        std::vector <uint64_t> &all_p,
-        std::vector <uint64_t> &all_o) {
-
+std::vector<_EDBPredicates> Exporter::getPredicatesToExtract() {
     //Get all rules that define IDB predicates from the standard EDB ternary triple
     //e.g. P1(a,b) :- TE(a, rdf:type, b)
     PredId_t edbpred = sn->getEDBLayer().getFirstEDBPredicate();
@@ -60,6 +63,13 @@ void Exporter::extractTriples(std::vector <uint64_t> &all_s,
         }
         ruleid++;
     }
+    return predicatesToExtract;
+}
+
+void Exporter::extractTriples(std::vector <uint64_t> &all_s,
+        std::vector <uint64_t> &all_p,
+        std::vector <uint64_t> &all_o) {
+    std::vector<_EDBPredicates> predicatesToExtract = getPredicatesToExtract();
 
     //How many tuples should I store?
     long count = 0;
@@ -400,57 +410,402 @@ void Exporter::generateTridentDiffIndex(std::string outputdir) {
     ofs.close();
 }
 
-void Exporter::generateNTTriples(std::string outputdir, bool decompress) {
-    std::vector<uint64_t> all_s;
-    std::vector<uint64_t> all_p;
-    std::vector<uint64_t> all_o;
-    extractTriples(all_s, all_p, all_o);
+//True if the values of the column can be read from any position in
+//constant time. getValue of a CompressedColumn scans its blocks.
+static bool canSeek(const Column *column) {
+    return column->supportsDirectAccess() &&
+        dynamic_cast<const CompressedColumn*>(column) == NULL;
+}
 
-    LOG(INFOL) << "Exporting the materialization in N-Triples format ...";
-    EDBLayer &edb = sn->getEDBLayer();
+std::vector<std::vector<Exporter::NTSegment>> Exporter::getNTShards(
+        const std::vector<_EDBPredicates> &predicatesToExtract,
+        size_t &ntriples) {
+    //The triples are numbered in the order of the predicates, then of
+    //their tables, and every shard gets the next NT_SHARD_TRIPLES triples.
+    //A table is split among several shards only if its columns can be read
+    //from any row (see writeNTShard). Otherwise it is written whole in one
+    //shard, which becomes larger.
+    std::vector<std::vector<NTSegment>> shards;
+    ntriples = 0;
+    size_t inShard = NT_SHARD_TRIPLES; //Triples in the last shard
+    for (size_t idx = 0; idx < predicatesToExtract.size(); ++idx) {
+        const _EDBPredicates &pred = predicatesToExtract[idx];
+        FCIterator tableItr = sn->getTable(pred.id);
+        bool isFirst = true;
+        while (!tableItr.isEmpty()) {
+            std::shared_ptr<const FCInternalTable> intTable = tableItr.getCurrentTable();
+            const size_t nrows = intTable->getNRows();
+            if (isFirst) {
+                isFirst = false;
+                if (tableItr.getCurrentBlock()->rule->ruleid == pred.ruleid) {
+                    //Skip the first table since they are all duplicates
+                    tableItr.moveNextCount();
+                    continue;
+                }
+            }
+            bool splittable = true;
+            for (uint8_t i = 0; i < pred.nPosToCopy; ++i) {
+                splittable &= canSeek(intTable->getColumn(i).get());
+            }
+            size_t begin = 0;
+            while (begin < nrows) {
+                if (inShard >= NT_SHARD_TRIPLES) {
+                    shards.push_back(std::vector<NTSegment>());
+                    inShard = 0;
+                }
+                NTSegment segment;
+                segment.pred = idx;
+                segment.table = intTable;
+                segment.begin = begin;
+                segment.end = splittable ? std::min(nrows, begin +
+                        NT_SHARD_TRIPLES - inShard) : nrows;
+                shards.back().push_back(segment);
+                ntriples += segment.end - segment.begin;
+                inShard += segment.end - segment.begin;
+                begin = segment.end;
+            }
+            tableItr.moveNextCount();
+        }
+    }
+    return shards;
+}
 
-    //Store the raw dataset in a text file for debug purposes
-    Utils::create_directories(outputdir);
-    std::unique_ptr<zstr::ofstream> out;
+//Writes a chunk of triples. If decompress is set, the distinct terms are
+//decoded only once, in sorted order.
+static void writeNTChunk(EDBLayer &edb, BufferedWriter &out,
+        const std::vector<uint64_t> &triples, const bool decompress,
+        std::vector<uint64_t> &ids, std::string &texts,
+        std::vector<size_t> &offsets) {
+    const size_t ntriples = triples.size() / 3;
+    if (! decompress) {
+        for (size_t i = 0; i < ntriples; ++i) {
+            out.writeNumber(triples[3 * i]);
+            out.put(' ');
+            out.writeNumber(triples[3 * i + 1]);
+            out.put(' ');
+            out.writeNumber(triples[3 * i + 2]);
+            out.put('\n');
+        }
+        return;
+    }
 
+    ids = triples;
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    texts.clear();
+    offsets.clear();
     char supportBuffer[MAX_TERM_SIZE];
-    size_t idx = 0;
-    for (int i = 0; i < all_s.size(); ++i) {
-        if (i % 10000000 == 0) {
-            if (i > 0) {
-                LOG(INFOL) << "So far exported " << i << " triples ...";
+    //The shards are written in parallel, but the terms are looked up by one
+    //thread at a time
+    std::mutex &dictMutex = edb.getDictTextMutex();
+    for (auto v : ids) {
+        offsets.push_back(texts.size());
+        bool known;
+        {
+            std::lock_guard<std::mutex> lock(dictMutex);
+            known = edb.getDictText(v, supportBuffer);
+        }
+        if (known) {
+            texts += supportBuffer;
+        } else {
+            texts += std::to_string(v);
+        }
+    }
+    offsets.push_back(texts.size());
+    for (size_t i = 0; i < triples.size(); ++i) {
+        const size_t idx = std::lower_bound(ids.begin(), ids.end(),
+                triples[i]) - ids.begin();
+        out.write(texts.c_str() + offsets[idx], offsets[idx + 1] -
+                offsets[idx]);
+        out.put(' ');
+        if (i % 3 == 2) {
+            out.write(".\n", 2);
+        }
+    }
+}
+
+void Exporter::writeNTShard(const std::string &filename,
+        const std::vector<_EDBPredicates> &predicatesToExtract,
+        const std::vector<NTSegment> &segments, const bool decompress,
+        const ExportCompression compression) {
+    BufferedWriter out(filename, compression);
+    EDBLayer &edb = sn->getEDBLayer();
+    std::vector<uint64_t> triples;
+    std::vector<uint64_t> ids;
+    std::string texts;
+    std::vector<size_t> offsets;
+    for (const auto &segment : segments) {
+        const _EDBPredicates &pred = predicatesToExtract[segment.pred];
+        //Readers of the positions that are not constant. A segment that
+        //does not start at the beginning of its table is read with getValue
+        //instead (getNTShards splits only tables that allow it).
+        const bool seek = segment.begin > 0;
+        std::unique_ptr<ColumnReader> readers[3];
+        std::shared_ptr<Column> columns[3];
+        uint8_t currentPosToCopy = 0;
+        for (int i = 0; i < 3; ++i) {
+            if (currentPosToCopy < pred.nPosToCopy &&
+                    pred.posToCopy[currentPosToCopy] == i) {
+                columns[i] = segment.table->getColumn(currentPosToCopy);
+                if (!seek) {
+                    readers[i] = columns[i]->getReader();
+                }
+                currentPosToCopy++;
+            }
+        }
+
+        size_t row = segment.begin;
+        while (row < segment.end) {
+            const size_t n = std::min(segment.end - row,
+                    (size_t) NT_CHUNK_TRIPLES);
+            triples.resize(3 * n);
+            for (size_t j = 0; j < n; ++j) {
+                for (int i = 0; i < 3; ++i) {
+                    if (columns[i] == NULL) {
+                        triples[3 * j + i] = pred.triple[i];
+                    } else if (seek) {
+                        triples[3 * j + i] = columns[i]->getValue(row + j);
+                    } else {
+                        if (!readers[i]->hasNext()) {
+                            throw std::string("Column shorter than its table");
+                        }
+                        triples[3 * j + i] = readers[i]->next();
+                    }
+                }
             }
-            //Create the file. Close the previous one
-            std::string filename = outputdir + DIR_SEP + "out-" + to_string(idx++) + ".nt.gz";
+            writeNTChunk(edb, out, triples, decompress, ids, texts, offsets);
+            row += n;
+        }
+    }
+    out.close();
+}
+
+void Exporter::NTShards::operator()(const ParallelRange& r) const {
+    for (size_t k = r.begin(); k < r.end(); ++k) {
+        try {
+            const std::string filename = BufferedWriter::getFileName(outputdir +
+                    DIR_SEP + "out-" + to_string(k) + ".nt", compression);
             LOG(DEBUGL) << "Creating file " << filename;
-            out = std::unique_ptr<zstr::ofstream>(new zstr::ofstream(filename));
+            exporter->writeNTShard(filename, predicatesToExtract, shards[k],
+                    decompress, compression);
+        } catch (std::string &e) {
+            std::lock_guard<std::mutex> lock(*errorMutex);
+            if (error->empty()) {
+                *error = e;
+            }
+        } catch (...) {
+            //An exception must not leave the worker thread
+            std::lock_guard<std::mutex> lock(*errorMutex);
+            if (error->empty()) {
+                *error = "Error while writing the shard " + to_string(k);
+            }
         }
-        if (decompress) {
-            if (edb.getDictText(all_s[i], supportBuffer)) {
-                *out << supportBuffer << " ";
-            } else {
-                std::string t = std::to_string(all_s[i]);
-                *out << t << " ";
+    }
+}
+
+void Exporter::generateNTTriples(std::string outputdir, bool decompress,
+        ExportCompression compression) {
+    LOG(INFOL) << "Exporting the materialization in N-Triples format ...";
+    Utils::create_directories(outputdir);
+
+    std::vector<_EDBPredicates> predicatesToExtract = getPredicatesToExtract();
+    size_t ntriples;
+    std::vector<std::vector<NTSegment>> shards = getNTShards(
+            predicatesToExtract, ntriples);
+
+    std::string error;
+    std::mutex errorMutex;
+    ParallelTasks::parallel_for(0, shards.size(), 1, NTShards(this,
+                predicatesToExtract, shards, outputdir, decompress,
+                compression, &error, &errorMutex));
+    if (!error.empty()) {
+        throw(error);
+    }
+    LOG(INFOL) << "Exported " << ntriples << " triples in " << shards.size()
+        << " files";
+}
+
+static void writeUInt(BufferedWriter &out, uint64_t v, const int nbytes) {
+    for (int i = 0; i < nbytes; ++i) {
+        out.put((char) (v & 0xff));
+        v >>= 8;
+    }
+}
+
+//Writes a column of a block: its minimum, and the other values as deltas
+//packed in the least number of bits and compressed with zlib
+static void writeColumnBlock(BufferedWriter &out,
+        const std::vector<Term_t> &values, std::vector<Bytef> &packed,
+        std::vector<Bytef> &compressed) {
+    Term_t min = values[0], max = values[0];
+    for (auto v : values) {
+        min = std::min(min, v);
+        max = std::max(max, v);
+    }
+    uint8_t bits = 0;
+    while (bits < 64 && ((max - min) >> bits) != 0) {
+        bits++;
+    }
+    writeUInt(out, min, 8);
+    out.put((char) bits);
+    if (bits == 0) {
+        return;
+    }
+
+    const size_t nwords = (values.size() * bits + 63) / 64;
+    packed.assign(nwords * 8, 0);
+    size_t bitpos = 0;
+    for (auto v : values) {
+        uint64_t delta = v - min;
+        for (uint8_t written = 0; written < bits;) {
+            const size_t byte = bitpos / 8;
+            const uint8_t offset = bitpos % 8;
+            const uint8_t n = std::min(bits - written, 8 - offset);
+            packed[byte] |= (Bytef) ((delta & ((1u << n) - 1)) << offset);
+            delta >>= n;
+            written += n;
+            bitpos += n;
+        }
+    }
+
+    uLongf size = compressBound(packed.size());
+    compressed.resize(size);
+    if (compress2(compressed.data(), &size, packed.data(), packed.size(),
+                Z_DEFAULT_COMPRESSION) != Z_OK) {
+        throw std::string("Could not compress a column");
+    }
+    writeUInt(out, size, 4);
+    out.write((const char*) compressed.data(), size);
+}
+
+void Exporter::writeColumnar(const std::string &filename, const PredId_t pred,
+        std::vector<Term_t> &terms) {
+    BufferedWriter out(filename, COMPR_NONE);
+    const uint8_t arity = sn->getProgram()->getPredicate(pred).getCardinality();
+    out.write("VLOGCOL1", 8);
+    out.put((char) arity);
+    writeUInt(out, sn->getSizeTable(pred), 8);
+
+    std::vector<std::vector<Term_t>> values(arity);
+    std::vector<Bytef> packed, compressed;
+    FCIterator itr = sn->getTable(pred);
+    while (!itr.isEmpty()) {
+        std::shared_ptr<const FCInternalTable> table = itr.getCurrentTable();
+        const size_t iteration = itr.getCurrentIteration();
+        std::vector<std::unique_ptr<ColumnReader>> readers;
+        for (uint8_t i = 0; i < arity; ++i) {
+            readers.push_back(table->getColumn(i)->getReader());
+        }
+        size_t remaining = table->getNRows();
+        while (remaining > 0) {
+            const size_t nrows = std::min(remaining,
+                    (size_t) COLUMNAR_BLOCK_ROWS);
+            writeUInt(out, nrows, 4);
+            writeUInt(out, iteration, 8);
+            for (uint8_t i = 0; i < arity; ++i) {
+                values[i].clear();
+                for (size_t j = 0; j < nrows && readers[i]->hasNext(); ++j) {
+                    values[i].push_back(readers[i]->next());
+                }
+                if (values[i].size() != nrows) {
+                    throw std::string("Column shorter than its table");
+                }
+                writeColumnBlock(out, values[i], packed, compressed);
+                //Remember the distinct terms of the block
+                std::sort(values[i].begin(), values[i].end());
+                values[i].erase(std::unique(values[i].begin(),
+                            values[i].end()), values[i].end());
+                terms.insert(terms.end(), values[i].begin(), values[i].end());
             }
-            if (edb.getDictText(all_p[i], supportBuffer)) {
-                *out << supportBuffer << " ";
-            } else {
-                std::string t = std::to_string(all_p[i]);
-                *out << t << " ";
+            remaining -= nrows;
+        }
+        //Keep the collected terms small
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        itr.moveNextCount();
+    }
+    out.close();
+}
+
+void Exporter::ColumnarPredicates::operator()(const ParallelRange& r) const {
+    for (size_t i = r.begin(); i < r.end(); ++i) {
+        const PredId_t pred = preds[i];
+        try {
+            exporter->writeColumnar(outputdir + DIR_SEP + VLogUtils::fileName(
+                        exporter->sn->getProgram()->getPredicateName(pred)) +
+                    ".vcol", pred, terms[i]);
+        } catch (std::string &e) {
+            std::lock_guard<std::mutex> lock(*errorMutex);
+            if (error->empty()) {
+                *error = e;
             }
-            if (edb.getDictText(all_o[i], supportBuffer)) {
-                *out << supportBuffer << " ." << endl;
-            } else {
-                std::string t = std::to_string(all_o[i]);
-                *out << t << " ." << endl;
+        } catch (...) {
+            //An exception must not leave the worker thread
+            std::lock_guard<std::mutex> lock(*errorMutex);
+            if (error->empty()) {
+                *error = "Error while writing the predicate " +
+                    exporter->sn->getProgram()->getPredicateName(pred);
             }
+        }
+    }
+}
+
+void Exporter::generateColumnar(std::string outputdir) {
+    LOG(INFOL) << "Exporting the materialization in columnar format ...";
+    Utils::create_directories(outputdir);
+
+    std::vector<std::pair<size_t, PredId_t>> sizes;
+    for (PredId_t i = 0; i < sn->getProgram()->getNPredicates(); ++i) {
+        const size_t size = sn->getSizeTable(i);
+        if (size > 0) {
+            sizes.push_back(std::make_pair(size, i));
+        }
+    }
+    std::sort(sizes.begin(), sizes.end(),
+            std::greater<std::pair<size_t, PredId_t>>());
+    std::vector<PredId_t> preds;
+    for (const auto &s : sizes) {
+        preds.push_back(s.second);
+    }
+
+    std::vector<std::vector<Term_t>> terms(preds.size());
+    std::string error;
+    std::mutex errorMutex;
+    ParallelTasks::parallel_for(0, preds.size(), 1, ColumnarPredicates(this,
+                preds, outputdir, terms, &error, &errorMutex));
+    if (!error.empty()) {
+        throw(error);
+    }
+
+    //Shared dictionary of all the predicates
+    std::vector<Term_t> allTerms;
+    for (auto &t : terms) {
+        allTerms.insert(allTerms.end(), t.begin(), t.end());
+        std::vector<Term_t>().swap(t);
+    }
+    std::sort(allTerms.begin(), allTerms.end());
+    allTerms.erase(std::unique(allTerms.begin(), allTerms.end()),
+            allTerms.end());
+
+    EDBLayer &edb = sn->getEDBLayer();
+    BufferedWriter out(outputdir + DIR_SEP + "dictionary.vdict", COMPR_NONE);
+    out.write("VLOGDIC1", 8);
+    writeUInt(out, allTerms.size(), 8);
+    char supportBuffer[MAX_TERM_SIZE];
+    for (auto v : allTerms) {
+        std::string text;
+        if (edb.getDictText(v, supportBuffer)) {
+            text = std::string(supportBuffer);
         } else {
-            *out << all_s[i];
-            *out << " ";
-            *out << all_p[i];
-            *out << " ";
-            *out << all_o[i];
-            *out << endl;
+            text = std::to_string(v >> 40) + "_"
+                + std::to_string((v >> 32) & 0377) + "_"
+                + std::to_string(v & 0xffffffff);
         }
+        writeUInt(out, v, 8);
+        writeUInt(out, text.size(), 4);
+        out.write(text);
     }
+    out.close();
+    LOG(INFOL) << "Exported " << preds.size() << " predicates and " <<
+        allTerms.size() << " terms";
 }
@@ -1,7 +1,72 @@
 #include <vlog/chasemgmt.h>
 
+#include <trident/utils/parallel.h>
+
 //************** ROWS ***************
-uint64_t ChaseMgmt::Rows::addRow(uint64_t* row) {
+static inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t ChaseMgmt::Rows::hash(const std::vector<const Term_t *> &columns,
+        const size_t i) {
+    uint64_t h = columns.size();
+    for (const auto c : columns) {
+        h = mix64(h ^ (c[i] * UINT64_C(0x9e3779b97f4a7c15)));
+    }
+    return h;
+}
+
+bool ChaseMgmt::Rows::existingRow(const uint64_t *row, uint64_t &value) const {
+    //Same hash as the one of the columns
+    uint64_t h = sizerow;
+    for (uint8_t i = 0; i < sizerow; ++i) {
+        h = mix64(h ^ (row[i] * UINT64_C(0x9e3779b97f4a7c15)));
+    }
+    return existingRow(row, h, value);
+}
+
+void ChaseMgmt::Rows::prefetch(const uint64_t hash) const {
+#if defined(__GNUC__)
+    const Shard &shard = getShard(hash);
+    if (!shard.entries.empty()) {
+        __builtin_prefetch(&shard.entries[hash & (shard.entries.size() - 1)]);
+    }
+#endif
+}
+
+bool ChaseMgmt::Rows::sameRow(const uint64_t pos, const uint64_t *row) const {
+    const uint64_t *stored = blocks[pos / SIZE_BLOCK].get() +
+        (pos % SIZE_BLOCK) * sizerow;
+    for (uint8_t i = 0; i < sizerow; ++i) {
+        if (stored[i] != row[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ChaseMgmt::Rows::grow(Shard &shard) {
+    std::vector<std::pair<uint64_t, uint64_t>> old;
+    old.swap(shard.entries);
+    shard.entries.resize(std::max((size_t) 16, old.size() * 2));
+    const uint64_t mask = shard.entries.size() - 1;
+    for (const auto &entry : old) {
+        if (entry.second != 0) {
+            uint64_t slot = entry.first & mask;
+            while (shard.entries[slot].second != 0) {
+                slot = (slot + 1) & mask;
+            }
+            shard.entries[slot] = entry;
+        }
+    }
+}
+
+uint64_t ChaseMgmt::Rows::addRow(const uint64_t *row, const uint64_t hash) {
     // LOG(TRACEL) << "Addrow: " << row[0];
     if (!currentblock || blockCounter >= SIZE_BLOCK) {
         //Create a new block
@@ -15,8 +80,18 @@ uint64_t ChaseMgmt::Rows::addRow(uint64_t* row) {
     for(uint8_t i = 0; i < sizerow; ++i) {
         currentblock[i] = row[i];
     }
-    ChaseRow r(sizerow, currentblock);
-    rows[r] = currentcounter;
+    Shard &shard = shards[hash >> (64 - CHASE_SHARD_BITS)];
+    if ((shard.nrows + 1) * 2 > shard.entries.size()) {
+        grow(shard);
+    }
+    const uint64_t mask = shard.entries.size() - 1;
+    uint64_t slot = hash & mask;
+    while (shard.entries[slot].second != 0) {
+        slot = (slot + 1) & mask;
+    }
+    shard.entries[slot] = std::make_pair(hash, nrows + 1);
+    shard.nrows++;
+    nrows++;
     currentblock += sizerow;
     blockCounter++;
     if (((uint32_t)currentcounter) == UINT32_MAX) {
@@ -38,12 +113,28 @@ uint64_t ChaseMgmt::Rows::addRow(uint64_t* row) {
     return out;
 }
 
-bool ChaseMgmt::Rows::existingRow(uint64_t *row, uint64_t &value) {
-    ChaseRow r(sizerow, row);
-    auto search = rows.find(r);
-    if (search != rows.end()) {
-        value = search->second;
-        return true;
+bool ChaseMgmt::Rows::existingRow(const uint64_t *row, const uint64_t hash,
+        uint64_t &value) const {
+    const Shard &shard = getShard(hash);
+    if (shard.nrows == 0) {
+        return false;
+    }
+    const uint64_t mask = shard.entries.size() - 1;
+    uint64_t slot = hash & mask;
+    while (shard.entries[slot].second != 0) {
+        const auto &entry = shard.entries[slot];
+        if (entry.first == hash && sameRow(entry.second - 1, row)) {
+            //The IDs are assigned in the order in which the rows are added,
+            //except for the SUM chases, which assign the same ID to all rows
+            if (typeChase != TypeChase::SUM_CHASE &&
+                    typeChase != TypeChase::SUM_RESTRICTED_CHASE) {
+                value = startCounter + entry.second - 1;
+            } else {
+                value = startCounter;
+            }
+            return true;
+        }
+        slot = (slot + 1) & mask;
     }
     return false;
 }
@@ -180,52 +271,120 @@ bool ChaseMgmt::checkRecursive(uint64_t rv) {
     return checkRecursive(mask, rv);
 }
 
+//Looks up a range of rows, in batches: the hashes of a batch are computed and
+//their entries prefetched before the rows are searched. Rows that are not
+//found get 0, which is never a valid ID.
+struct ChaseMgmt::LookupRows {
+    const ChaseMgmt::Rows *rows;
+    const std::vector<const Term_t *> &columns;
+    uint64_t *hashes;
+    Term_t *values;
+
+    LookupRows(const ChaseMgmt::Rows *rows,
+            const std::vector<const Term_t *> &columns,
+            uint64_t *hashes, Term_t *values) : rows(rows),
+    columns(columns), hashes(hashes), values(values) {
+    }
+
+    void operator()(const ParallelRange& r) const {
+        uint64_t row[256];
+        for (size_t b = r.begin(); b < r.end(); b += CHASE_BATCH_SIZE) {
+            const size_t e = std::min(r.end(), b + CHASE_BATCH_SIZE);
+            for (size_t i = b; i < e; ++i) {
+                hashes[i] = ChaseMgmt::Rows::hash(columns, i);
+                rows->prefetch(hashes[i]);
+            }
+            for (size_t i = b; i < e; ++i) {
+                for (size_t j = 0; j < columns.size(); ++j) {
+                    row[j] = columns[j][i];
+                }
+                uint64_t value = 0;
+                rows->existingRow(row, hashes[i], value);
+                values[i] = value;
+            }
+        }
+    }
+};
+
 std::shared_ptr<Column> ChaseMgmt::getNewOrExistingIDs(
         uint32_t ruleid,
         uint8_t var,
         std::vector<std::shared_ptr<Column>> &columns,
-        uint64_t sizecolumns) {
+        uint64_t sizecolumns,
+        const int nthreads) {
     assert(sizecolumns > 0);
     auto &ruleContainer = rules[ruleid];
     auto rows = ruleContainer->getRows(var);
     const uint8_t sizerow = rows->getSizeRow();
     assert(sizerow == columns.size());
-    std::vector<Term_t> functerms;
-    uint64_t row[256];
 
-    std::vector<std::unique_ptr<ColumnReader>> readers;
+    //Access the columns directly, without readers
+    std::vector<std::vector<Term_t>> copies(sizerow);
+    std::vector<const Term_t *> values;
     for(uint8_t j = 0; j < sizerow; ++j) {
-        readers.push_back(columns[j]->getReader());
-    }
-    uint64_t rulevar = RULE_SHIFT(ruleid) + VAR_SHIFT(var);
-    for(uint64_t i = 0; i < sizecolumns; ++i) {
-        for(uint8_t j = 0; j < sizerow; ++j) {
-            if (!readers[j]->hasNext()) {
+        if (columns[j]->isBackedByVector()) {
+            const std::vector<Term_t> &v = columns[j]->getVectorRef();
+            if (v.size() < sizecolumns) {
+                LOG(ERRORL) << "Should not happen ...";
+                throw 10;
+            }
+            values.push_back(v.data());
+        } else {
+            copies[j] = columns[j]->getReader()->asVector();
+            if (copies[j].size() < sizecolumns) {
                 LOG(ERRORL) << "Should not happen ...";
                 throw 10;
             }
-            row[j] = readers[j]->next();
-            if (checkCyclic) {
-                if ((ruleToCheck < 0 || ruleToCheck == ruleid) && ! cyclic) {
-                    // Check if we are about to introduce a cyclic term ...
-                    if ((row[j] & RULEVARMASK) != 0) {
-                        LOG(TRACEL) << "to check: " << rulevar << ", read value " << row[j];
-                        if ((row[j] & RULEVARMASK) == rulevar) {
-                            cyclic = true;
-                        } else {
-                            cyclic = checkRecursive(rulevar, row[j]);
-                        }
-						// LOG(TRACEL) << "cyclic = " << cyclic;
+            values.push_back(copies[j].data());
+        }
+    }
+
+    uint64_t rulevar = RULE_SHIFT(ruleid) + VAR_SHIFT(var);
+    if (checkCyclic && (ruleToCheck < 0 || ruleToCheck == ruleid)) {
+        for(uint64_t i = 0; i < sizecolumns && !cyclic; ++i) {
+            for(uint8_t j = 0; j < sizerow && !cyclic; ++j) {
+                const uint64_t v = values[j][i];
+                // Check if we are about to introduce a cyclic term ...
+                if ((v & RULEVARMASK) != 0) {
+                    LOG(TRACEL) << "to check: " << rulevar << ", read value " << v;
+                    if ((v & RULEVARMASK) == rulevar) {
+                        cyclic = true;
+                    } else {
+                        cyclic = checkRecursive(rulevar, v);
                     }
                 }
             }
         }
-        LOG(TRACEL) << "check: ruleid = " << ruleid << ", row[0] = " << row[0];
+    }
+
+    //First look up all the rows, which does not change the table ...
+    std::vector<uint64_t> hashes(sizecolumns);
+    std::vector<Term_t> functerms(sizecolumns);
+    LookupRows lookup(rows, values, &hashes[0], &functerms[0]);
+    if (nthreads > 1 && sizecolumns >= CHASE_PARALLEL_THRESHOLD) {
+        const size_t chunk = std::max((uint64_t) CHASE_BATCH_SIZE,
+                (sizecolumns + nthreads - 1) / nthreads);
+        ParallelTasks::parallel_for(0, sizecolumns, chunk, lookup);
+    } else {
+        lookup(ParallelRange(0, sizecolumns));
+    }
+
+    //... then add the missing ones, in the order of the rows, so that they
+    //get the same IDs as if they were added one by one
+    uint64_t row[256];
+    for(uint64_t i = 0; i < sizecolumns; ++i) {
+        if (functerms[i] != 0) {
+            continue;
+        }
+        for(uint8_t j = 0; j < sizerow; ++j) {
+            row[j] = values[j][i];
+        }
+        //The row may have been added by a previous row of this batch
         uint64_t value = 0;
-        if (!rows->existingRow(row, value)) {
-            value = rows->addRow(row);
+        if (!rows->existingRow(row, hashes[i], value)) {
+            value = rows->addRow(row, hashes[i]);
         }
-        functerms.push_back(value);
+        functerms[i] = value;
     }
     return ColumnWriter::getColumn(functerms, false);
 }
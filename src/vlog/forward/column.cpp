@@ -527,6 +527,189 @@ std::vector<Term_t> EDBColumnReader::asVector() {
     return load(l, posColumn, presortPos, layer, unq);
 }
 
+uint8_t PackedColumn::getBits(const Term_t *values, const size_t n,
+        Term_t &base) {
+    base = values[0];
+    Term_t max = values[0];
+    for (size_t i = 1; i < n; ++i) {
+        base = std::min(base, values[i]);
+        max = std::max(max, values[i]);
+    }
+    const uint64_t diff = (uint64_t) (max - base);
+    uint8_t nbits = 0;
+    while (nbits < 64 && (diff >> nbits) != 0) {
+        nbits++;
+    }
+    return nbits;
+}
+
+std::shared_ptr<Column> PackedColumn::pack(const std::vector<Term_t> &values) {
+    if (values.empty()) {
+        return NULL;
+    }
+    //Estimate the size of the packed column
+    size_t nwords = 0;
+    for (size_t i = 0; i < values.size(); i += BLOCK_SIZE) {
+        const size_t n = std::min(BLOCK_SIZE, values.size() - i);
+        Term_t base;
+        const uint8_t nbits = getBits(&values[i], n, base);
+        nwords += (n * nbits + 63) / 64;
+    }
+    const size_t nblocks = (values.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const size_t packedSize = nwords * sizeof(uint64_t) + nblocks *
+        (sizeof(Term_t) + sizeof(uint8_t) + sizeof(size_t));
+    if (packedSize * 2 > values.size() * sizeof(Term_t)) {
+        return NULL;
+    }
+    return std::shared_ptr<Column>(new PackedColumn(values));
+}
+
+PackedColumn::PackedColumn(const std::vector<Term_t> &values) :
+    words(NULL), nwords(0), _size(values.size()) {
+    const size_t nblocks = (_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    bases.reserve(nblocks);
+    bits.reserve(nblocks);
+    offsets.reserve(nblocks);
+    for (size_t i = 0; i < _size; i += BLOCK_SIZE) {
+        const size_t n = std::min(BLOCK_SIZE, _size - i);
+        Term_t base;
+        const uint8_t nbits = getBits(&values[i], n, base);
+        bases.push_back(base);
+        bits.push_back(nbits);
+        offsets.push_back(ownedWords.size());
+        if (nbits == 0) {
+            continue;
+        }
+        const size_t start = ownedWords.size();
+        ownedWords.resize(start + (n * nbits + 63) / 64);
+        uint64_t *w = &ownedWords[start];
+        for (size_t j = 0; j < n; ++j) {
+            const uint64_t d = (uint64_t) (values[i + j] - base);
+            const size_t bit = j * nbits;
+            const unsigned shift = bit & 63;
+            w[bit >> 6] |= d << shift;
+            if (shift + nbits > 64) {
+                w[(bit >> 6) + 1] |= d >> (64 - shift);
+            }
+        }
+    }
+    ownedWords.push_back(0);
+    ownedWords.shrink_to_fit();
+    words = &ownedWords[0];
+    nwords = ownedWords.size();
+}
+
+PackedColumn::PackedColumn(const PackedColumn &column,
+        std::shared_ptr<const char> region, const uint64_t *words) :
+    bases(column.bases), bits(column.bits), offsets(column.offsets),
+    region(region), words(words), nwords(column.nwords),
+    _size(column._size) {
+}
+
+std::shared_ptr<Column> PackedColumn::remap(std::shared_ptr<const char> region,
+        const uint64_t *words) const {
+    return std::shared_ptr<Column>(new PackedColumn(*this, region, words));
+}
+
+void PackedColumn::decodeBlock(const size_t b, Term_t *out) const {
+    const size_t n = std::min(BLOCK_SIZE, _size - b * BLOCK_SIZE);
+    const Term_t base = bases[b];
+    const uint8_t nbits = bits[b];
+    if (nbits == 0) {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = base;
+        }
+        return;
+    }
+    //Branch-free loop, which the compiler can vectorize
+    const uint64_t *w = &words[offsets[b]];
+    const uint64_t mask = nbits == 64 ? ~(uint64_t) 0 :
+        (((uint64_t) 1 << nbits) - 1);
+    for (size_t i = 0; i < n; ++i) {
+        const size_t bit = i * nbits;
+        const unsigned shift = bit & 63;
+        const uint64_t v = (w[bit >> 6] >> shift) |
+            ((w[(bit >> 6) + 1] << 1) << (63 - shift));
+        out[i] = base + (Term_t) (v & mask);
+    }
+}
+
+std::unique_ptr<ColumnReader> PackedColumn::getReader() const {
+    return std::unique_ptr<ColumnReader>(new PackedColumnReader(*this));
+}
+
+std::shared_ptr<Column> PackedColumn::sort() const {
+    std::vector<Term_t> values = getReader()->asVector();
+    std::sort(values.begin(), values.end());
+    return ColumnWriter::getColumn(values, true);
+}
+
+std::shared_ptr<Column> PackedColumn::sort(const int nthreads) const {
+    if (nthreads <= 1) {
+        return sort();
+    }
+    std::vector<Term_t> values = getReader()->asVector();
+    ParallelTasks::sort_int(values.begin(), values.end());
+    return ColumnWriter::getColumn(values, true);
+}
+
+std::shared_ptr<Column> PackedColumn::unique() const {
+    //I assume the column is already sorted
+    std::vector<Term_t> values = getReader()->asVector();
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    values.shrink_to_fit();
+    return ColumnWriter::getColumn(values, true);
+}
+
+bool PackedColumn::isIn(const Term_t t) const {
+    if (_size == 0) {
+        return false;
+    }
+    //The last block whose smallest value is not larger than t
+    auto itr = std::upper_bound(bases.begin(), bases.end(), t);
+    if (itr == bases.begin()) {
+        return false;
+    }
+    const size_t b = itr - bases.begin() - 1;
+    Term_t buffer[BLOCK_SIZE];
+    decodeBlock(b, buffer);
+    const size_t n = std::min(BLOCK_SIZE, _size - b * BLOCK_SIZE);
+    return std::binary_search(buffer, buffer + n, t);
+}
+
+bool PackedColumn::isConstant() const {
+    for (size_t b = 0; b < bases.size(); ++b) {
+        if (bits[b] != 0 || bases[b] != bases[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<Term_t> PackedColumnReader::asVector() {
+    std::vector<Term_t> values(column.size());
+    for (size_t b = 0; b < column.getNBlocks(); ++b) {
+        column.decodeBlock(b, &values[b * PackedColumn::BLOCK_SIZE]);
+    }
+    return values;
+}
+
+//Returns a column with the values (which are swapped). With PACKED_COLUMNS,
+//large columns are packed if it saves enough memory. A packed column is not
+//backed by a vector, so it is slower to scan.
+static std::shared_ptr<Column> getUncompressedColumn(std::vector<Term_t> &values) {
+#ifdef PACKED_COLUMNS
+    if (values.size() >= PACKED_COLUMN_MIN_SIZE) {
+        std::shared_ptr<Column> packed = PackedColumn::pack(values);
+        if (packed != NULL) {
+            std::vector<Term_t>().swap(values);
+            return packed;
+        }
+    }
+#endif
+    return std::shared_ptr<Column>(new InmemoryColumn(values, true));
+}
+
 void ColumnWriter::concatenate(Column * c) {
     std::vector<Term_t> values = c->getReader()->asVector();
     for (auto &value : values) {
@@ -551,10 +734,10 @@ std::shared_ptr<Column> ColumnWriter::getColumn() {
         } else {
             CompressedColumn col(blocks, /*offsetsize, deltas,*/ _size);
             std::vector<Term_t> values = col.getReader()->asVector();
-            cachedColumn = std::shared_ptr<Column>(new InmemoryColumn(values, true));
+            cachedColumn = getUncompressedColumn(values);
         }
     } else {
-        cachedColumn = std::shared_ptr<Column>(new InmemoryColumn(values, true));
+        cachedColumn = getUncompressedColumn(values);
     }
 #else
     cachedColumn = std::shared_ptr<Column>(new InmemoryColumn(values, true));
@@ -617,7 +800,7 @@ std::shared_ptr<Column> ColumnWriter::getColumn(std::vector<Term_t> &values, boo
         deltas, values.size()));*/
     } else {
         //swap the values. After, "values" is empty
-        return std::shared_ptr<Column>(new InmemoryColumn(values, true));
+        return getUncompressedColumn(values);
     }
 #else
     return std::shared_ptr<Column>(new InmemoryColumn(values, true));
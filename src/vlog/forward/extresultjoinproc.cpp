@@ -2,6 +2,10 @@
 #include <vlog/ruleexecdetails.h>
 #include <vlog/seminaiver.h>
 
+#include <trident/utils/parallel.h>
+
+#include <atomic>
+
 static bool isPresent(uint8_t el, std::vector<uint8_t> &v) {
     for (int i = 0; i < v.size(); i++) {
         if (el == v[i]) {
@@ -68,22 +72,213 @@ ExistentialRuleProcessor::ExistentialRuleProcessor(
         }
     }
 
-int _compare(std::unique_ptr<SegmentIterator> &itr1,
-        FCInternalTableItr *itr2,
-        const uint8_t *colsCheck,
-        const uint8_t ncolsCheck) {
-    for(uint8_t i = 0; i < ncolsCheck; ++i) {
-        auto t1 = itr1->get(colsCheck[i]);
-        auto t2 = itr2->getCurrentValue(colsCheck[i]);
-        if (t1 < t2) {
-            return -1;
-        } else if (t1 > t2) {
-            return 1;
+//The restricted chase marks the rows that are already satisfied in a bitmap
+static inline bool isSet(const std::vector<uint64_t> &bitmap, const uint64_t i) {
+    return (bitmap[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void setBit(std::vector<uint64_t> &bitmap, const uint64_t i) {
+    bitmap[i >> 6] |= UINT64_C(1) << (i & 63);
+}
+
+static std::vector<uint64_t> newBitmap(const uint64_t n, const bool value) {
+    std::vector<uint64_t> bitmap((n + 63) / 64, value ? ~UINT64_C(0) : 0);
+    if (value && (n & 63) != 0) {
+        bitmap.back() = (UINT64_C(1) << (n & 63)) - 1;
+    }
+    return bitmap;
+}
+
+static uint64_t countBits(const std::vector<uint64_t> &bitmap) {
+    uint64_t count = 0;
+    for (auto w : bitmap) {
+        while (w) {
+            w &= w - 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+//Returns a pointer to the values of the column. If the column is not backed
+//by a vector, they are copied in copy.
+static const Term_t *getValues(std::shared_ptr<Column> column,
+        std::vector<Term_t> &copy) {
+    if (column->isBackedByVector()) {
+        return column->getVectorRef().data();
+    }
+    copy = column->getReader()->asVector();
+    return copy.data();
+}
+
+//Orders the rows of the candidates on the columns to check
+struct CompareCandidates {
+    const std::vector<const Term_t *> &columns;
+
+    CompareCandidates(const std::vector<const Term_t *> &columns) :
+        columns(columns) {
+        }
+
+    bool operator ()(const uint64_t r1, const uint64_t r2) const {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i][r1] != columns[i][r2])
+                return columns[i][r1] < columns[i][r2];
+        }
+        return false;
+    }
+};
+
+//Every worker takes ranges of rows of a block of the head table and
+//searches them in the other side: if the block is sorted on the columns to
+//check, it searches ranges of the (sorted) candidates in the block, otherwise
+//ranges of the facts of the block in the candidates. The candidates that are
+//found are marked in the bitmap of the worker, so that the workers do not
+//need to synchronize.
+struct ExistentialRuleProcessor::ProbeTable {
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    const std::vector<const Term_t *> &candidates;
+    const std::vector<uint64_t> &sortedCandidates;
+    const std::vector<const Term_t *> &fact;
+    const size_t nfacts;
+    const bool searchCandidates;
+    const std::vector<Range> &ranges;
+    std::atomic<size_t> &nextRange;
+    std::vector<std::vector<uint64_t>> &found;
+
+    ProbeTable(const std::vector<const Term_t *> &candidates,
+            const std::vector<uint64_t> &sortedCandidates,
+            const std::vector<const Term_t *> &fact,
+            const size_t nfacts,
+            const bool searchCandidates,
+            const std::vector<Range> &ranges,
+            std::atomic<size_t> &nextRange,
+            std::vector<std::vector<uint64_t>> &found) :
+        candidates(candidates), sortedCandidates(sortedCandidates),
+        fact(fact), nfacts(nfacts), searchCandidates(searchCandidates),
+        ranges(ranges), nextRange(nextRange), found(found) {
+        }
+
+    //Compares the candidate at position idx with the fact
+    int compare(const uint64_t idx, const size_t row) const {
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            if (candidates[i][idx] != fact[i][row]) {
+                return candidates[i][idx] < fact[i][row] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    //Marks the candidates equal to the fact
+    void searchFact(const size_t row, std::vector<uint64_t> &bitmap) const {
+        //Binary search of the first candidate >= the fact
+        size_t lo = 0;
+        size_t hi = sortedCandidates.size();
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (compare(sortedCandidates[mid], row) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        while (lo < sortedCandidates.size() &&
+                compare(sortedCandidates[lo], row) == 0) {
+            setBit(bitmap, sortedCandidates[lo]);
+            lo++;
+        }
+    }
+
+    //Marks the candidate if it is among the (sorted) facts
+    void searchCandidate(const uint64_t idx,
+            std::vector<uint64_t> &bitmap) const {
+        size_t lo = 0;
+        size_t hi = nfacts;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            const int cmp = compare(idx, mid);
+            if (cmp == 0) {
+                setBit(bitmap, idx);
+                return;
+            } else if (cmp > 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+
+    void operator()(const ParallelRange& r) const {
+        for (size_t worker = r.begin(); worker < r.end(); ++worker) {
+            std::vector<uint64_t> &bitmap = found[worker];
+            size_t idx;
+            while ((idx = nextRange++) < ranges.size()) {
+                const Range &range = ranges[idx];
+                for (size_t i = range.begin; i < range.end; ++i) {
+                    if (searchCandidates) {
+                        searchCandidate(sortedCandidates[i], bitmap);
+                    } else {
+                        searchFact(i, bitmap);
+                    }
+                }
+            }
         }
     }
-    return 0;
+};
+
+//True if the rows of the table are sorted on the columns to check: the
+//table is sorted and the columns before the last one to check are either
+//checked or constant
+static bool isSortedOnColumns(const FCInternalTable *table,
+        const std::vector<uint8_t> &columnsToCheck) {
+    if (!table->isSorted()) {
+        return false;
+    }
+    size_t next = 0;
+    for (uint8_t i = 0; next < columnsToCheck.size(); ++i) {
+        if (columnsToCheck[next] == i) {
+            next++;
+        } else if (!table->isColumnConstant(i)) {
+            return false;
+        }
+    }
+    return true;
 }
 
+//Copies the values of the rows that are not marked in the bitmap
+struct ExistentialRuleProcessor::CopyNonExisting {
+    const std::vector<uint64_t> &existing;
+    const uint64_t sizecolumns;
+    std::vector<std::shared_ptr<Column>> &c;
+
+    CopyNonExisting(const std::vector<uint64_t> &existing,
+            const uint64_t sizecolumns,
+            std::vector<std::shared_ptr<Column>> &c) : existing(existing),
+    sizecolumns(sizecolumns), c(c) {
+    }
+
+    void operator()(const ParallelRange& r) const {
+        for (size_t i = r.begin(); i < r.end(); ++i) {
+            if (!c[i]) {
+                continue;
+            }
+            std::vector<Term_t> copy;
+            const Term_t *values = getValues(c[i], copy);
+            std::vector<Term_t> out;
+            for (uint64_t j = 0; j < sizecolumns; ++j) {
+                if (!isSet(existing, j)) {
+                    out.push_back(values[j]);
+                }
+            }
+            const bool constant = c[i]->isConstant();
+            c[i] = ColumnWriter::getColumn(out, constant);
+        }
+    }
+};
+
 void ExistentialRuleProcessor::filterDerivations(const Literal &literal,
         FCTable *t,
         Term_t *row,
@@ -93,7 +288,8 @@ void ExistentialRuleProcessor::filterDerivations(const Literal &literal,
         std::pair<uint8_t, uint8_t> *posCopyColumns,
         std::vector<std::shared_ptr<Column>> c,
         uint64_t sizecolumns,
-        std::vector<uint64_t> &outputProc) {
+        std::vector<uint64_t> &existing,
+        const int nthreads) {
     std::vector<std::shared_ptr<Column>> tobeRetained;
     std::vector<uint8_t> columnsToCheck;
     const uint8_t rowsize = literal.getTupleSize();
@@ -125,62 +321,100 @@ void ExistentialRuleProcessor::filterDerivations(const Literal &literal,
         }
     }
 
-    filterDerivations(t, tobeRetained, columnsToCheck, outputProc);
+    filterDerivations(t, tobeRetained, columnsToCheck, existing, nthreads);
 }
 
 void ExistentialRuleProcessor::filterDerivations(FCTable *t,
         std::vector<std::shared_ptr<Column>> &tobeRetained,
         std::vector<uint8_t> &columnsToCheck,
-        std::vector<uint64_t> &outputProc) {
-    std::vector<uint64_t> output;
-
+        std::vector<uint64_t> &existing,
+        const int nthreads) {
     //tobeRetained contained a copy of the head without the existential
     //replacements. I restrict it to only substitutions that are not in the KG
-    std::shared_ptr<const Segment> seg = std::shared_ptr<const Segment>(
-            new Segment(tobeRetained.size(), tobeRetained));
-
-    //do the filtering
-    const uint8_t *colsCheck = columnsToCheck.data();
-    const uint8_t nColsCheck = columnsToCheck.size();
-    auto sortedSeg = seg->sortBy(NULL);
+    if (columnsToCheck.empty()) {
+        //Every fact satisfies the atom
+        if (t->isEmpty()) {
+            std::fill(existing.begin(), existing.end(), 0);
+        }
+        return;
+    }
+    const uint64_t nrows = tobeRetained[0]->size();
+
+    //Sort the candidates on the columns to check
+    std::vector<std::vector<Term_t>> copies(columnsToCheck.size());
+    std::vector<const Term_t *> candidates;
+    for (size_t i = 0; i < columnsToCheck.size(); ++i) {
+        candidates.push_back(getValues(tobeRetained[columnsToCheck[i]],
+                    copies[i]));
+    }
+    std::vector<uint64_t> sortedCandidates;
+    for (uint64_t i = 0; i < nrows; ++i) {
+        if (isSet(existing, i)) {
+            sortedCandidates.push_back(i);
+        }
+    }
+    CompareCandidates cmp(candidates);
+    if (nthreads > 1 && sortedCandidates.size() > 1000) {
+        ParallelTasks::sort_int(sortedCandidates.begin(),
+                sortedCandidates.end(), cmp, nthreads);
+    } else {
+        std::sort(sortedCandidates.begin(), sortedCandidates.end(), cmp);
+    }
 
+    //Probe the blocks of the table one at a time, so that only the values
+    //of one block are copied at any time
+    const size_t rangeSize = 65536;
+    const int maxWorkers = std::max(1, nthreads);
+    std::vector<std::vector<uint64_t>> found(1,
+            std::vector<uint64_t>(existing.size()));
     auto tableItr = t->read(0);
-    while (!tableItr.isEmpty()) {
+    while (!tableItr.isEmpty() && !sortedCandidates.empty()) {
         auto table = tableItr.getCurrentTable();
-        auto itr1 = sortedSeg->iterator();
-        auto itr2 = table->getSortedIterator();
-        uint64_t idx = 0;
-        bool itr1Ok = itr1->hasNext();
-        if (itr1Ok) itr1->next();
-        bool itr2Ok = itr2->hasNext();
-        if (itr2Ok) itr2->next();
-        while (itr1Ok && itr2Ok) {
-            int cmp = _compare(itr1, itr2, colsCheck, nColsCheck);
-            if (cmp > 0) {
-                //the table must move to the next one
-                itr2Ok = itr2->hasNext();
-                if (itr2Ok)
-                    itr2->next();
-            } else if (cmp <= 0) {
-                if (cmp == 0)
-                    output.push_back(idx);
-                itr1Ok = itr1->hasNext();
-                if (itr1Ok)
-                    itr1->next();
-                // Should we not increment idx here??? Added. --Ceriel
-                idx++;
-            }
+        const size_t n = table->getNRows();
+        std::vector<std::vector<Term_t>> tableCopies(columnsToCheck.size());
+        std::vector<const Term_t *> fact;
+        for (size_t i = 0; i < columnsToCheck.size(); ++i) {
+            fact.push_back(getValues(table->getColumn(columnsToCheck[i]),
+                        tableCopies[i]));
+        }
+        //Search the side with fewer rows in the other one
+        const bool searchCandidates = sortedCandidates.size() < n &&
+            isSortedOnColumns(table.get(), columnsToCheck);
+        const size_t nrowsToSearch = searchCandidates ?
+            sortedCandidates.size() : n;
+        std::vector<ProbeTable::Range> ranges;
+        for (size_t begin = 0; begin < nrowsToSearch; begin += rangeSize) {
+            ProbeTable::Range range;
+            range.begin = begin;
+            range.end = std::min(nrowsToSearch, begin + rangeSize);
+            ranges.push_back(range);
+        }
+
+        const int nworkers = std::max(1, std::min(maxWorkers,
+                    (int) ranges.size()));
+        while (found.size() < nworkers) {
+            found.push_back(std::vector<uint64_t>(existing.size()));
+        }
+        std::atomic<size_t> nextRange(0);
+        ProbeTable probe(candidates, sortedCandidates, fact, n,
+                searchCandidates, ranges, nextRange, found);
+        if (nworkers > 1) {
+            ParallelTasks::parallel_for(0, nworkers, 1, probe);
+        } else {
+            probe(ParallelRange(0, 1));
         }
-        table->releaseIterator(itr2);
-        itr1->clear();
         tableItr.moveNextCount();
     }
 
-    std::sort(output.begin(), output.end());
-    auto end = std::unique(output.begin(), output.end());
-    output.resize(end - output.begin());
-    for(auto el : output)
-        outputProc.push_back(el);
+    //A row is satisfied if it was found by some worker (and satisfied
+    //all the previous atoms)
+    for (size_t i = 0; i < existing.size(); ++i) {
+        uint64_t w = 0;
+        for (const auto &bitmap : found) {
+            w |= bitmap[i];
+        }
+        existing[i] &= w;
+    }
 }
 
 // Filters out rows with recursive terms
@@ -224,95 +458,29 @@ void ExistentialRuleProcessor::retainNonRecursive(
 }
 
 void ExistentialRuleProcessor::retainNonExisting(
-        std::vector<uint64_t> &filterRows,
+        const std::vector<uint64_t> &existing,
         uint64_t &sizecolumns,
         std::vector<std::shared_ptr<Column>> &c) {
-
-    std::sort(filterRows.begin(), filterRows.end());
-    std::vector<uint64_t> newFilterRows; //Remember only the rows where all
-    //atoms were found
-    uint8_t count = 0;
-    uint64_t prevIdx = ~0lu;
-    for(uint64_t i = 0; i < filterRows.size(); ++i) {
-        if (filterRows[i] == prevIdx) {
-            count++;
-        } else {
-            if (prevIdx != ~0lu && count == atomTables.size()) {
-                newFilterRows.push_back(prevIdx);
-            }
-            prevIdx = filterRows[i];
-            count = 1;
-        }
-    }
-    if (prevIdx != ~0lu && count == atomTables.size()) {
-        newFilterRows.push_back(prevIdx);
+    //Now I can filter the columns
+    CopyNonExisting copy(existing, sizecolumns, c);
+    if (nthreads > 1 && c.size() > 1) {
+        ParallelTasks::parallel_for(0, c.size(), 1, copy);
+    } else {
+        copy(ParallelRange(0, c.size()));
     }
-    filterRows = newFilterRows;
-
-    if (!filterRows.empty()) {
-        //Now I can filter the columns
-        std::vector<ColumnWriter> writers;
-        std::vector<std::unique_ptr<ColumnReader>> readers;
-        for(uint8_t i = 0; i < c.size(); ++i) {
-            if (c[i]) {
-                readers.push_back(c[i]->getReader());
-            } else {
-                readers.emplace_back();
-            }
-        }
-        writers.resize(c.size());
-        uint64_t idxs = 0;
-        uint64_t nextid = filterRows[idxs];
-        for(uint64_t i = 0; i < sizecolumns; ++i) {
-            if (i < nextid) {
-                //Copy
-                for(uint8_t j = 0; j < c.size(); ++j) {
-                    if (readers[j]) {
-                        if (!readers[j]->hasNext()) {
-                            throw 10;
-                        }
-                        writers[j].add(readers[j]->next());
-                    }
-                }
-            } else {
-                //Move to the next ID if any
-                idxs++;
-                if (idxs < filterRows.size()) {
-                    nextid = filterRows[idxs];
-                } else {
-                    nextid = ~0lu; //highest value -- copy the rest
-                }
-                for(uint8_t j = 0; j < c.size(); ++j) {
-                    if (readers[j]) {
-                        if (!readers[j]->hasNext()) {
-                            throw 10;
-                        }
-                        readers[j]->next();
-                    }
-                }
-
-            }
-        }
-        //Copy back the retricted columns
+    sizecolumns = 0;
+    if (rowsize > 0) {
+        bool found = false;
         for(uint8_t i = 0; i < c.size(); ++i) {
             if (c[i]) {
-                c[i] = writers[i].getColumn();
+                sizecolumns = c[i]->size();
+                found = true;
+                break;
             }
         }
-        sizecolumns = 0;
-        if (rowsize > 0) {
-            bool found = false;
-            for(uint8_t i = 0; i < c.size(); ++i) {
-                if (c[i]) {
-                    sizecolumns = c[i]->size();
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                LOG(ERRORL) << "No atom without non-existential columns. I don't now how to get the size";
-                throw 10;
-            }
+        if (!found) {
+            LOG(ERRORL) << "No atom without non-existential columns. I don't now how to get the size";
+            throw 10;
         }
     }
 }
@@ -347,16 +515,16 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
     }
 
     if (chaseMgmt->isRestricted()) {
-        size_t nAtomsToCheck = atomTables.size();
         PredId_t headPredicateToIgnore = -1;
         if (chaseMgmt->getChaseType() == TypeChase::SUM_RESTRICTED_CHASE) {
             headPredicateToIgnore = chaseMgmt->getPredicateIgnoreBlocking();
         }
 
-        std::vector<uint64_t> filterRows; //The restricted chase might remove some IDs
+        //The restricted chase might remove some IDs
+        std::vector<uint64_t> existing = newBitmap(sizecolumns,
+                !chaseMgmt->isCheckCyclicMode());
         int count = 0;
         if (chaseMgmt->isCheckCyclicMode()) {
-            std::vector<bool> blocked(sizecolumns);
             size_t blockedCount = 0;
             uint64_t tmprow[256];
             std::vector<std::unique_ptr<ColumnReader>> columnReaders;
@@ -374,7 +542,7 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
                 }
 
                 if (blocked_check(tmprow, c.size(), headPredicateToIgnore)) {
-                    blocked[i] = true;
+                    setBit(existing, i);
                     blockedCount++;
                 }
             }
@@ -382,13 +550,6 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
             if (blockedCount == sizecolumns) {
                 return;
             }
-            for (size_t i = 0; i < sizecolumns; i++) {
-                if (blocked[i]) {
-                    for (int j = 0; j < atomTables.size(); j++) {
-                        filterRows.push_back(i);
-                    }
-                }
-            }
         } else {
             for(const auto &at : atomTables) {
                 const auto &h = at->getLiteral();
@@ -396,20 +557,20 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
                 FCTable *t = sn->getTable(headPredicate,
                         h.getPredicate().getCardinality());
                 filterDerivations(h, t, row, count, ruleDetails, nKnownColumns,
-                        posKnownColumns, c, sizecolumns, filterRows);
+                        posKnownColumns, c, sizecolumns, existing, nthreads);
                 count += h.getTupleSize();
             }
         }
 
-        if (filterRows.size() == sizecolumns * nAtomsToCheck) {
+        if (countBits(existing) == sizecolumns) {
             return; //every substitution already exists in the database. Nothing
             //new can be derived.
         }
 
         //Filter out the potential values for the derivation
         //(only restricted chase can do it)
-        if (!filterRows.empty()) {
-            retainNonExisting(filterRows, sizecolumns, c);
+        if (countBits(existing) > 0) {
+            retainNonExisting(existing, sizecolumns, c);
         }
     }
 
@@ -455,7 +616,8 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
                             ruleDetails->rule.getId(),
                             t.getId(),
                             knownColumns,
-                            sizecolumns);
+                            sizecolumns,
+                            nthreads);
                     extvars.insert(std::make_pair(t.getId(), extcolumn));
                 }
                 cols.push_back(extvars[t.getId()]);
@@ -546,16 +708,16 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
     }
 
     if (chaseMgmt->isRestricted()) {
-        size_t nAtomsToCheck = atomTables.size();
         PredId_t headPredicateToIgnore = -1;
         if (chaseMgmt->getChaseType() == TypeChase::SUM_RESTRICTED_CHASE) {
             headPredicateToIgnore = chaseMgmt->getPredicateIgnoreBlocking();
         }
 
-        std::vector<uint64_t> filterRows; //The restricted chase might remove some IDs
+        //The restricted chase might remove some IDs
+        std::vector<uint64_t> existing = newBitmap(sizecolumns,
+                !chaseMgmt->isCheckCyclicMode());
         int count = 0;
         if (chaseMgmt->isCheckCyclicMode()) {
-            std::vector<bool> blocked(sizecolumns);
             size_t blockedCount = 0;
             uint64_t tmprow[256];
             std::vector<std::unique_ptr<ColumnReader>> columnReaders;
@@ -574,7 +736,7 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
 
                 if (blocked_check(tmprow, c.size(), headPredicateToIgnore)) {
                     //It is blocked
-                    blocked[i] = true;
+                    setBit(existing, i);
                     blockedCount++;
                 }
             }
@@ -582,13 +744,6 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
             if (blockedCount == sizecolumns) {
                 return;
             }
-            for (size_t i = 0; i < sizecolumns; i++) {
-                if (blocked[i]) {
-                    for (int j = 0; j < atomTables.size(); j++) {
-                        filterRows.push_back(i);
-                    }
-                }
-            }
         } else {
             for(const auto &at : atomTables) {
                 const auto &h = at->getLiteral();
@@ -596,20 +751,20 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
                 FCTable *t = sn->getTable(headPredicate,
                         h.getPredicate().getCardinality());
                 filterDerivations(h, t, row, count, ruleDetails, nCopyFromSecond,
-                        posFromSecond, c, sizecolumns, filterRows);
+                        posFromSecond, c, sizecolumns, existing, nthreads);
                 count += h.getTupleSize();
             }
         }
 
-        if (filterRows.size() == sizecolumns * nAtomsToCheck) {
+        if (countBits(existing) == sizecolumns) {
             return; //every substitution already exists in the database. Nothing
             //new can be derived.
         }
 
         //Filter out the potential values for the derivation
         //(only restricted chase can do it)
-        if (!filterRows.empty()) {
-            retainNonExisting(filterRows, sizecolumns, c);
+        if (countBits(existing) > 0) {
+            retainNonExisting(existing, sizecolumns, c);
         }
     }
 
@@ -676,7 +831,8 @@ void ExistentialRuleProcessor::addColumns(const int blockid,
                             ruleDetails->rule.getId(),
                             t.getId(),
                             depc,
-                            sizecolumns);
+                            sizecolumns,
+                            nthreads);
                     extvars.insert(std::make_pair(t.getId(), extcolumn));
                 }
             }
@@ -1079,18 +1235,17 @@ void ExistentialRuleProcessor::consolidate(const bool isFinished) {
 
         //If the chase is restricted, we must first remove data
         if (chaseMgmt->isRestricted()) {
-            size_t nAtomsToCheck = atomTables.size();
             PredId_t headPredicateToIgnore = -1;
             if (chaseMgmt->getChaseType() == TypeChase::SUM_RESTRICTED_CHASE) {
                 headPredicateToIgnore = chaseMgmt->getPredicateIgnoreBlocking();
             }
 
-            std::vector<uint64_t> filterRows;
+            std::vector<uint64_t> existing = newBitmap(nrows,
+                    !chaseMgmt->isCheckCyclicMode());
             int count = 0;
             if (chaseMgmt->isCheckCyclicMode()) {
                 size_t blockedCount = 0;
                 const uint8_t segmentSize = unfilterdSegment->getNColumns();
-                std::vector<bool> blocked(nrows);
                 uint64_t tmprow[256];
                 std::vector<std::shared_ptr<Column>> segmentColumns;
                 std::vector<std::unique_ptr<ColumnReader>> segmentReaders;
@@ -1108,7 +1263,7 @@ void ExistentialRuleProcessor::consolidate(const bool isFinished) {
                         tmprow[j] = segmentReaders[j]->next();
                     }
                     if (blocked_check(tmprow, segmentSize, headPredicateToIgnore)) { //Is it blocked?
-                        blocked[i] = true;
+                        setBit(existing, i);
                         blockedCount++;
                     }
                 }
@@ -1117,13 +1272,6 @@ void ExistentialRuleProcessor::consolidate(const bool isFinished) {
                     tmpRelation = std::unique_ptr<SegmentInserter>();
                     return;
                 }
-                for (size_t i = 0; i < nrows; i++) {
-                    if (blocked[i]) {
-                        for (int j = 0; j < atomTables.size(); j++) {
-                            filterRows.push_back(i);
-                        }
-                    }
-                }
             } else {
                 for(const auto &at : atomTables) {
                     const auto &h = at->getLiteral();
@@ -1151,20 +1299,20 @@ void ExistentialRuleProcessor::consolidate(const bool isFinished) {
                             h.getPredicate().getCardinality());
                     filterDerivations(t, tobeRetained,
                             columnsToCheck,
-                            filterRows);
+                            existing, nthreads);
 
                     count += h.getTupleSize();
                 }
             }
 
-            if (filterRows.size() == nrows * nAtomsToCheck) {
+            if (countBits(existing) == nrows) {
                 tmpRelation = std::unique_ptr<SegmentInserter>();
                 return; //every substitution already exists in the database.
                 // Nothing new can be derived.
             }
             //Filter out only valid subs
-            if (!filterRows.empty()) {
-                retainNonExisting(filterRows, nrows, allColumns);
+            if (countBits(existing) > 0) {
+                retainNonExisting(existing, nrows, allColumns);
             }
         }
 
@@ -1188,7 +1336,8 @@ void ExistentialRuleProcessor::consolidate(const bool isFinished) {
                     ruleDetails->rule.getId(),
                     el.first, //ID of the variable
                     knownColumns,
-                    nrows);
+                    nrows,
+                    nthreads);
             for(uint8_t pos : el.second) { //Add the existential columns to the
                 //final list of columns
                 allColumns[pos] = extcolumn;
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <random>
+#include <cmath>
+#include <algorithm>
 
 FCInternalTable::~FCInternalTable() {
 }
@@ -734,103 +736,85 @@ if (filteredSegment != NULL && !filteredSegment->isEmpty()) {
 }
 }
 
-FCInternalTableItr *InmemoryFCInternalTable::getSortedIterator() const {
-    std::shared_ptr<const Segment> sortedValues;
+std::shared_ptr<const Segment> InmemoryFCInternalTable::getSortedValues(
+        const std::vector<uint8_t> *fields, const int nthreads) const {
+    bool primarySort = fields == NULL || isPrimarySorting(*fields);
+    if (unmergedSegments.size() == 0 && primarySort && isSorted()) {
+        return values;
+    }
+
+    //The primary sorting does not depend on the fields
+    std::vector<uint64_t> signature;
+    if (!primarySort) {
+        signature.assign(fields->begin(), fields->end());
+    }
+    const ProjectionKey key(cacheId, signature);
+    ProjectionCache &cache = ProjectionCache::getInstance();
+    std::shared_ptr<const Segment> sortedValues = cache.getSegment(key);
+    if (sortedValues != NULL) {
+        LOG(TRACEL) << "InmemoryFCInternalTable::sortBy: found in the cache";
+        return sortedValues;
+    }
 
     if (unmergedSegments.size() > 0) {
-        sortedValues = InmemoryFCInternalTable::mergeUnmergedSegments(values, sorted, unmergedSegments, true, 1);
+        LOG(TRACEL) << "InmemoryFCInternalTable::mergeUnmergedSegments";
+        sortedValues = InmemoryFCInternalTable::mergeUnmergedSegments(values, sorted, unmergedSegments, primarySort, nthreads);
         assert(sortedValues->getNColumns() == nfields);
     } else {
-        if (!isSorted()) {
-            sortedValues = values->sortBy(NULL);
+        if (primarySort && !isSorted()) {
+            LOG(TRACEL) << "InmemoryFCInternalTable::sorting";
+            if (nthreads < 2) {
+                sortedValues = values->sortBy(NULL);
+            } else {
+                sortedValues = values->sortBy(NULL, nthreads, false);
+            }
         } else {
             sortedValues = values;
         }
     }
 
+    if (!primarySort) {
+        LOG(TRACEL) << "InmemoryFCInternalTable::sorting2";
+        if (nthreads < 2) {
+            sortedValues = sortedValues->sortBy(fields);
+        } else {
+            sortedValues = sortedValues->sortBy(fields, nthreads, false);
+        }
+    }
+
+    //The cost to compute the projection again is the cost of the sorting
+    const double n = (double) std::max((size_t) 2, sortedValues->getNRows());
+    if (cache.putSegment(key, sortedValues, n * std::log2(n))) {
+        projectionsCached = true;
+    }
+    return sortedValues;
+}
+
+FCInternalTableItr *InmemoryFCInternalTable::getSortedIterator() const {
     InmemoryFCInternalTableItr *itr = new InmemoryFCInternalTableItr();
-    itr->init(nfields, iteration, sortedValues);
+    itr->init(nfields, iteration, getSortedValues(NULL, 1));
     return itr;
 }
 
 FCInternalTableItr *InmemoryFCInternalTable::getSortedIterator(int nthreads) const {
-    std::shared_ptr<const Segment> sortedValues;
-
-    if (unmergedSegments.size() > 0) {
-        sortedValues = InmemoryFCInternalTable::mergeUnmergedSegments(values, sorted, unmergedSegments, true, nthreads);
-        assert(sortedValues->getNColumns() == nfields);
-    } else {
-        if (!isSorted()) {
-            sortedValues = values->sortBy(NULL, nthreads, false);
-        } else {
-            sortedValues = values;
-        }
-    }
-
     InmemoryFCInternalTableItr *itr = new InmemoryFCInternalTableItr();
-    itr->init(nfields, iteration, sortedValues);
+    itr->init(nfields, iteration, getSortedValues(NULL, nthreads));
     return itr;
 }
 
 FCInternalTableItr *InmemoryFCInternalTable::sortBy(const std::vector<uint8_t> &fields) const {
-    bool primarySort = isPrimarySorting(fields);
-    std::shared_ptr<const Segment> sortedValues;
-
     LOG(TRACEL) << "InmemoryFCInternalTable::sortBy";
-
-    if (unmergedSegments.size() > 0) {
-        LOG(TRACEL) << "InmemoryFCInternalTable::mergeUnmergedSegments";
-        sortedValues = InmemoryFCInternalTable::mergeUnmergedSegments(values, sorted, unmergedSegments, primarySort, 1);
-    } else {
-        if (primarySort && !isSorted()) {
-            LOG(TRACEL) << "InmemoryFCInternalTable::sorting";
-            sortedValues = values->sortBy(NULL);
-        } else {
-            sortedValues = values;
-        }
-    }
-
-    if (!primarySort) {
-        LOG(TRACEL) << "InmemoryFCInternalTable::sorting2";
-        sortedValues = sortedValues->sortBy(&fields);
-    }
-
     InmemoryFCInternalTableItr *tableItr = new InmemoryFCInternalTableItr();
-    tableItr->init(nfields, iteration, sortedValues);
+    tableItr->init(nfields, iteration, getSortedValues(&fields, 1));
     return tableItr;
 }
 
 FCInternalTableItr *InmemoryFCInternalTable::sortBy(
         const std::vector<uint8_t> &fields,
         const int nthreads) const {
-    if (nthreads < 2) {
-        return sortBy(fields);
-    }
-
-    bool primarySort = isPrimarySorting(fields);
-    std::shared_ptr<const Segment> sortedValues;
-
     LOG(TRACEL) << "InmemoryFCInternalTable::sortBy (parallel version)";
-
-    if (unmergedSegments.size() > 0) {
-        LOG(TRACEL) << "InmemoryFCInternalTable::mergeUnmergedSegments";
-        sortedValues = InmemoryFCInternalTable::mergeUnmergedSegments(values, sorted, unmergedSegments, primarySort, nthreads);
-    } else {
-        if (primarySort && !isSorted()) {
-            LOG(TRACEL) << "InmemoryFCInternalTable::sorting";
-            sortedValues = values->sortBy(NULL, nthreads, false);
-        } else {
-            sortedValues = values;
-        }
-    }
-
-    if (!primarySort) {
-        LOG(TRACEL) << "InmemoryFCInternalTable::sorting2 (parallel)";
-        sortedValues = sortedValues->sortBy(&fields, nthreads, false);
-    }
-
     InmemoryFCInternalTableItr *tableItr = new InmemoryFCInternalTableItr();
-    tableItr->init(nfields, iteration, sortedValues);
+    tableItr->init(nfields, iteration, getSortedValues(&fields, nthreads));
     return tableItr;
 }
 
@@ -840,6 +824,9 @@ void InmemoryFCInternalTable::releaseIterator(FCInternalTableItr * itr) const {
 }
 
 InmemoryFCInternalTable::~InmemoryFCInternalTable() {
+    if (projectionsCached) {
+        ProjectionCache::getInstance().removeOwner(cacheId);
+    }
 }
 
 void InmemoryFCInternalTableItr::init(const uint8_t nfields, const size_t iteration,
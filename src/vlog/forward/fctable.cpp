@@ -2,17 +2,22 @@
 #include <vlog/fctable.h>
 #include <vlog/joinprocessor.h>
 #include <vlog/concepts.h>
+#include <vlog/tablespiller.h>
 
 #include <trident/model/table.h>
 
+#include <algorithm>
+
 // Note: When running multithreaded, mutex != NULL.
 
 FCTable::FCTable(std::mutex *mutex, const uint8_t sizeRow) :
-    sizeRow(sizeRow), mutex(mutex) {
+    sizeRow(sizeRow), cacheId(ProjectionCache::newOwnerId()), mutex(mutex) {
     }
 
-std::string FCTable::getSignature(const Literal &literal) {
-    std::string out = "";
+//Every term is encoded with two numbers: 0 and the value of a constant, or 1
+//and the position of the first occurrence of a variable
+std::vector<uint64_t> FCTable::getSignature(const Literal &literal) {
+    std::vector<uint64_t> out;
     std::vector<uint8_t> existingVars;
     for (uint8_t i = 0; i < literal.getTupleSize(); ++i) {
         VTerm t = literal.getTermAtPos(i);
@@ -29,9 +34,11 @@ std::string FCTable::getSignature(const Literal &literal) {
             if (! found) {
                 existingVars.push_back(t.getId());
             }
-            out += " " + std::to_string(idx) + " ";
+            out.push_back(1);
+            out.push_back(-1 - idx);
         } else {
-            out += " " + std::to_string(t.getValue()) + " ";
+            out.push_back(0);
+            out.push_back(t.getValue());
         }
     }
     return out;
@@ -106,6 +113,169 @@ void FCTable::collapseBlocks(size_t maxIter, int nThreads) {
         itr++;
     }
     blocks.begin()->table = currentTable;
+    blocks.begin()->spilled = false;
+}
+
+std::vector<std::pair<std::shared_ptr<const FCInternalTable>,
+    std::shared_ptr<const FCInternalTable>>> FCTable::copyEDBColumns(
+            const std::vector<PredId_t> &preds) {
+    std::vector<std::pair<std::shared_ptr<const FCInternalTable>,
+        std::shared_ptr<const FCInternalTable>>> replaced;
+    for (auto &block : blocks) {
+        if (dynamic_cast<const InmemoryFCInternalTable*>(
+                    block.table.get()) == NULL) {
+            continue;
+        }
+        std::vector<std::shared_ptr<Column>> columns;
+        bool found = false;
+        for (uint8_t i = 0; i < sizeRow; ++i) {
+            std::shared_ptr<Column> column = block.table->getColumn(i);
+            const EDBColumn *edbColumn = dynamic_cast<const EDBColumn*>(
+                    column.get());
+            if (edbColumn != NULL && std::find(preds.begin(), preds.end(),
+                        edbColumn->getLiteral().getPredicate().getId()) !=
+                    preds.end()) {
+                std::vector<Term_t> values = column->getReader()->asVector();
+                column = ColumnWriter::getColumn(values, false);
+                found = true;
+            }
+            columns.push_back(column);
+        }
+        if (found) {
+            std::shared_ptr<const Segment> segment(new Segment(sizeRow,
+                        columns));
+            std::shared_ptr<const FCInternalTable> table(
+                    new InmemoryFCInternalTable(sizeRow, block.iteration,
+                        block.table->isSorted(), segment));
+            replaced.push_back(std::make_pair(block.table, table));
+            block.table = table;
+        }
+    }
+    return replaced;
+}
+
+//Compares the current row of itr with the row idx of rows
+static int cmpRow(FCInternalTableItr *itr,
+        const std::vector<std::vector<Term_t>> &rows, const size_t idx) {
+    for (uint8_t i = 0; i < rows.size(); ++i) {
+        const Term_t v = itr->getCurrentValue(i);
+        if (v != rows[i][idx]) {
+            return v < rows[i][idx] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+std::vector<std::pair<std::shared_ptr<const FCInternalTable>,
+    std::shared_ptr<const FCInternalTable>>> FCTable::removeRows(
+            std::shared_ptr<const Segment> rows) {
+    std::vector<std::pair<std::shared_ptr<const FCInternalTable>,
+        std::shared_ptr<const FCInternalTable>>> replaced;
+    if (rows == NULL || rows->isEmpty() || sizeRow == 0) {
+        return replaced;
+    }
+    std::vector<std::vector<Term_t>> toRemove;
+    for (uint8_t i = 0; i < sizeRow; ++i) {
+        toRemove.push_back(rows->getColumn(i)->getReader()->asVector());
+    }
+    const size_t nToRemove = toRemove[0].size();
+
+    std::vector<FCBlock> newBlocks;
+    for (auto &block : blocks) {
+        //Both the block and the rows to remove are sorted: merge them
+        std::vector<ColumnWriter> writers(sizeRow);
+        size_t idx = 0;
+        bool removed = false;
+        FCInternalTableItr *itr = block.table->getSortedIterator();
+        while (itr->hasNext()) {
+            itr->next();
+            int cmp = 1;
+            while (idx < nToRemove && (cmp = cmpRow(itr, toRemove, idx)) > 0) {
+                idx++;
+            }
+            if (idx < nToRemove && cmp == 0) {
+                removed = true;
+                continue;
+            }
+            for (uint8_t i = 0; i < sizeRow; ++i) {
+                writers[i].add(itr->getCurrentValue(i));
+            }
+        }
+        block.table->releaseIterator(itr);
+        if (!removed) {
+            newBlocks.push_back(block);
+            continue;
+        }
+        std::shared_ptr<const FCInternalTable> table;
+        if (!writers[0].isEmpty()) {
+            std::vector<std::shared_ptr<Column>> columns;
+            for (auto &writer : writers) {
+                columns.push_back(writer.getColumn());
+            }
+            std::shared_ptr<const Segment> segment(new Segment(sizeRow,
+                        columns));
+            table = std::shared_ptr<const FCInternalTable>(
+                    new InmemoryFCInternalTable(sizeRow, block.iteration,
+                        true, segment));
+            newBlocks.push_back(block);
+            newBlocks.back().table = table;
+            newBlocks.back().spilled = false;
+        }
+        replaced.push_back(std::make_pair(block.table, table));
+    }
+    if (!replaced.empty()) {
+        blocks.clear();
+        for (const auto &block : newBlocks) {
+            blocks.push_back(block);
+        }
+        //The filtered tables in the cache may contain the removed rows
+        cache.clear();
+        ProjectionCache::getInstance().removeOwner(cacheId);
+    }
+    return replaced;
+}
+
+//Only the in-memory tables use memory. The other ones (e.g., views over
+//the EDB layer) are not counted.
+static size_t getBlockMemorySize(const FCBlock &block) {
+    if (block.spilled || dynamic_cast<const InmemoryFCInternalTable*>(
+                block.table.get()) == NULL) {
+        return 0;
+    }
+    return block.table->getNRows() * block.table->getRowSize() *
+        sizeof(Term_t);
+}
+
+size_t FCTable::getMemorySize() const {
+    size_t size = 0;
+    for (const auto &block : blocks) {
+        size += getBlockMemorySize(block);
+    }
+    return size;
+}
+
+size_t FCTable::spill(const size_t iteration, const std::string &path) {
+    for (auto &block : blocks) {
+        if (block.iteration == iteration) {
+            const size_t size = getBlockMemorySize(block);
+            block.spilled = true;
+            if (size == 0) {
+                return 0;
+            }
+            size_t written;
+            std::shared_ptr<const FCInternalTable> table =
+                TableSpiller::spill(block.table, iteration, path, written);
+            if (table == NULL) {
+                return 0;
+            }
+            LOG(DEBUGL) << "Moved " << block.table->getNRows() << " rows of "
+                "iteration " << iteration << " to disk (" << written <<
+                " bytes)";
+            block.table = table;
+            return size;
+        }
+    }
+    return 0;
 }
 
 FCBlock &FCTable::getLastBlock() {
@@ -146,7 +316,8 @@ std::shared_ptr<const FCTable> FCTable::filter(const Literal &literal,
         }
         std::shared_ptr<FCTable> output;
         std::vector<FCBlock>::iterator itr = blocks.begin();
-        std::string signature = getSignature(literal);
+        std::vector<uint64_t> signature = getSignature(literal);
+        const ProjectionKey key(cacheId, signature);
 
         if (mutex != NULL) {
             // We need a separate lock for the cache. We cannot promote the mutex to an exclusive
@@ -156,7 +327,14 @@ std::shared_ptr<const FCTable> FCTable::filter(const Literal &literal,
 
         FCCache::iterator cacheItr = cache.find(signature);
         if (cacheItr != cache.end()) {
-            output = cacheItr->second.table;
+            output = ProjectionCache::getInstance().getTable(key);
+            if (output == NULL) {
+                //The table was evicted from the shared cache
+                cache.erase(cacheItr);
+                cacheItr = cache.end();
+            }
+        }
+        if (cacheItr != cache.end()) {
 
             //First update the entry if there are more entries. Otherwise return
             if (cacheItr->second.end < blocks[blocks.size() - 1].iteration) {
@@ -249,6 +427,10 @@ std::shared_ptr<const FCTable> FCTable::filter(const Literal &literal,
             b.end = blocks[blocks.size() - 1].iteration;
             cache.insert(std::make_pair(signature, b));
         }
+        //Computing the table again requires a scan of this table
+        ProjectionCache::getInstance().putTable(key, output,
+                output->getNAllRows() * output->getSizeRow() * sizeof(Term_t),
+                (double) getNAllRows());
         if (mutex != NULL) {
             cache_mutex.unlock();
         }
@@ -356,12 +538,16 @@ bool FCTable::add(std::shared_ptr<const FCInternalTable> t,
         if (lastItr == iteration) {
             FCBlock *lastBlock = &blocks[sz - 1];
             lastBlock->table = lastBlock->table->merge(t, nthreads);
+            lastBlock->spilled = false;
 
             //Invalidate possible subtables which contain partial results
             for (FCCache::iterator itr = cache.begin(); itr != cache.end(); ++itr) {
                 if (itr->second.end == lastItr) {
+                    std::shared_ptr<FCTable> table = itr->second.table.lock();
                     itr->second.end = std::max<Term_t>(0, lastItr - 1);
-                    itr->second.table->removeBlock(lastItr);
+                    if (table != NULL) {
+                        table->removeBlock(lastItr);
+                    }
                 }
             }
             return false;
@@ -414,6 +600,7 @@ size_t FCTable::getNAllRows() const {
 }
 
 FCTable::~FCTable() {
+    ProjectionCache::getInstance().removeOwner(cacheId);
 }
 
 FCIterator::FCIterator(
@@ -0,0 +1,215 @@
+#include <vlog/fctupleitr.h>
+
+#include <algorithm>
+
+FCTupleItr::FCTupleItr(FCIterator tableItr, const Literal &query,
+        const bool returnOnlyVars) : tuple(query.getTuple()),
+    repeated(query.getRepeatedVars()), filtering(false), currentTable(0),
+    readersOpen(false), rowsLeft(0), nextProcessed(false),
+    nextOutcome(false) {
+        for (uint8_t i = 0; i < tuple.getSize(); ++i) {
+            if (!returnOnlyVars || tuple.get(i).isVariable()) {
+                outputPos.push_back(i);
+            }
+        }
+        current.resize(tuple.getSize());
+        row.resize(outputPos.size());
+        pendingRow.resize(outputPos.size());
+
+        while (!tableItr.isEmpty()) {
+            std::shared_ptr<const FCInternalTable> table =
+                tableItr.getCurrentTable();
+            //Skip the tables whose constant columns contradict the query
+            bool skip = table->isEmpty();
+            for (uint8_t i = 0; i < tuple.getSize() && !skip; ++i) {
+                if (!tuple.get(i).isVariable() && table->isColumnConstant(i)
+                        && table->getValueConstantColumn(i) !=
+                        tuple.get(i).getValue()) {
+                    skip = true;
+                }
+            }
+            if (!skip) {
+                tables.push_back(table);
+            }
+            tableItr.moveNextCount();
+        }
+    }
+
+bool FCTupleItr::moveToNextTable() {
+    readers.clear();
+    readersOpen = false;
+    while (currentTable < tables.size()) {
+        const FCInternalTable *table = tables[currentTable++].get();
+        rowsLeft = table->getNRows();
+        if (rowsLeft == 0) {
+            continue;
+        }
+        checkPos.clear();
+        for (uint8_t i = 0; i < tuple.getSize(); ++i) {
+            if (!tuple.get(i).isVariable() && !table->isColumnConstant(i)) {
+                checkPos.push_back(i);
+            }
+        }
+        filtering = !checkPos.empty() || !repeated.empty();
+        return true;
+    }
+    //Release the tables that were read
+    tables.clear();
+    currentTable = 0;
+    return false;
+}
+
+void FCTupleItr::openReaders() {
+    const FCInternalTable *table = tables[currentTable - 1].get();
+    readers.resize(tuple.getSize());
+    for (auto pos : outputPos) {
+        readers[pos] = table->getColumn(pos)->getReader();
+    }
+    if (filtering) {
+        for (auto pos : checkPos) {
+            if (readers[pos] == NULL) {
+                readers[pos] = table->getColumn(pos)->getReader();
+            }
+        }
+        for (const auto &r : repeated) {
+            if (readers[r.first] == NULL) {
+                readers[r.first] = table->getColumn(r.first)->getReader();
+            }
+            if (readers[r.second] == NULL) {
+                readers[r.second] = table->getColumn(r.second)->getReader();
+            }
+        }
+    }
+    readersOpen = true;
+}
+
+bool FCTupleItr::readMatchingRow(std::vector<Term_t> &out) {
+    while (true) {
+        while (rowsLeft == 0) {
+            if (!moveToNextTable()) {
+                return false;
+            }
+        }
+        if (!readersOpen) {
+            openReaders();
+        }
+        rowsLeft--;
+        for (uint8_t i = 0; i < readers.size(); ++i) {
+            if (readers[i] != NULL) {
+                current[i] = readers[i]->next();
+            }
+        }
+        bool match = true;
+        for (auto pos : checkPos) {
+            if (current[pos] != tuple.get(pos).getValue()) {
+                match = false;
+                break;
+            }
+        }
+        for (uint8_t i = 0; i < repeated.size() && match; ++i) {
+            if (current[repeated[i].first] != current[repeated[i].second]) {
+                match = false;
+            }
+        }
+        if (match) {
+            for (uint8_t i = 0; i < outputPos.size(); ++i) {
+                out[i] = current[outputPos[i]];
+            }
+            return true;
+        }
+    }
+}
+
+bool FCTupleItr::hasNext() {
+    if (!nextProcessed) {
+        nextOutcome = readMatchingRow(pendingRow);
+        nextProcessed = true;
+    }
+    return nextOutcome;
+}
+
+void FCTupleItr::next() {
+    if (!nextProcessed) {
+        hasNext();
+    }
+    row.swap(pendingRow);
+    nextProcessed = false;
+}
+
+size_t FCTupleItr::getTupleSize() {
+    return outputPos.size();
+}
+
+uint64_t FCTupleItr::getElementAt(const int pos) {
+    return row[pos];
+}
+
+size_t FCTupleItr::nextRows(uint64_t *out, const size_t maxRows) {
+    const size_t width = outputPos.size();
+    size_t n = 0;
+    if (nextProcessed) {
+        nextProcessed = false;
+        if (!nextOutcome) {
+            return 0;
+        }
+        if (maxRows == 0) {
+            nextProcessed = true;
+            return 0;
+        }
+        std::copy(pendingRow.begin(), pendingRow.end(), out);
+        n++;
+    }
+    while (n < maxRows) {
+        if (rowsLeft == 0 && !moveToNextTable()) {
+            break;
+        }
+        if (!filtering) {
+            //All the rows of the table match: copy them column by column
+            if (!readersOpen) {
+                openReaders();
+            }
+            const size_t k = std::min(maxRows - n, rowsLeft);
+            for (size_t c = 0; c < width; ++c) {
+                ColumnReader *reader = readers[outputPos[c]].get();
+                uint64_t *o = out + n * width + c;
+                for (size_t r = 0; r < k; ++r) {
+                    o[r * width] = reader->next();
+                }
+            }
+            n += k;
+            rowsLeft -= k;
+        } else {
+            if (!readMatchingRow(row)) {
+                break;
+            }
+            std::copy(row.begin(), row.end(), out + n * width);
+            n++;
+        }
+    }
+    return n;
+}
+
+size_t FCTupleItr::count() {
+    size_t n = 0;
+    if (nextProcessed) {
+        nextProcessed = false;
+        if (!nextOutcome) {
+            return 0;
+        }
+        n++;
+    }
+    while (true) {
+        if (rowsLeft == 0 && !moveToNextTable()) {
+            break;
+        }
+        if (!filtering) {
+            n += rowsLeft;
+            rowsLeft = 0;
+        } else if (readMatchingRow(row)) {
+            n++;
+        } else {
+            break;
+        }
+    }
+    return n;
+}
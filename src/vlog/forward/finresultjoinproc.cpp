@@ -187,6 +187,19 @@ bool SingleHeadFinalRuleProcessor::isEmpty() const {
     return true;
 }
 
+size_t SingleHeadFinalRuleProcessor::getNRows() const {
+    size_t n = 0;
+    for (int i = 0; i < nbuffers; ++i) {
+        if (utmpt != NULL && utmpt[i] != NULL)
+            n += utmpt[i]->getNRows();
+        if (tmpt != NULL && tmpt[i] != NULL)
+            n += tmpt[i]->getNRows();
+        if (tmptseg != NULL && tmptseg[i] != NULL)
+            n += tmptseg[i]->getNRows();
+    }
+    return n;
+}
+
 /*uint32_t SingleHeadFinalRuleProcessor::getRowsInBlock(const int blockId,
   const bool unique) const {
   if (!unique) {
@@ -810,6 +823,14 @@ bool FinalRuleProcessor::isEmpty() const {
     return out;
 }
 
+size_t FinalRuleProcessor::getNRows() const {
+    size_t n = 0;
+    for (auto &t : atomTables) {
+        n += t->getNRows();
+    }
+    return n;
+}
+
 void FinalRuleProcessor::processResults(const int blockid, const bool unique,
         std::mutex *m) {
     for(auto &t : atomTables) {
@@ -2,12 +2,15 @@
 #include <vlog/joinprocessor.h>
 #include <vlog/seminaiver.h>
 #include <vlog/filterhashjoin.h>
+#include <vlog/radixhashjoin.h>
 #include <vlog/finalresultjoinproc.h>
 #include <trident/model/table.h>
 
 #include <google/dense_hash_map>
 #include <limits.h>
 #include <vector>
+#include <atomic>
+#include <algorithm>
 #include <inttypes.h>
 
 bool JoinExecutor::isJoinTwoToOneJoin(const RuleExecutionPlan &hv,
@@ -1211,9 +1214,18 @@ void JoinExecutor::mergejoin(const FCInternalTable * t1, SemiNaiver * naiver,
             it.moveNextCount();
         }
 
-        if (tablesToMergeJoin.size() > 0)
-            do_mergejoin(t1, fields1, tablesToMergeJoin, fields1, NULL, NULL,
-                    fields2, output, nthreads);
+        if (tablesToMergeJoin.size() > 0) {
+            //Large inputs are joined without sorting them
+            if (fields1.size() > 0 &&
+                    t1->estimateNRows() > THRESHOLD_RADIXJOIN) {
+                LOG(TRACEL) << "Calling RadixHashJoin";
+                RadixHashJoin::join(t1, tablesToMergeJoin, fields1, fields2,
+                        output, nthreads);
+            } else {
+                do_mergejoin(t1, fields1, tablesToMergeJoin, fields1, NULL, NULL,
+                        fields2, output, nthreads);
+            }
+        }
     } else {
         //Positions to return when filtering the input query
         std::vector<uint8_t> posToCopy;
@@ -1740,6 +1752,44 @@ void JoinExecutor::do_merge_join_classicalgo(const std::vector<const std::vector
 #endif
 }
 
+//Adds the constant columns of the results of the faster merge join. counts
+//contains the number of results in every block.
+static void addFasterAlgoConstants(const uint8_t nValBlocks,
+        const Term_t *valBlocks, const std::vector<size_t> &counts,
+        ResultJoinProcessor *output) {
+    //Add the constant in the resultcontainer to avoid continuos additions
+    assert(output->getNCopyFromFirst() == 1);
+    const uint8_t posBlocksInResult = output->getPosFromFirst()[0].first;
+    for (uint8_t i = 0; i < nValBlocks; ++i) {
+        if (counts[i] != 0) {
+            std::shared_ptr<Column> column(new CompressedColumn(valBlocks[i], counts[i]));
+            output->addColumn(i, posBlocksInResult, column, false, false);
+        }
+    }
+
+    //Add all other constants that were set in row but do not come from the two sides
+    for (uint8_t i = 0; i < output->getRowSize(); ++i) {
+        if (i != posBlocksInResult) {
+            //Does it come from the literal?
+            bool found = false;
+            for (uint8_t j = 0; j < output->getNCopyFromSecond() && !found; ++j) {
+                if (i == output->getPosFromSecond()[j].first) {
+                    found = true;
+                }
+            }
+            if (!found) {
+                //Add it as constant
+                for (uint8_t m = 0; m < nValBlocks; ++m) {
+                    if (counts[m] != 0) {
+                        std::shared_ptr<Column> column(new CompressedColumn(output->getRawRow()[i], counts[m]));
+                        output->addColumn(m, i, column, false, true);
+                    }
+                }
+            }
+        }
+    }
+}
+
 void JoinExecutor::do_merge_join_fasteralgo(FCInternalTableItr * sortedItr1,
         FCInternalTableItr * sortedItr2,
         const std::vector<uint8_t> &fields1,
@@ -1811,37 +1861,7 @@ void JoinExecutor::do_merge_join_fasteralgo(FCInternalTableItr * sortedItr1,
         }
     }
 
-    //Add the constant in the resultcontainer to avoid continuos additions
-    assert(output->getNCopyFromFirst() == 1);
-    const uint8_t posBlocksInResult = output->getPosFromFirst()[0].first;
-    for (uint8_t i = 0; i < nValBlocks; ++i) {
-        if (counts[i] != 0) {
-            std::shared_ptr<Column> column(new CompressedColumn(valBlocks[i], counts[i]));
-            output->addColumn(i, posBlocksInResult, column, false, false);
-        }
-    }
-
-    //Add all other constants that were set in row but do not come from the two sides
-    for (uint8_t i = 0; i < output->getRowSize(); ++i) {
-        if (i != posBlocksInResult) {
-            //Does it come from the literal?
-            bool found = false;
-            for (uint8_t j = 0; j < output->getNCopyFromSecond() && !found; ++j) {
-                if (i == output->getPosFromSecond()[j].first) {
-                    found = true;
-                }
-            }
-            if (!found) {
-                //Add it as constant
-                for (uint8_t m = 0; m < nValBlocks; ++m) {
-                    if (counts[m] != 0) {
-                        std::shared_ptr<Column> column(new CompressedColumn(output->getRawRow()[i], counts[m]));
-                        output->addColumn(m, i, column, false, true);
-                    }
-                }
-            }
-        }
-    }
+    addFasterAlgoConstants(nValBlocks, valBlocks, counts, output);
 }
 
 struct CreateParallelMergeJoiner {
@@ -1884,44 +1904,275 @@ struct CreateParallelMergeJoiner {
     }
 };
 
-struct CreateParallelMergeJoinerVectors {
-    const std::vector<const std::vector<Term_t> *> vectors;
-    const std::vector<const std::vector<Term_t> *> vectors2;
+//Part of a merge join. [l1, u1) and [l2, u2) contain the rows of the two
+//sorted inputs with a join key in the same range.
+struct MergeJoinRange {
+    size_t l1, u1;
+    size_t l2, u2;
+};
+
+size_t JoinExecutor::lowerBoundKey(const std::vector<const std::vector<Term_t> *> &vectors,
+        const std::vector<uint8_t> &fields, size_t n,
+        const std::vector<const std::vector<Term_t> *> &keyVectors,
+        const std::vector<uint8_t> &keyFields, size_t i) {
+    size_t l = 0;
+    while (l < n) {
+        size_t m = (l + n) / 2;
+        if (JoinExecutor::cmp(vectors, m, keyVectors, i, fields, keyFields) < 0) {
+            l = m + 1;
+        } else {
+            n = m;
+        }
+    }
+    return l;
+}
+
+//Builds the ranges from the split points (positions in the two inputs). The
+//ranges in which one of the two sides is empty cannot produce results.
+static std::vector<MergeJoinRange> rangesFromBounds(
+        std::vector<std::pair<size_t, size_t>> &bounds) {
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    std::vector<MergeJoinRange> ranges;
+    for (size_t i = 1; i < bounds.size(); ++i) {
+        MergeJoinRange r;
+        r.l1 = bounds[i - 1].first;
+        r.u1 = bounds[i].first;
+        r.l2 = bounds[i - 1].second;
+        r.u2 = bounds[i].second;
+        if (r.l1 < r.u1 && r.l2 < r.u2) {
+            ranges.push_back(r);
+        }
+    }
+    return ranges;
+}
+
+//Splits the two sorted inputs of a merge join in (about) 2 * ntasks ranges of
+//join keys. The split points are taken at regular intervals on both sides, so
+//that a large number of rows on either side is spread over several ranges.
+//Rows with the same key are never split.
+static std::vector<MergeJoinRange> partitionMergeJoin(
+        const std::vector<const std::vector<Term_t> *> &vectors1, size_t n1,
+        const std::vector<const std::vector<Term_t> *> &vectors2, size_t n2,
+        const std::vector<uint8_t> &fields1,
+        const std::vector<uint8_t> &fields2,
+        const size_t ntasks) {
+    std::vector<std::pair<size_t, size_t>> bounds;
+    if (n1 == 0 || n2 == 0) {
+        return std::vector<MergeJoinRange>();
+    }
+    bounds.push_back(std::make_pair(0, 0));
+    bounds.push_back(std::make_pair(n1, n2));
+    if (fields1.size() == 0) {
+        //No join keys: every part of the first input is joined with all the
+        //second one
+        for (size_t i = 1; i < ntasks; ++i) {
+            bounds.push_back(std::make_pair(n1 * i / ntasks, 0));
+        }
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+        std::vector<MergeJoinRange> ranges;
+        for (size_t i = 1; i < bounds.size(); ++i) {
+            MergeJoinRange r;
+            r.l1 = bounds[i - 1].first;
+            r.u1 = bounds[i].first;
+            r.l2 = 0;
+            r.u2 = n2;
+            if (r.l1 < r.u1) {
+                ranges.push_back(r);
+            }
+        }
+        return ranges;
+    }
+    for (size_t i = 1; i < ntasks; ++i) {
+        const size_t k1 = n1 * i / ntasks;
+        bounds.push_back(std::make_pair(
+                    JoinExecutor::lowerBoundKey(vectors1, fields1, n1, vectors1, fields1, k1),
+                    JoinExecutor::lowerBoundKey(vectors2, fields2, n2, vectors1, fields1, k1)));
+        const size_t k2 = n2 * i / ntasks;
+        bounds.push_back(std::make_pair(
+                    JoinExecutor::lowerBoundKey(vectors1, fields1, n1, vectors2, fields2, k2),
+                    JoinExecutor::lowerBoundKey(vectors2, fields2, n2, vectors2, fields2, k2)));
+    }
+    return rangesFromBounds(bounds);
+}
+
+//Each thread takes the next range that was not processed yet, until all are
+//done, so that threads that finish early take over the remaining work. The
+//results of a thread are buffered in its own Output, which adds them to the
+//processor (under the lock) when it is full and at the end.
+struct ParallelMergeJoinWorker {
+    const std::vector<MergeJoinRange> &ranges;
+    std::atomic<size_t> &nextRange;
+    const std::vector<const std::vector<Term_t> *> &vectors;
+    const std::vector<const std::vector<Term_t> *> &vectors2;
     const std::vector<uint8_t> &fields1;
     const std::vector<uint8_t> &fields2;
     const uint8_t posBlocks;
-    const uint8_t nValBlocks;
     const Term_t *valBlocks;
     ResultJoinProcessor *output;
     std::mutex *m;
 
-    CreateParallelMergeJoinerVectors(const std::vector<const std::vector<Term_t> *> &vectors,
-            const std::vector<const std::vector<Term_t> *> vectors2,
+    ParallelMergeJoinWorker(const std::vector<MergeJoinRange> &ranges,
+            std::atomic<size_t> &nextRange,
+            const std::vector<const std::vector<Term_t> *> &vectors,
+            const std::vector<const std::vector<Term_t> *> &vectors2,
             const std::vector<uint8_t> &fields1,
             const std::vector<uint8_t> &fields2,
             const uint8_t posBlocks,
-            const uint8_t nValBlocks,
             const Term_t *valBlocks,
             ResultJoinProcessor *output,
             std::mutex *m) :
-        vectors(vectors), vectors2(vectors2),
-        fields1(fields1), fields2(fields2), posBlocks(posBlocks),
-        nValBlocks(nValBlocks), valBlocks(valBlocks), output(output), m(m) {
+        ranges(ranges), nextRange(nextRange), vectors(vectors),
+        vectors2(vectors2), fields1(fields1), fields2(fields2),
+        posBlocks(posBlocks), valBlocks(valBlocks), output(output), m(m) {
         }
 
     void operator()(const ParallelRange& r) const {
-        LOG(TRACEL) << "Parallel vector merge joiner: r.begin = " << r.begin() << ", r.end = " << r.end();
         Output out(output, m);
+        size_t i;
+        while ((i = nextRange++) < ranges.size()) {
+            const MergeJoinRange &range = ranges[i];
+            LOG(TRACEL) << "Parallel vector merge joiner: l1 = " << range.l1
+                << ", u1 = " << range.u1 << ", l2 = " << range.l2
+                << ", u2 = " << range.u2;
+            JoinExecutor::do_merge_join_classicalgo(vectors, range.l1,
+                    range.u1, vectors2, range.l2, range.u2,
+                    fields1, fields2,
+                    posBlocks, valBlocks, &out);
+        }
+        out.flush();
+    }
+};
 
-        JoinExecutor::do_merge_join_classicalgo(vectors, r.begin(), r.end(),
-                vectors2, 0, vectors2[0]->size(),
-                fields1, fields2,
-                posBlocks, valBlocks, &out);
+//Same as ParallelMergeJoinWorker, for the faster algorithm. Here the ranges
+//refer to the grouped keys of the first input. The values of every range are
+//stored in results, per block.
+struct ParallelFasterMergeJoinWorker {
+    const std::vector<MergeJoinRange> &ranges;
+    std::atomic<size_t> &nextRange;
+    const std::vector<std::pair<Term_t, uint32_t>> &keys;
+    const std::vector<Term_t> &keyColumn;
+    const std::vector<Term_t> &copyColumn;
+    std::vector<std::vector<std::vector<Term_t>>> &results;
+
+    ParallelFasterMergeJoinWorker(const std::vector<MergeJoinRange> &ranges,
+            std::atomic<size_t> &nextRange,
+            const std::vector<std::pair<Term_t, uint32_t>> &keys,
+            const std::vector<Term_t> &keyColumn,
+            const std::vector<Term_t> &copyColumn,
+            std::vector<std::vector<std::vector<Term_t>>> &results) :
+        ranges(ranges), nextRange(nextRange), keys(keys),
+        keyColumn(keyColumn), copyColumn(copyColumn), results(results) {
+        }
 
-        out.flush();
+    void operator()(const ParallelRange& r) const {
+        size_t i;
+        while ((i = nextRange++) < ranges.size()) {
+            const MergeJoinRange &range = ranges[i];
+            std::vector<std::vector<Term_t>> &blocks = results[i];
+            size_t k = range.l1;
+            for (size_t j = range.l2; j < range.u2; ++j) {
+                const Term_t v = keyColumn[j];
+                while (k < range.u1 && keys[k].first < v) {
+                    k++;
+                }
+                if (k == range.u1) {
+                    break;
+                }
+                if (keys[k].first == v) {
+                    uint64_t mask = keys[k].second;
+                    uint8_t idx = 0;
+                    while (mask != 0) {
+                        if (mask & 1) {
+                            if (blocks.size() <= idx) {
+                                blocks.resize(idx + 1);
+                            }
+                            blocks[idx].push_back(copyColumn[j]);
+                        }
+                        mask = (mask >> 1);
+                        idx++;
+                    }
+                }
+            }
+        }
     }
 };
 
+void JoinExecutor::do_merge_join_fasteralgo(
+        const std::vector<const std::vector<Term_t> *> &vectors1, size_t n1,
+        const std::vector<const std::vector<Term_t> *> &vectors2, size_t n2,
+        const std::vector<uint8_t> &fields1,
+        const std::vector<uint8_t> &fields2,
+        const uint8_t posBlocks,
+        const uint8_t nValBlocks,
+        const Term_t *valBlocks,
+        ResultJoinProcessor * output,
+        int nthreads) {
+
+    if (n1 == 0 || n2 == 0) {
+        return;
+    }
+
+    //Group the keys on the left side, as in the sequential version
+    const std::vector<Term_t> &keyColumn1 = *vectors1[fields1[0]];
+    const std::vector<Term_t> &blockColumn = *vectors1[posBlocks];
+    std::vector<std::pair<Term_t, uint32_t>> keys;
+    for (size_t i = 0; i < n1; ++i) {
+        if (i == 0 || keyColumn1[i] != keys.back().first) {
+            keys.push_back(std::make_pair(keyColumn1[i], (uint32_t) 0));
+        }
+        uint8_t idxBlock = 0;
+        while (valBlocks[idxBlock] < blockColumn[i]) {
+            idxBlock++;
+        }
+        keys.back().second |= 1 << idxBlock;
+    }
+
+    //Split both sides in ranges of keys
+    assert(output->getNCopyFromSecond() == 1);
+    const std::vector<Term_t> &keyColumn2 = *vectors2[fields2[0]];
+    const std::vector<Term_t> &copyColumn =
+        *vectors2[output->getPosFromSecond()[0].second];
+    const size_t ntasks = MERGEJOIN_TASKS_PER_THREAD * nthreads;
+    std::vector<std::pair<size_t, size_t>> bounds;
+    bounds.push_back(std::make_pair(0, 0));
+    bounds.push_back(std::make_pair(keys.size(), n2));
+    for (size_t i = 1; i < ntasks; ++i) {
+        Term_t splitKeys[2];
+        splitKeys[0] = keys[keys.size() * i / ntasks].first;
+        splitKeys[1] = keyColumn2[n2 * i / ntasks];
+        for (int j = 0; j < 2; ++j) {
+            const Term_t key = splitKeys[j];
+            size_t p1 = std::lower_bound(keys.begin(), keys.end(),
+                    std::make_pair(key, (uint32_t) 0)) - keys.begin();
+            size_t p2 = std::lower_bound(keyColumn2.begin(),
+                    keyColumn2.begin() + n2, key) - keyColumn2.begin();
+            bounds.push_back(std::make_pair(p1, p2));
+        }
+    }
+    std::vector<MergeJoinRange> ranges = rangesFromBounds(bounds);
+
+    std::vector<std::vector<std::vector<Term_t>>> results(ranges.size());
+    std::atomic<size_t> nextRange(0);
+    ParallelTasks::parallel_for(0, nthreads, 1,
+            ParallelFasterMergeJoinWorker(ranges, nextRange, keys,
+                keyColumn2, copyColumn, results));
+
+    //Add the results in the order of the keys, so that the result is the
+    //same as with the sequential version
+    std::vector<size_t> counts(256);
+    for (auto &blocks : results) {
+        for (uint8_t idx = 0; idx < blocks.size(); ++idx) {
+            for (auto v : blocks[idx]) {
+                output->processResultsAtPos(idx, 0, v, false);
+            }
+            counts[idx] += blocks[idx].size();
+        }
+    }
+    addFasterAlgoConstants(nValBlocks, valBlocks, counts, output);
+}
+
 void JoinExecutor::do_mergejoin(const FCInternalTable * filteredT1,
         std::vector<uint8_t> &fieldsToSortInMap,
         std::vector<std::shared_ptr<const FCInternalTable>> &tables2,
@@ -1988,7 +2239,6 @@ void JoinExecutor::do_mergejoin(const FCInternalTable * filteredT1,
     // Possibility to parallelize, but also a possibility to create a faster
     // iterator.
     if (nthreads > 1) {
-        // chunks = (totalsize1 + nthreads - 1) / nthreads;
         chunks = (totalsize1 + 2 * nthreads - 1) / (2 * nthreads);
     }
     // for (int i = 0; i < ncols; i++) {
@@ -2056,7 +2306,17 @@ void JoinExecutor::do_mergejoin(const FCInternalTable * filteredT1,
             t2Size = vectors2[0]->size();
         }
         assert(t2->getNRows() == t2Size);
-        if (faster) {
+        const bool parallel = nthreads > 1 && totalsize1 > 1 &&
+            (totalsize1 + t2Size) > 4096;
+        if (faster && parallel && vectors2.size() > 0) {
+            LOG(TRACEL) << "Faster algo, parallel";
+            JoinExecutor::do_merge_join_fasteralgo(vectors, totalsize1,
+                    vectors2, t2Size, fields1, fields2, posBlocks, nValBlocks,
+                    valBlocks, output, nthreads);
+#if DEBUG
+            output->checkSizes();
+#endif
+        } else if (faster) {
             sortedItr2 = new VectorFCInternalTableItr(vectors2, 0, t2Size);
             LOG(TRACEL) << "Faster algo";
             JoinExecutor::do_merge_join_fasteralgo(itr1, sortedItr2, fields1,
@@ -2069,18 +2329,20 @@ void JoinExecutor::do_mergejoin(const FCInternalTable * filteredT1,
         } else {
             LOG(TRACEL) << "Classical algo";
             LOG(TRACEL) << "totalsize1 = " << totalsize1 << ", t2Size = " << t2Size;
-            if (/* vectorSupported && */ nthreads > 1 && totalsize1 > 1 && (totalsize1 + t2Size) > 4096 /* ? */) {
-                LOG(TRACEL) << "Chunk size = " << chunks << ", t2->getNRows() = " << t2Size;
+            if (parallel) {
                 if (vector2Supported) {
-                    //tbb::parallel_for(tbb::blocked_range<int>(0, totalsize1, chunks),
-                    //        CreateParallelMergeJoinerVectors(vectors, vectors2, fields1, fields2, posBlocks, nValBlocks, valBlocks, output, &m));
-                    ParallelTasks::parallel_for(0, totalsize1, chunks,
-                            CreateParallelMergeJoinerVectors(vectors, vectors2,
-                                fields1, fields2, posBlocks, nValBlocks,
-                                valBlocks, output, &m));
+                    std::vector<MergeJoinRange> ranges = partitionMergeJoin(
+                            vectors, totalsize1, vectors2, t2Size,
+                            fields1, fields2,
+                            MERGEJOIN_TASKS_PER_THREAD * nthreads);
+                    LOG(TRACEL) << "Ranges = " << ranges.size() << ", t2->getNRows() = " << t2Size;
+                    std::atomic<size_t> nextRange(0);
+                    ParallelTasks::parallel_for(0, nthreads, 1,
+                            ParallelMergeJoinWorker(ranges, nextRange,
+                                vectors, vectors2, fields1, fields2,
+                                posBlocks, valBlocks, output, &m));
                 } else {
-                    //tbb::parallel_for(tbb::blocked_range<int>(0, totalsize1, chunks),
-                    //        CreateParallelMergeJoiner(vectors, sortedItr2, fields1, fields2, posBlocks, nValBlocks, valBlocks, output, &m));
+                    LOG(TRACEL) << "Chunk size = " << chunks << ", t2->getNRows() = " << t2Size;
                     ParallelTasks::parallel_for(0, totalsize1, chunks,
                             CreateParallelMergeJoiner(vectors, sortedItr2,
                                 fields1, fields2, posBlocks, nValBlocks,
@@ -0,0 +1,471 @@
+#include <vlog/leapfrogjoin.h>
+#include <vlog/joinprocessor.h>
+#include <vlog/seminaiver.h>
+#include <vlog/fcinttable.h>
+
+#include <trident/utils/parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+//First position in [from, to) whose value is >= v (or > v, if strict). The
+//values are sorted, and the position is close to from most of the times, so
+//it is first bounded with an exponential search.
+static size_t gallop(const std::vector<Term_t> &column, size_t from,
+        const size_t to, const Term_t v, const bool strict) {
+    size_t step = 1;
+    size_t bound = from;
+    while (bound < to && (strict ? column[bound] <= v : column[bound] < v)) {
+        from = bound + 1;
+        bound += step;
+        step <<= 1;
+    }
+    bound = std::min(bound, to);
+    if (strict) {
+        return std::upper_bound(column.begin() + from, column.begin() + bound,
+                v) - column.begin();
+    } else {
+        return std::lower_bound(column.begin() + from, column.begin() + bound,
+                v) - column.begin();
+    }
+}
+
+struct CompareRows {
+    const std::vector<std::vector<Term_t>> &columns;
+
+    CompareRows(const std::vector<std::vector<Term_t>> &columns) :
+        columns(columns) {
+        }
+
+    int compare(const size_t r1, const size_t r2) const {
+        for (const auto &column : columns) {
+            if (column[r1] != column[r2]) {
+                return column[r1] < column[r2] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    bool operator()(const size_t r1, const size_t r2) const {
+        return compare(r1, r2) < 0;
+    }
+};
+
+//Sorts the rows of columns
+static void sortRows(std::vector<std::vector<Term_t>> &columns,
+        const int nthreads) {
+    CompareRows cmp(columns);
+    const size_t nrows = columns[0].size();
+    bool sorted = true;
+    for (size_t i = 1; i < nrows && sorted; ++i) {
+        sorted = cmp.compare(i - 1, i) <= 0;
+    }
+    if (sorted) {
+        return;
+    }
+    std::vector<size_t> rows(nrows);
+    for (size_t i = 0; i < nrows; ++i) {
+        rows[i] = i;
+    }
+    ParallelTasks::sort_int(rows.begin(), rows.end(), cmp, nthreads);
+    for (auto &c : columns) {
+        std::vector<Term_t> out(nrows);
+        for (size_t i = 0; i < nrows; ++i) {
+            out[i] = c[rows[i]];
+        }
+        c.swap(out);
+    }
+}
+
+//Merges the sorted runs in out (one vector per column), without duplicates
+static void mergeRuns(const std::vector<std::vector<std::vector<Term_t>>> &runs,
+        std::vector<std::vector<Term_t>> &out) {
+    //Position of every run, in a heap ordered on the current row of the run
+    typedef std::pair<size_t, size_t> Cursor;
+    auto compare = [&](const Cursor &c1, const Cursor &c2) {
+        for (size_t i = 0; i < out.size(); ++i) {
+            const Term_t v1 = runs[c1.first][i][c1.second];
+            const Term_t v2 = runs[c2.first][i][c2.second];
+            if (v1 != v2) {
+                return v1 > v2;
+            }
+        }
+        return false;
+    };
+    std::vector<Cursor> heap;
+    size_t total = 0;
+    for (size_t r = 0; r < runs.size(); ++r) {
+        if (!runs[r][0].empty()) {
+            heap.push_back(std::make_pair(r, 0));
+            total += runs[r][0].size();
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), compare);
+    for (auto &c : out) {
+        c.reserve(total);
+    }
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), compare);
+        Cursor &cursor = heap.back();
+        const std::vector<std::vector<Term_t>> &run = runs[cursor.first];
+        bool duplicate = !out[0].empty();
+        for (size_t i = 0; i < out.size() && duplicate; ++i) {
+            duplicate = out[i].back() == run[i][cursor.second];
+        }
+        if (!duplicate) {
+            for (size_t i = 0; i < out.size(); ++i) {
+                out[i].push_back(run[i][cursor.second]);
+            }
+        }
+        if (++cursor.second < run[0].size()) {
+            std::push_heap(heap.begin(), heap.end(), compare);
+        } else {
+            heap.pop_back();
+        }
+    }
+}
+
+//************** TRIE ITERATOR ***************
+void LeapfrogTrieJoin::TrieIterator::open() {
+    if (depth < 0) {
+        pos[0] = 0;
+        end[0] = relation->nrows;
+    } else {
+        //The children of the current value are the rows in which it appears
+        pos[depth + 1] = pos[depth];
+        end[depth + 1] = gallop(relation->columns[depth], pos[depth],
+                end[depth], key(), true);
+    }
+    depth++;
+}
+
+void LeapfrogTrieJoin::TrieIterator::next() {
+    pos[depth] = gallop(relation->columns[depth], pos[depth], end[depth],
+            key(), true);
+}
+
+void LeapfrogTrieJoin::TrieIterator::seek(const Term_t v) {
+    pos[depth] = gallop(relation->columns[depth], pos[depth], end[depth],
+            v, false);
+}
+//************** END TRIE ITERATOR ***************
+
+//Every worker takes ranges of values of the first variable and joins them
+struct LeapfrogTrieJoin::JoinRanges {
+    const LeapfrogTrieJoin &join;
+    const std::vector<Term_t> &bounds;
+    std::atomic<size_t> &nextRange;
+    ResultJoinProcessor *output;
+    std::mutex *m;
+
+    JoinRanges(const LeapfrogTrieJoin &join,
+            const std::vector<Term_t> &bounds,
+            std::atomic<size_t> &nextRange,
+            ResultJoinProcessor *output,
+            std::mutex *m) : join(join), bounds(bounds),
+    nextRange(nextRange), output(output), m(m) {
+    }
+
+    void operator()(const ParallelRange& r) const {
+        for (size_t worker = r.begin(); worker < r.end(); ++worker) {
+            Output out(output, m);
+            State state;
+            join.initState(state, &out);
+            size_t idx;
+            //Range i contains the values in [bounds[i], bounds[i + 1])
+            while ((idx = nextRange++) < bounds.size()) {
+                const bool bounded = idx + 1 < bounds.size();
+                join.search(state, 0, bounds[idx],
+                        bounded ? bounds[idx + 1] : 0, bounded);
+            }
+            join.flush(state);
+            out.flush();
+        }
+    }
+};
+
+LeapfrogTrieJoin::LeapfrogTrieJoin(const std::vector<const Literal *> &body,
+        const std::vector<Literal> &heads) : atoms(body) {
+    //Count in how many atoms every variable appears
+    std::vector<uint8_t> bodyVars;
+    std::vector<size_t> occurrences;
+    for (const auto literal : body) {
+        for (auto v : literal->getAllVars()) {
+            auto itr = std::find(bodyVars.begin(), bodyVars.end(), v);
+            if (itr == bodyVars.end()) {
+                bodyVars.push_back(v);
+                occurrences.push_back(1);
+            } else {
+                occurrences[itr - bodyVars.begin()]++;
+            }
+        }
+    }
+    std::vector<uint8_t> headVars;
+    for (const auto &head : heads) {
+        std::vector<uint8_t> v = head.getAllVars();
+        std::copy(v.begin(), v.end(), std::back_inserter(headVars));
+    }
+
+    //The variables shared by most atoms are bound first, since they restrict
+    //the most the values of the others. Ties are broken on the order of the
+    //atoms in the plan.
+    std::vector<size_t> order;
+    for (size_t i = 0; i < bodyVars.size(); ++i) {
+        if (occurrences[i] > 1 || std::find(headVars.begin(), headVars.end(),
+                    bodyVars[i]) != headVars.end()) {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return occurrences[a] > occurrences[b];
+            });
+    for (auto i : order) {
+        variables.push_back(bodyVars[i]);
+    }
+
+    uint32_t offset = 0;
+    for (const auto &head : heads) {
+        for (uint8_t i = 0; i < head.getTupleSize(); ++i) {
+            const VTerm t = head.getTermAtPos(i);
+            if (t.isVariable()) {
+                auto itr = std::find(variables.begin(), variables.end(),
+                        t.getId());
+                posFromFirst.push_back(std::make_pair(offset + i,
+                            itr - variables.begin()));
+            }
+        }
+        offset += head.getTupleSize();
+    }
+}
+
+bool LeapfrogTrieJoin::load(SemiNaiver *naiver, const Literal &literal,
+        const size_t min, const size_t max, Relation &relation,
+        int &processedTables, const int nthreads) {
+    //The tables contain a column for every occurrence of a variable. Take
+    //the first one of the variables that are bound, in the order in which
+    //they are bound.
+    std::vector<std::pair<uint8_t, uint8_t>> varColumn;
+    uint8_t column = 0;
+    for (uint8_t i = 0; i < literal.getTupleSize(); ++i) {
+        const VTerm t = literal.getTermAtPos(i);
+        if (!t.isVariable()) {
+            continue;
+        }
+        auto itr = std::find(variables.begin(), variables.end(), t.getId());
+        if (itr != variables.end()) {
+            const uint8_t var = itr - variables.begin();
+            bool found = false;
+            for (const auto &p : varColumn) {
+                found |= p.first == var;
+            }
+            if (!found) {
+                varColumn.push_back(std::make_pair(var, column));
+            }
+        }
+        column++;
+    }
+    std::sort(varColumn.begin(), varColumn.end());
+    for (const auto &p : varColumn) {
+        relation.vars.push_back(p.first);
+    }
+    relation.columns.resize(varColumn.size());
+
+    FCIterator itr = naiver->getTable(literal, min, max);
+    if (literal.getPredicate().getType() == IDB) {
+        processedTables += itr.getNTables();
+    }
+    if (varColumn.empty()) {
+        //The atom only needs to be non-empty
+        relation.nrows = itr.isEmpty() ? 0 : 1;
+        return !itr.isEmpty();
+    }
+    //The blocks in memory are sorted on the columns of the variables with
+    //sortBy, which keeps the sorted projection in the ProjectionCache: the
+    //next executions of the rule do not sort the same blocks again. The
+    //other blocks are collected in one run, which is sorted here. Then the
+    //sorted runs are merged.
+    std::vector<uint8_t> fields;
+    for (const auto &p : varColumn) {
+        fields.push_back(p.second);
+    }
+    std::vector<std::vector<std::vector<Term_t>>> runs;
+    std::vector<std::vector<Term_t>> unsorted(varColumn.size());
+    size_t nblocks = 0;
+    size_t nsorted = 0;
+    while (!itr.isEmpty()) {
+        std::shared_ptr<const FCInternalTable> table = itr.getCurrentTable();
+        const bool inmemory = dynamic_cast<const InmemoryFCInternalTable*>(
+                table.get()) != NULL;
+        FCInternalTableItr *tableItr = inmemory ?
+            table->sortBy(fields, nthreads) : table->getIterator();
+        std::vector<const std::vector<Term_t> *> vectors =
+            tableItr->getAllVectors(nthreads);
+        if (!vectors.empty()) {
+            if (inmemory) {
+                runs.push_back(std::vector<std::vector<Term_t>>());
+                for (size_t i = 0; i < varColumn.size(); ++i) {
+                    runs.back().push_back(*vectors[varColumn[i].second]);
+                }
+                nsorted++;
+            } else {
+                for (size_t i = 0; i < varColumn.size(); ++i) {
+                    const std::vector<Term_t> *v = vectors[varColumn[i].second];
+                    unsorted[i].insert(unsorted[i].end(), v->begin(), v->end());
+                }
+            }
+        }
+        tableItr->deleteAllVectors(vectors);
+        table->releaseIterator(tableItr);
+        nblocks++;
+        itr.moveNextCount();
+    }
+    if (!unsorted[0].empty()) {
+        sortRows(unsorted, nthreads);
+        runs.push_back(std::vector<std::vector<Term_t>>());
+        runs.back().swap(unsorted);
+    }
+    mergeRuns(runs, relation.columns);
+    relation.nrows = relation.columns[0].size();
+    LOG(DEBUGL) << "Leapfrog: atom " << literal.tostring() << " has " <<
+        relation.nrows << " distinct rows in " << nblocks << " blocks (" <<
+        nsorted << " sorted with the cache)";
+    return relation.nrows > 0;
+}
+
+void LeapfrogTrieJoin::initState(State &state, Output *output) const {
+    state.output = output;
+    for (const auto &relation : relations) {
+        state.iterators.push_back(TrieIterator(&relation));
+    }
+    state.levels.resize(variables.size());
+    for (size_t i = 0; i < relations.size(); ++i) {
+        for (auto var : relations[i].vars) {
+            state.levels[var].push_back(&state.iterators[i]);
+        }
+    }
+    state.binding.resize(variables.size());
+    state.results.resize(variables.size());
+    for (const auto &r : state.results) {
+        state.vectors.push_back(&r);
+    }
+}
+
+void LeapfrogTrieJoin::flush(State &state) const {
+    const size_t n = state.results[0].size();
+    for (size_t i = 0; i < n; ++i) {
+        state.output->processResults(0, state.vectors, i, state.vectors, i,
+                false);
+    }
+    for (auto &r : state.results) {
+        r.clear();
+    }
+}
+
+void LeapfrogTrieJoin::search(State &state, const size_t level,
+        const Term_t lo, const Term_t hi, const bool bounded) const {
+    std::vector<TrieIterator *> &iterators = state.levels[level];
+    bool atEnd = false;
+    for (auto it : iterators) {
+        it->open();
+        if (lo > 0) {
+            it->seek(lo);
+        }
+        atEnd |= it->atEnd();
+    }
+
+    if (!atEnd) {
+        std::sort(iterators.begin(), iterators.end(),
+                [](const TrieIterator *a, const TrieIterator *b) {
+                return a->key() < b->key();
+                });
+        const size_t n = iterators.size();
+        size_t p = 0;
+        Term_t max = iterators[n - 1]->key();
+        while (!bounded || max < hi) {
+            TrieIterator *it = iterators[p];
+            if (it->key() == max) {
+                //All the atoms contain the value
+                state.binding[level] = max;
+                if (level + 1 == variables.size()) {
+                    for (size_t i = 0; i < variables.size(); ++i) {
+                        state.results[i].push_back(state.binding[i]);
+                    }
+                    if (state.results[0].size() >= LEAPFROG_BATCH) {
+                        flush(state);
+                    }
+                } else {
+                    search(state, level + 1, 0, 0, false);
+                }
+                it->next();
+            } else {
+                it->seek(max);
+            }
+            if (it->atEnd()) {
+                break;
+            }
+            max = it->key();
+            p = (p + 1) % n;
+        }
+    }
+
+    for (auto it : iterators) {
+        it->up();
+    }
+}
+
+void LeapfrogTrieJoin::join(SemiNaiver *naiver,
+        const std::vector<std::pair<size_t, size_t>> &ranges,
+        ResultJoinProcessor *output,
+        int &processedTables,
+        const int nthreads) {
+    relations.clear();
+    relations.resize(atoms.size());
+    for (size_t i = 0; i < atoms.size(); ++i) {
+        if (!load(naiver, *atoms[i], ranges[i].first, ranges[i].second,
+                    relations[i], processedTables, nthreads)) {
+            LOG(DEBUGL) << "Leapfrog: atom " << i << " is empty";
+            relations.clear();
+            return;
+        }
+    }
+    //The atoms without variables to bind were only checked
+    relations.erase(std::remove_if(relations.begin(), relations.end(),
+                [](const Relation &r) {
+                return r.vars.empty();
+                }), relations.end());
+
+    //Split the values of the first variable in ranges, using the largest
+    //atom that contains it
+    const Relation *largest = NULL;
+    for (const auto &relation : relations) {
+        if (relation.vars[0] == 0 &&
+                (largest == NULL || relation.nrows > largest->nrows)) {
+            largest = &relation;
+        }
+    }
+    std::vector<Term_t> bounds;
+    bounds.push_back(0);
+    if (nthreads > 1 && largest->nrows > LEAPFROG_PARALLEL_THRESHOLD) {
+        const std::vector<Term_t> &column = largest->columns[0];
+        const size_t ntasks = nthreads * LEAPFROG_TASKS_PER_THREAD;
+        for (size_t i = 1; i < ntasks; ++i) {
+            const Term_t v = column[column.size() * i / ntasks];
+            if (v > bounds.back()) {
+                bounds.push_back(v);
+            }
+        }
+    }
+
+    std::atomic<size_t> nextRange(0);
+    if (bounds.size() > 1) {
+        std::mutex m;
+        const int nworkers = std::min((size_t) nthreads, bounds.size());
+        ParallelTasks::parallel_for(0, nworkers, 1,
+                JoinRanges(*this, bounds, nextRange, output, &m));
+    } else {
+        JoinRanges(*this, bounds, nextRange, output, NULL)(
+                ParallelRange(0, 1));
+    }
+    relations.clear();
+}
@@ -0,0 +1,166 @@
+#include <vlog/projectioncache.h>
+#include <vlog/fctable.h>
+
+#include <algorithm>
+
+std::atomic<uint64_t> ProjectionCache::ownerCounter(0);
+
+ProjectionCache &ProjectionCache::getInstance() {
+    //Never destroyed: the tables that are destroyed at exit still use it
+    static ProjectionCache *instance = new ProjectionCache();
+    return *instance;
+}
+
+void ProjectionCache::setBudget(const size_t bytes) {
+    std::vector<std::shared_ptr<FCTable>> toRelease;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = bytes;
+        evict();
+        if (budget == 0) {
+            candidates.clear();
+        }
+        toRelease.swap(released);
+    }
+}
+
+ProjectionCache::Entry *ProjectionCache::find(const ProjectionKey &key) {
+    auto itr = entries.find(key);
+    if (itr == entries.end()) {
+        stats.misses++;
+        return NULL;
+    }
+    stats.hits++;
+    //Renew the priority of the entry
+    Entry &entry = itr->second;
+    priorities.erase(entry.position);
+    entry.position = priorities.insert(std::make_pair(
+                inflation + entry.cost / std::max((size_t) 1, entry.size),
+                key));
+    return &entry;
+}
+
+void ProjectionCache::add(const ProjectionKey &key, Entry &entry) {
+    auto itr = entries.find(key);
+    if (itr != entries.end()) {
+        remove(itr);
+    }
+    if (entry.size > budget) {
+        return;
+    }
+    entry.position = priorities.insert(std::make_pair(
+                inflation + entry.cost / std::max((size_t) 1, entry.size),
+                key));
+    entries.insert(std::make_pair(key, entry));
+    owners[key.owner].push_back(key.signature);
+    stats.bytes += entry.size;
+    stats.entries++;
+    evict();
+}
+
+void ProjectionCache::remove(std::unordered_map<ProjectionKey, Entry,
+        ProjectionKeyHash>::iterator itr) {
+    const ProjectionKey &key = itr->first;
+    Entry &entry = itr->second;
+    auto owner = owners.find(key.owner);
+    if (owner != owners.end()) {
+        auto &signatures = owner->second;
+        signatures.erase(std::find(signatures.begin(), signatures.end(),
+                    key.signature));
+        if (signatures.empty()) {
+            owners.erase(owner);
+        }
+    }
+    priorities.erase(entry.position);
+    stats.bytes -= entry.size;
+    stats.entries--;
+    if (entry.table != NULL) {
+        released.push_back(entry.table);
+    }
+    entries.erase(itr);
+}
+
+void ProjectionCache::evict() {
+    while (stats.bytes > budget && !priorities.empty()) {
+        auto lowest = priorities.begin();
+        inflation = lowest->first;
+        remove(entries.find(lowest->second));
+        stats.evictions++;
+    }
+}
+
+std::shared_ptr<const Segment> ProjectionCache::getSegment(
+        const ProjectionKey &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (budget == 0) {
+        return std::shared_ptr<const Segment>();
+    }
+    Entry *entry = find(key);
+    return entry != NULL ? entry->segment : std::shared_ptr<const Segment>();
+}
+
+bool ProjectionCache::putSegment(const ProjectionKey &key,
+        std::shared_ptr<const Segment> segment, const double cost) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (budget == 0) {
+        return false;
+    }
+    if (candidates.erase(key) == 0) {
+        if (candidates.size() >= PROJECTIONCACHE_MAX_CANDIDATES) {
+            candidates.clear();
+        }
+        candidates.insert(key);
+        return false;
+    }
+    Entry entry;
+    entry.segment = segment;
+    entry.size = segment->getNRows() * segment->getNColumns() *
+        sizeof(Term_t);
+    entry.cost = cost;
+    add(key, entry);
+    return true;
+}
+
+std::shared_ptr<FCTable> ProjectionCache::getTable(const ProjectionKey &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry *entry = find(key);
+    return entry != NULL ? entry->table : std::shared_ptr<FCTable>();
+}
+
+void ProjectionCache::putTable(const ProjectionKey &key,
+        std::shared_ptr<FCTable> table, const size_t size, const double cost) {
+    std::vector<std::shared_ptr<FCTable>> toRelease;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (budget > 0) {
+            Entry entry;
+            entry.table = table;
+            entry.size = size;
+            entry.cost = cost;
+            add(key, entry);
+        }
+        toRelease.swap(released);
+    }
+}
+
+void ProjectionCache::removeOwner(const uint64_t owner) {
+    std::vector<std::shared_ptr<FCTable>> toRelease;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto itr = owners.find(owner);
+        if (itr == owners.end()) {
+            return;
+        }
+        //remove() changes the list of the owner
+        std::vector<std::vector<uint64_t>> signatures = itr->second;
+        for (const auto &signature : signatures) {
+            remove(entries.find(ProjectionKey(owner, signature)));
+        }
+        toRelease.swap(released);
+    }
+}
+
+ProjectionCache::Stats ProjectionCache::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
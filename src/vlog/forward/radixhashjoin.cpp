@@ -0,0 +1,300 @@
+#include <vlog/radixhashjoin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+struct RadixHashJoin::PartitionChunks {
+    const std::vector<const std::vector<Term_t> *> &vectors;
+    const std::vector<uint8_t> &fields;
+    const size_t nrows;
+    const size_t chunkSize;
+    const uint64_t mask;
+    std::vector<uint64_t> &hashes;
+    //Position in out of the next row of every chunk and partition
+    std::vector<size_t> &positions;
+    Partitioned *out;
+
+    PartitionChunks(const std::vector<const std::vector<Term_t> *> &vectors,
+            const std::vector<uint8_t> &fields, const size_t nrows,
+            const size_t chunkSize, const uint64_t mask,
+            std::vector<uint64_t> &hashes, std::vector<size_t> &positions,
+            Partitioned *out) :
+        vectors(vectors), fields(fields), nrows(nrows), chunkSize(chunkSize),
+        mask(mask), hashes(hashes), positions(positions), out(out) {
+        }
+
+    //If out is NULL, it computes the hashes and counts the rows of every
+    //partition. Otherwise, it copies the rows in out.
+    void operator()(const ParallelRange& r) const {
+        const size_t nparts = mask + 1;
+        for (size_t c = r.begin(); c != r.end(); ++c) {
+            size_t *pos = &positions[c * nparts];
+            const size_t end = std::min(nrows, (c + 1) * chunkSize);
+            if (out == NULL) {
+                for (size_t i = c * chunkSize; i < end; ++i) {
+                    const uint64_t h = RadixHashJoin::hash(vectors, fields, i);
+                    hashes[i] = h;
+                    pos[h & mask]++;
+                }
+            } else {
+                for (size_t i = c * chunkSize; i < end; ++i) {
+                    const uint64_t h = hashes[i];
+                    const size_t idx = pos[h & mask]++;
+                    out->rows[idx] = i;
+                    out->hashes[idx] = h;
+                }
+            }
+        }
+    }
+};
+
+struct RadixHashJoin::BuildPartitions {
+    RadixHashJoin &join;
+
+    BuildPartitions(RadixHashJoin &join) : join(join) {
+    }
+
+    void operator()(const ParallelRange& r) const {
+        for (size_t p = r.begin(); p != r.end(); ++p) {
+            join.buildPartition(p);
+        }
+    }
+};
+
+//Every thread takes the next partition that was not probed yet, so that the
+//threads that finish early take over the remaining ones. The results of a
+//thread are buffered in its own Output.
+struct RadixHashJoin::ProbePartitions {
+    const RadixHashJoin &join;
+    const Partitioned &probe;
+    const std::vector<const std::vector<Term_t> *> &vectors2;
+    const std::vector<uint8_t> &fields2;
+    std::atomic<size_t> &nextPartition;
+    ResultJoinProcessor *output;
+    std::mutex *m;
+
+    ProbePartitions(const RadixHashJoin &join, const Partitioned &probe,
+            const std::vector<const std::vector<Term_t> *> &vectors2,
+            const std::vector<uint8_t> &fields2,
+            std::atomic<size_t> &nextPartition,
+            ResultJoinProcessor *output, std::mutex *m) :
+        join(join), probe(probe), vectors2(vectors2), fields2(fields2),
+        nextPartition(nextPartition), output(output), m(m) {
+        }
+
+    void operator()(const ParallelRange& r) const {
+        Output out(output, m);
+        const size_t nparts = probe.offsets.size() - 1;
+        size_t p;
+        while ((p = nextPartition++) < nparts) {
+            join.probePartition(p, probe, vectors2, fields2, &out);
+        }
+        out.flush();
+    }
+};
+
+uint8_t RadixHashJoin::getBits(const size_t nrows) {
+    //Memory used by every row of the first side: position, hash, chain and
+    //(on average) two buckets
+    const size_t rowSize = 5 * sizeof(size_t);
+    uint8_t bits = 0;
+    while (((size_t) 1 << bits) < RADIXJOIN_MAX_PARTITIONS &&
+            (nrows * rowSize >> bits) > RADIXJOIN_PARTITION_SIZE) {
+        bits++;
+    }
+    return bits;
+}
+
+uint64_t RadixHashJoin::hash(const std::vector<const std::vector<Term_t> *> &vectors,
+        const std::vector<uint8_t> &fields, const size_t row) {
+    uint64_t h = 0;
+    for (auto f : fields) {
+        h ^= (uint64_t) (*vectors[f])[row];
+        //Finalizer of MurmurHash3
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+    }
+    return h;
+}
+
+void RadixHashJoin::partition(const std::vector<const std::vector<Term_t> *> &vectors,
+        const std::vector<uint8_t> &fields, const size_t nrows,
+        Partitioned &out) const {
+    const size_t nparts = (size_t) 1 << bits;
+    const uint64_t mask = nparts - 1;
+    size_t nchunks = nthreads > 1 ? 4 * nthreads : 1;
+    const size_t chunkSize = std::max((size_t) 1,
+            (nrows + nchunks - 1) / nchunks);
+    nchunks = (nrows + chunkSize - 1) / chunkSize;
+
+    std::vector<uint64_t> hashes(nrows);
+    std::vector<size_t> positions(nchunks * nparts);
+    out.rows.resize(nrows);
+    out.hashes.resize(nrows);
+    out.offsets.resize(nparts + 1);
+    if (nchunks == 0) {
+        return;
+    }
+
+    //First count the rows of every chunk in every partition...
+    PartitionChunks count(vectors, fields, nrows, chunkSize, mask, hashes,
+            positions, NULL);
+    if (nchunks > 1) {
+        ParallelTasks::parallel_for(0, nchunks, 1, count);
+    } else {
+        for (size_t i = 0; i < nrows; ++i) {
+            hashes[i] = hash(vectors, fields, i);
+            positions[hashes[i] & mask]++;
+        }
+    }
+    size_t start = 0;
+    for (size_t p = 0; p < nparts; ++p) {
+        out.offsets[p] = start;
+        for (size_t c = 0; c < nchunks; ++c) {
+            const size_t n = positions[c * nparts + p];
+            positions[c * nparts + p] = start;
+            start += n;
+        }
+    }
+    out.offsets[nparts] = start;
+
+    //... then copy them
+    PartitionChunks copy(vectors, fields, nrows, chunkSize, mask, hashes,
+            positions, &out);
+    if (nchunks > 1) {
+        ParallelTasks::parallel_for(0, nchunks, 1, copy);
+    } else {
+        for (size_t i = 0; i < nrows; ++i) {
+            const size_t idx = positions[hashes[i] & mask]++;
+            out.rows[idx] = i;
+            out.hashes[idx] = hashes[i];
+        }
+    }
+}
+
+void RadixHashJoin::buildPartition(const size_t p) {
+    const size_t nbuckets = bucketOffsets[p + 1] - bucketOffsets[p];
+    size_t *b = &buckets[bucketOffsets[p]];
+    //The rows are added from the last one, so that the chains are in the
+    //order of the table
+    for (size_t k = build.offsets[p + 1]; k > build.offsets[p]; --k) {
+        const size_t idx = (build.hashes[k - 1] >> bits) & (nbuckets - 1);
+        next[k - 1] = b[idx];
+        b[idx] = k;
+    }
+}
+
+void RadixHashJoin::probePartition(const size_t p, const Partitioned &probe,
+        const std::vector<const std::vector<Term_t> *> &vectors2,
+        const std::vector<uint8_t> &fields2, Output *out) const {
+    const size_t nbuckets = bucketOffsets[p + 1] - bucketOffsets[p];
+    if (nbuckets == 0) {
+        return;
+    }
+    const size_t *b = &buckets[bucketOffsets[p]];
+    for (size_t k2 = probe.offsets[p]; k2 < probe.offsets[p + 1]; ++k2) {
+        const uint64_t h = probe.hashes[k2];
+        const size_t row2 = probe.rows[k2];
+        for (size_t e = b[(h >> bits) & (nbuckets - 1)]; e != 0;
+                e = next[e - 1]) {
+            if (build.hashes[e - 1] != h) {
+                continue;
+            }
+            const size_t row1 = build.rows[e - 1];
+            bool equal = true;
+            for (size_t i = 0; i < fields1.size() && equal; ++i) {
+                equal = (*vectors1[fields1[i]])[row1] ==
+                    (*vectors2[fields2[i]])[row2];
+            }
+            if (equal) {
+                out->processResults(0, vectors1, row1, vectors2, row2, false);
+            }
+        }
+    }
+}
+
+RadixHashJoin::RadixHashJoin(
+        const std::vector<const std::vector<Term_t> *> &vectors1,
+        const std::vector<uint8_t> &fields1, const size_t nrows1,
+        const int nthreads) : vectors1(vectors1), fields1(fields1),
+    nthreads(nthreads), bits(getBits(nrows1)) {
+    partition(vectors1, fields1, nrows1, build);
+
+    //Every partition gets a power of two buckets, at least twice its rows
+    const size_t nparts = build.offsets.size() - 1;
+    bucketOffsets.resize(nparts + 1);
+    size_t nbuckets = 0;
+    for (size_t p = 0; p < nparts; ++p) {
+        bucketOffsets[p] = nbuckets;
+        const size_t n = build.offsets[p + 1] - build.offsets[p];
+        if (n > 0) {
+            size_t s = 1;
+            while (s < 2 * n) {
+                s <<= 1;
+            }
+            nbuckets += s;
+        }
+    }
+    bucketOffsets[nparts] = nbuckets;
+    buckets.resize(nbuckets);
+    next.resize(nrows1);
+    if (nthreads > 1 && nparts > 1) {
+        ParallelTasks::parallel_for(0, nparts,
+                std::max((size_t) 1, nparts / (4 * nthreads)),
+                BuildPartitions(*this));
+    } else {
+        for (size_t p = 0; p < nparts; ++p) {
+            buildPartition(p);
+        }
+    }
+}
+
+void RadixHashJoin::join(const FCInternalTable *t1,
+        std::vector<std::shared_ptr<const FCInternalTable>> &tables2,
+        const std::vector<uint8_t> &fields1,
+        const std::vector<uint8_t> &fields2,
+        ResultJoinProcessor *output, int nthreads) {
+    FCInternalTableItr *itr1 = t1->getIterator();
+    std::vector<const std::vector<Term_t> *> vectors1 =
+        itr1->getAllVectors(nthreads);
+    const size_t nrows1 = vectors1.size() == 0 ? 0 : vectors1[0]->size();
+
+    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    RadixHashJoin join(vectors1, fields1, nrows1, nthreads);
+    std::chrono::duration<double> sec = std::chrono::system_clock::now() - start;
+    LOG(DEBUGL) << "Radix hash join: " << nrows1 << " rows in "
+        << (1 << join.bits) << " partitions, build time "
+        << sec.count() * 1000 << "ms";
+
+    std::mutex m;
+    for (auto t2 : tables2) {
+        FCInternalTableItr *itr2 = t2->getIterator();
+        std::vector<const std::vector<Term_t> *> vectors2 =
+            itr2->getAllVectors(nthreads);
+        const size_t nrows2 = vectors2.size() == 0 ? 0 : vectors2[0]->size();
+
+        Partitioned probe;
+        join.partition(vectors2, fields2, nrows2, probe);
+        std::atomic<size_t> nextPartition(0);
+        if (nthreads > 1) {
+            ParallelTasks::parallel_for(0, nthreads, 1,
+                    ProbePartitions(join, probe, vectors2, fields2,
+                        nextPartition, output, &m));
+        } else {
+            Output out(output, NULL);
+            for (size_t p = 0; p + 1 < probe.offsets.size(); ++p) {
+                join.probePartition(p, probe, vectors2, fields2, &out);
+            }
+        }
+
+        itr2->deleteAllVectors(vectors2);
+        t2->releaseIterator(itr2);
+    }
+    itr1->deleteAllVectors(vectors1);
+    t1->releaseIterator(itr1);
+}
@@ -0,0 +1,263 @@
+#include <vlog/radixsort.h>
+
+#include <trident/utils/parallel.h>
+
+#include <algorithm>
+
+struct RadixSort::MinMax {
+    const Term_t *values;
+    const size_t n;
+    const size_t chunkSize;
+    std::vector<Term_t> &mins;
+    std::vector<Term_t> &maxs;
+
+    MinMax(const Term_t *values, const size_t n, const size_t chunkSize,
+            std::vector<Term_t> &mins, std::vector<Term_t> &maxs) :
+        values(values), n(n), chunkSize(chunkSize), mins(mins), maxs(maxs) {
+        }
+
+    void operator()(const ParallelRange& r) const {
+        for (size_t c = r.begin(); c != r.end(); ++c) {
+            const size_t end = std::min(n, (c + 1) * chunkSize);
+            Term_t min = values[c * chunkSize];
+            Term_t max = min;
+            for (size_t i = c * chunkSize + 1; i < end; ++i) {
+                if (values[i] < min) {
+                    min = values[i];
+                } else if (values[i] > max) {
+                    max = values[i];
+                }
+            }
+            mins[c] = min;
+            maxs[c] = max;
+        }
+    }
+};
+
+//Copies the values of a column, in the current order of the rows, as
+//distance from the minimum
+struct RadixSort::Gather {
+    const Term_t *values;
+    const Term_t min;
+    const std::vector<size_t> &idxs;
+    const size_t n;
+    const size_t chunkSize;
+    std::vector<uint64_t> &keys;
+
+    Gather(const Term_t *values, const Term_t min,
+            const std::vector<size_t> &idxs, const size_t n,
+            const size_t chunkSize, std::vector<uint64_t> &keys) :
+        values(values), min(min), idxs(idxs), n(n), chunkSize(chunkSize),
+        keys(keys) {
+        }
+
+    void operator()(const ParallelRange& r) const {
+        for (size_t c = r.begin(); c != r.end(); ++c) {
+            const size_t end = std::min(n, (c + 1) * chunkSize);
+            for (size_t i = c * chunkSize; i < end; ++i) {
+                keys[i] = (uint64_t) (values[idxs[i]] - min);
+            }
+        }
+    }
+};
+
+struct RadixSort::RadixPass {
+    const std::vector<uint64_t> &keys;
+    const std::vector<size_t> &idxs;
+    const size_t n;
+    const size_t chunkSize;
+    const uint8_t shift;
+    //Counts (first phase) or positions in the output (second phase) of every
+    //chunk and digit
+    std::vector<size_t> &positions;
+    std::vector<uint64_t> *outKeys;
+    std::vector<size_t> *outIdxs;
+
+    RadixPass(const std::vector<uint64_t> &keys,
+            const std::vector<size_t> &idxs, const size_t n,
+            const size_t chunkSize, const uint8_t shift,
+            std::vector<size_t> &positions,
+            std::vector<uint64_t> *outKeys, std::vector<size_t> *outIdxs) :
+        keys(keys), idxs(idxs), n(n), chunkSize(chunkSize), shift(shift),
+        positions(positions), outKeys(outKeys), outIdxs(outIdxs) {
+        }
+
+    void operator()(const ParallelRange& r) const {
+        for (size_t c = r.begin(); c != r.end(); ++c) {
+            size_t *pos = &positions[c * NDIGITS];
+            const size_t end = std::min(n, (c + 1) * chunkSize);
+            if (outKeys == NULL) {
+                for (size_t i = c * chunkSize; i < end; ++i) {
+                    pos[(keys[i] >> shift) & (NDIGITS - 1)]++;
+                }
+            } else {
+                for (size_t i = c * chunkSize; i < end; ++i) {
+                    const size_t p = pos[(keys[i] >> shift) & (NDIGITS - 1)]++;
+                    (*outKeys)[p] = keys[i];
+                    (*outIdxs)[p] = idxs[i];
+                }
+            }
+        }
+    }
+};
+
+//Copies the rows in the sorted order. If unique is set, a row is copied only
+//if it is different from the previous one. In this case, the first phase
+//(out == NULL) only counts the rows of every chunk.
+struct RadixSort::CopyRows {
+    const std::vector<const std::vector<Term_t> *> &vectors;
+    const std::vector<size_t> &idxs;
+    const size_t n;
+    const size_t chunkSize;
+    const bool unique;
+    std::vector<size_t> &positions;
+    std::vector<std::vector<Term_t>> *out;
+
+    CopyRows(const std::vector<const std::vector<Term_t> *> &vectors,
+            const std::vector<size_t> &idxs, const size_t n,
+            const size_t chunkSize, const bool unique,
+            std::vector<size_t> &positions,
+            std::vector<std::vector<Term_t>> *out) :
+        vectors(vectors), idxs(idxs), n(n), chunkSize(chunkSize),
+        unique(unique), positions(positions), out(out) {
+        }
+
+    bool isDuplicate(const size_t i) const {
+        if (i == 0) {
+            return false;
+        }
+        for (size_t j = 0; j < vectors.size(); ++j) {
+            if ((*vectors[j])[idxs[i]] != (*vectors[j])[idxs[i - 1]]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void operator()(const ParallelRange& r) const {
+        for (size_t c = r.begin(); c != r.end(); ++c) {
+            const size_t end = std::min(n, (c + 1) * chunkSize);
+            size_t p = positions[c];
+            for (size_t i = c * chunkSize; i < end; ++i) {
+                if (unique && isDuplicate(i)) {
+                    continue;
+                }
+                if (out != NULL) {
+                    for (size_t j = 0; j < vectors.size(); ++j) {
+                        (*out)[j][p] = (*vectors[j])[idxs[i]];
+                    }
+                }
+                p++;
+            }
+            if (out == NULL) {
+                positions[c] = p - positions[c];
+            }
+        }
+    }
+};
+
+void RadixSort::sort(const std::vector<const std::vector<Term_t> *> &vectors,
+        const bool unique, const int nthreads,
+        std::vector<std::vector<Term_t>> &out) {
+    out.resize(vectors.size());
+    const size_t n = vectors.size() == 0 ? 0 : vectors[0]->size();
+    if (n == 0) {
+        for (auto &o : out) {
+            o.clear();
+        }
+        return;
+    }
+    size_t nchunks = nthreads > 1 && n >= RADIXSORT_THRESHOLD ?
+        (size_t) nthreads : 1;
+    const size_t chunkSize = (n + nchunks - 1) / nchunks;
+    nchunks = (n + chunkSize - 1) / chunkSize;
+
+    std::vector<size_t> idxs(n);
+    for (size_t i = 0; i < n; ++i) {
+        idxs[i] = i;
+    }
+    std::vector<size_t> tmpIdxs(n);
+    std::vector<uint64_t> keys(n);
+    std::vector<uint64_t> tmpKeys(n);
+    std::vector<size_t> positions(nchunks * NDIGITS);
+    std::vector<Term_t> mins(nchunks);
+    std::vector<Term_t> maxs(nchunks);
+
+    for (size_t col = vectors.size(); col > 0; --col) {
+        const Term_t *values = &(*vectors[col - 1])[0];
+        MinMax minmax(values, n, chunkSize, mins, maxs);
+        ParallelTasks::parallel_for(0, nchunks, 1, minmax);
+        const Term_t min = *std::min_element(mins.begin(), mins.end());
+        const Term_t max = *std::max_element(maxs.begin(), maxs.end());
+        if (min == max) {
+            //All rows have the same value
+            continue;
+        }
+        uint8_t bits = 0;
+        while (bits < 64 && ((uint64_t) (max - min) >> bits) != 0) {
+            bits++;
+        }
+
+        Gather gather(values, min, idxs, n, chunkSize, keys);
+        ParallelTasks::parallel_for(0, nchunks, 1, gather);
+
+        for (uint8_t shift = 0; shift < bits; shift += DIGIT_BITS) {
+            std::fill(positions.begin(), positions.end(), 0);
+            RadixPass count(keys, idxs, n, chunkSize, shift, positions,
+                    NULL, NULL);
+            ParallelTasks::parallel_for(0, nchunks, 1, count);
+            //Skip the digit if all rows have the same value
+            size_t start = 0;
+            bool sameDigit = false;
+            for (size_t d = 0; d < NDIGITS; ++d) {
+                size_t total = 0;
+                for (size_t c = 0; c < nchunks; ++c) {
+                    total += positions[c * NDIGITS + d];
+                }
+                if (total == n) {
+                    sameDigit = true;
+                    break;
+                }
+                for (size_t c = 0; c < nchunks; ++c) {
+                    const size_t cnt = positions[c * NDIGITS + d];
+                    positions[c * NDIGITS + d] = start;
+                    start += cnt;
+                }
+            }
+            if (sameDigit) {
+                continue;
+            }
+            RadixPass scatter(keys, idxs, n, chunkSize, shift, positions,
+                    &tmpKeys, &tmpIdxs);
+            ParallelTasks::parallel_for(0, nchunks, 1, scatter);
+            keys.swap(tmpKeys);
+            idxs.swap(tmpIdxs);
+        }
+    }
+    std::vector<uint64_t>().swap(keys);
+    std::vector<uint64_t>().swap(tmpKeys);
+    std::vector<size_t>().swap(tmpIdxs);
+
+    //Copy the rows, and remove the duplicates
+    std::vector<size_t> starts(nchunks);
+    size_t nrows = n;
+    if (unique) {
+        CopyRows count(vectors, idxs, n, chunkSize, true, starts, NULL);
+        ParallelTasks::parallel_for(0, nchunks, 1, count);
+        nrows = 0;
+        for (size_t c = 0; c < nchunks; ++c) {
+            const size_t cnt = starts[c];
+            starts[c] = nrows;
+            nrows += cnt;
+        }
+    } else {
+        for (size_t c = 0; c < nchunks; ++c) {
+            starts[c] = c * chunkSize;
+        }
+    }
+    for (auto &o : out) {
+        o.resize(nrows);
+    }
+    CopyRows copy(vectors, idxs, n, chunkSize, unique, starts, &out);
+    ParallelTasks::parallel_for(0, nchunks, 1, copy);
+}
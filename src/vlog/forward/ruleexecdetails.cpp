@@ -326,6 +326,7 @@ void RuleExecutionDetails::createExecutionPlans(
     auto &heads = rule.getHeads();
     p.calculateJoinsCoordinates(heads, copyAllVars);
     orderExecutions.push_back(p);
+    checkCyclicBody();
 }
 
 void RuleExecutionDetails::createExecutionPlans(bool copyAllVars) {
@@ -435,4 +436,39 @@ void RuleExecutionDetails::createExecutionPlans(bool copyAllVars) {
         }
         p->calculateJoinsCoordinates(heads, copyAllVars);
     }
+    checkCyclicBody();
+}
+
+void RuleExecutionDetails::checkCyclicBody() {
+    //GYO reduction: remove the atoms whose variables shared with the other
+    //atoms are all contained in a single other atom (the "ears"). The body
+    //is cyclic if the atoms cannot be all removed this way.
+    std::vector<const Literal*> remaining;
+    for (const auto &literal : bodyLiterals) {
+        if (!literal.isNegated() && literal.getNVars() > 0) {
+            remaining.push_back(&literal);
+        }
+    }
+    bool removed = true;
+    while (remaining.size() > 2 && removed) {
+        removed = false;
+        for (size_t i = 0; i < remaining.size() && !removed; ++i) {
+            std::vector<uint8_t> othersVars;
+            for (size_t j = 0; j < remaining.size(); ++j) {
+                if (j != i) {
+                    std::vector<uint8_t> v = remaining[j]->getAllVars();
+                    std::copy(v.begin(), v.end(), std::back_inserter(othersVars));
+                }
+            }
+            std::vector<uint8_t> shared = remaining[i]->getSharedVars(othersVars);
+            for (size_t j = 0; j < remaining.size() && !removed; ++j) {
+                if (j != i && remaining[j]->getSharedVars(shared).size() ==
+                        shared.size()) {
+                    remaining.erase(remaining.begin() + i);
+                    removed = true;
+                }
+            }
+        }
+    }
+    cyclicBody = remaining.size() > 2;
 }
@@ -1,5 +1,6 @@
 #include <vlog/ruleexecplan.h>
 #include <vlog/ruleexecdetails.h>
+#include <vlog/statistics.h>
 
 #include <kognac/logs.h>
 
@@ -60,6 +61,242 @@ RuleExecutionPlan RuleExecutionPlan::reorder(std::vector<uint8_t> &order,
     return newPlan;
 }
 
+//Up to this number of literals, costBasedOrder considers all orders
+#define MAX_DP_LITERALS 10
+
+//Estimate of the values of a variable in a (intermediate) relation
+struct VarEstimate {
+    double ndv;
+    Term_t lo, hi;
+    const Histogram *histogram;
+};
+
+struct PartialOrder {
+    double cost;
+    double card;
+    std::map<uint8_t, VarEstimate> vars;
+    std::vector<uint8_t> order;
+};
+
+static std::map<uint8_t, VarEstimate> estimateVars(const Literal *literal,
+        const size_t card, const TableStatistics *stats) {
+    std::map<uint8_t, VarEstimate> vars;
+    for (uint8_t pos = 0; pos < literal->getTupleSize(); ++pos) {
+        const VTerm term = literal->getTermAtPos(pos);
+        if (!term.isVariable()) {
+            continue;
+        }
+        VarEstimate e;
+        e.ndv = card;
+        e.lo = 0;
+        e.hi = ~((Term_t) 0);
+        e.histogram = NULL;
+        if (stats != NULL && pos < stats->getNColumns()) {
+            const ColumnStatistics &column = stats->getColumn(pos);
+            e.ndv = std::min(e.ndv, (double) column.getNDV());
+            if (!column.getHistogram().isEmpty()) {
+                e.lo = column.getHistogram().getMin();
+                e.hi = column.getHistogram().getMax();
+                e.histogram = &column.getHistogram();
+            }
+        }
+        e.ndv = std::max(e.ndv, 1.0);
+        auto itr = vars.find(term.getId());
+        if (itr == vars.end()) {
+            vars.insert(std::make_pair(term.getId(), e));
+        } else {
+            itr->second.ndv = std::min(itr->second.ndv, e.ndv);
+        }
+    }
+    return vars;
+}
+
+static bool shareVars(const std::map<uint8_t, VarEstimate> &v1,
+        const std::map<uint8_t, VarEstimate> &v2) {
+    for (const auto &v : v2) {
+        if (v1.count(v.first)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Estimates the join of the partial order with a literal. The size of the join
+//on a variable is |R||S| / max(ndv_R, ndv_S), after having restricted both
+//sides to the range of values they have in common.
+static PartialOrder join(const PartialOrder &left, const uint8_t literal,
+        const size_t card, const std::map<uint8_t, VarEstimate> &vars) {
+    PartialOrder out;
+    out.order = left.order;
+    out.order.push_back(literal);
+    out.vars = left.vars;
+    double c = left.card * card;
+    for (const auto &rv : vars) {
+        auto lv = out.vars.find(rv.first);
+        if (lv == out.vars.end()) {
+            out.vars.insert(rv);
+            continue;
+        }
+        VarEstimate &l = lv->second;
+        const VarEstimate &r = rv.second;
+        const Term_t lo = std::max(l.lo, r.lo);
+        const Term_t hi = std::min(l.hi, r.hi);
+        const double fl = l.histogram ? l.histogram->fractionIn(lo, hi) : 1.0;
+        const double fr = r.histogram ? r.histogram->fractionIn(lo, hi) : 1.0;
+        const double ndvl = std::max(1.0, l.ndv * fl);
+        const double ndvr = std::max(1.0, r.ndv * fr);
+        c *= fl * fr / std::max(ndvl, ndvr);
+        l.ndv = std::min(ndvl, ndvr);
+        l.lo = lo;
+        l.hi = hi;
+        if (l.histogram == NULL) {
+            l.histogram = r.histogram;
+        }
+    }
+    for (auto &v : out.vars) {
+        v.second.ndv = std::max(1.0, std::min(v.second.ndv, c));
+    }
+    out.card = c;
+    out.cost = left.cost + c;
+    return out;
+}
+
+//Joins the first n literals of the plan, in their order. If nFixed > 0, the
+//join of the first nFixed literals is known to have observedCard rows.
+static PartialOrder joinPrefix(const RuleExecutionPlan &plan, const uint8_t n,
+        const std::vector<size_t> &cards,
+        const std::vector<std::shared_ptr<const TableStatistics>> &stats,
+        const uint8_t nFixed, const double observedCard) {
+    PartialOrder prefix;
+    prefix.cost = 0;
+    prefix.card = 1;
+    for (uint8_t i = 0; i < n && i < plan.plan.size(); ++i) {
+        if (!plan.plan[i]->isNegated()) {
+            prefix = join(prefix, i, cards[i], estimateVars(plan.plan[i],
+                        cards[i], i < stats.size() ? stats[i].get() : NULL));
+        }
+        if (i + 1 == nFixed) {
+            prefix.card = std::max(1.0, observedCard);
+            for (auto &v : prefix.vars) {
+                v.second.ndv = std::max(1.0, std::min(v.second.ndv,
+                            prefix.card));
+            }
+        }
+    }
+    return prefix;
+}
+
+double RuleExecutionPlan::estimateCardinality(const std::vector<size_t> &cards,
+        const std::vector<std::shared_ptr<const TableStatistics>> &stats,
+        const uint8_t n, const uint8_t nFixed,
+        const double observedCard) const {
+    return joinPrefix(*this, n, cards, stats, nFixed, observedCard).card;
+}
+
+std::vector<uint8_t> RuleExecutionPlan::costBasedOrder(
+        const std::vector<size_t> &cards,
+        const std::vector<std::shared_ptr<const TableStatistics>> &stats,
+        const uint8_t nFixed, const double observedCard) const {
+    //The order starts from the join of the fixed literals, whose size is
+    //known, or from an empty relation
+    PartialOrder start = joinPrefix(*this, nFixed, cards, stats, nFixed,
+            observedCard);
+    start.cost = 0;
+    start.order.clear();
+
+    std::vector<uint8_t> positive, negated;
+    for (uint8_t i = nFixed; i < plan.size(); ++i) {
+        if (plan[i]->isNegated()) {
+            negated.push_back(i);
+        } else {
+            positive.push_back(i);
+        }
+    }
+    const size_t n = positive.size();
+    std::vector<std::map<uint8_t, VarEstimate>> vars;
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t idx = positive[i];
+        vars.push_back(estimateVars(plan[idx], cards[idx],
+                    idx < stats.size() ? stats[idx].get() : NULL));
+    }
+
+    std::vector<uint8_t> best;
+    if (n <= MAX_DP_LITERALS) {
+        //Dynamic programming on the sets of literals joined so far (only
+        //left-deep plans)
+        std::vector<PartialOrder> orders(((size_t) 1) << n);
+        std::vector<bool> reached(orders.size(), false);
+        orders[0] = start;
+        reached[0] = true;
+        for (size_t set = 0; set < orders.size(); ++set) {
+            if (!reached[set]) {
+                continue;
+            }
+            const PartialOrder &current = orders[set];
+            //Avoid cartesian products, unless there is no other choice
+            bool connected = false;
+            for (size_t j = 0; j < n && !connected; ++j) {
+                connected = !(set & (((size_t) 1) << j)) &&
+                    shareVars(current.vars, vars[j]);
+            }
+            for (size_t j = 0; j < n; ++j) {
+                if ((set & (((size_t) 1) << j)) ||
+                        (connected && !shareVars(current.vars, vars[j]))) {
+                    continue;
+                }
+                PartialOrder next = join(current, j, cards[positive[j]],
+                        vars[j]);
+                const size_t nextSet = set | (((size_t) 1) << j);
+                if (!reached[nextSet] || next.cost < orders[nextSet].cost) {
+                    orders[nextSet] = next;
+                    reached[nextSet] = true;
+                }
+            }
+        }
+        best = orders.back().order;
+    } else {
+        //Greedy: always add the literal that leads to the smallest
+        //intermediate result
+        PartialOrder current = start;
+        std::vector<bool> used(n, false);
+        for (size_t step = 0; step < n; ++step) {
+            bool connected = false;
+            for (size_t j = 0; j < n && !connected; ++j) {
+                connected = !used[j] && shareVars(current.vars, vars[j]);
+            }
+            PartialOrder next;
+            size_t chosen = n;
+            for (size_t j = 0; j < n; ++j) {
+                if (used[j] || (connected &&
+                            !shareVars(current.vars, vars[j]))) {
+                    continue;
+                }
+                PartialOrder candidate = join(current, j, cards[positive[j]],
+                        vars[j]);
+                if (chosen == n || candidate.card < next.card) {
+                    next = candidate;
+                    chosen = j;
+                }
+            }
+            used[chosen] = true;
+            current = next;
+        }
+        best = current.order;
+    }
+
+    std::vector<uint8_t> order;
+    for (uint8_t i = 0; i < nFixed; ++i) {
+        order.push_back(i);
+    }
+    for (auto i : best) {
+        order.push_back(positive[i]);
+    }
+    for (auto i : negated) {
+        order.push_back(i);
+    }
+    return order;
+}
+
 void RuleExecutionPlan::calculateJoinsCoordinates(const std::vector<Literal> &heads,
         bool copyAllVars) {
     std::vector<uint8_t> existingVariables;
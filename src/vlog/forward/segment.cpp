@@ -2,6 +2,7 @@
 #include <vlog/segment_support.h>
 #include <vlog/support.h>
 #include <vlog/fcinttable.h>
+#include <vlog/radixsort.h>
 
 //#include <tbb/parallel_for.h>
 
@@ -247,6 +248,19 @@ std::shared_ptr<Segment> Segment::sortBy(const std::vector<uint8_t> *fields,
     }
 }
 
+//Sorts the rows of vectors with RadixSort, and adds the sorted columns to
+//sortedColumns
+static void radixSortColumns(const std::vector<const std::vector<Term_t> *> &vectors,
+        const bool unique, const int nthreads,
+        std::vector<std::shared_ptr<Column>> &sortedColumns) {
+    std::vector<std::vector<Term_t>> out;
+    RadixSort::sort(vectors, unique, nthreads, out);
+    sortedColumns.push_back(ColumnWriter::getColumn(out[0], true));
+    for (int i = 1; i < out.size(); i++) {
+        sortedColumns.push_back(ColumnWriter::getColumn(out[i], false));
+    }
+}
+
 std::shared_ptr<Segment> Segment::intsort(
         const std::vector<uint8_t> *fields) const {
     if (!isEmpty()) {
@@ -298,7 +312,11 @@ std::shared_ptr<Segment> Segment::intsort(
                 idxVarColumns = newIdxVarColumns;
             }
 
-            if (varColumns.size() == 2) {
+            if (varColumns[0]->size() >= RADIXSORT_THRESHOLD) {
+                std::vector<const std::vector<Term_t> *> vectors = getAllVectors(varColumns);
+                radixSortColumns(vectors, false, 1, sortedColumns);
+                deleteAllVectors(varColumns, vectors);
+            } else if (varColumns.size() == 2) {
                 //Populate the array
                 std::vector<const std::vector<Term_t> *> vectors = getAllVectors(varColumns);
                 std::vector<std::pair<Term_t, Term_t>> values;
@@ -450,8 +468,11 @@ std::shared_ptr<Segment> Segment::intsort(
             std::vector<const std::vector<Term_t> *> vectors = getAllVectors(varColumns, nthreads);
 
             size_t sz = varColumns[0]->size();
+            //The comparator sort below cannot remove duplicates with more
+            //than two columns
+            const bool radix = sz >= RADIXSORT_THRESHOLD ||
+                (filterDupl && varColumns.size() > 2);
             std::vector<size_t> idxs;
-            idxs.reserve(sz);
 
             size_t chunks = (sz + nthreads - 1) / nthreads;
 
@@ -461,13 +482,16 @@ std::shared_ptr<Segment> Segment::intsort(
                InitArray(idxs));
                } else
                */
-            {
+            if (!radix) {
+                idxs.reserve(sz);
                 for (size_t i = 0; i < sz; i++) {
                     idxs.push_back(i);
                 }
             }
 
-            if (varColumns.size() == 2) {
+            if (radix) {
+                radixSortColumns(vectors, filterDupl, nthreads, sortedColumns);
+            } else if (varColumns.size() == 2) {
                 //Populate array
                 //std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
                 const Term_t *rawv1 = &(*(vectors[0]))[0];
@@ -626,7 +650,7 @@ std::shared_ptr<Segment> Segment::intsort(
         std::vector<std::shared_ptr<Column>> allSortedColumns;
 
         assert(varColumns.size() > 0);
-        size_t newsize = varColumns[0]->size();
+        size_t newsize = sortedColumns[0]->size();
 
         for (uint8_t i = 0; i < nfields; ++i) {
             bool isVar = false;
@@ -6,8 +6,12 @@
 #include <vlog/filterer.h>
 #include <vlog/finalresultjoinproc.h>
 #include <vlog/extresultjoinproc.h>
+#include <vlog/leapfrogjoin.h>
+#include <vlog/projectioncache.h>
 #include <vlog/utils.h>
+#include <vlog/bufferedwriter.h>
 #include <trident/model/table.h>
+#include <trident/utils/parallel.h>
 #include <kognac/consts.h>
 #include <kognac/utils.h>
 
@@ -17,6 +21,9 @@
 #include <memory>
 #include <sstream>
 #include <unordered_set>
+#include <mutex>
+#include <functional>
+#include <cstdlib>
 
 void SemiNaiver::createGraphRuleDependency(std::vector<int> &nodes,
         std::vector<std::pair<int, int>> &edges) {
@@ -29,14 +36,15 @@ void SemiNaiver::createGraphRuleDependency(std::vector<int> &nodes,
     std::vector<int> *definedBy = new std::vector<int>[program->getNPredicates()];
     for (int i = 0; i < rules.size(); i++) {
         Rule ri = rules[i];
-        PredId_t pred = ri.getFirstHead().getPredicate().getId();
         std::vector<Literal> body = ri.getBody();
         for (std::vector<Literal>::const_iterator itr = body.begin(); itr != body.end(); ++itr) {
             Predicate p = itr->getPredicate();
             if (p.getType() == IDB) {
                 // Only add "interesting" rules: ones that have an IDB predicate in the RHS.
                 nodes.push_back(i);
-                definedBy[pred].push_back(i);
+                for (const auto &head : ri.getHeads()) {
+                    definedBy[head.getPredicate().getId()].push_back(i);
+                }
                 LOG(DEBUGL) << " Rule " << i << ": " << ri.tostring(program, &layer);
                 break;
             }
@@ -94,6 +102,8 @@ SemiNaiver::SemiNaiver(EDBLayer &layer,
         std::vector<Rule> ruleset = program->getAllRules();
         predicatesTables.resize(program->getMaxPredicateId());
         ignoreDuplicatesElimination = false;
+        memoryBudget = 0;
+        replanFactor = 10;
         TableFilterer::setOptIntersect(opt_intersect);
 
         if (! program->stratify(stratification, nStratificationClasses)) {
@@ -301,35 +311,115 @@ void SemiNaiver::prepare(size_t lastExecution, int singleRuleToCheck, std::vecto
 #endif
 }
 
-void SemiNaiver::run(size_t lastExecution, size_t it, unsigned long *timeout,
-        bool checkCyclicTerms, int singleRuleToCheck, PredId_t predIgnoreBlock) {
-    this->checkCyclicTerms = checkCyclicTerms;
-    this->foundCyclicTerms = false;
-    this->predIgnoreBlock = predIgnoreBlock; //Used in the RMSA
-
-    running = true;
-    iteration = it;
-    startTime = std::chrono::system_clock::now();
-#ifdef WEBINTERFACE
-    statsLastIteration = -1;
+void SemiNaiver::setMemoryBudget(const size_t bytes,
+        const std::string &spillDir) {
+#if defined(_WIN32)
+    //Without mmap, the blocks would be read back in memory
+    LOG(WARNL) << "Moving tables to disk is not supported on Windows";
+#else
+    this->memoryBudget = bytes;
+    if (!this->spillDir.empty()) {
+        Utils::remove_all(this->spillDir);
+        this->spillDir = "";
+    }
+    if (bytes > 0) {
+        if (!Utils::exists(spillDir)) {
+            Utils::create_directories(spillDir);
+        }
+        //Every instance writes in its own directory, so that the files of
+        //other instances (also in other processes) are never overwritten
+        std::string pattern = spillDir + "/vlog-spill-XXXXXX";
+        std::vector<char> path(pattern.begin(), pattern.end());
+        path.push_back('\0');
+        if (mkdtemp(&path[0]) == NULL) {
+            LOG(ERRORL) << "Could not create a directory in " << spillDir;
+            throw ("Could not create a directory in " + spillDir);
+        }
+        this->spillDir = std::string(&path[0]);
+    }
 #endif
-    listDerivations.clear();
+}
 
-    std::vector<RuleExecutionDetails> allrules;
-    // Note: allrules must be declared here, not in prepare itself, since when declared there,
-    // it (and stuff inside it) will be de-allocated too early. --Ceriel
-    prepare(lastExecution, singleRuleToCheck, allrules);
+void SemiNaiver::checkMemoryBudget() {
+    if (memoryBudget == 0) {
+        return;
+    }
+    size_t used = 0;
+    for (auto table : predicatesTables) {
+        if (table != NULL) {
+            used += table->getMemorySize();
+        }
+    }
+    if (used <= memoryBudget) {
+        return;
+    }
 
-    //Used for statistics
-    std::vector<StatIteration> costRules;
+    //Move the oldest completed blocks to disk, until the tables use at most
+    //3/4 of the budget
+    std::vector<std::pair<size_t, PredId_t>> candidates;
+    for (PredId_t p = 0; p < predicatesTables.size(); ++p) {
+        if (predicatesTables[p] == NULL) {
+            continue;
+        }
+        FCIterator itr = predicatesTables[p]->read(0);
+        while (!itr.isEmpty()) {
+            const FCBlock *block = itr.getCurrentBlock();
+            if (!block->spilled && block->isCompleted &&
+                    block->iteration < iteration) {
+                candidates.push_back(std::make_pair(block->iteration, p));
+            }
+            itr.moveNextCount();
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    const size_t target = memoryBudget / 4 * 3;
+    size_t nspilled = 0;
+    size_t freed = 0;
+    for (const auto &c : candidates) {
+        if (used <= target) {
+            break;
+        }
+        FCTable *table = predicatesTables[c.second];
+        std::shared_ptr<const FCInternalTable> oldTable =
+            table->read(c.first, c.first).getCurrentTable();
+        const size_t size = table->spill(c.first, spillDir + "/" +
+                std::to_string(c.second) + "-" + std::to_string(c.first));
+        if (size == 0) {
+            continue;
+        }
+        //The derivations keep a copy of the block, which must also point to
+        //the new table to release the memory
+        std::shared_ptr<const FCInternalTable> newTable =
+            table->read(c.first, c.first).getCurrentTable();
+        for (auto &der : listDerivations) {
+            if (der.table == oldTable) {
+                der.table = newTable;
+                der.spilled = true;
+            }
+        }
+        used -= std::min(used, size);
+        freed += size;
+        nspilled++;
+    }
+    std::chrono::duration<double> sec = std::chrono::system_clock::now() - start;
+    LOG(INFOL) << "Memory budget exceeded: moved " << nspilled << " blocks ("
+        << freed / 1024 / 1024 << " MB) to disk in " << sec.count() * 1000
+        << " ms";
+}
 
+void SemiNaiver::executeProgram(std::vector<RuleExecutionDetails> &edbRules,
+        std::vector<std::vector<RuleExecutionDetails>> &idbRules,
+        std::vector<StatIteration> &costRules,
+        unsigned long *timeout) {
     if ((typeChase == TypeChase::RESTRICTED_CHASE ||
                 typeChase == TypeChase::SUM_RESTRICTED_CHASE)
             && program->areExistentialRules()) {
         //Split the program: First execute the rules without existential
         //quantifiers, then all the others
-        std::vector<RuleExecutionDetails> originalEDBruleset = allEDBRules;
-        std::vector<std::vector<RuleExecutionDetails>> originalRuleset = allIDBRules;
+        std::vector<RuleExecutionDetails> originalEDBruleset = edbRules;
+        std::vector<std::vector<RuleExecutionDetails>> originalRuleset = idbRules;
 
         //Only non-existential rules
         std::vector<RuleExecutionDetails> tmpEDBRules;
@@ -386,11 +476,45 @@ void SemiNaiver::run(size_t lastExecution, size_t it, unsigned long *timeout,
             }
         }
     } else {
-        executeRules(allEDBRules, allIDBRules, costRules, 0, true, timeout);
+        executeRules(edbRules, idbRules, costRules, 0, true, timeout);
     }
+}
+
+void SemiNaiver::run(size_t lastExecution, size_t it, unsigned long *timeout,
+        bool checkCyclicTerms, int singleRuleToCheck, PredId_t predIgnoreBlock) {
+    this->checkCyclicTerms = checkCyclicTerms;
+    this->foundCyclicTerms = false;
+    this->predIgnoreBlock = predIgnoreBlock; //Used in the RMSA
+
+    running = true;
+    iteration = it;
+    startTime = std::chrono::system_clock::now();
+#ifdef WEBINTERFACE
+    statsLastIteration = -1;
+#endif
+    listDerivations.clear();
+
+    // Note: chaseRules must not be declared in prepare itself, since when declared there,
+    // it (and stuff inside it) will be de-allocated too early. --Ceriel
+    // It is a member, because the chase manager is also used by updateEDB.
+    chaseRules.clear();
+    prepare(lastExecution, singleRuleToCheck, chaseRules);
+
+    //Used for statistics
+    std::vector<StatIteration> costRules;
+
+    executeProgram(allEDBRules, allIDBRules, costRules, timeout);
 
     running = false;
     LOG(DEBUGL) << "Finished process. Iterations=" << iteration;
+    ProjectionCache::Stats cacheStats = ProjectionCache::getInstance().getStats();
+    if (cacheStats.hits + cacheStats.misses > 0) {
+        LOG(INFOL) << "Projection cache: hits=" << cacheStats.hits
+            << " misses=" << cacheStats.misses
+            << " evictions=" << cacheStats.evictions
+            << " entries=" << cacheStats.entries
+            << " bytes=" << cacheStats.bytes;
+    }
 
     //DEBUGGING CODE -- needed to see which rules cost the most
     //Sort the iteration costs
@@ -401,7 +525,7 @@ void SemiNaiver::run(size_t lastExecution, size_t it, unsigned long *timeout,
     double sum10 = 0;
     for (auto &el : costRules) {
         LOG(DEBUGL) << "Cost iteration " << el.iteration << " " <<
-            el.time;
+            el.time << " replans " << el.nReplans;
         i++;
         if (i >= 20)
             break;
@@ -448,6 +572,7 @@ bool SemiNaiver::executeUntilSaturation(
         stat.rule = &ruleset[currentRule].rule;
         stat.time = sec.count() * 1000;
         stat.derived = response;
+        stat.nReplans = ruleset[currentRule].nReplans;
         costRules.push_back(stat);
         if (limitView > 0) {
             // Don't use iteration here, because lastExecution determines which data we'll look at during the next round,
@@ -457,6 +582,7 @@ bool SemiNaiver::executeUntilSaturation(
             ruleset[currentRule].lastExecution = iteration;
         }
         iteration++;
+        checkMemoryBudget();
 
         if (checkCyclicTerms) {
             foundCyclicTerms = chaseMgmt->checkCyclicTerms(currentRule);
@@ -494,6 +620,7 @@ bool SemiNaiver::executeUntilSaturation(
                     stat.rule = &ruleset[currentRule].rule;
                     stat.time = sec.count() * 1000;
                     stat.derived = response;
+                    stat.nReplans = ruleset[currentRule].nReplans;
                     costRules.push_back(stat);
                     if (timeout != NULL && *timeout != 0) {
                         std::chrono::duration<double> s = std::chrono::system_clock::now() - startTime;
@@ -542,6 +669,7 @@ bool SemiNaiver::executeUntilSaturation(
                     if (n < 10 || exec.derived) {
                         out += "Iteration " + to_string(exec.iteration) + " runtime " + to_string(exec.time);
                         out += " " + exec.rule->tostring(program, &layer) + " response " + to_string(exec.derived);
+                        out += " replans " + to_string(exec.nReplans);
                         out += "\n";
                     }
                     n++;
@@ -558,105 +686,160 @@ bool SemiNaiver::executeUntilSaturation(
                     return newDer;
 }
 
-void SemiNaiver::storeOnFile(std::string path, const PredId_t pred, const bool decompress, const int minLevel, const bool csv) {
-    FCTable *table = predicatesTables[pred];
+//Writes rows of terms that were collected from a table. The distinct terms
+//are decoded only once, in sorted order.
+static void writeDecodedRows(EDBLayer &layer, BufferedWriter &out,
+        const std::vector<size_t> &iterations, const std::vector<Term_t> &rows,
+        const uint8_t sizeRow, const bool csv) {
+    std::vector<Term_t> ids(rows);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
     char buffer[MAX_TERM_SIZE];
+    std::string texts;
+    std::vector<size_t> offsets;
+    offsets.reserve(ids.size() + 1);
+    //The predicates are written in parallel (see storeOnFiles), but the
+    //terms are looked up by one thread at a time
+    std::mutex &dictMutex = layer.getDictTextMutex();
+    for (auto v : ids) {
+        offsets.push_back(texts.size());
+        std::string t;
+        bool known;
+        {
+            std::lock_guard<std::mutex> lock(dictMutex);
+            known = layer.getDictText(v, buffer);
+        }
+        if (known) {
+            t = std::string(buffer);
+        } else {
+            t = "" + std::to_string(v >> 40) + "_"
+                + std::to_string((v >> 32) & 0377) + "_"
+                + std::to_string(v & 0xffffffff);
+        }
+        texts += csv ? VLogUtils::csvString(t) : t;
+    }
+    offsets.push_back(texts.size());
 
-    std::ofstream streamout(path);
-    if (streamout.fail()) {
-        throw("Could not open " + path + " for writing");
+    for (size_t i = 0; i < iterations.size(); ++i) {
+        if (! csv) {
+            out.writeNumber(iterations[i]);
+        }
+        for (uint8_t m = 0; m < sizeRow; ++m) {
+            const size_t idx = std::lower_bound(ids.begin(), ids.end(),
+                    rows[i * sizeRow + m]) - ids.begin();
+            if (csv) {
+                if (m > 0) {
+                    out.put(',');
+                }
+            } else {
+                out.put('\t');
+            }
+            out.write(texts.c_str() + offsets[idx],
+                    offsets[idx + 1] - offsets[idx]);
+        }
+        out.put('\n');
     }
+}
+
+void SemiNaiver::storeOnFile(std::string path, const PredId_t pred, const bool decompress, const int minLevel, const bool csv,
+        const ExportCompression compression) {
+    FCTable *table = predicatesTables[pred];
+    BufferedWriter out(BufferedWriter::getFileName(path, compression),
+            compression);
 
     if (table != NULL && !table->isEmpty()) {
         FCIterator itr = table->read(0);
-        if (! itr.isEmpty()) {
-            const uint8_t sizeRow = table->getSizeRow();
-            while (!itr.isEmpty()) {
-                std::shared_ptr<const FCInternalTable> t = itr.getCurrentTable();
-                FCInternalTableItr *iitr = t->getIterator();
-                while (iitr->hasNext()) {
-                    iitr->next();
-                    std::string row = "";
-                    if (! csv) {
-                        row = to_string(iitr->getCurrentIteration());
-                    }
-                    bool first = true;
+        const uint8_t sizeRow = table->getSizeRow();
+        const bool decode = decompress || csv;
+        std::vector<size_t> iterations;
+        std::vector<Term_t> rows;
+        while (!itr.isEmpty()) {
+            std::shared_ptr<const FCInternalTable> t = itr.getCurrentTable();
+            FCInternalTableItr *iitr = t->getIterator();
+            while (iitr->hasNext()) {
+                iitr->next();
+                if (! decode) {
+                    out.writeNumber(iitr->getCurrentIteration());
                     for (uint8_t m = 0; m < sizeRow; ++m) {
-                        if (decompress || csv) {
-                            if (layer.getDictText(iitr->getCurrentValue(m), buffer)) {
-                                if (csv) {
-                                    if (first) {
-                                        first = false;
-                                    } else {
-                                        row += ",";
-                                    }
-                                    row += VLogUtils::csvString(std::string(buffer));
-                                } else {
-                                    row += "\t";
-                                    row += std::string(buffer);
-                                }
-                            } else {
-                                uint64_t v = iitr->getCurrentValue(m);
-                                std::string t = "" + std::to_string(v >> 40) + "_"
-                                    + std::to_string((v >> 32) & 0377) + "_"
-                                    + std::to_string(v & 0xffffffff);
-                                if (csv) {
-                                    if (first) {
-                                        first = false;
-                                    } else {
-                                        row += ",";
-                                    }
-                                    row += VLogUtils::csvString(t);
-                                } else {
-                                    row += "\t";
-                                    row += t;
-                                }
-                            }
-                        } else {
-                            row += "\t" + to_string(iitr->getCurrentValue(m));
-                        }
+                        out.put('\t');
+                        out.writeNumber(iitr->getCurrentValue(m));
                     }
-                    streamout << row << std::endl;
+                    out.put('\n');
+                    continue;
+                }
+                iterations.push_back(iitr->getCurrentIteration());
+                for (uint8_t m = 0; m < sizeRow; ++m) {
+                    rows.push_back(iitr->getCurrentValue(m));
+                }
+                if (iterations.size() == STORE_DECODE_ROWS) {
+                    writeDecodedRows(layer, out, iterations, rows, sizeRow, csv);
+                    iterations.clear();
+                    rows.clear();
                 }
-                t->releaseIterator(iitr);
-                itr.moveNextCount();
             }
+            t->releaseIterator(iitr);
+            itr.moveNextCount();
+        }
+        if (! iterations.empty()) {
+            writeDecodedRows(layer, out, iterations, rows, sizeRow, csv);
         }
     }
-    streamout.close();
+    out.close();
 }
 
-static std::string generateFileName(std::string name) {
-    std::stringstream stream;
-
-    stream << std::oct << std::setfill('0');
-
-    for(char ch : name) {
-        int code = static_cast<unsigned char>(ch);
-
-        if (code != '\\' && code != '/') {
-            stream.put(ch);
-        } else {
-            stream << "\\" << std::setw(3) << code;
+void SemiNaiver::StorePredicates::operator()(const ParallelRange& r) const {
+    for (size_t i = r.begin(); i < r.end(); ++i) {
+        const PredId_t pred = preds[i];
+        try {
+            sn->storeOnFile(path + "/" + VLogUtils::fileName(
+                        sn->program->getPredicateName(pred)), pred,
+                    decompress, minLevel, csv, compression);
+        } catch (std::string &e) {
+            std::lock_guard<std::mutex> lock(*errorMutex);
+            if (error->empty()) {
+                *error = e;
+            }
+        } catch (...) {
+            //An exception must not leave the worker thread
+            std::lock_guard<std::mutex> lock(*errorMutex);
+            if (error->empty()) {
+                *error = "Error while writing the predicate " +
+                    sn->program->getPredicateName(pred);
+            }
         }
     }
-
-    return stream.str();
 }
 
 void SemiNaiver::storeOnFiles(std::string path, const bool decompress,
-        const int minLevel, const bool csv) {
-    char buffer[MAX_TERM_SIZE];
-
+        const int minLevel, const bool csv,
+        const ExportCompression compression) {
     Utils::create_directories(path);
 
-    //I create a new file for every idb predicate
+    //I create a new file for every idb predicate. The largest ones are
+    //written first, so that they do not end up alone at the end.
+    std::vector<std::pair<size_t, PredId_t>> sizes;
     for (PredId_t i = 0; i < program->getNPredicates(); ++i) {
         FCTable *table = predicatesTables[i];
         if (table != NULL && !table->isEmpty()) {
-            storeOnFile(path + "/" + generateFileName(program->getPredicateName(i)), i, decompress, minLevel, csv);
+            sizes.push_back(std::make_pair(table->getNAllRows(), i));
         }
     }
+    std::sort(sizes.begin(), sizes.end(),
+            std::greater<std::pair<size_t, PredId_t>>());
+    std::vector<PredId_t> preds;
+    for (const auto &s : sizes) {
+        preds.push_back(s.second);
+    }
+
+    std::string error;
+    std::mutex errorMutex;
+    ParallelTasks::parallel_for(0, preds.size(), 1, StorePredicates(this,
+                preds, path, decompress, minLevel, csv, compression, &error,
+                &errorMutex));
+    if (!error.empty()) {
+        throw(error);
+    }
 }
 
 bool _sortCards(const std::pair<uint8_t, size_t> &v1, const std::pair<uint8_t, size_t> &v2) {
@@ -670,7 +853,7 @@ void SemiNaiver::addDataToIDBRelation(const Predicate pred,
     table->addBlock(block);
 }
 
-bool SemiNaiver::bodyChangedSince(Rule &rule, size_t iteration) {
+bool SemiNaiver::bodyChangedSince(const Rule &rule, size_t iteration) {
     LOG(DEBUGL) << "bodyChangedSince, iteration = " << iteration <<
         " Rule: " << rule.tostring(program, &layer);
     const std::vector<Literal> &body = rule.getBody();
@@ -704,7 +887,8 @@ bool SemiNaiver::bodyChangedSince(Rule &rule, size_t iteration) {
 bool SemiNaiver::checkIfAtomsAreEmpty(const RuleExecutionDetails &ruleDetails,
         const RuleExecutionPlan &plan,
         size_t limitView,
-        std::vector<size_t> &cards) {
+        std::vector<size_t> &cards,
+        std::vector<std::shared_ptr<const TableStatistics>> *stats) {
     const uint8_t nBodyLiterals = (uint8_t) plan.plan.size();
     bool isOneRelEmpty = false;
     //First I check if there are tuples in each relation.
@@ -732,6 +916,14 @@ bool SemiNaiver::checkIfAtomsAreEmpty(const RuleExecutionDetails &ruleDetails,
             isOneRelEmpty = true;
             break;
         }
+        if (stats != NULL) {
+            FCTable *table = predicatesTables[plan.plan[i]->getPredicate().getId()];
+            if (plan.plan[i]->isNegated() || table == NULL) {
+                stats->push_back(std::shared_ptr<const TableStatistics>());
+            } else {
+                stats->push_back(statistics.get(table, min, max, layer));
+            }
+        }
     }
     return isOneRelEmpty;
 }
@@ -1033,7 +1225,19 @@ void SemiNaiver::reorderPlanForNegatedLiterals(RuleExecutionPlan &plan, const st
 void SemiNaiver::reorderPlan(RuleExecutionPlan &plan,
         const std::vector<size_t> &cards,
         const std::vector<Literal> &heads,
-        bool copyAllVars) {
+        bool copyAllVars,
+        const std::vector<std::shared_ptr<const TableStatistics>> &stats) {
+    if (!stats.empty()) {
+        std::vector<uint8_t> order = plan.costBasedOrder(cards, stats);
+        for (uint8_t i = 0; i < order.size(); ++i) {
+            if (order[i] != i) {
+                plan = plan.reorder(order, heads, copyAllVars);
+                break;
+            }
+        }
+        return;
+    }
+
     //Reorder the atoms in terms of cardinality.
     std::vector<std::pair<uint8_t, size_t>> positionCards;
     for (uint8_t i = 0; i < cards.size(); ++i) {
@@ -1097,6 +1301,56 @@ void SemiNaiver::reorderPlan(RuleExecutionPlan &plan,
     }
 }
 
+//Permutes cards and stats, which follow the order of the atoms in before,
+//so that they follow the order of the atoms in plan
+static void alignToPlan(const std::vector<const Literal*> &before,
+        const RuleExecutionPlan &plan, std::vector<size_t> &cards,
+        std::vector<std::shared_ptr<const TableStatistics>> &stats) {
+    std::vector<size_t> newCards;
+    std::vector<std::shared_ptr<const TableStatistics>> newStats;
+    for (const auto literal : plan.plan) {
+        const size_t idx = std::find(before.begin(), before.end(), literal) -
+            before.begin();
+        newCards.push_back(cards[idx]);
+        newStats.push_back(stats[idx]);
+    }
+    cards.swap(newCards);
+    stats.swap(newStats);
+}
+
+bool SemiNaiver::replan(RuleExecutionPlan &plan, const uint8_t nJoined,
+        const size_t observed, const uint8_t nPrevious,
+        const size_t previousRows, std::vector<size_t> &cards,
+        std::vector<std::shared_ptr<const TableStatistics>> &stats,
+        const std::vector<Literal> &heads) {
+    const double estimate = std::max(1.0, plan.estimateCardinality(cards,
+                stats, nJoined, nPrevious, previousRows));
+    const double ratio = std::max((size_t) 1, observed) / estimate;
+    if (ratio <= replanFactor && ratio * replanFactor >= 1) {
+        return false;
+    }
+    std::vector<uint8_t> order = plan.costBasedOrder(cards, stats, nJoined,
+            observed);
+    bool changed = false;
+    for (uint8_t i = 0; i < order.size(); ++i) {
+        if (order[i] != i) {
+            changed = true;
+            break;
+        }
+    }
+    LOG(DEBUGL) << "The join of the first " << (int) nJoined << " atoms "
+        "returned " << observed << " rows instead of " << (size_t) estimate <<
+        (changed ? ": the remaining atoms are reordered" : "");
+    if (!changed) {
+        return false;
+    }
+    std::vector<const Literal*> before = plan.plan;
+    plan = plan.reorder(order, heads, checkCyclicTerms);
+    reorderPlanForNegatedLiterals(plan, heads);
+    alignToPlan(before, plan, cards, stats);
+    return true;
+}
+
 FCTable *SemiNaiver::getTable(const PredId_t pred, const uint8_t card) {
     FCTable *endTable;
     if (predicatesTables[pred] != NULL) {
@@ -1121,6 +1375,7 @@ bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
         const size_t iteration, const size_t limitView,
         std::vector<ResultJoinProcessor*> *finalResultContainer) {
     Rule rule = ruleDetails.rule;
+    ruleDetails.nReplans = 0;
     if (! bodyChangedSince(rule, ruleDetails.lastExecution)) {
         LOG(DEBUGL) << "Rule application: " << iteration << ", rule " << rule.tostring(program, &layer) << " skipped because dependencies did not change since the previous application of this rule";
         return false;
@@ -1133,6 +1388,77 @@ bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
 }
 
 
+//Range of the iterations of the facts of the atom at position idx of the plan
+static void getRange(const RuleExecutionPlan &plan, const uint8_t idx,
+        const RuleExecutionDetails &ruleDetails, const size_t limitView,
+        size_t &min, size_t &max) {
+    min = plan.ranges[idx].first;
+    max = plan.ranges[idx].second;
+    if (min == 1)
+        min = ruleDetails.lastExecution;
+    if (max == 1)
+        max = ruleDetails.lastExecution - 1;
+    if (limitView != 0) {
+        // For execution of the restricted chase, we must limit the
+        // view: we may not include data from the current round.
+        // We use a parameter "limitView", which in this case indicates
+        // the iteration number after the last round.
+        if (max >= limitView) {
+            max = limitView - 1;
+        }
+    }
+}
+
+ResultJoinProcessor *SemiNaiver::createFinalProcessor(
+        RuleExecutionDetails &ruleDetails,
+        std::vector<Literal> &heads,
+        std::vector<std::pair<uint8_t, uint8_t>> &posFromFirst,
+        std::vector<std::pair<uint8_t, uint8_t>> &posFromSecond,
+        const uint8_t orderExecution,
+        const size_t iteration,
+        const bool addToEndTable) {
+    if (ruleDetails.rule.isExistential()) {
+        return new ExistentialRuleProcessor(
+                posFromFirst,
+                posFromSecond,
+                listDerivations,
+                heads, &ruleDetails,
+                orderExecution, iteration,
+                addToEndTable,
+                !multithreaded ? -1 : nthreads,
+                this,
+                chaseMgmt,
+                chaseMgmt->hasRuleToCheck(),
+                ignoreDuplicatesElimination);
+    } else if (heads.size() == 1) {
+        FCTable *table = getTable(heads[0].getPredicate().getId(),
+                heads[0].getPredicate().getCardinality());
+        return new SingleHeadFinalRuleProcessor(
+                posFromFirst,
+                posFromSecond,
+                listDerivations,
+                table,
+                heads[0],
+                0,
+                &ruleDetails,
+                orderExecution,
+                iteration,
+                addToEndTable,
+                !multithreaded ? -1 : nthreads,
+                ignoreDuplicatesElimination);
+    } else {
+        return new FinalRuleProcessor(
+                posFromFirst,
+                posFromSecond,
+                listDerivations,
+                heads, &ruleDetails,
+                orderExecution, iteration,
+                addToEndTable,
+                !multithreaded ? -1 : nthreads, this,
+                ignoreDuplicatesElimination);
+    }
+}
+
 bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
         std::vector<Literal> &heads,
         const size_t iteration,
@@ -1194,16 +1520,30 @@ bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
         const uint8_t nBodyLiterals = (uint8_t) plan.plan.size();
 
         //**** Should I skip the evaluation because some atoms are empty? ***
-        bool isOneRelEmpty = checkIfAtomsAreEmpty(ruleDetails, plan, limitView, cards);
+        //With more than two atoms, the order of the joins is chosen using
+        //the statistics of the tables
+        std::vector<std::shared_ptr<const TableStatistics>> stats;
+        size_t nPositive = 0;
+        for (const auto literal : plan.plan) {
+            if (!literal->isNegated()) {
+                nPositive++;
+            }
+        }
+        bool isOneRelEmpty = checkIfAtomsAreEmpty(ruleDetails, plan, limitView,
+                cards, nPositive > 2 ? &stats : NULL);
         if (isOneRelEmpty) {
             LOG(DEBUGL) << "Aborting this combination";
             continue;
         }
 
         //Reorder the list of atoms depending on the observed cardinalities
-        reorderPlan(plan, cards, heads, checkCyclicTerms);
+        std::vector<const Literal*> literalsBefore = plan.plan;
+        reorderPlan(plan, cards, heads, checkCyclicTerms, stats);
         //Reorder for input negation (can we merge these two?)
         reorderPlanForNegatedLiterals(plan, heads);
+        if (!stats.empty()) {
+            alignToPlan(literalsBefore, plan, cards, stats);
+        }
 
 #ifdef DEBUG
         std::string listLiterals = "EXEC COMB: ";
@@ -1215,8 +1555,52 @@ bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
 
         /*******************************************************************/
 
+        //Cyclic bodies are joined all at once, to avoid the large
+        //intermediate results of the binary joins
+        if (ruleDetails.cyclicBody && !rule.isExistential() &&
+                nPositive == nBodyLiterals) {
+            std::vector<std::pair<size_t, size_t>> ranges;
+            bool emptyRange = false;
+            for (uint8_t i = 0; i < nBodyLiterals; ++i) {
+                size_t min, max;
+                getRange(plan, i, ruleDetails, limitView, min, max);
+                emptyRange |= min > max;
+                ranges.push_back(std::make_pair(min, max));
+            }
+            if (emptyRange) {
+                continue;
+            }
+            LOG(DEBUGL) << "Executing leapfrog triejoin";
+            std::chrono::system_clock::time_point start =
+                std::chrono::system_clock::now();
+            LeapfrogTrieJoin lftj(plan.plan, heads);
+            std::vector<std::pair<uint8_t, uint8_t>> noPositions;
+            ResultJoinProcessor *joinOutput = createFinalProcessor(
+                    ruleDetails, heads, lftj.getPosFromFirst(),
+                    noPositions, (uint8_t) orderExecution, iteration,
+                    finalResultContainer == NULL);
+            lftj.join(this, ranges, joinOutput, processedTables,
+                    multithreaded ? nthreads : -1);
+            durationJoin += std::chrono::system_clock::now() - start;
+
+            std::chrono::system_clock::time_point startC =
+                std::chrono::system_clock::now();
+            joinOutput->consolidate(true);
+            durationConsolidation += std::chrono::system_clock::now() - startC;
+            if (finalResultContainer) {
+                finalResultContainer->push_back(joinOutput);
+            } else {
+                delete joinOutput;
+            }
+            continue;
+        }
+
         std::shared_ptr<const FCInternalTable> currentResults;
         int optimalOrderIdx = 0;
+        //Size of the last intermediate result, and number of atoms joined to
+        //produce it
+        uint8_t nJoined = 0;
+        size_t joinedRows = 0;
 
         bool first = true;
         while (optimalOrderIdx < nBodyLiterals) {
@@ -1246,67 +1630,17 @@ bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
                         plan.posFromSecond[optimalOrderIdx],
                         ! multithreaded ? -1 : nthreads);
             } else {
-                if (ruleDetails.rule.isExistential()) {
-                    joinOutput = new ExistentialRuleProcessor(
-                            plan.posFromFirst[optimalOrderIdx],
-                            plan.posFromSecond[optimalOrderIdx],
-                            listDerivations,
-                            heads, &ruleDetails,
-                            (uint8_t) orderExecution, iteration,
-                            finalResultContainer == NULL,
-                            !multithreaded ? -1 : nthreads,
-                            this,
-                            chaseMgmt,
-                            chaseMgmt->hasRuleToCheck(),
-                            ignoreDuplicatesElimination);
-                } else {
-                    if (heads.size() == 1) {
-                        FCTable *table = getTable(heads[0].getPredicate().getId(),
-                                heads[0].getPredicate().getCardinality());
-                        joinOutput = new SingleHeadFinalRuleProcessor(
-                                plan.posFromFirst[optimalOrderIdx],
-                                plan.posFromSecond[optimalOrderIdx],
-                                listDerivations,
-                                table,
-                                heads[0],
-                                0,
-                                &ruleDetails,
-                                (uint8_t) orderExecution,
-                                iteration,
-                                finalResultContainer == NULL,
-                                !multithreaded ? -1 : nthreads,
-                                ignoreDuplicatesElimination);
-                    } else {
-                        joinOutput = new FinalRuleProcessor(
-                                plan.posFromFirst[optimalOrderIdx],
-                                plan.posFromSecond[optimalOrderIdx],
-                                listDerivations,
-                                heads, &ruleDetails,
-                                (uint8_t) orderExecution, iteration,
-                                finalResultContainer == NULL,
-                                !multithreaded ? -1 : nthreads, this,
-                                ignoreDuplicatesElimination);
-                    }
-                }
+                joinOutput = createFinalProcessor(ruleDetails, heads,
+                        plan.posFromFirst[optimalOrderIdx],
+                        plan.posFromSecond[optimalOrderIdx],
+                        (uint8_t) orderExecution, iteration,
+                        finalResultContainer == NULL);
             }
             //END --  Determine where to put the results of the query
 
             //Calculate range for the retrieval of the triples
-            size_t min = plan.ranges[optimalOrderIdx].first;
-            size_t max = plan.ranges[optimalOrderIdx].second;
-            if (min == 1)
-                min = ruleDetails.lastExecution;
-            if (max == 1)
-                max = ruleDetails.lastExecution - 1;
-            if (limitView != 0) {
-                // For execution of the restricted chase, we must limit the
-                // view: we may not include data from the current round.
-                // We use a parameter "limitView", which in this case indicates
-                // the iteration number after the last round.
-                if (max >= limitView) {
-                    max = limitView - 1;
-                }
-            }
+            size_t min, max;
+            getRange(plan, optimalOrderIdx, ruleDetails, limitView, min, max);
             if (min > max) {
                 optimalOrderIdx++;
                 continue;
@@ -1372,6 +1706,20 @@ bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
             //Prepare for the processing of the next atom (if any)
             if (!lastLiteral && !first) {
                 currentResults = ((InterTableJoinProcessor*)joinOutput)->getTable();
+
+                //If the intermediate result is far from the estimate, the
+                //remaining atoms are reordered
+                if (replanFactor > 0 && !stats.empty() &&
+                        optimalOrderIdx + 2 < nBodyLiterals &&
+                        currentResults != NULL && !currentResults->isEmpty()) {
+                    const size_t rows = currentResults->getNRows();
+                    if (replan(plan, optimalOrderIdx + 1, rows, nJoined,
+                                joinedRows, cards, stats, heads)) {
+                        ruleDetails.nReplans++;
+                    }
+                    nJoined = optimalOrderIdx + 1;
+                    joinedRows = rows;
+                }
             }
             if (lastLiteral && finalResultContainer) {
                 finalResultContainer->push_back(joinOutput);
@@ -1425,6 +1773,7 @@ bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
     }
     //Jacopo: td is not existing anymore...
     stats.timems = (long)td;
+    stats.nReplans = ruleDetails.nReplans;
     saveStatistics(stats);
     currentPredicate = -1;
     currentRule = "";
@@ -1446,6 +1795,7 @@ bool SemiNaiver::executeRule(RuleExecutionDetails &ruleDetails,
     }
     LOG(DEBUGL) << "Combinations " << orderExecution
         << ", Processed IDB Tables=" << processedTables
+        << ", Replans=" << ruleDetails.nReplans
         << ", Total runtime " << stream.str()
         << ", join " << durationJoin.count() * 1000
         << "ms, consolidation " << durationConsolidation.count() * 1000
@@ -1537,7 +1887,7 @@ FCIterator SemiNaiver::getTableFromEDBLayer(const Literal & literal) {
     PredId_t id = literal.getPredicate().getId();
     FCTable *table = predicatesTables[id];
     if (table == NULL) {
-        table = SemiNaiver::getTable(id, (uint8_t) literal.getTupleSize());
+        table = getTable(id, (uint8_t) literal.getTupleSize());
 
         VTuple t = literal.getTuple();
         //Add all different variables
@@ -1605,6 +1955,10 @@ SemiNaiver::~SemiNaiver() {
             delete predicatesTables[i];
         }
     }
+    //The spilled files are removed once mapped, only the directory is left
+    if (!spillDir.empty()) {
+        Utils::remove_all(spillDir);
+    }
 
     /*for (EDBCache::iterator itr = edbCache.begin(); itr != edbCache.end(); ++itr) {
       delete itr->second;
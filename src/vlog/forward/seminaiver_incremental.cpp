@@ -0,0 +1,618 @@
+#include <vlog/seminaiver.h>
+#include <vlog/fctable.h>
+#include <vlog/fcinttable.h>
+#include <vlog/segment.h>
+
+#include <algorithm>
+
+//Sorted and unique rows, stored one after the other
+struct RowSet {
+    uint8_t arity;
+    std::vector<Term_t> values;
+
+    RowSet(const uint8_t arity) : arity(arity) {
+    }
+
+    size_t size() const {
+        return values.size() / arity;
+    }
+
+    bool empty() const {
+        return values.empty();
+    }
+
+    const Term_t *row(const size_t i) const {
+        return &values[i * arity];
+    }
+};
+
+static RowSet toRowSet(std::shared_ptr<const Segment> segment,
+        const uint8_t arity) {
+    RowSet out(arity);
+    if (segment == NULL || segment->isEmpty()) {
+        return out;
+    }
+    std::vector<std::unique_ptr<ColumnReader>> readers;
+    for (uint8_t i = 0; i < arity; ++i) {
+        readers.push_back(segment->getColumn(i)->getReader());
+    }
+    out.values.reserve(segment->getNRows() * arity);
+    while (readers[0]->hasNext()) {
+        for (uint8_t i = 0; i < arity; ++i) {
+            out.values.push_back(readers[i]->next());
+        }
+    }
+    return out;
+}
+
+static RowSet sortRows(SegmentInserter &inserter, const uint8_t arity) {
+    if (inserter.isEmpty()) {
+        return RowSet(arity);
+    }
+    return toRowSet(inserter.getSortedAndUniqueSegment(), arity);
+}
+
+static RowSet sortRows(const std::vector<uint64_t> &rows,
+        const uint8_t arity) {
+    SegmentInserter inserter(arity);
+    for (size_t i = 0; i + arity <= rows.size(); i += arity) {
+        inserter.addRow(&rows[i]);
+    }
+    return sortRows(inserter, arity);
+}
+
+static std::shared_ptr<const Segment> toSegment(const RowSet &rows) {
+    std::vector<ColumnWriter> writers(rows.arity);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        for (uint8_t j = 0; j < rows.arity; ++j) {
+            writers[j].add(rows.row(i)[j]);
+        }
+    }
+    std::vector<std::shared_ptr<Column>> columns;
+    for (auto &writer : writers) {
+        columns.push_back(writer.getColumn());
+    }
+    return std::shared_ptr<const Segment>(new Segment(rows.arity, columns));
+}
+
+static int cmpRows(const Term_t *r1, const Term_t *r2, const uint8_t arity) {
+    for (uint8_t i = 0; i < arity; ++i) {
+        if (r1[i] != r2[i]) {
+            return r1[i] < r2[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+//Rows that are in r1 (keepFirst), in r2 (keepSecond) and in both (keepBoth)
+static RowSet mergeRows(const RowSet &r1, const RowSet &r2,
+        const bool keepFirst, const bool keepSecond, const bool keepBoth) {
+    RowSet out(r1.arity);
+    size_t i = 0, j = 0;
+    while (i < r1.size() || j < r2.size()) {
+        int cmp;
+        if (i == r1.size()) {
+            cmp = 1;
+        } else if (j == r2.size()) {
+            cmp = -1;
+        } else {
+            cmp = cmpRows(r1.row(i), r2.row(j), r1.arity);
+        }
+        const Term_t *row = cmp <= 0 ? r1.row(i) : r2.row(j);
+        if ((cmp < 0 && keepFirst) || (cmp > 0 && keepSecond) ||
+                (cmp == 0 && keepBoth)) {
+            out.values.insert(out.values.end(), row, row + r1.arity);
+        }
+        if (cmp <= 0) {
+            i++;
+        }
+        if (cmp >= 0) {
+            j++;
+        }
+    }
+    return out;
+}
+
+static RowSet unionRows(const RowSet &r1, const RowSet &r2) {
+    return mergeRows(r1, r2, true, true, true);
+}
+
+static RowSet minusRows(const RowSet &r1, const RowSet &r2) {
+    return mergeRows(r1, r2, true, false, false);
+}
+
+static RowSet intersectRows(const RowSet &r1, const RowSet &r2) {
+    return mergeRows(r1, r2, false, false, true);
+}
+
+static RowSet getEDBRows(EDBLayer &layer, const Predicate &pred) {
+    VTuple t(pred.getCardinality());
+    for (uint8_t i = 0; i < t.getSize(); ++i) {
+        t.set(VTerm(i + 1, 0), i);
+    }
+    Literal literal(pred, t);
+    SegmentInserter inserter(pred.getCardinality());
+    Term_t row[256];
+    EDBIterator *itr = layer.getIterator(literal);
+    while (itr->hasNext()) {
+        itr->next();
+        for (uint8_t i = 0; i < pred.getCardinality(); ++i) {
+            row[i] = itr->getElementAt(i);
+        }
+        inserter.addRow(row);
+    }
+    layer.releaseIterator(itr);
+    return sortRows(inserter, pred.getCardinality());
+}
+
+static RowSet getIDBRows(FCTable *table) {
+    SegmentInserter inserter(table->getSizeRow());
+    FCIterator itr = table->read(0);
+    while (!itr.isEmpty()) {
+        std::shared_ptr<const FCInternalTable> t = itr.getCurrentTable();
+        FCInternalTableItr *rows = t->getIterator();
+        while (rows->hasNext()) {
+            rows->next();
+            inserter.addRow(rows);
+        }
+        t->releaseIterator(rows);
+        itr.moveNextCount();
+    }
+    return sortRows(inserter, table->getSizeRow());
+}
+
+PredId_t SemiNaiver::getAuxiliaryPredicate(const std::string &prefix,
+        const PredId_t pred, const uint8_t card) {
+    std::string name = prefix + std::to_string(pred);
+    int64_t id = program->getOrAddPredicate(name, card);
+    if (id < 0) {
+        LOG(ERRORL) << "Could not create the predicate " << name;
+        throw 10;
+    }
+    if (id >= predicatesTables.size()) {
+        predicatesTables.resize(id + 1, NULL);
+    }
+    return (PredId_t) id;
+}
+
+void SemiNaiver::setAuxiliaryTable(const PredId_t pred, const uint8_t arity,
+        std::vector<Term_t> &rows) {
+    layer.addInmemoryTable(pred, arity, rows);
+    //The table of the previous content is no longer valid
+    if (predicatesTables[pred] != NULL) {
+        delete predicatesTables[pred];
+        predicatesTables[pred] = NULL;
+    }
+}
+
+//Executes a rule derived from original in the current iteration. The new
+//blocks are attributed to original, since details does not outlive the call.
+//If the block of a head was also extended by another rule of the same
+//iteration, it is attributed to no rule.
+bool SemiNaiver::executeAuxiliaryRule(const Rule &rule,
+        const RuleExecutionDetails &original,
+        std::map<PredId_t, const RuleExecutionDetails*> &producers) {
+    RuleExecutionDetails details(rule, original.ruleid);
+    for (const auto &literal : rule.getBody()) {
+        if (literal.getPredicate().getType() == IDB) {
+            details.nIDBs++;
+        }
+    }
+    details.createExecutionPlans(checkCyclicTerms);
+    if (details.nIDBs != 0) {
+        details.calculateNVarsInHeadFromEDB();
+    }
+    bool response = executeRule(details, iteration, 0, NULL);
+    for (const auto &head : rule.getHeads()) {
+        const PredId_t pred = head.getPredicate().getId();
+        FCTable *table = predicatesTables[pred];
+        if (table == NULL || table->isEmpty(iteration)) {
+            continue;
+        }
+        FCBlock &block = table->getLastBlock();
+        if (block.iteration != iteration) {
+            continue;
+        }
+        auto itr = producers.find(pred);
+        if (itr == producers.end()) {
+            producers[pred] = &original;
+        } else if (itr->second != &original) {
+            itr->second = NULL;
+        }
+        block.rule = producers[pred];
+    }
+    return response;
+}
+
+//Ends the iteration in which the auxiliary rules of a step were executed.
+//The derivations of the step are merged in one block per predicate, so only
+//these blocks are kept in listDerivations.
+void SemiNaiver::endAuxiliaryIteration(const size_t nderivations,
+        const std::map<PredId_t, const RuleExecutionDetails*> &producers) {
+    while (listDerivations.size() > nderivations) {
+        listDerivations.pop_back();
+    }
+    for (const auto &p : producers) {
+        FCTable *table = predicatesTables[p.first];
+        if (table != NULL && !table->isEmpty(iteration) &&
+                table->getLastBlock().iteration == iteration) {
+            listDerivations.push_back(table->getLastBlock());
+        }
+    }
+    iteration++;
+}
+
+//Executes all rules where one of the body atoms over the predicates in deltas
+//is replaced with an atom over the auxiliary relation that contains the
+//changed rows. If heads is not NULL, the derivations are stored in auxiliary
+//relations instead of the head predicates.
+bool SemiNaiver::executeDeltaRules(const std::map<PredId_t, PredId_t> &deltas,
+        std::map<PredId_t, PredId_t> *heads) {
+    std::vector<RuleExecutionDetails*> rules;
+    for (auto &r : allEDBRules) {
+        rules.push_back(&r);
+    }
+    for (auto &strata : allIDBRules) {
+        for (auto &r : strata) {
+            rules.push_back(&r);
+        }
+    }
+
+    bool response = false;
+    const size_t nderivations = listDerivations.size();
+    std::map<PredId_t, const RuleExecutionDetails*> producers;
+    for (auto r : rules) {
+        const std::vector<Literal> &body = r->rule.getBody();
+        std::vector<Literal> newHeads;
+        for (const auto &head : r->rule.getHeads()) {
+            if (heads == NULL) {
+                newHeads.push_back(head);
+                continue;
+            }
+            const Predicate pred = head.getPredicate();
+            if (!heads->count(pred.getId())) {
+                (*heads)[pred.getId()] = getAuxiliaryPredicate("__vlog_od_",
+                        pred.getId(), pred.getCardinality());
+            }
+            newHeads.push_back(Literal(Predicate(heads->at(pred.getId()), 0,
+                            IDB, pred.getCardinality()), head.getTuple()));
+        }
+        for (size_t i = 0; i < body.size(); ++i) {
+            const Predicate pred = body[i].getPredicate();
+            auto itr = deltas.find(pred.getId());
+            if (itr == deltas.end()) {
+                continue;
+            }
+            //Literals cannot be assigned, so the body is copied
+            std::vector<Literal> newBody;
+            for (size_t j = 0; j < body.size(); ++j) {
+                if (j == i) {
+                    newBody.push_back(Literal(Predicate(itr->second, 0, EDB,
+                                    pred.getCardinality()), body[i].getTuple()));
+                } else {
+                    newBody.push_back(body[j]);
+                }
+            }
+            Rule rule(r->rule.getId(), newHeads, newBody);
+            response |= executeAuxiliaryRule(rule, *r, producers);
+        }
+    }
+    endAuxiliaryIteration(nderivations, producers);
+    return response;
+}
+
+void SemiNaiver::replaceDerivations(const std::vector<std::pair<
+        std::shared_ptr<const FCInternalTable>,
+        std::shared_ptr<const FCInternalTable>>> &replaced) {
+    if (replaced.empty()) {
+        return;
+    }
+    std::vector<FCBlock> derivations;
+    for (const auto &block : listDerivations) {
+        derivations.push_back(block);
+        for (const auto &r : replaced) {
+            if (r.first == block.table) {
+                derivations.back().table = r.second;
+                break;
+            }
+        }
+        if (derivations.back().table == NULL) {
+            derivations.pop_back();
+        }
+    }
+    listDerivations.clear();
+    for (const auto &block : derivations) {
+        listDerivations.push_back(block);
+    }
+}
+
+void SemiNaiver::updateEDB(std::vector<EDBUpdate> &updates) {
+    if (chaseMgmt == NULL) {
+        LOG(ERRORL) << "The materialization must be computed before it can be updated";
+        throw 10;
+    }
+    //The auxiliary predicates exist only during the update: they are added
+    //to a copy of the program, and their tables are removed at the end. The
+    //next update reuses the same IDs.
+    Program *originalProgram = program;
+    Program updateProgram = program->clone();
+    const PredId_t firstAuxiliary = (PredId_t) updateProgram.getMaxPredicateId();
+    const size_t nTables = predicatesTables.size();
+    program = &updateProgram;
+    try {
+        applyEDBUpdates(updates);
+    } catch (...) {
+        removeAuxiliaryPredicates(firstAuxiliary, nTables);
+        program = originalProgram;
+        throw;
+    }
+    removeAuxiliaryPredicates(firstAuxiliary, nTables);
+    program = originalProgram;
+}
+
+void SemiNaiver::removeAuxiliaryPredicates(const PredId_t firstAuxiliary,
+        const size_t nTables) {
+    const PredId_t end = (PredId_t) program->getMaxPredicateId();
+    for (PredId_t p = firstAuxiliary; p < end; ++p) {
+        layer.removeTable(p);
+        if (p < predicatesTables.size() && predicatesTables[p] != NULL) {
+            delete predicatesTables[p];
+            predicatesTables[p] = NULL;
+        }
+    }
+    if (predicatesTables.size() > nTables) {
+        predicatesTables.resize(nTables);
+    }
+}
+
+void SemiNaiver::applyEDBUpdates(std::vector<EDBUpdate> &updates) {
+    std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+    for (const auto &rule : program->getAllRules()) {
+        for (const auto &literal : rule.getBody()) {
+            if (literal.isNegated()) {
+                LOG(ERRORL) << "Incremental updates are not supported with negation";
+                throw 10;
+            }
+        }
+    }
+
+    //Compute the new content of the relations. The updates are applied in
+    //order, and in every update the deletions come before the insertions.
+    std::map<PredId_t, RowSet> oldContent;
+    std::map<PredId_t, RowSet> newContent;
+    for (const auto &update : updates) {
+        const PredId_t id = update.predicate;
+        if (!layer.doesPredExists(id) || layer.getPredType(id) != "INMEMORY") {
+            LOG(ERRORL) << "Predicate " << id << " is not an in-memory EDB relation";
+            throw 10;
+        }
+        const Predicate pred = program->getPredicate(id);
+        const uint8_t arity = pred.getCardinality();
+        if (arity == 0 || update.inserted.size() % arity != 0 ||
+                update.deleted.size() % arity != 0) {
+            LOG(ERRORL) << "The updates of predicate " << id << " do not have arity " << (int) arity;
+            throw 10;
+        }
+        if (!oldContent.count(id)) {
+            oldContent.insert(std::make_pair(id, getEDBRows(layer, pred)));
+            newContent.insert(std::make_pair(id, oldContent.at(id)));
+        }
+        RowSet &content = newContent.at(id);
+        content = unionRows(minusRows(content,
+                    sortRows(update.deleted, arity)),
+                sortRows(update.inserted, arity));
+    }
+
+    //Rows that are really inserted and deleted
+    std::map<PredId_t, RowSet> inserted;
+    std::map<PredId_t, RowSet> deleted;
+    for (const auto &old : oldContent) {
+        const RowSet &content = newContent.at(old.first);
+        RowSet ins = minusRows(content, old.second);
+        RowSet del = minusRows(old.second, content);
+        if (!ins.empty()) {
+            inserted.insert(std::make_pair(old.first, ins));
+        }
+        if (!del.empty()) {
+            deleted.insert(std::make_pair(old.first, del));
+        }
+    }
+    oldContent.clear();
+    if (!deleted.empty() && program->areExistentialRules()) {
+        LOG(ERRORL) << "Deletions are not supported with existential rules";
+        throw 10;
+    }
+    LOG(INFOL) << "Updating the materialization: " << inserted.size() <<
+        " relations with insertions, " << deleted.size() <<
+        " relations with deletions";
+
+    //1) Over-delete: find all facts that have a derivation which uses a
+    //deleted fact. The derivations are computed on the old content.
+    std::map<PredId_t, RowSet> overDeleted;
+    std::map<PredId_t, RowSet> deltas = deleted;
+    while (!deltas.empty()) {
+        std::map<PredId_t, PredId_t> bodyDeltas;
+        for (auto &delta : deltas) {
+            const PredId_t aux = getAuxiliaryPredicate("__vlog_del_",
+                    delta.first, delta.second.arity);
+            setAuxiliaryTable(aux, delta.second.arity, delta.second.values);
+            bodyDeltas[delta.first] = aux;
+        }
+        std::map<PredId_t, PredId_t> heads;
+        const size_t nderivations = listDerivations.size();
+        //The derivations are only collected, they are not part of the
+        //materialization
+        executeDeltaRules(bodyDeltas, &heads);
+        while (listDerivations.size() > nderivations) {
+            listDerivations.pop_back();
+        }
+
+        deltas.clear();
+        for (const auto &head : heads) {
+            FCTable *table = predicatesTables[head.second];
+            if (table == NULL) {
+                continue;
+            }
+            RowSet rows = getIDBRows(table);
+            delete table;
+            predicatesTables[head.second] = NULL;
+            if (!overDeleted.count(head.first)) {
+                overDeleted.insert(std::make_pair(head.first,
+                            RowSet(rows.arity)));
+            }
+            RowSet &all = overDeleted.at(head.first);
+            RowSet newRows = minusRows(rows, all);
+            if (!newRows.empty()) {
+                all = unionRows(all, newRows);
+                deltas.insert(std::make_pair(head.first, newRows));
+            }
+        }
+    }
+    for (auto &delta : deleted) {
+        std::vector<Term_t> empty;
+        setAuxiliaryTable(getAuxiliaryPredicate("__vlog_del_", delta.first,
+                    delta.second.arity), delta.second.arity, empty);
+    }
+    for (auto &d : overDeleted) {
+        std::vector<Term_t> empty;
+        setAuxiliaryTable(getAuxiliaryPredicate("__vlog_del_", d.first,
+                    d.second.arity), d.second.arity, empty);
+    }
+
+    //2) Update the EDB relations. The derived tables must no longer read
+    //their columns from them.
+    std::vector<PredId_t> changed;
+    for (const auto &content : newContent) {
+        changed.push_back(content.first);
+    }
+    for (PredId_t p = 0; p < predicatesTables.size(); ++p) {
+        if (predicatesTables[p] != NULL && !layer.doesPredExists(p)) {
+            replaceDerivations(predicatesTables[p]->copyEDBColumns(changed));
+        }
+    }
+    for (auto &content : newContent) {
+        layer.addInmemoryTable(content.first, content.second.arity,
+                content.second.values);
+        if (predicatesTables[content.first] != NULL) {
+            delete predicatesTables[content.first];
+            predicatesTables[content.first] = NULL;
+        }
+    }
+    newContent.clear();
+
+    //3) Remove the over-deleted facts
+    size_t nOverDeleted = 0;
+    for (const auto &d : overDeleted) {
+        nOverDeleted += d.second.size();
+        if (predicatesTables[d.first] == NULL) {
+            continue;
+        }
+        replaceDerivations(predicatesTables[d.first]->removeRows(
+                    toSegment(d.second)));
+    }
+    LOG(INFOL) << "Over-deleted " << nOverDeleted << " facts";
+
+    const size_t startIteration = iteration;
+
+    //4) Rederive the removed facts that can still be derived. The rules are
+    //restricted to the removed facts with an additional atom.
+    std::vector<RuleExecutionDetails*> rules;
+    for (auto &r : allEDBRules) {
+        rules.push_back(&r);
+    }
+    for (auto &strata : allIDBRules) {
+        for (auto &r : strata) {
+            rules.push_back(&r);
+        }
+    }
+    std::map<PredId_t, PredId_t> removed;
+    for (auto &d : overDeleted) {
+        const PredId_t aux = getAuxiliaryPredicate("__vlog_red_", d.first,
+                d.second.arity);
+        setAuxiliaryTable(aux, d.second.arity, d.second.values);
+        removed[d.first] = aux;
+    }
+    overDeleted.clear();
+    const size_t nderivations = listDerivations.size();
+    std::map<PredId_t, const RuleExecutionDetails*> producers;
+    for (auto r : rules) {
+        for (const auto &head : r->rule.getHeads()) {
+            const Predicate pred = head.getPredicate();
+            auto itr = removed.find(pred.getId());
+            if (itr == removed.end()) {
+                continue;
+            }
+            std::vector<Literal> body;
+            body.push_back(Literal(Predicate(itr->second, 0, EDB,
+                            pred.getCardinality()), head.getTuple()));
+            for (const auto &literal : r->rule.getBody()) {
+                body.push_back(literal);
+            }
+            Rule rule(r->rule.getId(), r->rule.getHeads(), body);
+            executeAuxiliaryRule(rule, *r, producers);
+        }
+    }
+    endAuxiliaryIteration(nderivations, producers);
+
+    //5) Derive the facts that use the inserted rows
+    std::map<PredId_t, PredId_t> bodyInserts;
+    for (auto &ins : inserted) {
+        const PredId_t aux = getAuxiliaryPredicate("__vlog_add_", ins.first,
+                ins.second.arity);
+        setAuxiliaryTable(aux, ins.second.arity, ins.second.values);
+        bodyInserts[ins.first] = aux;
+    }
+    executeDeltaRules(bodyInserts, NULL);
+
+    //6) Propagate the new facts semi-naively
+    for (auto &strata : allIDBRules) {
+        for (auto &r : strata) {
+            r.lastExecution = startIteration;
+        }
+    }
+    std::vector<RuleExecutionDetails> emptyRuleset;
+    std::vector<StatIteration> costRules;
+    executeProgram(emptyRuleset, allIDBRules, costRules, NULL);
+
+    std::chrono::duration<double> sec = std::chrono::system_clock::now() - start;
+    LOG(INFOL) << "Updated the materialization in " << sec.count() * 1000 <<
+        " ms. Iterations=" << iteration;
+}
+
+void SemiNaiver::addDataAndResume(const Predicate pred, FCBlock block,
+        unsigned long *timeout) {
+    if (chaseMgmt == NULL) {
+        LOG(ERRORL) << "The materialization must be computed before it can be resumed";
+        throw 10;
+    }
+    for (const auto &rule : program->getAllRules()) {
+        for (const auto &literal : rule.getBody()) {
+            if (literal.isNegated()) {
+                LOG(ERRORL) << "Resuming the materialization is not supported with negation";
+                throw 10;
+            }
+        }
+    }
+    running = true;
+    startTime = std::chrono::system_clock::now();
+    listDerivations.clear();
+
+    //The new block is the only delta of the first round. The rules with
+    //only EDB atoms in the body cannot derive anything new.
+    const size_t startIteration = iteration;
+    block.iteration = iteration++;
+    addDataToIDBRelation(pred, block);
+    for (auto &strata : allIDBRules) {
+        for (auto &r : strata) {
+            r.lastExecution = startIteration;
+        }
+    }
+    std::vector<RuleExecutionDetails> emptyRuleset;
+    std::vector<StatIteration> costRules;
+    executeProgram(emptyRuleset, allIDBRules, costRules, timeout);
+
+    running = false;
+    std::chrono::duration<double> sec = std::chrono::system_clock::now() - startTime;
+    LOG(DEBUGL) << "Resumed the materialization in " << sec.count() * 1000 <<
+        " ms. Iterations=" << iteration;
+}
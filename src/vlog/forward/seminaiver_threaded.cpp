@@ -2,246 +2,281 @@
 #include <vlog/resultjoinproc.h>
 #include <vlog/finalresultjoinproc.h>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
 #include <vector>
 
-bool SemiNaiverThreaded::executeUntilSaturation(
-        std::vector<RuleExecutionDetails> &ruleset,
-        std::vector<StatIteration> &costRules,
-	uint32_t limitView,
-        bool fixpoint) {
-
-    if (limitView != 0) {
-	LOG(ERRORL) << "limitView not implemented in parallel version;";
-	abort();
+//Rows derived by a rule (its processors are either single or multi-head)
+static size_t countRows(const std::vector<ResultJoinProcessor*> &outputs) {
+    size_t n = 0;
+    for (auto output : outputs) {
+        FinalRuleProcessor *multiHead =
+            dynamic_cast<FinalRuleProcessor*>(output);
+        if (multiHead != NULL) {
+            n += multiHead->getNRows();
+        } else {
+            n += ((SingleHeadFinalRuleProcessor*) output)->getNRows();
+        }
     }
-    //Create n threads
-    std::vector<std::thread> threads(interRuleThreads);
-    bool anotherRound;
-    bool newDer = false;
-    do {
-        std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
-        //LOG(INFOL) << "Creating threads ...";
-        //Create a shared datastructure to record the execution of the rules
-        StatusRuleExecution_ThreadSafe status(ruleset.size());
+    return n;
+}
 
-        //Execute the rules on multiple threads
-        size_t iterationBeginBlock = iteration;
-        for (int i = 0; i < interRuleThreads; ++i) {
-            threads[i] = std::thread(&SemiNaiverThreaded::runThread,
-                    this,
-                    std::ref(ruleset),
-                    &status,
-                    &costRules,
-                    iterationBeginBlock);
+//Calls f(i) for all i in [0, n), on at most nthreads threads
+template<typename F>
+static void runTasks(const size_t n, const int nthreads, F f) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < n) {
+            f(i);
         }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min((size_t) std::max(nthreads, 1), n); ++t) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &t : threads) {
+        t.join();
+    }
+}
 
-        //Wait until all threads are finished
-        for (int i = 0; i < interRuleThreads; ++i) {
-            threads[i].join();
-        }
+void SemiNaiverThreaded::computeConsumers() {
+    std::vector<int> nodes;
+    std::vector<std::pair<int, int>> edges;
+    createGraphRuleDependency(nodes, edges);
+    consumers.clear();
+    consumers.resize(program->getAllRules().size());
+    for (const auto &edge : edges) {
+        consumers[edge.first].push_back(edge.second);
+    }
+}
 
-        //Copy all the derivations produced by the rules in the KB
-        anotherRound = false;
-        // anotherRound = doGlobalConsolidation(status);
-        for (int i = 0; i < marked.size(); i++) {
-            marked[i] = newMarked[i];
-            if (marked[i]) {
-                anotherRound = true;
+void SemiNaiverThreaded::createTables(
+        std::vector<RuleExecutionDetails> &ruleset) {
+    for (auto &details : ruleset) {
+        for (const auto &head : details.rule.getHeads()) {
+            getTable(head.getPredicate().getId(),
+                    head.getPredicate().getCardinality());
+        }
+        for (const auto &literal : details.rule.getBody()) {
+            if (literal.getPredicate().getType() == EDB) {
+                getTableFromEDBLayer(literal);
+            } else {
+                getTable(literal.getPredicate().getId(),
+                        literal.getPredicate().getCardinality());
             }
-            newMarked[i] = false;
         }
-
-        //LOG(INFOL) << "Another round = " << anotherRound;
-        std::chrono::duration<double> sec2 = std::chrono::system_clock::now() - start;
-        LOG(WARNL) << "--Time round " << sec2.count() * 1000 << " " << iteration;
-        newDer |= anotherRound;
-    } while (anotherRound);
-    return newDer;
+    }
 }
 
-bool sortByIteration(ResultJoinProcessor *p1, ResultJoinProcessor *p2) {
-    return ((SingleHeadFinalRuleProcessor*)p1)->getIteration() <
-        ((SingleHeadFinalRuleProcessor*)p2)->getIteration();
+void SemiNaiverThreaded::executeWave(
+        std::vector<RuleExecutionDetails> &ruleset,
+        const std::vector<size_t> &wave, const size_t version,
+        std::vector<ResultJoinProcessor*> *outputs,
+        std::vector<StatIteration> &costRules) {
+    std::vector<StatIteration> stats(wave.size());
+    runTasks(wave.size(), interRuleThreads, [&](const size_t i) {
+            RuleExecutionDetails &details = ruleset[wave[i]];
+            std::chrono::system_clock::time_point start =
+                std::chrono::system_clock::now();
+            executeRule(details, version + i, 0, &outputs[i]);
+            std::chrono::duration<double> sec =
+                std::chrono::system_clock::now() - start;
+            stats[i].iteration = version + i;
+            stats[i].rule = &details.rule;
+            stats[i].time = sec.count() * 1000;
+            stats[i].derived = countRows(outputs[i]) > 0;
+            stats[i].nReplans = details.nReplans;
+            });
+    costRules.insert(costRules.end(), stats.begin(), stats.end());
 }
 
-bool SemiNaiverThreaded::doGlobalConsolidation(
-        StatusRuleExecution_ThreadSafe &data) {
-
-    //Sort by iteration
-    //LOG(WARNL) << "Start consolidation ...";
-    //std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
-    std::sort(data.getTmpDerivations().begin(),
-            data.getTmpDerivations().end(),
-            sortByIteration);
-
-    bool response = false;
-    std::map<PredId_t, std::vector<SingleHeadFinalRuleProcessor*>> allDersByPred;
-    for (const auto &el : data.getTmpDerivations()) {
-        SingleHeadFinalRuleProcessor *fel = (SingleHeadFinalRuleProcessor*)el;
-        if (!el->isEmpty()) {
-            PredId_t pid = fel->getLiteral().getPredicate().getId();
-            if (allDersByPred.count(pid)) {
-                allDersByPred.find(pid)->second.push_back(fel);
+std::vector<PredId_t> SemiNaiverThreaded::publish(
+        std::vector<ResultJoinProcessor*> *outputs,
+        const size_t nOutputs, const size_t version) {
+    //Group the derivations by predicate. Within a group, they are sorted by
+    //iteration, so that the blocks are added in the right order.
+    std::map<PredId_t, std::vector<SingleHeadFinalRuleProcessor*>> byPredicate;
+    for (size_t i = 0; i < nOutputs; ++i) {
+        for (auto output : outputs[i]) {
+            std::vector<SingleHeadFinalRuleProcessor*> heads;
+            FinalRuleProcessor *multiHead =
+                dynamic_cast<FinalRuleProcessor*>(output);
+            if (multiHead != NULL) {
+                heads = multiHead->getAtomTables();
             } else {
-                std::vector<SingleHeadFinalRuleProcessor*> vec;
-                vec.push_back(fel);
-                allDersByPred.insert(make_pair(pid, vec));
+                heads.push_back((SingleHeadFinalRuleProcessor*) output);
+            }
+            for (auto head : heads) {
+                byPredicate[head->getLiteral().getPredicate().getId()].
+                    push_back(head);
             }
         }
     }
+    std::vector<std::pair<PredId_t, std::vector<SingleHeadFinalRuleProcessor*>>>
+        groups(byPredicate.begin(), byPredicate.end());
+
+    //Every predicate has its own table, so they are updated in parallel
+    //Not a vector<bool>, since the threads write to it
+    std::vector<char> changed(groups.size(), false);
+    runTasks(groups.size(), interRuleThreads, [&](const size_t i) {
+            FCTable *table = groups[i].second[0]->getTable();
+            for (auto head : groups[i].second) {
+                for (auto segment : head->getAllSegments()) {
+                    segment = table->retainFrom(segment, true, nthreads);
+                    if (!segment->isEmpty()) {
+                        head->consolidateSegment(segment);
+                        changed[i] = true;
+                    }
+                }
+            }
+            if (changed[i] && table->nBlocks() > 32) {
+                table->collapseBlocks(version, nthreads);
+            }
+            });
 
-    //Determine which derivations should be consolidated in parallel
-    std::vector<std::pair<PredId_t, std::vector<SingleHeadFinalRuleProcessor*>>> parallelDerivations;
-    for (auto p = allDersByPred.begin(); p != allDersByPred.end(); ++p) {
-        /*if (p->second.size() == 1) {
-        //Is the derivation unique? Or very small?
-        if (!p->second[0]->containsUnfilteredDerivation()) {
-        p->second[0]->consolidate(true, true);
-        LOG(WARNL) << "P " << p->first << " consolidated sequentially ...";
-        continue;
+    std::vector<PredId_t> out;
+    std::vector<FCBlock> &derivations = getDerivationsSoFar();
+    for (size_t i = 0; i < groups.size(); ++i) {
+        if (!changed[i]) {
+            continue;
+        }
+        out.push_back(groups[i].first);
+        FCIterator itr = groups[i].second[0]->getTable()->read(version);
+        while (!itr.isEmpty()) {
+            derivations.push_back(*itr.getCurrentBlock());
+            itr.moveNextCount();
         }
-        }*/
-        parallelDerivations.push_back(make_pair(p->first, p->second));
     }
-
-    //LOG(WARNL) << "Predicates to update in parallel: " << parallelDerivations.size();
-    //std::chrono::duration<double> sec1 = std::chrono::system_clock::now() - start;
-    //LOG(WARNL) << "Time consolidation so far " << sec1.count() * 1000;
-
-    for (auto p = parallelDerivations.begin(); p != parallelDerivations.end();
-            ++p) {
-        for (auto cont = p->second.begin(); cont != p->second.end(); ++cont) {
-            //std::chrono::system_clock::time_point startS = std::chrono::system_clock::now();
-            auto segments = (*cont)->getAllSegments();
-            //std::chrono::duration<double> sec1 = std::chrono::system_clock::now() - startS;
-            //LOG(WARNL) << "--Time getAllSegms " << sec1.count() * 1000;
-            FCTable *table = (*cont)->getTable();
-            for (auto segment = segments.begin(); segment != segments.end();
-                    ++segment) {
-                //std::chrono::system_clock::time_point startR = std::chrono::system_clock::now();
-                auto newseg = table->retainFrom(*segment, false, nthreads);
-                //std::chrono::duration<double> sec1 = std::chrono::system_clock::now() - startR;
-                //LOG(WARNL) << "--Time retain " << sec1.count() * 1000;
-
-
-                //std::chrono::system_clock::time_point startC = std::chrono::system_clock::now();
-                if (!newseg->isEmpty()) {
-                    (*cont)->consolidateSegment(newseg);
-                    response = true;
-                    newMarked[p->first] = true;
-                    marked[p->first] = true;
-                }
-                //std::chrono::duration<double> sec2 = std::chrono::system_clock::now() - startC;
-                //LOG(WARNL) << "--Time conso" << sec2.count() * 1000;
-            }
+    for (size_t i = 0; i < nOutputs; ++i) {
+        for (auto output : outputs[i]) {
+            delete output;
         }
+        outputs[i].clear();
     }
-
-    //std::chrono::duration<double> sec = std::chrono::system_clock::now() - start;
-    //LOG(WARNL) << "Time consolidation " << sec.count() * 1000;
-    return response;
+    return out;
 }
 
-void SemiNaiverThreaded::runThread(
+bool SemiNaiverThreaded::executeUntilSaturation(
         std::vector<RuleExecutionDetails> &ruleset,
-        StatusRuleExecution_ThreadSafe *status,
-        std::vector<StatIteration> *costRules,
-        size_t lastExec) {
-
-    int ruleToExecute = status->getRuleIDToExecute();
-    SemiNaiver_Threadlocal *data = new SemiNaiver_Threadlocal();
-    thread_data.reset(data);
+        std::vector<StatIteration> &costRules,
+        size_t limitView,
+        bool fixpoint, unsigned long *timeout) {
+    if (limitView != 0) {
+        LOG(ERRORL) << "limitView not implemented in parallel version;";
+        throw 10;
+    }
+    if (consumers.size() != program->getAllRules().size()) {
+        computeConsumers();
+    }
+    createTables(ruleset);
 
-    std::vector<ResultJoinProcessor*> res;
+    //Position in ruleset of every rule
+    std::vector<int> positions(consumers.size(), -1);
+    for (size_t i = 0; i < ruleset.size(); ++i) {
+        positions[ruleset[i].rule.getId()] = i;
+    }
 
-    while (ruleToExecute != -1) {
+    std::vector<bool> ready(ruleset.size(), true);
+    bool newDer = false;
+    size_t nwaves = 0;
+    while (true) {
+        std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
+        std::vector<size_t> wave;
+        std::vector<size_t> existentialRules;
+        for (size_t i = 0; i < ruleset.size(); ++i) {
+            if (ready[i] && bodyChangedSince(ruleset[i].rule,
+                        ruleset[i].lastExecution)) {
+                if (ruleset[i].rule.isExistential()) {
+                    existentialRules.push_back(i);
+                } else {
+                    wave.push_back(i);
+                }
+            }
+            ready[i] = false;
+        }
+        if (wave.empty() && existentialRules.empty()) {
+            break;
+        }
 
-        //Get atomic iteration
-        data->iteration = getAtomicIteration();
-        Literal headLiteral = ruleset[ruleToExecute].rule.getFirstHead();
-        PredId_t idHeadPredicate = headLiteral.getPredicate().getId();
-        std::vector<PredId_t> predicates;
-        predicates.push_back(idHeadPredicate);
-        std::vector<Literal> body = ruleset[ruleToExecute].rule.getBody();
-        for (std::vector<Literal>::const_iterator itr = body.begin(); itr != body.end(); ++itr) {
-            if (itr->getPredicate().getType() == IDB) {
-                predicates.push_back(itr->getPredicate().getId());
+        std::vector<PredId_t> changed;
+        if (!wave.empty()) {
+            //The rules of the wave see only the blocks before version, and
+            //all the blocks they produce come after it
+            const size_t version = iteration;
+            iteration += wave.size();
+            std::vector<std::vector<ResultJoinProcessor*>> outputs(wave.size());
+            executeWave(ruleset, wave, version, &outputs[0], costRules);
+            for (auto i : wave) {
+                ruleset[i].lastExecution = version;
             }
+            changed = publish(&outputs[0], outputs.size(), version);
         }
-        // Sort predicates, to avoid deadlock
-        std::sort(predicates.begin(), predicates.end());
 
-        lock(predicates, idHeadPredicate);
+        //The existential rules use the chase manager, which is not
+        //thread-safe
+        for (auto i : existentialRules) {
+            std::chrono::system_clock::time_point startRule =
+                std::chrono::system_clock::now();
+            bool response = executeRule(ruleset[i], iteration, 0, NULL);
+            std::chrono::duration<double> sec =
+                std::chrono::system_clock::now() - startRule;
+            StatIteration stat;
+            stat.iteration = iteration;
+            stat.rule = &ruleset[i].rule;
+            stat.time = sec.count() * 1000;
+            stat.derived = response;
+            stat.nReplans = ruleset[i].nReplans;
+            costRules.push_back(stat);
+            ruleset[i].lastExecution = iteration;
+            iteration++;
+            if (response) {
+                for (const auto &head : ruleset[i].rule.getHeads()) {
+                    changed.push_back(head.getPredicate().getId());
+                }
+            }
+        }
+        checkMemoryBudget();
+
+        //Schedule the rules that depend on the predicates that changed
+        std::sort(changed.begin(), changed.end());
+        for (const auto &details : ruleset) {
+            for (const auto &head : details.rule.getHeads()) {
+                if (!std::binary_search(changed.begin(), changed.end(),
+                            head.getPredicate().getId())) {
+                    continue;
+                }
+                for (auto c : consumers[details.rule.getId()]) {
+                    if (positions[c] >= 0) {
+                        ready[positions[c]] = true;
+                    }
+                }
+            }
+        }
+        newDer |= !changed.empty();
+        nwaves++;
 
-        //Execute the rule
-        std::chrono::system_clock::time_point start = std::chrono::system_clock::now();
-        bool response = executeRule(ruleset[ruleToExecute],
-                data->iteration,
-		0,
-                // &res);
-        NULL);
         std::chrono::duration<double> sec = std::chrono::system_clock::now() - start;
-        StatIteration stat;
-        stat.iteration = data->iteration;
-        stat.rule = &ruleset[ruleToExecute].rule;
-        stat.time = sec.count() * 1000;
-        stat.derived = response;
-
-        //Add statistics
-        mutexInsert.lock();
-        costRules->push_back(stat);
-        mutexInsert.unlock();
-
-        //Change it to "lastExecution"
-        // ruleset[ruleToExecute].lastExecution = lastExec;
-        ruleset[ruleToExecute].lastExecution = data->iteration;
-
-        if (response) {
-            newMarked[idHeadPredicate] = true;
-            marked[idHeadPredicate] = true;
-            if (ruleset[ruleToExecute].rule.isRecursive()) {
-                int recursiveIterations = 0;
-                do {
-                    // LOG(INFOL) << "Iteration " << iteration;
-                    data->iteration = getAtomicIteration();
-                    start = std::chrono::system_clock::now();
-                    recursiveIterations++;
-                    response = executeRule(ruleset[ruleToExecute],
-                            data->iteration,
-			    0,
-                            // &res);
-                    NULL);
-
-                    ruleset[ruleToExecute].lastExecution = data->iteration;
-                    sec = std::chrono::system_clock::now() - start;
-                    ++recursiveIterations;
-                    stat.iteration = data->iteration;
-                    stat.rule = &ruleset[ruleToExecute].rule;
-                    stat.time = sec.count() * 1000;
-                    stat.derived = response;
-                    mutexInsert.lock();
-                    costRules->push_back(stat);
-                    mutexInsert.unlock();
-                    /*if (++recursiveIterations % 10 == 0) {
-                      LOG(INFOL) << "Saturating rule " <<
-                      ruleset[currentRule].rule.tostring(program, dict) <<
-                      " " << recursiveIterations;
-                      }*/
-                } while (response);
-                    LOG(DEBUGL) << "Rule required " << recursiveIterations << " to saturate";
+        LOG(DEBUGL) << "Wave " << nwaves << ": " << wave.size() << " rules, "
+            << existentialRules.size() << " existential rules, "
+            << changed.size() << " predicates with new facts, time "
+            << sec.count() * 1000 << "ms";
+
+        if (timeout != NULL && *timeout != 0) {
+            std::chrono::duration<double> s = std::chrono::system_clock::now() - getStartingTimeMs();
+            if (s.count() > *timeout) {
+                *timeout = 0;   // To indicate materialization was stopped because of timeout.
+                return newDer;
             }
         }
-
-        unlock(predicates, idHeadPredicate);
-
-        ruleToExecute = status->getRuleIDToExecute();
-    }
-
-    //Register the derivations
-    if (!res.empty()) {
-        for (auto &el : res)
-            status->registerDerivations(el);
+        if (!fixpoint) {
+            break;
+        }
     }
+    LOG(DEBUGL) << "Stratum saturated after " << nwaves << " waves";
+    return newDer;
 }
 
 void SemiNaiverThreaded::saveDerivationIntoDerivationList(FCTable *endTable) {
@@ -259,32 +294,16 @@ void SemiNaiverThreaded::saveStatistics(StatsRule &stats) {
     SemiNaiver::saveStatistics(stats);
 }
 
-StatusRuleExecution_ThreadSafe::StatusRuleExecution_ThreadSafe(const int nrules)
-    : rulecount(0), nrules(nrules) {
-    }
-
-
-int StatusRuleExecution_ThreadSafe::getRuleIDToExecute() {
-    //Return -1 if no rule is available. Otherwise return the ID of the rule to
-    //execute.
-    std::lock_guard<std::mutex> lock(mutexRules);
-    if (rulecount == nrules) {
-        return -1;
-    }
-    LOG(DEBUGL) << "Got rule " << rulecount;
-    return rulecount++;
-}
-
-void StatusRuleExecution_ThreadSafe::registerDerivations(
-        ResultJoinProcessor *res) {
-    std::lock_guard<std::mutex> lock(mutexRules);
-    tmpderivations.push_back(res);
-}
-
 FCTable *SemiNaiverThreaded::getTable(const PredId_t pred, const uint8_t card) {
+    //createTables creates the tables of the rules before the waves, so
+    //during a wave the table is found without taking the lock
+    FCTable *table = predicatesTables[pred];
+    if (table != NULL) {
+        return table;
+    }
+    std::lock_guard<std::mutex> lock(mutexGetTable);
     if (predicatesTables[pred] == NULL) {
-        std::lock_guard<std::mutex> lock(mutexGetTable);
-        return SemiNaiver::getTable(pred, card);
+        predicatesTables[pred] = new FCTable(&mutexTables, card);
     }
     return predicatesTables[pred];
 }
@@ -293,75 +312,8 @@ FCIterator SemiNaiverThreaded::getTableFromEDBLayer(const Literal &literal) {
     PredId_t id = literal.getPredicate().getId();
     FCTable *table = predicatesTables[id];
     if (table == NULL) {
-        std::lock_guard<std::mutex> lock(mutexGetTable);
+        std::lock_guard<std::mutex> lock(mutexEDBTables);
         return SemiNaiver::getTableFromEDBLayer(literal);
     }
     return SemiNaiver::getTableFromEDBLayer(literal);
 }
-
-bool SemiNaiverThreaded::tryLock(std::vector<PredId_t> &predicates, PredId_t idHeadPredicate) {
-    PredId_t prev = (PredId_t) - 1;
-    LOG(DEBUGL) << "Getting locks ...";
-    for (std::vector<PredId_t>::const_iterator itr = predicates.begin(); itr != predicates.end(); ++itr) {
-        if (*itr != prev) {
-            LOG(DEBUGL) << "Getting lock " << *itr;
-            bool gotlock;
-            if (*itr == idHeadPredicate) {
-                gotlock = mutexes[*itr].try_lock();
-            } else {
-                gotlock = mutexes[*itr].try_lock(); //Previously it was a shared lock
-            }
-            if (! gotlock) {
-                prev = (PredId_t) -1;
-                for (std::vector<PredId_t>::const_iterator itr1 = predicates.begin(); itr1 != itr; ++itr1) {
-                    if (*itr1 != prev) {
-                        if (*itr1 == idHeadPredicate) {
-                            mutexes[*itr1].unlock();
-                        } else {
-                            mutexes[*itr1].unlock(); //Previously it was a shared lock
-                        }
-                    }
-                }
-                return false;
-            }
-        }
-        prev = *itr;
-    }
-    LOG(DEBUGL) << "Got locks!";
-    return true;
-}
-
-void SemiNaiverThreaded::lock(std::vector<PredId_t> &predicates, PredId_t idHeadPredicate) {
-
-    PredId_t prev = (PredId_t) - 1;
-    LOG(DEBUGL) << "Getting locks ...";
-    for (std::vector<PredId_t>::const_iterator itr = predicates.begin(); itr != predicates.end(); ++itr) {
-        if (*itr != prev) {
-            LOG(DEBUGL) << "Getting lock " << *itr;
-            if (*itr == idHeadPredicate) {
-                mutexes[*itr].lock();
-            } else {
-                mutexes[*itr].lock(); //Previously it was a shared lock
-            }
-        }
-        prev = *itr;
-    }
-    LOG(DEBUGL) << "Got locks!";
-}
-
-void SemiNaiverThreaded::unlock(std::vector<PredId_t> &predicates, PredId_t idHeadPredicate) {
-    PredId_t prev = (PredId_t) - 1;
-    LOG(DEBUGL) << "Releasing locks ...";
-    for (std::vector<PredId_t>::const_iterator itr = predicates.begin(); itr != predicates.end(); ++itr) {
-        if (*itr != prev) {
-            LOG(DEBUGL) << "Releasing lock " << *itr;
-            if (*itr == idHeadPredicate) {
-                mutexes[*itr].unlock();
-            } else {
-                mutexes[*itr].unlock(); //Previously it was a shared lock
-            }
-        }
-        prev = *itr;
-    }
-    LOG(DEBUGL) << "Released locks!";
-}
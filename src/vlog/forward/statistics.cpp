@@ -0,0 +1,251 @@
+#include <vlog/statistics.h>
+#include <vlog/fcinttable.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//************** HYPERLOGLOG ***************
+HyperLogLog::HyperLogLog() {
+    memset(registers, 0, sizeof(registers));
+}
+
+void HyperLogLog::add(const Term_t value) {
+    uint64_t h = value;
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    const size_t idx = h >> (64 - HLL_BITS);
+    //Position of the first 1 in the remaining bits
+    uint64_t rest = h << HLL_BITS;
+    uint8_t rank = 1;
+    while (rank <= 64 - HLL_BITS && !(rest & (UINT64_C(1) << 63))) {
+        rest <<= 1;
+        rank++;
+    }
+    if (rank > registers[idx]) {
+        registers[idx] = rank;
+    }
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+    for (size_t i = 0; i < (1 << HLL_BITS); ++i) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+    }
+}
+
+uint64_t HyperLogLog::estimate() const {
+    const double m = 1 << HLL_BITS;
+    double sum = 0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < (1 << HLL_BITS); ++i) {
+        sum += std::ldexp(1.0, -registers[i]);
+        if (registers[i] == 0) {
+            zeros++;
+        }
+    }
+    double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+    //Small cardinalities are better estimated with linear counting
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * std::log(m / zeros);
+    }
+    return (uint64_t) (estimate + 0.5);
+}
+//************** END HYPERLOGLOG ***************
+
+//************** HISTOGRAM ***************
+Histogram::Histogram() : min(0), max(0), total(0) {
+    memset(counts, 0, sizeof(counts));
+}
+
+size_t Histogram::getBucket(const Term_t value) const {
+    if (value <= min) {
+        return 0;
+    }
+    return std::min((size_t) ((value - min) / getWidth()),
+            (size_t) HISTOGRAM_BUCKETS - 1);
+}
+
+void Histogram::build(std::vector<Term_t> &values) {
+    memset(counts, 0, sizeof(counts));
+    total = values.size();
+    if (values.empty()) {
+        return;
+    }
+    auto minmax = std::minmax_element(values.begin(), values.end());
+    min = *minmax.first;
+    max = *minmax.second;
+    for (auto v : values) {
+        counts[getBucket(v)]++;
+    }
+}
+
+void Histogram::merge(const Histogram &other) {
+    if (other.isEmpty()) {
+        return;
+    }
+    if (isEmpty()) {
+        *this = other;
+        return;
+    }
+    //Move the buckets of both histograms in the buckets of the union of
+    //their ranges that contain their midpoints
+    const Histogram first = *this;
+    min = std::min(first.min, other.min);
+    max = std::max(first.max, other.max);
+    memset(counts, 0, sizeof(counts));
+    total = first.total + other.total;
+    const Histogram *parts[2] = { &first, &other };
+    for (int j = 0; j < 2; ++j) {
+        const Histogram *h = parts[j];
+        const uint64_t width = h->getWidth();
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            if (h->counts[i] > 0) {
+                const Term_t begin = h->min + i * width;
+                const Term_t end = std::min(h->max, begin + (width - 1));
+                counts[getBucket(begin + (end - begin) / 2)] += h->counts[i];
+            }
+        }
+    }
+}
+
+double Histogram::fractionIn(const Term_t lo, const Term_t hi) const {
+    if (isEmpty()) {
+        //Nothing is known about the values
+        return 1.0;
+    }
+    if (lo > hi || hi < min || lo > max) {
+        return 0.0;
+    }
+    if (lo <= min && hi >= max) {
+        return 1.0;
+    }
+    const uint64_t width = getWidth();
+    double inRange = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        const Term_t begin = min + i * width;
+        const Term_t end = std::min(max, begin + (width - 1));
+        if (end < lo || begin > hi) {
+            continue;
+        }
+        const Term_t b = std::max(begin, lo);
+        const Term_t e = std::min(end, hi);
+        inRange += counts[i] * ((double) (e - b) + 1) / ((double) (end - begin) + 1);
+    }
+    return inRange / total;
+}
+//************** END HISTOGRAM ***************
+
+//************** COLUMN STATISTICS ***************
+void ColumnStatistics::build(std::vector<Term_t> &values) {
+    for (auto v : values) {
+        sketch.add(v);
+    }
+    histogram.build(values);
+}
+
+void ColumnStatistics::merge(const ColumnStatistics &other) {
+    if (knownNDV != 0 || other.knownNDV != 0) {
+        //Upper bound
+        knownNDV = getNDV() + other.getNDV();
+    } else {
+        sketch.merge(other.sketch);
+    }
+    histogram.merge(other.histogram);
+}
+
+uint64_t ColumnStatistics::getNDV() const {
+    if (knownNDV != 0) {
+        return knownNDV;
+    }
+    return sketch.estimate();
+}
+//************** END COLUMN STATISTICS ***************
+
+//************** TABLE STATISTICS ***************
+std::shared_ptr<const TableStatistics> TableStatistics::compute(
+        const FCBlock &block, EDBLayer &layer) {
+    std::shared_ptr<const FCInternalTable> table = block.table;
+    const uint8_t ncolumns = table->getRowSize();
+    std::shared_ptr<TableStatistics> stats(new TableStatistics(ncolumns));
+    stats->nrows = table->getNRows();
+    for (uint8_t i = 0; i < ncolumns; ++i) {
+        if (table->isEDB()) {
+            stats->columns[i].setNDV(std::max((size_t) 1,
+                        layer.getCardinalityColumn(block.query, i)));
+        } else if (table->isColumnConstant(i)) {
+            std::vector<Term_t> value(1, table->getValueConstantColumn(i));
+            stats->columns[i].build(value);
+        } else {
+            std::vector<Term_t> values = table->getColumn(i)->getReader()->
+                asVector();
+            stats->columns[i].build(values);
+        }
+    }
+    return stats;
+}
+
+void TableStatistics::merge(const TableStatistics &other) {
+    nrows += other.nrows;
+    for (uint8_t i = 0; i < columns.size() && i < other.columns.size(); ++i) {
+        columns[i].merge(other.columns[i]);
+    }
+}
+//************** END TABLE STATISTICS ***************
+
+//************** STATISTICS ***************
+std::shared_ptr<const TableStatistics> Statistics::getBlock(
+        const FCBlock &block, EDBLayer &layer) {
+    const FCInternalTable *key = block.table.get();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto itr = blocks.find(key);
+        if (itr != blocks.end() && itr->second.first.lock() == block.table) {
+            return itr->second.second;
+        }
+    }
+
+    //The statistics are computed without the lock, so that the threads do
+    //not wait for each other's blocks. If two threads compute the same
+    //block, the first result is kept.
+    std::shared_ptr<const TableStatistics> stats =
+        TableStatistics::compute(block, layer);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto itr = blocks.find(key);
+    if (itr != blocks.end() && itr->second.first.lock() == block.table) {
+        return itr->second.second;
+    }
+    blocks[key] = std::make_pair(std::weak_ptr<const FCInternalTable>(
+                block.table), stats);
+
+    //Forget the blocks that were removed
+    if (blocks.size() > pruneAt) {
+        for (auto b = blocks.begin(); b != blocks.end();) {
+            if (b->second.first.expired()) {
+                b = blocks.erase(b);
+            } else {
+                ++b;
+            }
+        }
+        pruneAt = std::max((size_t) 1024, blocks.size() * 2);
+    }
+    return stats;
+}
+
+std::shared_ptr<const TableStatistics> Statistics::get(FCTable *table,
+        const size_t min, const size_t max, EDBLayer &layer) {
+    std::shared_ptr<TableStatistics> stats(
+            new TableStatistics(table->getSizeRow()));
+    FCIterator itr = table->read(min, max);
+    while (!itr.isEmpty()) {
+        stats->merge(*getBlock(*itr.getCurrentBlock(), layer));
+        itr.moveNextCount();
+    }
+    return stats;
+}
+//************** END STATISTICS ***************
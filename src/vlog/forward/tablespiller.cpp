@@ -0,0 +1,87 @@
+#include <vlog/tablespiller.h>
+#include <vlog/inmemory/snapshot.h>
+
+#include <kognac/utils.h>
+
+#include <fstream>
+
+bool TableSpiller::shouldSpill(std::shared_ptr<Column> column) {
+    return !column->isEmpty() && (column->isBackedByVector() ||
+            dynamic_cast<const PackedColumn*>(column.get()) != NULL);
+}
+
+std::shared_ptr<const FCInternalTable> TableSpiller::spill(
+        std::shared_ptr<const FCInternalTable> table,
+        const size_t iteration, const std::string &path,
+        size_t &freed) {
+    freed = 0;
+    const uint8_t nfields = table->getRowSize();
+    std::vector<std::shared_ptr<Column>> columns(nfields);
+    bool found = false;
+    for (uint8_t i = 0; i < nfields; ++i) {
+        columns[i] = table->getColumn(i);
+        found = found || shouldSpill(columns[i]);
+    }
+    if (!found) {
+        return NULL;
+    }
+
+    std::ofstream out(path, std::ios_base::out | std::ios_base::binary |
+            std::ios_base::trunc);
+    if (out.fail()) {
+        LOG(ERRORL) << "Could not open " << path;
+        throw ("Could not open file " + path + " for writing");
+    }
+    //Offset of every column in the file. The packed columns are kept to
+    //replace their words with the ones in the file.
+    std::vector<size_t> offsets(nfields);
+    std::vector<std::shared_ptr<Column>> packed(nfields);
+    for (uint8_t i = 0; i < nfields; ++i) {
+        if (!shouldSpill(columns[i])) {
+            continue;
+        }
+        offsets[i] = freed;
+        packed[i] = columns[i];
+        if (dynamic_cast<const PackedColumn*>(packed[i].get()) == NULL) {
+            std::vector<Term_t> values = columns[i]->getReader()->asVector();
+            packed[i] = PackedColumn::pack(values);
+            if (packed[i] == NULL) {
+                out.write((const char *) &values[0],
+                        values.size() * sizeof(Term_t));
+                freed += values.size() * sizeof(Term_t);
+                continue;
+            }
+        }
+        size_t nwords;
+        const uint64_t *words = ((const PackedColumn*) packed[i].get())->
+            getWords(nwords);
+        out.write((const char *) words, nwords * sizeof(uint64_t));
+        freed += nwords * sizeof(uint64_t);
+    }
+    out.close();
+    if (out.fail()) {
+        LOG(ERRORL) << "Could not write " << path;
+        throw ("Could not write file " + path);
+    }
+
+    size_t size;
+    std::shared_ptr<const char> region = TableSnapshot::readFile(path, size);
+    //The mapping stays valid after the file is removed
+    Utils::remove(path);
+    for (uint8_t i = 0; i < nfields; ++i) {
+        if (!shouldSpill(columns[i])) {
+            continue;
+        }
+        const char *start = region.get() + offsets[i];
+        if (packed[i] != NULL) {
+            columns[i] = ((const PackedColumn*) packed[i].get())->remap(region,
+                    (const uint64_t *) start);
+        } else {
+            columns[i] = std::shared_ptr<Column>(new MappedColumn(region,
+                        (const Term_t *) start, columns[i]->size()));
+        }
+    }
+    std::shared_ptr<const Segment> segment(new Segment(nfields, columns));
+    return std::shared_ptr<const FCInternalTable>(new InmemoryFCInternalTable(
+                nfields, iteration, table->isSorted(), segment));
+}
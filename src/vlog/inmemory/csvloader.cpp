@@ -0,0 +1,414 @@
+#include <vlog/inmemory/csvloader.h>
+
+#include <kognac/utils.h>
+
+#include <zstr/zstr.hpp>
+
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Returns true if [p, e) contains a quote, a carriage return or a NUL (which
+//truncates the field). Those rows need the slow parser. The test is done one
+//64-bit word at a time.
+static bool needsSlowParse(const char *p, const char *e) {
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highs = 0x8080808080808080ull;
+    const uint64_t quotes = ones * (uint64_t) '"';
+    const uint64_t crs = ones * (uint64_t) '\r';
+    while (e - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        const uint64_t q = w ^ quotes;
+        const uint64_t c = w ^ crs;
+        if ((((q - ones) & ~q) | ((c - ones) & ~c) | ((w - ones) & ~w))
+                & highs) {
+            return true;
+        }
+        p += 8;
+    }
+    while (p < e) {
+        if (*p == '"' || *p == '\r' || *p == '\0') {
+            return true;
+        }
+        p++;
+    }
+    return false;
+}
+
+//Character-at-a-time parser, used for rows with quotes or carriage returns.
+//It behaves exactly like the original reader on an istream.
+static const char *parseRowSlow(const char *in, const char *end,
+        const bool eof, std::vector<std::string> &result) {
+    char buffer[CSVLoader::MAX_FIELD_SIZE + 1];
+    bool insideEscaped = false;
+    char *p = &buffer[0];
+    bool justSeenQuote = false;
+    int quoteCount = 0;     // keep track of number of concecutive quotes.
+    while (true) {
+        int c;
+        bool atEnd = (in == end);
+        if (atEnd) {
+            if (! eof) {
+                result.clear();
+                return NULL;
+            }
+            if (p == buffer && result.size() == 0) {
+                return end;
+            }
+            c = '\n';
+        } else {
+            c = *in++;
+        }
+        if (c == '\r') {
+            // ignore these?
+            continue;
+        }
+        if (p == buffer && ! justSeenQuote) {
+            // Watch out for more than one initial quote ...
+            if (c == '"') {
+                // Initial character is a quote.
+                insideEscaped = true;
+                justSeenQuote = true;
+                continue;
+            }
+        } else if (c == '"') {
+            quoteCount++;
+            insideEscaped = (quoteCount & 1) == 0;
+            if (insideEscaped) {
+                p--;
+            }
+        } else {
+            quoteCount = 0;
+        }
+        if (atEnd || (! insideEscaped && (c == '\n' || c == ','))) {
+            if (justSeenQuote) {
+                *(p-1) = '\0';
+            } else {
+                *p = '\0';
+            }
+            result.push_back(std::string(buffer));
+            if (c == '\n') {
+                return in;
+            }
+            p = buffer;
+            insideEscaped = false;
+        } else {
+            if (p - buffer >= CSVLoader::MAX_FIELD_SIZE) {
+                throw "Maximum field size exceeded in CSV file: 65535";
+            }
+            *p++ = c;
+        }
+        justSeenQuote = (c == '"');
+    }
+}
+
+const char *CSVLoader::parseRow(const char *p, const char *end,
+        const bool eof, std::vector<std::string> &row) {
+    if (p == end) {
+        return eof ? end : NULL;
+    }
+    const char *nl = (const char *) memchr(p, '\n', end - p);
+    if (nl == NULL) {
+        if (! eof) {
+            return NULL;
+        }
+        nl = end;
+    }
+    if (needsSlowParse(p, nl)) {
+        return parseRowSlow(p, end, eof, row);
+    }
+    while (true) {
+        const char *sep = (const char *) memchr(p, ',', nl - p);
+        if (sep == NULL) {
+            sep = nl;
+        }
+        if (sep - p > MAX_FIELD_SIZE) {
+            throw "Maximum field size exceeded in CSV file: 65535";
+        }
+        row.push_back(std::string(p, sep));
+        if (sep == nl) {
+            break;
+        }
+        p = sep + 1;
+    }
+    return nl == end ? end : nl + 1;
+}
+
+const char *CSVLoader::nextRowStart(const char *from, const char *target,
+        const char *end, const bool exact) {
+    if (target >= end) {
+        return end;
+    }
+    const char *nl = (const char *) memchr(target - 1, '\n',
+            end - (target - 1));
+    if (nl == NULL) {
+        return end;
+    }
+    if (!exact || memchr(from, '"', nl - from) == NULL) {
+        //Without quotes, every newline terminates a row
+        return nl + 1;
+    }
+    //Quoted fields may contain newlines. Skip whole rows.
+    std::vector<std::string> row;
+    const char *p = from;
+    while (p < target) {
+        row.clear();
+        p = parseRow(p, end, true, row);
+    }
+    return p;
+}
+
+void CSVLoader::parseChunk(Chunk &chunk) {
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::string> row;
+    const char *p = chunk.begin;
+    try {
+        while (true) {
+            row.clear();
+            const char *next = parseRow(p, chunk.end, chunk.eof, row);
+            if (next == NULL) {
+                //Incomplete row: it is left for the next window
+                break;
+            }
+            if (row.empty()) {
+                p = next;
+                break;
+            }
+            if (chunk.nrows == 0) {
+                chunk.arity = row.size();
+            } else if (row.size() != chunk.arity) {
+                chunk.multipleArities = true;
+                break;
+            }
+            for (auto &field : row) {
+                auto itr = ids.find(field);
+                uint32_t id;
+                if (itr == ids.end()) {
+                    id = chunk.terms.size();
+                    ids.insert(std::make_pair(field, id));
+                    chunk.terms.push_back(field);
+                } else {
+                    id = itr->second;
+                }
+                chunk.cells.push_back(id);
+            }
+            chunk.nrows++;
+            p = next;
+        }
+    } catch (const char *msg) {
+        chunk.error = std::string(msg);
+    }
+    chunk.consumed = p;
+}
+
+void CSVLoader::ParseChunks::operator()(const ParallelRange& r) const {
+    for (size_t i = r.begin(); i != r.end(); ++i) {
+        CSVLoader::parseChunk(chunks[i]);
+    }
+}
+
+void CSVLoader::lookupChunk(Chunk &chunk, EDBLayer *layer) {
+    chunk.dictIds.resize(chunk.terms.size());
+    chunk.found.resize(chunk.terms.size());
+    for (size_t i = 0; i < chunk.terms.size(); ++i) {
+        chunk.found[i] = layer->getAddedDictNumber(chunk.terms[i].c_str(),
+                chunk.terms[i].size(), chunk.dictIds[i]);
+    }
+}
+
+void CSVLoader::LookupChunks::operator()(const ParallelRange& r) const {
+    for (size_t i = r.begin(); i != r.end(); ++i) {
+        CSVLoader::lookupChunk(chunks[i], layer);
+    }
+}
+
+void CSVLoader::addChunk(Chunk &chunk) {
+    if (chunk.nrows > 0) {
+        if (arity == 0) {
+            arity = chunk.arity;
+        }
+        if (chunk.arity != arity) {
+            LOG(ERRORL) << "Multiple arities";
+            throw ("Multiple arities in file " + path);
+        }
+    }
+    if (chunk.multipleArities) {
+        LOG(ERRORL) << "Multiple arities";
+        throw ("Multiple arities in file " + path);
+    }
+    if (! chunk.error.empty()) {
+        LOG(ERRORL) << "Max field size";
+        throw "Maximum field size exceeded in CSV file: 65535";
+    }
+    if (chunk.nrows == 0) {
+        return;
+    }
+
+    //The terms that were not found by lookupChunk (if it was called) are
+    //added in order of first appearance, so the IDs are assigned as before.
+    std::vector<uint64_t> &dictIds = chunk.dictIds;
+    dictIds.resize(chunk.terms.size());
+    for (size_t i = 0; i < chunk.terms.size(); ++i) {
+        if (i >= chunk.found.size() || ! chunk.found[i]) {
+            layer->getOrAddDictNumber(chunk.terms[i].c_str(),
+                    chunk.terms[i].size(), dictIds[i]);
+        }
+    }
+    std::vector<std::string>().swap(chunk.terms);
+
+    if (inserter == NULL) {
+        inserter = new SegmentInserter(arity);
+    }
+    Term_t rowc[256];
+    const uint32_t *cell = chunk.cells.data();
+    for (size_t i = 0; i < chunk.nrows; ++i) {
+        for (uint8_t j = 0; j < arity; ++j) {
+            rowc[j] = dictIds[*cell++];
+        }
+        inserter->addRow(rowc);
+    }
+}
+
+const char *CSVLoader::processWindow(const char *begin, const char *end,
+        const bool eof) {
+    const size_t maxChunks = std::max(1u, std::thread::hardware_concurrency());
+    const char *p = begin;
+    //Set when the previous split was wrong: the next chunk is then found
+    //by parsing the rows, so that it starts at a row
+    bool exact = false;
+    while (p < end) {
+        std::vector<Chunk> chunks;
+        while (p < end && chunks.size() < maxChunks) {
+            Chunk chunk;
+            chunk.begin = p;
+            const char *target = (size_t)(end - p) > CHUNK_SIZE ?
+                p + CHUNK_SIZE : end;
+            chunk.end = nextRowStart(p, target, end, exact);
+            exact = false;
+            //A chunk that does not end at the end of the window must end
+            //with a complete row, otherwise the split was wrong
+            chunk.eof = eof && chunk.end == end;
+            chunks.push_back(chunk);
+            p = chunk.end;
+        }
+
+        if (chunks.size() > 1) {
+            ParallelTasks::parallel_for(0, chunks.size(), 1,
+                    ParseChunks(chunks));
+            ParallelTasks::parallel_for(0, chunks.size(), 1,
+                    LookupChunks(chunks, layer));
+        } else {
+            parseChunk(chunks[0]);
+        }
+
+        for (auto &chunk : chunks) {
+            addChunk(chunk);
+            if (chunk.consumed < chunk.end) {
+                if (chunk.end == end) {
+                    //Incomplete row: it is left for the next window
+                    return chunk.consumed;
+                }
+                //A quoted field spans the end of the chunk. The following
+                //chunks did not start at a row and are parsed again.
+                p = chunk.consumed;
+                exact = true;
+                break;
+            }
+        }
+    }
+    return p;
+}
+
+void CSVLoader::loadFromStream(std::istream &ifs) {
+    const size_t windowSize = CHUNK_SIZE *
+        std::max(1u, std::thread::hardware_concurrency());
+    std::vector<char> buffer;
+    size_t carry = 0;
+    bool eof = false;
+    while (! eof) {
+        buffer.resize(carry + windowSize);
+        ifs.read(&buffer[carry], windowSize);
+        const size_t n = ifs.gcount();
+        eof = n < windowSize;
+        const char *begin = &buffer[0];
+        const char *end = begin + carry + n;
+        const char *consumed = processWindow(begin, end, eof);
+        carry = end - consumed;
+        if (carry > 0) {
+            memmove(&buffer[0], consumed, carry);
+        }
+    }
+}
+
+#if !defined(_WIN32)
+void CSVLoader::loadFromMappedFile() {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        LOG(ERRORL) << "Could not open " << path;
+        throw ("Could not open file " + path + " for reading");
+    }
+    const size_t size = st.st_size;
+    if (size > 0) {
+        void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            LOG(ERRORL) << "Could not map " << path;
+            throw ("Could not open file " + path + " for reading");
+        }
+        madvise(data, size, MADV_SEQUENTIAL);
+        try {
+            processWindow((const char *) data, (const char *) data + size,
+                    true);
+        } catch (...) {
+            munmap(data, size);
+            close(fd);
+            throw;
+        }
+        munmap(data, size);
+    }
+    close(fd);
+}
+#endif
+
+SegmentInserter *CSVLoader::load(std::string path, EDBLayer *layer,
+        uint8_t &arity) {
+    CSVLoader loader(path, layer);
+    LOG(DEBUGL) << "Reading " << path;
+    try {
+        if (path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0) {
+            zstr::ifstream ifs(path);
+            if (ifs.fail()) {
+                LOG(ERRORL) << "Could not open " << path;
+                throw ("Could not open file " + path + " for reading");
+            }
+            loader.loadFromStream(ifs);
+        } else {
+#if defined(_WIN32)
+            std::ifstream ifs(path, ios_base::in | ios_base::binary);
+            if (ifs.fail()) {
+                LOG(ERRORL) << "Could not open " << path;
+                throw ("Could not open file " + path + " for reading");
+            }
+            loader.loadFromStream(ifs);
+#else
+            loader.loadFromMappedFile();
+#endif
+        }
+    } catch (...) {
+        if (loader.inserter != NULL) {
+            delete loader.inserter;
+        }
+        throw;
+    }
+    arity = loader.arity;
+    return loader.inserter;
+}
@@ -1,71 +1,13 @@
 #include <vlog/inmemory/inmemorytable.h>
+#include <vlog/inmemory/csvloader.h>
+#include <vlog/inmemory/snapshot.h>
 #include <vlog/fcinttable.h>
 #include <vlog/support.h>
 
 #include <kognac/utils.h>
 #include <kognac/filereader.h>
 
-#include <zstr/zstr.hpp>
-
-std::vector<std::string> readRow(istream &ifs) {
-    char buffer[65536];
-    bool insideEscaped = false;
-    char *p = &buffer[0];
-    bool justSeenQuote = false;
-    int quoteCount = 0;     // keep track of number of concecutive quotes.
-    std::vector<std::string> result;
-    while (true) {
-        int c = ifs.get();
-        bool eof = (c == EOF);
-        if (eof) {
-            if (p == buffer && result.size() == 0) {
-                return result;
-            }
-            c = '\n';
-        }
-        if (c == '\r') {
-            // ignore these?
-            continue;
-        }
-        if (p == buffer && ! justSeenQuote) {
-            // Watch out for more than one initial quote ...
-            if (c == '"') {
-                // Initial character is a quote.
-                insideEscaped = true;
-                justSeenQuote = true;
-                continue;
-            }
-        } else if (c == '"') {
-            quoteCount++;
-            insideEscaped = (quoteCount & 1) == 0;
-            if (insideEscaped) {
-                p--;
-            }
-        } else {
-            quoteCount = 0;
-        }
-        if (eof || (! insideEscaped && (c == '\n' || c == ','))) {
-            if (justSeenQuote) {
-                *(p-1) = '\0';
-            } else {
-                *p = '\0';
-            }
-            result.push_back(std::string(buffer));
-            if (c == '\n') {
-                return result;
-            }
-            p = buffer;
-            insideEscaped = false;
-        } else {
-            if (p - buffer >= 65535) {
-                LOG(ERRORL) << "Max field size";
-                throw "Maximum field size exceeded in CSV file: 65535";
-            }
-            *p++ = c;
-        }
-        justSeenQuote = (c == '"');
-    }
-}
+#include <thread>
 
 std::string convertString(const char *s, int len) {
     if (s == NULL || len == 0) {
@@ -81,7 +23,7 @@ std::string convertString(const char *s, int len) {
 }
 
 InmemoryTable::InmemoryTable(std::string repository, std::string tablename,
-        PredId_t predid, EDBLayer *layer) {
+        PredId_t predid, EDBLayer *layer, bool snapshot) {
     this->layer = layer;
     arity = 0;
     this->predid = predid;
@@ -90,43 +32,23 @@ InmemoryTable::InmemoryTable(std::string repository, std::string tablename,
     if (repository == "") {
         repository = ".";
     }
+    if (snapshot) {
+        std::string snapshotfile = repository + "/" + tablename +
+            TableSnapshot::EXTENSION;
+        if (Utils::exists(snapshotfile)) {
+            segment = TableSnapshot::load(snapshotfile, layer, arity,
+                    minValues, maxValues);
+            return;
+        }
+        LOG(WARNL) << "Could not find " << snapshotfile
+            << ". Loading the table from the original file.";
+    }
     std::string tablefile = repository + "/" + tablename + ".csv";
     std::string gz = tablefile + ".gz";
-    istream *ifs = NULL;
     if (Utils::exists(gz)) {
-        ifs = new zstr::ifstream(gz);
+        inserter = CSVLoader::load(gz, layer, arity);
     } else if (Utils::exists(tablefile)) {
-        ifs = new std::ifstream(tablefile, ios_base::in | ios_base::binary);
-    }
-    if (ifs != NULL) {
-        if (ifs->fail()) {
-            LOG(ERRORL) << "Could not open " << tablefile;
-            throw ("Could not open file " + tablefile + " for reading");
-        }
-        LOG(DEBUGL) << "Reading " << tablefile;
-        while (! ifs->eof()) {
-            std::vector<std::string> row = readRow(*ifs);
-            Term_t rowc[256];
-            if (arity == 0) {
-                arity = row.size();
-            }
-            if (row.size() == 0) {
-                break;
-            } else if (row.size() != arity) {
-                LOG(ERRORL) << "Multiple arities";
-                throw ("Multiple arities in file " + tablefile);
-            }
-            if (inserter == NULL) {
-                inserter = new SegmentInserter(arity);
-            }
-            for (int i = 0; i < arity; i++) {
-                uint64_t val;
-                layer->getOrAddDictNumber(row[i].c_str(), row[i].size(), val);
-                rowc[i] = val;
-            }
-            inserter->addRow(rowc);
-        }
-        delete ifs;
+        inserter = CSVLoader::load(tablefile, layer, arity);
     } else {
         tablefile = repository + "/" + tablename + ".nt";
         std::string gz = tablefile + ".gz";
@@ -176,6 +98,7 @@ InmemoryTable::InmemoryTable(std::string repository, std::string tablename,
         segment = inserter->getSortedAndUniqueSegment();
         delete inserter;
     }
+    computeMinMax();
 }
 
 InmemoryTable::InmemoryTable(PredId_t predid,
@@ -212,6 +135,33 @@ InmemoryTable::InmemoryTable(PredId_t predid,
         segment = inserter->getSortedAndUniqueSegment();
         delete inserter;
     }
+    computeMinMax();
+}
+
+InmemoryTable::InmemoryTable(PredId_t predid,
+        std::vector<std::vector<Term_t>> &columns,
+        EDBLayer *layer) {
+    this->arity = columns.size();
+    this->predid = predid;
+    this->layer = layer;
+    if (arity == 0) {
+        segment = NULL;
+        return;
+    }
+    //The columns are added as a whole, without copying them row by row
+    SegmentInserter *inserter = new SegmentInserter(arity);
+    if (!columns[0].empty()) {
+        std::vector<std::shared_ptr<Column>> c;
+        for (auto &column : columns) {
+            c.push_back(std::shared_ptr<Column>(
+                        new InmemoryColumn(column, true)));
+        }
+        inserter->addColumns(c, false, true);
+    }
+    const int nthreads = std::max(1u, std::thread::hardware_concurrency());
+    segment = inserter->getSortedAndUniqueSegment(nthreads);
+    delete inserter;
+    computeMinMax();
 }
 
 InmemoryTable::InmemoryTable(PredId_t predid,
@@ -235,6 +185,34 @@ InmemoryTable::InmemoryTable(PredId_t predid,
         segment = inserter->getSortedAndUniqueSegment();
     }
     delete inserter;
+    computeMinMax();
+}
+
+void InmemoryTable::computeMinMax() {
+    minValues.clear();
+    maxValues.clear();
+    if (segment == NULL || segment->getNRows() == 0) {
+        return;
+    }
+    for (uint8_t i = 0; i < arity; ++i) {
+        auto reader = segment->getColumn(i)->getReader();
+        Term_t min = reader->first();
+        Term_t max = min;
+        while (reader->hasNext()) {
+            Term_t v = reader->next();
+            if (v < min) {
+                min = v;
+            } else if (v > max) {
+                max = v;
+            }
+        }
+        minValues.push_back(min);
+        maxValues.push_back(max);
+    }
+}
+
+void InmemoryTable::storeSnapshot(std::string path) {
+    TableSnapshot::store(path, segment, arity, layer);
 }
 
 struct VSorter {
@@ -579,6 +557,17 @@ EDBIterator *InmemoryTable::getSortedIterator2(const Literal &query,
     _literal2filter(query, posVarsToCopy, posConstantsToFilter,
             valuesConstantsToFilter, repeatedVars);
 
+    //A constant outside the range of its column cannot match
+    if (minValues.size() == arity) {
+        for (int i = 0; i < posConstantsToFilter.size(); i++) {
+            const uint8_t pos = posConstantsToFilter[i];
+            if (valuesConstantsToFilter[i] < minValues[pos] ||
+                    valuesConstantsToFilter[i] > maxValues[pos]) {
+                return new InmemoryIterator(NULL, predid, fields);
+            }
+        }
+    }
+
     /*** If there are no constants, then just returned a sorted version of the
      * table ***/
     if (posConstantsToFilter.empty() && repeatedVars.empty()) {
@@ -0,0 +1,264 @@
+#include <vlog/inmemory/snapshot.h>
+
+#include <kognac/utils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(Term_t) == sizeof(uint64_t),
+        "Snapshots require 64-bit terms");
+
+static const char SNAPSHOT_MAGIC[] = "VLOGSNAP";
+
+const std::string TableSnapshot::EXTENSION = ".snapshot";
+
+static void writeValue(std::ofstream &out, const uint64_t v) {
+    out.write((const char *) &v, sizeof(uint64_t));
+}
+
+void TableSnapshot::store(const std::string &path,
+        std::shared_ptr<const Segment> segment, const uint8_t arity,
+        EDBLayer *layer) {
+    const uint64_t nrows = segment == NULL ? 0 : segment->getNRows();
+    std::vector<uint64_t> header(H_COLUMNS + 3 * arity);
+    memcpy(&header[H_MAGIC], SNAPSHOT_MAGIC, sizeof(uint64_t));
+    header[H_VERSION] = VERSION;
+    header[H_ARITY] = arity;
+    header[H_NROWS] = nrows;
+
+    //The file is written to a temporary file, which then replaces path
+    const std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios_base::out | std::ios_base::binary |
+            std::ios_base::trunc);
+    if (out.fail()) {
+        LOG(ERRORL) << "Could not open " << tmpPath;
+        throw ("Could not open file " + tmpPath + " for writing");
+    }
+    out.write((const char *) &header[0], header.size() * sizeof(uint64_t));
+
+    //Columns
+    std::vector<Term_t> terms;
+    uint64_t offset = header.size() * sizeof(uint64_t);
+    for (uint8_t i = 0; i < arity && nrows > 0; ++i) {
+        std::vector<Term_t> values = segment->getColumn(i)->getReader()->
+            asVector();
+        assert(values.size() == nrows);
+        Term_t min = values[0];
+        Term_t max = values[0];
+        for (auto v : values) {
+            if (v < min) {
+                min = v;
+            }
+            if (v > max) {
+                max = v;
+            }
+        }
+        header[H_COLUMNS + 3 * i] = min;
+        header[H_COLUMNS + 3 * i + 1] = max;
+        header[H_COLUMNS + 3 * i + 2] = offset;
+        out.write((const char *) &values[0], nrows * sizeof(Term_t));
+        offset += nrows * sizeof(Term_t);
+        terms.insert(terms.end(), values.begin(), values.end());
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    }
+
+    //Dictionary, sorted by ID: for each term its ID, length and text
+    header[H_NTERMS] = terms.size();
+    header[H_DICT] = offset;
+    for (auto t : terms) {
+        std::string text = layer->getDictText(t);
+        if (text == "") {
+            uint64_t id;
+            if (! layer->getDictNumber("", 0, id) || id != t) {
+                LOG(ERRORL) << "Term " << t << " is not in the dictionary";
+                throw 10;
+            }
+        }
+        writeValue(out, t);
+        writeValue(out, text.size());
+        out.write(text.c_str(), text.size());
+    }
+
+    out.seekp(0);
+    out.write((const char *) &header[0], header.size() * sizeof(uint64_t));
+    out.close();
+    if (out.fail()) {
+        LOG(ERRORL) << "Could not write " << tmpPath;
+        throw ("Could not write file " + tmpPath);
+    }
+    if (Utils::exists(path)) {
+        Utils::remove(path);
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        LOG(ERRORL) << "Could not rename " << tmpPath << " to " << path;
+        throw ("Could not write file " + path);
+    }
+    LOG(DEBUGL) << "Stored " << nrows << " rows and " << terms.size()
+        << " terms in " << path;
+}
+
+std::shared_ptr<const char> TableSnapshot::readFile(const std::string &path,
+        size_t &size) {
+#if defined(_WIN32)
+    std::ifstream ifs(path, std::ios_base::in | std::ios_base::binary);
+    if (ifs.fail()) {
+        LOG(ERRORL) << "Could not open " << path;
+        throw ("Could not open file " + path + " for reading");
+    }
+    ifs.seekg(0, std::ios_base::end);
+    size = ifs.tellg();
+    ifs.seekg(0, std::ios_base::beg);
+    char *data = new char[std::max(size, (size_t) 1)];
+    ifs.read(data, size);
+    if ((size_t) ifs.gcount() != size) {
+        delete[] data;
+        LOG(ERRORL) << "Could not read " << path;
+        throw ("Could not read file " + path);
+    }
+    return std::shared_ptr<const char>(data, [](const char *p) {
+            delete[] p;
+            });
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        LOG(ERRORL) << "Could not open " << path;
+        throw ("Could not open file " + path + " for reading");
+    }
+    size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        LOG(ERRORL) << "Snapshot " << path << " is empty";
+        throw ("Invalid snapshot " + path);
+    }
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    //The mapping stays valid after the file is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG(ERRORL) << "Could not map " << path;
+        throw ("Could not open file " + path + " for reading");
+    }
+    const size_t len = size;
+    return std::shared_ptr<const char>((const char *) data,
+            [len](const char *p) {
+            munmap((void *) p, len);
+            });
+#endif
+}
+
+std::shared_ptr<const Segment> TableSnapshot::load(const std::string &path,
+        EDBLayer *layer, uint8_t &arity,
+        std::vector<Term_t> &minValues,
+        std::vector<Term_t> &maxValues) {
+    size_t size;
+    std::shared_ptr<const char> data = readFile(path, size);
+    const uint64_t *header = (const uint64_t *) data.get();
+    if (size < H_COLUMNS * sizeof(uint64_t) ||
+            memcmp(&header[H_MAGIC], SNAPSHOT_MAGIC, sizeof(uint64_t)) != 0 ||
+            header[H_VERSION] != VERSION || header[H_ARITY] > 255 ||
+            size < (H_COLUMNS + 3 * header[H_ARITY]) * sizeof(uint64_t) ||
+            header[H_DICT] > size) {
+        LOG(ERRORL) << "File " << path << " is not a valid snapshot";
+        throw ("Invalid snapshot " + path);
+    }
+    arity = (uint8_t) header[H_ARITY];
+    const uint64_t nrows = header[H_NROWS];
+    for (uint8_t i = 0; i < arity && nrows > 0; ++i) {
+        const uint64_t offset = header[H_COLUMNS + 3 * i + 2];
+        if (offset % sizeof(uint64_t) != 0 || offset > size ||
+                (size - offset) / sizeof(Term_t) < nrows) {
+            LOG(ERRORL) << "File " << path << " is not a valid snapshot";
+            throw ("Invalid snapshot " + path);
+        }
+    }
+
+    //Add the terms to the dictionary, and check whether they get the same
+    //IDs as when the snapshot was written
+    const uint64_t nterms = header[H_NTERMS];
+    std::vector<uint64_t> oldIds;
+    std::vector<uint64_t> newIds;
+    oldIds.reserve(nterms);
+    newIds.reserve(nterms);
+    bool sameIds = true;
+    const char *p = data.get() + header[H_DICT];
+    const char *end = data.get() + size;
+    for (uint64_t i = 0; i < nterms; ++i) {
+        uint64_t id, len;
+        if (end - p < 2 * sizeof(uint64_t)) {
+            LOG(ERRORL) << "File " << path << " is not a valid snapshot";
+            throw ("Invalid snapshot " + path);
+        }
+        memcpy(&id, p, sizeof(uint64_t));
+        memcpy(&len, p + sizeof(uint64_t), sizeof(uint64_t));
+        p += 2 * sizeof(uint64_t);
+        if ((uint64_t) (end - p) < len) {
+            LOG(ERRORL) << "File " << path << " is not a valid snapshot";
+            throw ("Invalid snapshot " + path);
+        }
+        uint64_t newId;
+        layer->getOrAddDictNumber(p, len, newId);
+        p += len;
+        sameIds = sameIds && newId == id;
+        oldIds.push_back(id);
+        newIds.push_back(newId);
+    }
+
+    if (nrows == 0 || arity == 0) {
+        return NULL;
+    }
+
+    minValues.resize(arity);
+    maxValues.resize(arity);
+    std::vector<const Term_t *> values(arity);
+    for (uint8_t i = 0; i < arity; ++i) {
+        values[i] = (const Term_t *) (data.get() +
+                header[H_COLUMNS + 3 * i + 2]);
+    }
+
+    if (sameIds) {
+        std::vector<std::shared_ptr<Column>> columns;
+        for (uint8_t i = 0; i < arity; ++i) {
+            minValues[i] = header[H_COLUMNS + 3 * i];
+            maxValues[i] = header[H_COLUMNS + 3 * i + 1];
+            columns.push_back(std::shared_ptr<Column>(new MappedColumn(
+                            data, values[i], nrows)));
+        }
+        LOG(DEBUGL) << "Mapped " << nrows << " rows from " << path;
+        return std::shared_ptr<const Segment>(new Segment(arity, columns));
+    }
+
+    //The IDs have changed. Translate them and sort the rows again.
+    LOG(INFOL) << "The terms in " << path << " have different IDs than when "
+        << "the snapshot was created. Sorting the table again.";
+    for (uint8_t i = 0; i < arity; ++i) {
+        minValues[i] = (Term_t) -1;
+        maxValues[i] = 0;
+    }
+    SegmentInserter inserter(arity);
+    Term_t row[256];
+    for (uint64_t r = 0; r < nrows; ++r) {
+        for (uint8_t i = 0; i < arity; ++i) {
+            auto itr = std::lower_bound(oldIds.begin(), oldIds.end(),
+                    (uint64_t) values[i][r]);
+            if (itr == oldIds.end() || *itr != values[i][r]) {
+                LOG(ERRORL) << "File " << path << " is not a valid snapshot";
+                throw ("Invalid snapshot " + path);
+            }
+            row[i] = newIds[itr - oldIds.begin()];
+            minValues[i] = std::min(minValues[i], row[i]);
+            maxValues[i] = std::max(maxValues[i], row[i]);
+        }
+        inserter.addRow(row);
+    }
+    return inserter.getSortedAndUniqueSegment();
+}
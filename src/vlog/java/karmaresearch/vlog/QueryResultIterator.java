@@ -1,5 +1,7 @@
 package karmaresearch.vlog;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.Iterator;
 import java.util.NoSuchElementException;
 
@@ -85,6 +87,100 @@ public class QueryResultIterator implements Iterator<long[]>, AutoCloseable {
         return retval;
     }
 
+    /**
+     * Returns the number of terms in each result.
+     *
+     * @return the number of terms in a result.
+     */
+    public int getTupleSize() {
+        if (cleaned) {
+            throw new IllegalStateException("Iterator already closed");
+        }
+        return getTupleSize(handle);
+    }
+
+    // Moves the result read by hasNext() to the buffer. Returns the number of
+    // rows moved (0 or 1), or -1 if there are no more results.
+    private int takeSaved(long[] buffer, ByteBuffer byteBuffer, int width) {
+        if (!hasNextCalled) {
+            return 0;
+        }
+        if (!hasNextValue) {
+            return -1;
+        }
+        if (saved == null) {
+            // The row is still in the native iterator
+            hasNextCalled = false;
+            return 0;
+        }
+        if (buffer != null) {
+            if (buffer.length < width) {
+                return 0;
+            }
+            System.arraycopy(saved, 0, buffer, 0, width);
+        } else {
+            if (byteBuffer.remaining() < 8 * width) {
+                return 0;
+            }
+            for (long v : saved) {
+                byteBuffer.putLong(v);
+            }
+        }
+        hasNextCalled = false;
+        saved = null;
+        return 1;
+    }
+
+    /**
+     * Copies the next results in the buffer, one after the other, so that
+     * thousands of results are transferred with a single native call. Result
+     * <code>i</code> starts at position <code>i * getTupleSize()</code>.
+     *
+     * @param buffer
+     *            the buffer to fill
+     * @return the number of results copied, 0 if there are no more results.
+     */
+    public int nextRows(long[] buffer) {
+        if (cleaned) {
+            throw new IllegalStateException("Iterator already closed");
+        }
+        int width = getTupleSize(handle);
+        int n = takeSaved(buffer, null, width);
+        if (n < 0) {
+            return 0;
+        }
+        return n + nextRowsArray(handle, buffer, n * width, filterBlanks);
+    }
+
+    /**
+     * Copies the next results in a direct buffer, one after the other, as
+     * longs in native byte order. The results are written from the position
+     * of the buffer, which is advanced past the last result. The native
+     * code writes directly in the memory of the buffer.
+     *
+     * @param buffer
+     *            a direct buffer with native byte order
+     * @return the number of results copied, 0 if there are no more results.
+     */
+    public int nextRows(ByteBuffer buffer) {
+        if (cleaned) {
+            throw new IllegalStateException("Iterator already closed");
+        }
+        if (!buffer.isDirect() || buffer.order() != ByteOrder.nativeOrder()) {
+            throw new IllegalArgumentException(
+                    "The buffer must be direct and in native byte order");
+        }
+        int width = getTupleSize(handle);
+        int n = takeSaved(null, buffer, width);
+        if (n < 0) {
+            return 0;
+        }
+        int rows = nextRowsBuffer(handle, buffer, buffer.position(),
+                buffer.remaining(), filterBlanks);
+        buffer.position(buffer.position() + rows * width * 8);
+        return n + rows;
+    }
+
     /**
      * Cleans up the underlying VLog iterator, if not done before.
      */
@@ -107,6 +203,14 @@ public class QueryResultIterator implements Iterator<long[]>, AutoCloseable {
 
     private native boolean hasBlanks(long[] v);
 
+    private native int getTupleSize(long handle);
+
+    private native int nextRowsArray(long handle, long[] buffer, int offset,
+            boolean filterBlanks);
+
+    private native int nextRowsBuffer(long handle, ByteBuffer buffer,
+            int offset, int length, boolean filterBlanks);
+
     @Override
     public void close() {
         if (!cleaned) {
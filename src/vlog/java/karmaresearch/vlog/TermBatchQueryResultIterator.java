@@ -0,0 +1,67 @@
+package karmaresearch.vlog;
+
+import java.util.Iterator;
+import java.util.NoSuchElementException;
+
+/**
+ * Encapsulates the result of a batch query, with the results as terms. Every
+ * result is returned without the index of the binding row it answers, which
+ * is available with {@link #getBindingRow()}.
+ */
+public class TermBatchQueryResultIterator
+        implements Iterator<Term[]>, AutoCloseable {
+
+    private final VLog vlog;
+    private final QueryResultIterator iter;
+    private int bindingRow = -1;
+
+    /**
+     * Creates a batch query result enumeration with the results as terms.
+     *
+     * @param vlog
+     *            the VLog JNI interface object.
+     * @param iter
+     *            the underlying vlog result enumeration, whose results start
+     *            with the index of their binding row.
+     */
+    public TermBatchQueryResultIterator(VLog vlog, QueryResultIterator iter) {
+        this.vlog = vlog;
+        this.iter = iter;
+    }
+
+    /**
+     * Returns whether there are more results to the queries.
+     *
+     * @return whether there are more results.
+     */
+    public boolean hasNext() {
+        return iter.hasNext();
+    }
+
+    /**
+     * Returns the terms of the next result.
+     *
+     * @return the next result
+     * @exception NoSuchElementException
+     *                is thrown when no more elements exist.
+     */
+    public Term[] next() {
+        long[] v = iter.next();
+        bindingRow = (int) v[0];
+        return TermQueryResultIterator.toTerms(vlog, v, 1);
+    }
+
+    /**
+     * Returns the index of the binding row answered by the last result
+     * returned by {@link #next()}.
+     *
+     * @return the index of the binding row, or -1 before the first result.
+     */
+    public int getBindingRow() {
+        return bindingRow;
+    }
+
+    public void close() {
+        iter.close();
+    }
+};
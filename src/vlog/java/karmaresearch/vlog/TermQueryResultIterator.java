@@ -44,18 +44,32 @@ public class TermQueryResultIterator
      *                is thrown when no more elements exist.
      */
     public Term[] next() {
-        long[] v = iter.next();
-        Term[] result = new Term[v.length];
-        for (int i = 0; i < v.length; i++) {
+        return toTerms(vlog, iter.next(), 0);
+    }
+
+    /**
+     * Converts the ids of a result, starting from position from, in terms.
+     *
+     * @param vlog
+     *            the VLog JNI interface object.
+     * @param v
+     *            the ids of the result.
+     * @param from
+     *            the first position to convert.
+     * @return the terms.
+     */
+    static Term[] toTerms(VLog vlog, long[] v, int from) {
+        Term[] result = new Term[v.length - from];
+        for (int i = from; i < v.length; i++) {
             try {
                 long val = v[i];
                 String s = vlog.getConstant(val);
                 if (s == null) {
-                    result[i] = new Term(TermType.BLANK, "" + (val >> 40) + "_"
+                    result[i - from] = new Term(TermType.BLANK, "" + (val >> 40) + "_"
                             + ((val >> 32) & 0377) + "_" + (val & 0xffffffffL));
 
                 } else {
-                    result[i] = new Term(TermType.CONSTANT, s);
+                    result[i - from] = new Term(TermType.CONSTANT, s);
                 }
             } catch (NotStartedException e) {
                 // Should not happen, we just did a query ...
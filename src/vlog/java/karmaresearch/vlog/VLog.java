@@ -4,6 +4,7 @@ import java.io.BufferedInputStream;
 import java.io.File;
 import java.io.IOException;
 import java.io.InputStream;
+import java.nio.ByteBuffer;
 import java.nio.file.Files;
 import java.nio.file.StandardCopyOption;
 import java.util.ArrayList;
@@ -191,6 +192,59 @@ public class VLog {
     public native void addData(String predicate, String[][] contents)
             throws EDBConfigurationException;
 
+    private native void addDataColumns(String predicate, long[][] columns)
+            throws EDBConfigurationException;
+
+    private native void addDataBuffer(String predicate, int arity,
+            ByteBuffer terms, int[] offsets) throws EDBConfigurationException;
+
+    /**
+     * Adds the data for the specified predicate to the database, given as
+     * columns of term identifiers, as returned by {@link #getConstantId} or by
+     * queries. The columns are copied once, directly in the table. If VLog is
+     * not started yet, it will be started with an empty configuration.
+     *
+     * @param predicate
+     *            the predicate
+     * @param columns
+     *            the columns of the data, all of the same length
+     * @exception EDBConfigurationException
+     *                is thrown when the columns don't all have the same
+     *                length.
+     */
+    public void addData(String predicate, long[][] columns)
+            throws EDBConfigurationException {
+        addDataColumns(predicate, columns);
+    }
+
+    /**
+     * Adds the data for the specified predicate to the database, given as
+     * UTF-8 encoded terms in a direct buffer. The terms are stored one row
+     * after the other: term <code>i</code> occupies the bytes from
+     * <code>offsets[i]</code> to <code>offsets[i + 1]</code>, so there is one
+     * more offset than terms. The terms are read directly from the buffer and
+     * are encoded in parallel. If VLog is not started yet, it will be started
+     * with an empty configuration.
+     *
+     * @param predicate
+     *            the predicate
+     * @param arity
+     *            the arity of the predicate
+     * @param terms
+     *            a direct buffer with the terms
+     * @param offsets
+     *            the offsets of the terms in the buffer
+     * @exception EDBConfigurationException
+     *                is thrown when the data could not be added.
+     */
+    public void addData(String predicate, int arity, ByteBuffer terms,
+            int[] offsets) throws EDBConfigurationException {
+        if (!terms.isDirect()) {
+            throw new IllegalArgumentException("The buffer must be direct");
+        }
+        addDataBuffer(predicate, arity, terms, offsets);
+    }
+
     /**
      * Stops and de-allocates the reasoner. If vlog is not started yet, this
      * call does nothing, so it does no harm to call it more than once.
@@ -373,6 +427,78 @@ public class VLog {
                 query(intPred, longTerms, includeConstants, filterBlanks));
     }
 
+    /**
+     * Answers at once a batch of queries that differ only in the values of
+     * some of their variables. If the database is not materialized, queries
+     * on derived predicates are evaluated with a single magic-set
+     * materialization that is seeded with all the bindings. Every result
+     * starts with the index of the binding row it answers, followed by all the
+     * terms of the query. The results are sorted by binding row.
+     *
+     * @param predicateId
+     *            the predicate id of the query.
+     * @param terms
+     *            the constant values or variables. If the term is negative, it
+     *            is assumed to be a variable.
+     * @param positions
+     *            the positions of the variables in terms that are bound.
+     * @param bindings
+     *            the binding rows, one after the other. Every row has a value
+     *            for each of the positions.
+     * @param filterBlanks
+     *            whether results with blanks in them should be filtered out
+     * @return the result iterator.
+     * @exception NotStartedException
+     *                is thrown when vlog is not started yet.
+     * @exception NonExistingPredicateException
+     *                is thrown when the query predicate does not exist.
+     */
+    public native QueryResultIterator batchQuery(int predicateId, long[] terms,
+            int[] positions, long[] bindings, boolean filterBlanks)
+            throws NotStartedException, NonExistingPredicateException;
+
+    /**
+     * Answers at once a batch of queries that differ only in the values of
+     * some of their variables. See
+     * {@link #batchQuery(int, long[], int[], long[], boolean)}. The results
+     * are returned as terms, and the index of the binding row they answer is
+     * available with {@link TermBatchQueryResultIterator#getBindingRow()}.
+     *
+     * @param query
+     *            the query, as an atom.
+     * @param positions
+     *            the positions of the variables of the query that are bound.
+     * @param bindings
+     *            the binding rows. Every row has a constant for each of the
+     *            positions.
+     * @param filterBlanks
+     *            whether results with blanks in them should be filtered out
+     * @return the result iterator.
+     * @exception NotStartedException
+     *                is thrown when vlog is not started yet.
+     * @exception NonExistingPredicateException
+     *                is thrown when the query predicate does not exist.
+     */
+    public TermBatchQueryResultIterator batchQuery(Atom query, int[] positions,
+            String[][] bindings, boolean filterBlanks)
+            throws NotStartedException, NonExistingPredicateException {
+        query.checkNoBlank();
+        int intPred = getPredicateId(query.getPredicate());
+        long[] longTerms = extractTerms(query.getTerms());
+        long[] longBindings = new long[bindings.length * positions.length];
+        for (int i = 0; i < bindings.length; i++) {
+            if (bindings[i].length != positions.length) {
+                throw new IllegalArgumentException(
+                        "Binding row " + i + " does not have " + positions.length + " values");
+            }
+            for (int j = 0; j < positions.length; j++) {
+                longBindings[i * positions.length + j] = getOrAddConstantId(bindings[i][j]);
+            }
+        }
+        return new TermBatchQueryResultIterator(this,
+                batchQuery(intPred, longTerms, positions, longBindings, filterBlanks));
+    }
+
     /**
      * Queries the current, so possibly materialized, database, and returns the 
      * number of observations associated to predicate.
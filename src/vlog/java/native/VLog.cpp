@@ -5,6 +5,7 @@
 #include <vlog/seminaiver.h>
 #include <vlog/cycles/checker.h>
 #include <vlog/reasoner.h>
+#include <vlog/fctupleitr.h>
 #include <vlog/utils.h>
 #include <kognac/utils.h>
 #include <kognac/logs.h>
@@ -13,22 +14,31 @@
 #include <fstream>
 #include <cstring>
 #include <cstdint>
+#include <vector>
 
 #define IS_BLANK(c) (c >= (INT64_C(1) << 40))
 
+//Rows that are read at once to count the answers of a query
+#define COUNT_CHUNK_ROWS 65536
+
 class VLogInfo {
 	public:
 		SemiNaiver *sn;
 		Program *program;
 		EDBLayer *layer;
+		// Kept across the calls, so that batch queries reuse the magic-set
+		// sessions of the previous ones while rules and data do not change.
+		Reasoner reasoner;
 
-		VLogInfo() {
+		VLogInfo() : reasoner((uint64_t) 0) {
 			sn = NULL;
 			program = NULL;
 			layer = NULL;
 		}
 
 		~VLogInfo() {
+			// The sessions refer to the layer
+			reasoner.clearMagicSessions();
 			if (layer != NULL) {
 				delete layer;
 				layer = NULL;
@@ -321,12 +331,9 @@ extern "C" {
 		vlogMap.erase(inf);
 	}
 
-	/*
-	 * Class:     karmaresearch_vlog_VLog
-	 * Method:    addData
-	 * Signature: (Ljava/lang/String;[[Ljava/lang/String;)V
-	 */
-	JNIEXPORT void JNICALL Java_karmaresearch_vlog_VLog_addData(JNIEnv *env, jobject obj, jstring jpred, jobjectArray data) {
+	//Prepares the VLog instance (starting it if needed) for adding data.
+	//Returns NULL if data cannot be added.
+	static VLogInfo *getVLogInfoForData(JNIEnv *env, jobject obj) {
 		jint id = getVLogId(env, obj);
 		VLogInfo *f = getVLogInfo(id);
 		if (f == NULL) {
@@ -343,16 +350,29 @@ extern "C" {
 			f->layer = new EDBLayer(conf, false);
 		}
 
-		std::string pred = jstring2string(env, jpred);
-
 		if (f->program != NULL) {
 			if (f->program->getNRules() > 0) {
 				throwEDBConfigurationException(env, "Cannot add data if there already are rules");
-				return;
+				return NULL;
 			}
 			delete f->program;
 			f->program = NULL;
 		}
+		return f;
+	}
+
+	/*
+	 * Class:     karmaresearch_vlog_VLog
+	 * Method:    addData
+	 * Signature: (Ljava/lang/String;[[Ljava/lang/String;)V
+	 */
+	JNIEXPORT void JNICALL Java_karmaresearch_vlog_VLog_addData(JNIEnv *env, jobject obj, jstring jpred, jobjectArray data) {
+		VLogInfo *f = getVLogInfoForData(env, obj);
+		if (f == NULL) {
+			return;
+		}
+
+		std::string pred = jstring2string(env, jpred);
 
 		if (data == NULL) {
 			throwEDBConfigurationException(env, "null data");
@@ -399,6 +419,112 @@ extern "C" {
 		f->program = new Program(f->layer);
 	}
 
+	/*
+	 * Class:     karmaresearch_vlog_VLog
+	 * Method:    addDataColumns
+	 * Signature: (Ljava/lang/String;[[J)V
+	 */
+	JNIEXPORT void JNICALL Java_karmaresearch_vlog_VLog_addDataColumns(JNIEnv *env, jobject obj, jstring jpred, jobjectArray data) {
+		VLogInfo *f = getVLogInfoForData(env, obj);
+		if (f == NULL) {
+			return;
+		}
+
+		std::string pred = jstring2string(env, jpred);
+
+		if (data == NULL) {
+			throwEDBConfigurationException(env, "null data");
+			return;
+		}
+		jsize arity = env->GetArrayLength(data);
+		if (arity != (uint8_t) arity) {
+			throwIllegalArgumentException(env, ("Arity of " + pred + " too large (" + std::to_string(arity) + " > 255)").c_str());
+			return;
+		}
+		// Copy the columns directly in the vectors that become the table.
+		std::vector<std::vector<Term_t>> columns(arity);
+		for (int j = 0; j < arity; j++) {
+			jlongArray column = (jlongArray) env->GetObjectArrayElement(data, (jsize) j);
+			if (column == NULL) {
+				throwEDBConfigurationException(env, "null data");
+				return;
+			}
+			columns[j].resize(env->GetArrayLength(column));
+			env->GetLongArrayRegion(column, 0, (jsize) columns[j].size(), (jlong *) columns[j].data());
+			env->DeleteLocalRef(column);
+		}
+
+		try {
+			f->layer->addInmemoryTable(pred, columns);
+		} catch(std::string s) {
+			throwEDBConfigurationException(env, s.c_str());
+			return;
+		} catch(char const *s) {
+			throwEDBConfigurationException(env, s);
+			return;
+		}
+
+		f->program = new Program(f->layer);
+	}
+
+	/*
+	 * Class:     karmaresearch_vlog_VLog
+	 * Method:    addDataBuffer
+	 * Signature: (Ljava/lang/String;ILjava/nio/ByteBuffer;[I)V
+	 */
+	JNIEXPORT void JNICALL Java_karmaresearch_vlog_VLog_addDataBuffer(JNIEnv *env, jobject obj, jstring jpred, jint arity, jobject buffer, jintArray joffsets) {
+		VLogInfo *f = getVLogInfoForData(env, obj);
+		if (f == NULL) {
+			return;
+		}
+
+		std::string pred = jstring2string(env, jpred);
+
+		if (buffer == NULL || joffsets == NULL) {
+			throwEDBConfigurationException(env, "null data");
+			return;
+		}
+		if (arity <= 0 || arity != (uint8_t) arity) {
+			throwIllegalArgumentException(env, ("Invalid arity for " + pred + " (" + std::to_string(arity) + ")").c_str());
+			return;
+		}
+		const char *text = (const char *) env->GetDirectBufferAddress(buffer);
+		if (text == NULL) {
+			throwIllegalArgumentException(env, "The buffer is not a direct buffer");
+			return;
+		}
+		const jlong capacity = env->GetDirectBufferCapacity(buffer);
+		const jsize noffsets = env->GetArrayLength(joffsets);
+		if (noffsets == 0 || (noffsets - 1) % arity != 0) {
+			throwIllegalArgumentException(env, "The number of offsets is not a multiple of the arity plus one");
+			return;
+		}
+		// The terms are read directly from the buffer.
+		jint *offsets = env->GetIntArrayElements(joffsets, NULL);
+		for (jsize i = 0; i < noffsets; i++) {
+			if (offsets[i] < 0 || offsets[i] > capacity || (i > 0 && offsets[i] < offsets[i - 1])) {
+				env->ReleaseIntArrayElements(joffsets, offsets, JNI_ABORT);
+				throwIllegalArgumentException(env, "The offsets are not increasing or exceed the buffer");
+				return;
+			}
+		}
+
+		try {
+			f->layer->addInmemoryTable(pred, (uint8_t) arity, text, (const int32_t *) offsets, (noffsets - 1) / arity);
+		} catch(std::string s) {
+			env->ReleaseIntArrayElements(joffsets, offsets, JNI_ABORT);
+			throwEDBConfigurationException(env, s.c_str());
+			return;
+		} catch(char const *s) {
+			env->ReleaseIntArrayElements(joffsets, offsets, JNI_ABORT);
+			throwEDBConfigurationException(env, s);
+			return;
+		}
+		env->ReleaseIntArrayElements(joffsets, offsets, JNI_ABORT);
+
+		f->program = new Program(f->layer);
+	}
+
 
 	/*
 	 * Class:     karmaresearch_vlog_VLog
@@ -535,18 +661,8 @@ extern "C" {
 		return env->NewStringUTF(s.c_str());
 	}
 
-	static TupleIterator *getQueryIter(JNIEnv *env, jobject obj, PredId_t p, jlongArray els, jboolean includeConstants) {
-		VLogInfo *f = getVLogInfo(env, obj);
-		if (f == NULL || f->program == NULL) {
-			throwNotStartedException(env, "VLog is not started yet");
-			return NULL;
-		}
-
-		// Create a VLog query from the parameters.
-		Predicate pred = f->program->getPredicate((PredId_t) p);
-		if (pred.getCardinality() == 0) {
-			return NULL;
-		}
+	// Converts the terms of a query: negative values are variables.
+	static VTuple getQueryTuple(JNIEnv *env, jlongArray els) {
 		jsize sz = env->GetArrayLength(els);
 		VTuple tuple((uint8_t) sz);
 		jlong *e = env->GetLongArrayElements(els, NULL);
@@ -563,7 +679,23 @@ extern "C" {
 			tuple.set(vterm, i);
 		}
 		env->ReleaseLongArrayElements(els, e, JNI_ABORT);
-		Literal query(pred, tuple);
+		return tuple;
+	}
+
+	static TupleIterator *getQueryIter(JNIEnv *env, jobject obj, PredId_t p, jlongArray els, jboolean includeConstants) {
+		VLogInfo *f = getVLogInfo(env, obj);
+		if (f == NULL || f->program == NULL) {
+			throwNotStartedException(env, "VLog is not started yet");
+			return NULL;
+		}
+
+		// Create a VLog query from the parameters.
+		Predicate pred = f->program->getPredicate((PredId_t) p);
+		if (pred.getCardinality() == 0) {
+			return NULL;
+		}
+		jsize sz = env->GetArrayLength(els);
+		Literal query(pred, getQueryTuple(env, els));
 
 		// Now create an iterator over the query result.
 		TupleIterator *iter = NULL;
@@ -597,6 +729,61 @@ extern "C" {
         return vars.size();
     }
 
+	//Removes the rows with blanks from the first n rows of out and returns
+	//the number of rows that are left
+	static size_t removeBlankRows(uint64_t *out, const size_t n, const size_t sz) {
+		size_t kept = 0;
+		for (size_t i = 0; i < n; i++) {
+			const uint64_t *row = out + i * sz;
+			bool blank = false;
+			for (size_t j = 0; j < sz; j++) {
+				if (IS_BLANK(row[j])) {
+					blank = true;
+					break;
+				}
+			}
+			if (!blank) {
+				if (kept != i) {
+					memmove(out + kept * sz, row, sz * sizeof(uint64_t));
+				}
+				kept++;
+			}
+		}
+		return kept;
+	}
+
+	//Copies up to maxRows answers in out, one row after the other. The
+	//answers of a materialization are copied directly from the columns.
+	static size_t fillRows(TupleIterator *iter, uint64_t *out, const size_t maxRows, const bool filterBlanks) {
+		const size_t sz = iter->getTupleSize();
+		FCTupleItr *fcIter = dynamic_cast<FCTupleItr*>(iter);
+		size_t n = 0;
+		if (fcIter != NULL) {
+			while (n < maxRows) {
+				size_t rows = fcIter->nextRows(out + n * sz, maxRows - n);
+				if (rows == 0) {
+					break;
+				}
+				if (filterBlanks) {
+					rows = removeBlankRows(out + n * sz, rows, sz);
+				}
+				n += rows;
+			}
+			return n;
+		}
+		while (n < maxRows && iter->hasNext()) {
+			iter->next();
+			uint64_t *row = out + n * sz;
+			for (size_t i = 0; i < sz; i++) {
+				row[i] = iter->getElementAt(i);
+			}
+			if (!filterBlanks || removeBlankRows(row, 1, sz) == 1) {
+				n++;
+			}
+		}
+		return n;
+	}
+
 	/*
 	 * Class:     karmaresearch_vlog_VLog
 	 * Method:    query
@@ -619,6 +806,79 @@ extern "C" {
 		return jobj;
 	}
 
+	/*
+	 * Class:     karmaresearch_vlog_VLog
+	 * Method:    batchQuery
+	 * Signature: (I[J[I[JZ)Lkarmaresearch/vlog/QueryResultIterator;
+	 */
+	JNIEXPORT jobject JNICALL Java_karmaresearch_vlog_VLog_batchQuery(JNIEnv * env, jobject obj, jint p, jlongArray els, jintArray jpositions, jlongArray jbindings, jboolean filterBlanks) {
+		VLogInfo *f = getVLogInfo(env, obj);
+		if (f == NULL || f->program == NULL) {
+			throwNotStartedException(env, "VLog is not started yet");
+			return NULL;
+		}
+		if (p == -1) {
+			throwNonExistingPredicateException(env, "Query contains non-existing predicate");
+			return NULL;
+		}
+		Predicate pred = f->program->getPredicate((PredId_t) p);
+		VTuple tuple = getQueryTuple(env, els);
+		if (pred.getCardinality() == 0 || pred.getCardinality() != tuple.getSize()) {
+			throwIllegalArgumentException(env, "The query does not match the arity of the predicate");
+			return NULL;
+		}
+
+		// The positions are positions in the query; the reasoner wants
+		// positions among the variables.
+		std::vector<uint8_t> posJoins;
+		jsize npositions = env->GetArrayLength(jpositions);
+		jint *positions = env->GetIntArrayElements(jpositions, NULL);
+		for (int i = 0; i < npositions; i++) {
+			jint pos = positions[i];
+			if (pos < 0 || pos >= tuple.getSize() || ! tuple.get(pos).isVariable()) {
+				env->ReleaseIntArrayElements(jpositions, positions, JNI_ABORT);
+				throwIllegalArgumentException(env, "Bound positions must be variables of the query");
+				return NULL;
+			}
+			uint8_t posJoin = 0;
+			for (int j = 0; j < pos; j++) {
+				if (tuple.get(j).isVariable()) {
+					posJoin++;
+				}
+			}
+			posJoins.push_back(posJoin);
+		}
+		env->ReleaseIntArrayElements(jpositions, positions, JNI_ABORT);
+
+		jsize nvalues = env->GetArrayLength(jbindings);
+		if (npositions == 0 || nvalues % npositions != 0) {
+			throwIllegalArgumentException(env, "The number of bindings is not a multiple of the number of bound positions");
+			return NULL;
+		}
+		std::vector<Term_t> bindings(nvalues);
+		jlong *values = env->GetLongArrayElements(jbindings, NULL);
+		for (int i = 0; i < nvalues; i++) {
+			bindings[i] = (Term_t) values[i];
+		}
+		env->ReleaseLongArrayElements(jbindings, values, JNI_ABORT);
+
+		// Without a materialization, IDB queries are answered with a
+		// magic-set materialization seeded with all the bindings.
+		Literal query(pred, tuple);
+		TupleIterator *iter = NULL;
+		try {
+			iter = f->reasoner.getBatchIterator(query, posJoins, bindings, *(f->layer), *(f->program), f->sn);
+		} catch (int e) {
+			throwIllegalArgumentException(env, "Batch query failed");
+			return NULL;
+		}
+		jclass jcls=env->FindClass("karmaresearch/vlog/QueryResultIterator");
+		jmethodID mID = env->GetMethodID(jcls, "<init>", "(JZ)V");
+		jobject jobj = env->NewObject(jcls, mID, (jlong) iter, filterBlanks);
+
+		return jobj;
+	}
+
 /*
 * Class:     karmaresearch_vlog_VLog
 * Method:    nativeQuerySize
@@ -647,32 +907,32 @@ JNIEXPORT jlong JNICALL Java_karmaresearch_vlog_VLog_nativeQuerySize(JNIEnv * en
             throwNotStartedException(env, "Materialization has not run yet");
             return result;
         }
-    } else {
-        TupleIterator *iter = getQueryIter(env, obj, (PredId_t) p, els, (jboolean) includeConstants);
-        if (iter == NULL) {
-            return result;
-        }
-        size_t sz = iter->getTupleSize();
-        while (iter->hasNext()) {
-            iter->next();
-            if (filterBlanks) {
-                bool filterOut = false;
-                for (int i = 0; i < sz; i++) {
-                    if (IS_BLANK(iter->getElementAt(i))) {
-                        filterOut = true;
-                        break;
-                    }
-                }
-                if (!filterOut) {
-                    ++result;
-                }
-            }
-            else {
-                ++result;
-            }
+    } else if (pred.getType() == EDB && !filterBlanks) {
+        //The EDB layer counts the answers without iterating over them
+        Literal query(pred, getQueryTuple(env, els));
+        if (!query.hasRepeatedVars()) {
+            return f->layer->getCardinality(query);
         }
+    }
+
+    TupleIterator *iter = getQueryIter(env, obj, (PredId_t) p, els, (jboolean) includeConstants);
+    if (iter == NULL) {
         return result;
     }
+    FCTupleItr *fcIter = dynamic_cast<FCTupleItr*>(iter);
+    if (fcIter != NULL && !filterBlanks) {
+        //Uses the sizes of the tables that do not need to be filtered
+        result = fcIter->count();
+    } else {
+        std::vector<uint64_t> rows(COUNT_CHUNK_ROWS *
+                std::max((size_t) 1, iter->getTupleSize()));
+        size_t n;
+        while ((n = fillRows(iter, rows.data(), COUNT_CHUNK_ROWS, (bool) filterBlanks)) > 0) {
+            result += n;
+        }
+    }
+    delete iter;
+    return result;
 }
 
 
@@ -945,6 +1205,86 @@ JNIEXPORT jlong JNICALL Java_karmaresearch_vlog_VLog_nativeQuerySize(JNIEnv * en
 		return outJNIArray;
 	}
 
+	/*
+	 * Class:     karmaresearch_vlog_QueryResultIterator
+	 * Method:    getTupleSize
+	 * Signature: (J)I
+	 */
+	JNIEXPORT jint JNICALL Java_karmaresearch_vlog_QueryResultIterator_getTupleSize(JNIEnv *env, jobject obj, jlong ref) {
+		TupleIterator *iter = (TupleIterator *) ref;
+		if (iter == NULL) {
+			return 0;
+		}
+		return (jint) iter->getTupleSize();
+	}
+
+	/*
+	 * Class:     karmaresearch_vlog_QueryResultIterator
+	 * Method:    nextRowsArray
+	 * Signature: (J[JIZ)I
+	 */
+	JNIEXPORT jint JNICALL Java_karmaresearch_vlog_QueryResultIterator_nextRowsArray(JNIEnv *env, jobject obj, jlong ref, jlongArray buffer, jint offset, jboolean filterBlanks) {
+		TupleIterator *iter = (TupleIterator *) ref;
+		if (iter == NULL) {
+			return 0;
+		}
+		const size_t sz = std::max((size_t) 1, iter->getTupleSize());
+		const size_t maxRows = (env->GetArrayLength(buffer) - offset) / sz;
+		if (maxRows == 0) {
+			return 0;
+		}
+		//The rows are collected in a native buffer, one chunk at a time, and
+		//then copied in the Java array. Filling the array directly would
+		//need a critical section, which can block the garbage collector
+		//for as long as the rows are computed.
+		const size_t width = iter->getTupleSize();
+		const size_t chunkRows = std::min(maxRows, (size_t) COUNT_CHUNK_ROWS);
+		std::vector<uint64_t> rows(chunkRows * sz);
+		size_t n = 0;
+		while (n < maxRows) {
+			const size_t toRead = std::min(maxRows - n, chunkRows);
+			const size_t read = fillRows(iter, rows.data(), toRead, (bool) filterBlanks);
+			env->SetLongArrayRegion(buffer, offset + n * width, read * width, (const jlong *) rows.data());
+			n += read;
+			if (read < toRead) {
+				break;
+			}
+		}
+		return (jint) n;
+	}
+
+	/*
+	 * Class:     karmaresearch_vlog_QueryResultIterator
+	 * Method:    nextRowsBuffer
+	 * Signature: (JLjava/nio/ByteBuffer;IIZ)I
+	 */
+	JNIEXPORT jint JNICALL Java_karmaresearch_vlog_QueryResultIterator_nextRowsBuffer(JNIEnv *env, jobject obj, jlong ref, jobject buffer, jint offset, jint length, jboolean filterBlanks) {
+		TupleIterator *iter = (TupleIterator *) ref;
+		if (iter == NULL) {
+			return 0;
+		}
+		char *address = (char *) env->GetDirectBufferAddress(buffer);
+		if (address == NULL) {
+			throwIllegalArgumentException(env, "The buffer is not a direct buffer");
+			return 0;
+		}
+		address += offset;
+		const size_t sz = std::max((size_t) 1, iter->getTupleSize());
+		const size_t maxRows = length / sizeof(uint64_t) / sz;
+		if (maxRows == 0) {
+			return 0;
+		}
+		size_t n;
+		if (((uintptr_t) address) % sizeof(uint64_t) == 0) {
+			n = fillRows(iter, (uint64_t *) address, maxRows, (bool) filterBlanks);
+		} else {
+			std::vector<uint64_t> rows(maxRows * sz);
+			n = fillRows(iter, rows.data(), maxRows, (bool) filterBlanks);
+			memcpy(address, rows.data(), n * iter->getTupleSize() * sizeof(uint64_t));
+		}
+		return (jint) n;
+	}
+
 	/*
 	 * Class:     karmaresearch_vlog_QueryResultIterator
 	 * Method:    cleanup
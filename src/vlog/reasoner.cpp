@@ -7,92 +7,48 @@
 #include <vlog/edb.h>
 #include <vlog/qsqquery.h>
 #include <vlog/qsqr.h>
+#include <vlog/bindingstable.h>
+#include <vlog/fctupleitr.h>
 
 #include <trident/kb/consts.h>
 #include <trident/model/table.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
-long cmpRow(std::vector<uint8_t> *posJoins, const Term_t *row1, const uint64_t *row2) {
-    for (int i = 0; i < posJoins->size(); ++i) {
-        long r = (row1[i] - row2[(*posJoins)[i]]);
-        // LOG(DEBUGL) << "cmpRow: i = " << i << ", row1[i] = " << row1[i]
-        //     << ", row2[(*posJoins)[i]] = " << row2[(*posJoins)[i]] << ", r = " << r;
-        if (r != 0) {
-            return r;
-        }
-    }
-    return 0;
-}
-
+//Removes from possibleValuesJoins the bindings that are already in input.
+//The rows of input are kept in a hash set, so the two do not need to be
+//sorted.
 void Reasoner::cleanBindings(std::vector<Term_t> &possibleValuesJoins, std::vector<uint8_t> * posJoins, TupleTable *input) {
     if (input != NULL) {
         const size_t sizeBindings = posJoins->size();
         if (possibleValuesJoins.size() / sizeBindings == input->getNRows()) {
             possibleValuesJoins.clear();
         } else {
-            /*
-               uint8_t posJoinsCopy[sizeBindings];
-               for (int j = sizeBindings - 1; j >= 0; j--) {
-               posJoinsCopy[j] = posJoins->at(j);
-               }
-               */
+            std::unordered_set<std::vector<Term_t>, hash_Terms> existing;
+            std::vector<Term_t> key(sizeBindings);
+            for (size_t i = 0; i < input->getNRows(); ++i) {
+                const uint64_t *row = input->getRow(i);
+                for (size_t j = 0; j < sizeBindings; ++j) {
+                    key[j] = row[(*posJoins)[j]];
+                }
+                existing.insert(key);
+            }
 
             std::vector<Term_t> outputBindings;
-
-            //I assume input and bindings are already sorted
-            size_t idxInput = 0;
-            const uint64_t *currentRowInput = input->getRow(idxInput);
-            size_t idxBindings = 0;
-            const Term_t *currentRowBindings = &possibleValuesJoins[0];
-            while (idxInput < input->getNRows() && idxBindings < possibleValuesJoins.size()) {
-                //Compare the two rows
-                const long cmpResult = cmpRow(posJoins, currentRowBindings, currentRowInput);
-                if (cmpResult < 0) {
-                    for (int j = 0; j < sizeBindings; ++j)
-                        outputBindings.push_back(currentRowBindings[j]);
-                    idxBindings += sizeBindings;
-                    if (idxBindings < possibleValuesJoins.size())
-                        currentRowBindings = &possibleValuesJoins[idxBindings];
-                } else if (cmpResult >= 0) {
-                    idxInput++;
-                    if (idxInput < input->getNRows())
-                        currentRowInput = input->getRow(idxInput);
+            for (size_t i = 0; i + sizeBindings <= possibleValuesJoins.size();
+                    i += sizeBindings) {
+                for (size_t j = 0; j < sizeBindings; ++j) {
+                    key[j] = possibleValuesJoins[i + j];
                 }
-                if (cmpResult == 0) {
-                    idxBindings += sizeBindings;
-                    if (idxBindings < possibleValuesJoins.size())
-                        currentRowBindings = &possibleValuesJoins[idxBindings];
+                if (!existing.count(key)) {
+                    outputBindings.insert(outputBindings.end(), key.begin(),
+                            key.end());
                 }
             }
-
-            //Write all elements that are left
-            while (idxBindings < possibleValuesJoins.size()) {
-                outputBindings.push_back(possibleValuesJoins[idxBindings++]);
-            }
-
-
-            /*
-               for (int i = input->getNRows() - 1; i >= 0; i--) {
-               const Term_t *rowToRemove = input->getRow(i);
-            //Go through the bindings
-            for (std::vector<Term_t>::reverse_iterator itr = possibleValuesJoins.rbegin();
-            itr != possibleValuesJoins.rend();) {
-            bool same = true;
-            for (int j = sizeBindings - 1; j >= 0; j--) {
-            if (same && rowToRemove[posJoinsCopy[j]] != *itr) {
-            same = false;
-            }
-            itr++;
-            }
-            //Remove the row
-            if (same) {
-            possibleValuesJoins.erase(itr.base(), itr.base() + sizeBindings);
-            break;
-            }
-            }
-            }*/
             possibleValuesJoins.swap(outputBindings);
         }
     }
@@ -515,6 +471,135 @@ TupleIterator *Reasoner::getIncrReasoningIterator(Literal &query,
     }
 }
 
+Reasoner::MagicSessionKey Reasoner::getMagicSessionKey(Literal &query,
+        EDBLayer &edb, Program &program) {
+    return MagicSessionKey(program.getGeneration(), edb.getGeneration(),
+            query.getPredicate().getId(), query.getPredicate().getAdorment());
+}
+
+std::shared_ptr<MagicSession> Reasoner::getMagicSession(Literal &query,
+        EDBLayer &edb, Program &program, bool &created) {
+    const MagicSessionKey key = getMagicSessionKey(query, edb, program);
+    auto itr = magicSessions.find(key);
+    if (itr != magicSessions.end()) {
+        LOG(DEBUGL) << "Reusing the magic program of a previous query";
+        created = false;
+        return itr->second;
+    }
+    //Drop the sessions of other generations: their rules or tables changed
+    //(or were destroyed), so they cannot be reused
+    for (auto s = magicSessions.begin(); s != magicSessions.end();) {
+        if (std::get<0>(s->first) != std::get<0>(key) ||
+                std::get<1>(s->first) != std::get<1>(key)) {
+            s = magicSessions.erase(s);
+        } else {
+            ++s;
+        }
+    }
+
+    //Get all adorned rules
+    std::shared_ptr<MagicSession> session(new MagicSession());
+    std::unique_ptr<Wizard> wizard = std::unique_ptr<Wizard>(new Wizard());
+    session->adornedProgram = wizard->getAdornedProgram(query, program);
+    //Print all rules
+#if DEBUG
+    LOG(DEBUGL) << "Adorned program:";
+    std::vector<Rule> newRules = session->adornedProgram->getAllRules();
+    for (std::vector<Rule>::iterator itr = newRules.begin(); itr != newRules.end(); ++itr) {
+        LOG(DEBUGL) << itr->tostring(session->adornedProgram.get(), &edb);
+    }
+#endif
+
+    //Rewrite and add the rules
+    session->magicProgram = wizard->doMagic(query, session->adornedProgram,
+            session->inputOutputRelIDs);
+
+#if DEBUG
+    LOG(DEBUGL) << "Magic program:";
+    newRules = session->magicProgram->getAllRules();
+    for (std::vector<Rule>::iterator itr = newRules.begin(); itr != newRules.end(); ++itr) {
+        LOG(DEBUGL) << itr->tostring(session->magicProgram.get(), &edb);
+    }
+#endif
+
+    session->naiver = std::unique_ptr<SemiNaiver>(new SemiNaiver(
+                edb, session->magicProgram.get(), true, true, false, -1, false,
+                false));
+
+    //The materialization cannot be resumed with negation, so the session is
+    //not kept
+    session->resumable = true;
+    for (const auto &rule : session->magicProgram->getAllRules()) {
+        for (const auto &literal : rule.getBody()) {
+            session->resumable &= !literal.isNegated();
+        }
+    }
+    created = true;
+    return session;
+}
+
+//Returns the rows of the input block that are not yet in the magic relation,
+//or NULL if there are none
+static std::shared_ptr<const FCInternalTable> getNewMagicFacts(
+        SemiNaiver *naiver, const Literal &magicLiteral, const FCBlock &input) {
+    const uint8_t card = magicLiteral.getTupleSize();
+    FCIterator known = naiver->getTable(magicLiteral, 0, (size_t) - 1);
+    if (card == 0) {
+        return known.isEmpty() ? input.table : NULL;
+    }
+
+    std::unordered_set<std::vector<Term_t>, hash_Terms> knownRows;
+    std::vector<Term_t> row(card);
+    while (!known.isEmpty()) {
+        std::shared_ptr<const FCInternalTable> table = known.getCurrentTable();
+        FCInternalTableItr *itrTable = table->getIterator();
+        while (itrTable->hasNext()) {
+            itrTable->next();
+            for (uint8_t j = 0; j < card; ++j) {
+                row[j] = itrTable->getCurrentValue(j);
+            }
+            knownRows.insert(row);
+        }
+        table->releaseIterator(itrTable);
+        known.moveNextCount();
+    }
+
+    SegmentInserter inserter(card);
+    FCInternalTableItr *itrTable = input.table->getIterator();
+    while (itrTable->hasNext()) {
+        itrTable->next();
+        for (uint8_t j = 0; j < card; ++j) {
+            row[j] = itrTable->getCurrentValue(j);
+        }
+        if (knownRows.insert(row).second) {
+            inserter.addRow(row.data());
+        }
+    }
+    input.table->releaseIterator(itrTable);
+    if (inserter.isEmpty()) {
+        return NULL;
+    }
+    std::shared_ptr<const Segment> seg = inserter.getSegment();
+    if (!inserter.isSorted()) {
+        seg = seg->sortBy(NULL);
+    }
+    return std::shared_ptr<const FCInternalTable>(
+            new InmemoryFCInternalTable(card, 0, true, seg));
+}
+
+static bool isRequestedBinding(FCInternalTableItr *itr,
+        const std::vector<uint8_t> &posBindings,
+        const std::unordered_set<std::vector<Term_t>, hash_Terms> &bindings,
+        std::vector<Term_t> &binding) {
+    if (posBindings.empty()) {
+        return true;
+    }
+    for (size_t i = 0; i < posBindings.size(); ++i) {
+        binding[i] = itr->getCurrentValue(posBindings[i]);
+    }
+    return bindings.count(binding);
+}
+
 TupleIterator *Reasoner::getMagicIterator(Literal &query,
         std::vector<uint8_t> *posJoins,
         std::vector<Term_t> *possibleValuesJoins,
@@ -568,33 +653,13 @@ TupleIterator *Reasoner::getMagicIterator(Literal &query,
     Predicate pred1(query.getPredicate(), Predicate::calculateAdornment(boundTuple));
     Literal query1(pred1, boundTuple);
 
-    //Get all adorned rules
-    std::unique_ptr<Wizard> wizard = std::unique_ptr<Wizard>(new Wizard());
-    std::shared_ptr<Program> adornedProgram = wizard->getAdornedProgram(query1, program);
-    //Print all rules
-#if DEBUG
-    LOG(DEBUGL) << "Adorned program:";
-    std::vector<Rule> newRules = adornedProgram->getAllRules();
-    for (std::vector<Rule>::iterator itr = newRules.begin(); itr != newRules.end(); ++itr) {
-        LOG(DEBUGL) << itr->tostring(adornedProgram.get(), &edb);
-    }
-#endif
-
-    //Rewrite and add the rules
-    std::pair<PredId_t, PredId_t> inputOutputRelIDs;
-    std::shared_ptr<Program> magicProgram = wizard->doMagic(query1, adornedProgram,
-            inputOutputRelIDs);
-
-#if DEBUG
-    LOG(DEBUGL) << "Magic program:";
-    newRules = magicProgram->getAllRules();
-    for (std::vector<Rule>::iterator itr = newRules.begin(); itr != newRules.end(); ++itr) {
-        LOG(DEBUGL) << itr->tostring(magicProgram.get(), &edb);
-    }
-#endif
-
-    SemiNaiver *naiver = new SemiNaiver(
-            edb, magicProgram.get(), true, true, false, -1, false, false) ;
+    bool created;
+    std::shared_ptr<MagicSession> session = getMagicSession(query1, edb,
+            program, created);
+    Program *magicProgram = session->magicProgram.get();
+    SemiNaiver *naiver = session->naiver.get();
+    const std::pair<PredId_t, PredId_t> &inputOutputRelIDs =
+        session->inputOutputRelIDs;
 
     //Add all the input tuples in the input relation
     Predicate pred = magicProgram->getPredicate(inputOutputRelIDs.first);
@@ -607,17 +672,64 @@ TupleIterator *Reasoner::getMagicIterator(Literal &query,
     }
 
     Literal unboundQuery(pred, onlyConstsTuple);
-    LOG(DEBUGL) << "unboundQuery = " << unboundQuery.tostring(magicProgram.get(), &edb);
-    naiver->addDataToIDBRelation(magicProgram->getPredicate(inputOutputRelIDs.first),
-            getBlockFromQuery(unboundQuery, query1,
-                newPosJoins.size() != 0 ? &newPosJoins : NULL, possibleValuesJoins));
+    LOG(DEBUGL) << "unboundQuery = " << unboundQuery.tostring(magicProgram, &edb);
+    FCBlock input = getBlockFromQuery(unboundQuery, query1,
+            newPosJoins.size() != 0 ? &newPosJoins : NULL, possibleValuesJoins);
+
+    //Exec the materialization. A session is stored only once its first
+    //materialization is complete, and dropped if a later one fails: its
+    //magic relation would contain facts whose consequences are missing.
+    const MagicSessionKey key = getMagicSessionKey(query1, edb, program);
+    try {
+        if (created) {
+            naiver->addDataToIDBRelation(pred, input);
+            naiver->run(1, 2);
+            if (session->resumable) {
+                magicSessions.insert(std::make_pair(key, session));
+            }
+        } else {
+            VTuple varsTuple(pred.getCardinality());
+            for (uint8_t i = 0; i < pred.getCardinality(); ++i) {
+                varsTuple.set(VTerm(i + 1, 0), i);
+            }
+            Literal magicLiteral(pred, varsTuple);
+            std::shared_ptr<const FCInternalTable> newInput =
+                getNewMagicFacts(naiver, magicLiteral, input);
+            if (newInput != NULL) {
+                naiver->addDataAndResume(pred, FCBlock(0, newInput,
+                            magicLiteral, 0, NULL, 0, true));
+            } else {
+                LOG(DEBUGL) << "All the input tuples were already processed";
+            }
+        }
+    } catch (...) {
+        magicSessions.erase(key);
+        throw;
+    }
 
-    //Exec the materialization
-    naiver->run(1, 2);
+    //The output relation also contains the answers of the previous queries
+    //of the session, so the rows are restricted to the requested bindings
+    std::vector<uint8_t> posBindings;
+    std::unordered_set<std::vector<Term_t>, hash_Terms> bindings;
+    if (posJoins != NULL && !newPosJoins.empty()) {
+        std::vector<uint8_t> posVarsQuery = query.getPosVars();
+        for (auto p : newPosJoins) {
+            posBindings.push_back(std::find(posVarsQuery.begin(),
+                        posVarsQuery.end(), p) - posVarsQuery.begin());
+        }
+        const size_t nbindings = newPosJoins.size();
+        for (size_t i = 0; i + nbindings <= possibleValuesJoins->size();
+                i += nbindings) {
+            bindings.insert(std::vector<Term_t>(
+                        possibleValuesJoins->begin() + i,
+                        possibleValuesJoins->begin() + i + nbindings));
+        }
+    }
+    std::vector<Term_t> binding(posBindings.size());
 
     //Extract the tuples from the output relation
     Literal outputLiteral(magicProgram->getPredicate(inputOutputRelIDs.second), t);
-    LOG(DEBUGL) << "outputLiteral = " << outputLiteral.tostring(magicProgram.get(), &edb);
+    LOG(DEBUGL) << "outputLiteral = " << outputLiteral.tostring(magicProgram, &edb);
     LOG(DEBUGL) << "returnOnlyVars = " << returnOnlyVars;
     LOG(DEBUGL) << "sortByFields->empty() = " << (sortByFields == NULL ? true : sortByFields->empty());
 
@@ -640,6 +752,10 @@ TupleIterator *Reasoner::getMagicIterator(Literal &query,
         if (returnOnlyVars) {
             while (itrTable->hasNext()) {
                 itrTable->next();
+                if (!isRequestedBinding(itrTable, posBindings, bindings,
+                            binding)) {
+                    continue;
+                }
                 if (finalTable->getSizeRow() == 0) {
                     Term_t row = 0;
                     finalTable->addRow(&row);
@@ -657,6 +773,10 @@ TupleIterator *Reasoner::getMagicIterator(Literal &query,
         } else {
             while (itrTable->hasNext()) {
                 itrTable->next();
+                if (!isRequestedBinding(itrTable, posBindings, bindings,
+                            binding)) {
+                    continue;
+                }
                 for (uint8_t j = 0; j < nPosToCopy; ++j) {
                     outputTuple[posToCopy[j]] = itrTable->getCurrentValue(j);
                 }
@@ -670,7 +790,6 @@ TupleIterator *Reasoner::getMagicIterator(Literal &query,
     }
 
     std::shared_ptr<TupleTable> pFinalTable(finalTable);
-    delete naiver;
 
     if (sortByFields != NULL && !sortByFields->empty()) {
         std::shared_ptr<TupleTable> sortTab = std::shared_ptr<TupleTable>(
@@ -682,6 +801,83 @@ TupleIterator *Reasoner::getMagicIterator(Literal &query,
     }
 }
 
+TupleIterator *Reasoner::getBatchIterator(Literal &query,
+        std::vector<uint8_t> &posJoins,
+        std::vector<Term_t> &possibleValuesJoins,
+        EDBLayer &edb, Program &program,
+        SemiNaiver *sn) {
+    const uint8_t tupleSize = query.getTupleSize();
+    const size_t nbindings = posJoins.size();
+    if (nbindings == 0 || possibleValuesJoins.size() % nbindings != 0) {
+        LOG(ERRORL) << "The bindings do not have " << nbindings << " columns";
+        throw 10;
+    }
+    std::vector<uint8_t> posVars = query.getPosVars();
+    std::vector<uint8_t> posBindings; //Positions in the tuple
+    for (auto p : posJoins) {
+        if (p >= posVars.size()) {
+            LOG(ERRORL) << "The query does not have " << (int) p + 1 << " variables";
+            throw 10;
+        }
+        posBindings.push_back(posVars[p]);
+    }
+
+    //Input rows of every distinct binding
+    std::unordered_map<std::vector<Term_t>, std::vector<size_t>, hash_Terms>
+        inputRows;
+    const size_t nrows = possibleValuesJoins.size() / nbindings;
+    for (size_t i = 0; i < nrows; ++i) {
+        std::vector<Term_t> binding(possibleValuesJoins.begin() + i * nbindings,
+                possibleValuesJoins.begin() + (i + 1) * nbindings);
+        inputRows[binding].push_back(i);
+    }
+    LOG(DEBUGL) << "Batch of " << nrows << " queries, " << inputRows.size() <<
+        " distinct";
+
+    TupleIterator *itr;
+    if (nrows == 0) {
+        itr = new TupleTableItr(std::shared_ptr<TupleTable>(
+                    new TupleTable(tupleSize)));
+    } else if (query.getPredicate().getType() == EDB) {
+        itr = getEDBIterator(query, &posJoins, &possibleValuesJoins, edb, false,
+                NULL);
+    } else if (sn != NULL) {
+        itr = getIteratorWithMaterialization(sn, query, false, NULL);
+    } else {
+        itr = getMagicIterator(query, &posJoins, &possibleValuesJoins, edb,
+                program, false, NULL);
+    }
+
+    //Tag every answer with the input rows it answers
+    TupleTable *taggedTable = new TupleTable(tupleSize + 1);
+    std::vector<Term_t> binding(nbindings);
+    uint64_t row[257];
+    while (itr->hasNext()) {
+        itr->next();
+        for (size_t j = 0; j < nbindings; ++j) {
+            binding[j] = itr->getElementAt(posBindings[j]);
+        }
+        auto rows = inputRows.find(binding);
+        if (rows == inputRows.end()) {
+            continue;
+        }
+        for (uint8_t j = 0; j < tupleSize; ++j) {
+            row[j + 1] = itr->getElementAt(j);
+        }
+        for (auto idx : rows->second) {
+            row[0] = idx;
+            taggedTable->addRow(row);
+        }
+    }
+    delete itr;
+
+    std::shared_ptr<TupleTable> pTaggedTable(taggedTable);
+    std::vector<uint8_t> sortByFields(1, 0);
+    std::shared_ptr<TupleTable> sortTab = std::shared_ptr<TupleTable>(
+            pTaggedTable->sortBy(sortByFields));
+    return new TupleTableItr(sortTab);
+}
+
 TupleIterator *Reasoner::getMaterializationIterator(Literal &query,
         std::vector<uint8_t> *posJoins,
         std::vector<Term_t> *possibleValuesJoins,
@@ -717,6 +913,10 @@ TupleIterator *Reasoner::getIteratorWithMaterialization(SemiNaiver *sn, Literal
         std::vector<uint8_t> *sortByFields) {
 
     FCIterator tableIt = sn->getTable(query.getPredicate().getId());
+    if (sortByFields == NULL || sortByFields->empty()) {
+        //Stream the answers from the columns of the tables
+        return new FCTupleItr(tableIt, query, returnOnlyVars);
+    }
     VTuple tuple = query.getTuple();
 
     TupleTable *finalTable;
@@ -898,6 +1098,7 @@ TupleIterator *Reasoner::getTopDownIterator(Literal &query,
     QSQQuery rootQuery(query);
     LOG(DEBUGL) << "QSQQuery = " << rootQuery.tostring();
     std::unique_ptr<QSQR> evaluator = std::unique_ptr<QSQR>(new QSQR(edb, &program));
+    evaluator->setNThreads(nthreads);
     TupleTable *finalTable;
     finalTable = evaluator->evaluateQuery(QSQR_EVAL, &rootQuery, newPosJoins.size() > 0 ? &newPosJoins : NULL,
             possibleValuesJoins, returnOnlyVars);
@@ -921,7 +1122,11 @@ std::shared_ptr<SemiNaiver> Reasoner::getSemiNaiver(EDBLayer &layer,
         TypeChase typeChase,
         int nthreads, int interRuleThreads, bool shuffleRules, Program *restrictedCheck) {
     LOG(DEBUGL) << "interRuleThreads = " << interRuleThreads << ", shuffleRules = " << shuffleRules;
-    if (interRuleThreads > 0 && restrictedCheck == NULL) {
+    //The parallel scheduler executes the existential rules with the skolem
+    //chase
+    if (interRuleThreads > 0 && restrictedCheck == NULL &&
+            (typeChase == TypeChase::SKOLEM_CHASE ||
+             !p->areExistentialRules())) {
         std::shared_ptr<SemiNaiver> sn(new SemiNaiverThreaded(
                     layer, p, opt_intersect, opt_filtering,
                     shuffleRules, nthreads, interRuleThreads));
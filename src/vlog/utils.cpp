@@ -1,5 +1,7 @@
 #include <vlog/utils.h>
 #include <string>
+#include <sstream>
+#include <iomanip>
 
 #include <launcher/vloglayer.h>
 #include <cts/parser/SPARQLLexer.hpp>
@@ -35,6 +37,26 @@ std::string VLogUtils::csvString(std::string s) {
     return result;
 }
 
+// Escapes the slashes and backslashes of a predicate name, so that it can be
+// used as a file name.
+std::string VLogUtils::fileName(std::string name) {
+    std::stringstream stream;
+
+    stream << std::oct << std::setfill('0');
+
+    for(char ch : name) {
+        int code = static_cast<unsigned char>(ch);
+
+        if (code != '\\' && code != '/') {
+            stream.put(ch);
+        } else {
+            stream << "\\" << std::setw(3) << code;
+        }
+    }
+
+    return stream.str();
+}
+
 void VLogUtils::parseQuery(bool &success,
         SPARQLParser &parser,
         std::shared_ptr<QueryGraph> &queryGraph,